@@ -0,0 +1,175 @@
+/*
+ * Oh-arena.c - Bump allocation for per-render and per-lookup memory
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * An Arena hands out memory by bumping a pointer through large chunks and
+ * frees all of it at once on reset, keeping one chunk the size of what was
+ * used, so the next render of a similar document allocates nothing. The
+ * render's arrays come from its state's arena (see process_lines_single_pass).
+ * Each thread also has a scratch arena for disk cache lookups: between
+ * scratch_begin() and scratch_end() jansson's allocations on that thread
+ * come from it once the CLI has installed the allocator, so parsing or
+ * building a cache file's JSON tree mallocs nothing and the whole tree
+ * goes at scratch_end().
+ */
+
+#include "Oh.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_KEEP_MAX (64 * 1024 * 1024)  // larger chunks go back to malloc on reset
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t size;
+    size_t used;
+    // Data follows the header, which is padded to ARENA_ALIGNMENT
+};
+
+#define CHUNK_HEADER ((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define CHUNK_DATA(chunk) ((char *)(chunk) + CHUNK_HEADER)
+
+static ArenaChunk* arena_chunk_new(size_t size) {
+    ArenaChunk *chunk = malloc(CHUNK_HEADER + size);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+// Allocate size bytes, aligned for any type; NULL when out of memory
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (size == 0) size = ARENA_ALIGNMENT;
+    ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = chunk ? chunk->size * 2 : ARENA_CHUNK_SIZE;
+        if (chunk_size < size) chunk_size = size;
+        ArenaChunk *grown = arena_chunk_new(chunk_size);
+        if (!grown) return NULL;
+        grown->next = chunk;
+        arena->chunks = grown;
+        chunk = grown;
+    }
+    void *pointer = CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += size;
+    arena->allocated += size;
+    return pointer;
+}
+
+void* arena_calloc(Arena *arena, size_t count, size_t size) {
+    if (size != 0 && count > (size_t)-1 / size) return NULL;
+    void *pointer = arena_alloc(arena, count * size);
+    if (pointer) memset(pointer, 0, count * size);
+    return pointer;
+}
+
+int arena_owns(const Arena *arena, const void *pointer) {
+    for (const ArenaChunk *chunk = arena->chunks; chunk; chunk = chunk->next) {
+        const char *data = CHUNK_DATA(chunk);
+        if ((const char *)pointer >= data && (const char *)pointer < data + chunk->size) return 1;
+    }
+    return 0;
+}
+
+// Release everything allocated. One chunk stays; when the memory in use had
+// spilled over several, they are replaced by one that holds it all.
+void arena_reset(Arena *arena) {
+    ArenaChunk *chunk = arena->chunks;
+    if (chunk && chunk->next) {
+        size_t total = arena->allocated;
+        arena_free(arena);
+        if (total <= ARENA_KEEP_MAX) {
+            arena->chunks = arena_chunk_new(total > ARENA_CHUNK_SIZE ? total : ARENA_CHUNK_SIZE);
+        }
+    } else if (chunk && chunk->size > ARENA_KEEP_MAX) {
+        arena_free(arena);
+    } else if (chunk) {
+        chunk->used = 0;
+    }
+    arena->allocated = 0;
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->allocated = 0;
+}
+
+// Per-thread scratch arenas, freed when their thread exits
+typedef struct {
+    Arena arena;
+    int depth;
+} ScratchState;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void scratch_destroy(void *state) {
+    arena_free(&((ScratchState *)state)->arena);
+    free(state);
+}
+
+static void scratch_key_create(void) {
+    pthread_key_create(&scratch_key, scratch_destroy);
+}
+
+static ScratchState* scratch_state(int create) {
+    pthread_once(&scratch_once, scratch_key_create);
+    ScratchState *state = pthread_getspecific(scratch_key);
+    if (!state && create) {
+        state = calloc(1, sizeof(ScratchState));
+        if (state && pthread_setspecific(scratch_key, state) != 0) {
+            free(state);
+            state = NULL;
+        }
+    }
+    return state;
+}
+
+// Route this thread's allocations to its scratch arena until scratch_end()
+void scratch_begin(void) {
+    ScratchState *state = scratch_state(1);
+    if (state) state->depth++;
+}
+
+void scratch_end(void) {
+    ScratchState *state = scratch_state(0);
+    if (state && state->depth > 0 && --state->depth == 0) {
+        arena_reset(&state->arena);
+    }
+}
+
+// Memory that lasts until scratch_end(); plain malloc outside a scratch scope
+// would leak, so callers only use it between scratch_begin() and scratch_end()
+void* scratch_alloc(size_t size) {
+    ScratchState *state = scratch_state(0);
+    return state && state->depth > 0 ? arena_alloc(&state->arena, size) : NULL;
+}
+
+static void* scratch_malloc(size_t size) {
+    void *pointer = scratch_alloc(size);
+    return pointer ? pointer : malloc(size);
+}
+
+// Blocks of the scratch arena are released by scratch_end(), not one by one
+static void scratch_free(void *pointer) {
+    if (!pointer) return;
+    ScratchState *state = scratch_state(0);
+    if (state && arena_owns(&state->arena, pointer)) return;
+    free(pointer);
+}
+
+// Point jansson at the scratch arenas for the whole process; the CLI calls
+// this once at startup, before any JSON value exists. liboh does not, as a
+// program linking it may use jansson itself: there cache-file trees come
+// from malloc, and only strings taken with scratch_alloc() from the arenas.
+void scratch_install(void) {
+    json_set_alloc_funcs(scratch_malloc, scratch_free);
+}
@@ -0,0 +1,180 @@
+/*
+ * Oh-batch.c - Convert many input files in one process (--batch)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * A manifest lists one "input output" pair per line; paths containing
+ * spaces are separated by a tab instead, and a line with only an input
+ * writes next to it with the extension replaced by .svg; repeated -i/-o
+ * pairs on the command line are converted the same way. Every file is
+ * rendered with the same options, each file a task of the worker pool on
+ * that worker's own render state, so -j N converts N files at a time (one
+ * file alone still spreads over the pool). The parsed-line and fragment
+ * caches stay in memory and are shared by the files, so prompts, banners
+ * and other lines repeated across files are parsed and rendered once.
+ * Recordings (*.cast, or every entry with --cast) become animated SVGs.
+ */
+
+#include "Oh.h"
+
+// Split a manifest line into input and output paths; returns -1 if malformed
+static int parse_batch_entry(char *entry, char *input, char *output) {
+    char *separator = strchr(entry, '\t');
+    if (!separator) separator = strchr(entry, ' ');
+    if (separator) {
+        *separator++ = '\0';
+        while (*separator == ' ' || *separator == '\t') separator++;
+    }
+
+    if (snprintf(input, MAX_PATH_LENGTH, "%s", entry) >= MAX_PATH_LENGTH) return -1;
+    if (separator && *separator) {
+        return snprintf(output, MAX_PATH_LENGTH, "%s", separator) >= MAX_PATH_LENGTH ? -1 : 0;
+    }
+
+    const char *slash = strrchr(input, '/');
+    const char *dot = strrchr(slash ? slash : input, '.');
+    int stem = dot && dot != input && dot[-1] != '/' ? (int)(dot - input) : (int)strlen(input);
+    if (snprintf(output, MAX_PATH_LENGTH, "%.*s.svg", stem, input) >= MAX_PATH_LENGTH) return -1;
+    return strcmp(input, output) == 0 ? -1 : 0;
+}
+
+// The files to convert, with one render state per pool worker
+typedef struct {
+    const Config *config;
+    FilePair *files;
+    int *failed;                // per file; set up front for malformed manifest lines
+    int file_count;
+    int file_capacity;
+    RenderState *renders;
+} BatchJob;
+
+// Append a file to the job; returns NULL if out of memory
+static FilePair* batch_add_file(BatchJob *job) {
+    if (job->file_count == job->file_capacity) {
+        int capacity = job->file_capacity ? job->file_capacity * 2 : 64;
+        FilePair *files = realloc(job->files, capacity * sizeof(FilePair));
+        if (!files) return NULL;
+        job->files = files;
+        int *failed = realloc(job->failed, capacity * sizeof(int));
+        if (!failed) return NULL;
+        job->failed = failed;
+        job->file_capacity = capacity;
+    }
+    job->failed[job->file_count] = 0;
+    return &job->files[job->file_count++];
+}
+
+// Read the manifest's entries into the job; returns -1 if out of memory
+static int batch_read_manifest(BatchJob *job, FILE *manifest) {
+    char entry[2 * MAX_PATH_LENGTH + 16];
+    long entry_line = 0;
+    while (fgets(entry, sizeof(entry), manifest)) {
+        entry_line++;
+        size_t length = strlen(entry);
+        while (length > 0 && (entry[length - 1] == '\n' || entry[length - 1] == '\r' ||
+                              entry[length - 1] == ' ' || entry[length - 1] == '\t')) {
+            entry[--length] = '\0';
+        }
+        char *start = entry;
+        while (*start == ' ' || *start == '\t') start++;
+        if (*start == '\0' || *start == '#') continue;
+
+        FilePair *file = batch_add_file(job);
+        if (!file) return -1;
+        if (parse_batch_entry(start, file->input_file, file->output_file) != 0) {
+            fprintf(stderr, "Error: %s:%ld: Cannot read an input and output path\n", job->config->batch_file, entry_line);
+            job->failed[job->file_count - 1] = 1;
+        }
+    }
+    return 0;
+}
+
+// Convert one file on the render state of the pool worker running it
+static void batch_file_task(void *context, int index, int worker) {
+    BatchJob *job = (BatchJob *)context;
+    if (job->failed[index]) return;
+
+    char msg[1536];
+    Config file_config = *job->config;
+    memcpy(file_config.input_file, job->files[index].input_file, sizeof(file_config.input_file));
+    memcpy(file_config.output_file, job->files[index].output_file, sizeof(file_config.output_file));
+    RenderState *render = &job->renders[worker];
+
+    int status;
+    memset(&render->stats, 0, sizeof(render->stats));
+    render->line_count = 0;
+    if (file_config.cast || is_cast_file(file_config.input_file)) {
+        status = cast_svg(&file_config);
+    } else {
+        status = read_input(render, &file_config);
+        if (status == 0) {
+            status = output_svg(render, &file_config);
+        }
+    }
+    if (status != 0) {
+        job->failed[index] = 1;
+        snprintf(msg, sizeof(msg), "Batch: %.500s failed", file_config.input_file);
+    } else {
+        snprintf(msg, sizeof(msg), "Batch: %.500s -> %.500s (%d lines; segments %d/%d, fragments %d/%d cached)",
+                 file_config.input_file, file_config.output_file, render->line_count,
+                 render->stats.segment_hits, render->stats.segment_hits + render->stats.segment_misses,
+                 render->stats.svg_hits, render->stats.svg_hits + render->stats.svg_misses);
+    }
+    status_output(msg);
+}
+
+// Convert every file the manifest (or the -i/-o pairs) lists; returns -1 if any of them failed
+int batch_svg(Config *config) {
+    char msg[1536];
+    BatchJob job;
+    memset(&job, 0, sizeof(job));
+    job.config = config;
+    int workers = pool_size(worker_pool);
+    int listed = 1;
+
+    if (config->file_pair_count > 0) {
+        for (int p = 0; p < config->file_pair_count && listed; p++) {
+            FilePair *file = batch_add_file(&job);
+            if (file) *file = config->file_pairs[p];
+            listed = file != NULL;
+        }
+        snprintf(msg, sizeof(msg), "Batch: converting %d files, %d at a time", config->file_pair_count, workers);
+    } else {
+        FILE *manifest = strcmp(config->batch_file, "-") == 0 ? stdin : fopen(config->batch_file, "r");
+        if (!manifest) {
+            fprintf(stderr, "Error: Batch manifest '%s' not found\n", config->batch_file);
+            return -1;
+        }
+        listed = batch_read_manifest(&job, manifest) == 0;
+        if (manifest != stdin) fclose(manifest);
+        snprintf(msg, sizeof(msg), "Batch: converting the files listed in %.500s, %d at a time", config->batch_file, workers);
+    }
+    job.renders = listed ? calloc(workers, sizeof(RenderState)) : NULL;
+    if (!job.renders || memory_caches_create(config->memory_cache_mb, 1) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(job.renders);
+        free(job.files);
+        free(job.failed);
+        return -1;
+    }
+    progress_output(msg);
+    resident_mode = 1;
+
+    for (int w = 0; w < workers; w++) render_state_init(&job.renders[w]);
+    double start_time = get_current_time();
+    pool_run(worker_pool, batch_file_task, &job, job.file_count);
+    int failed = 0;
+    for (int f = 0; f < job.file_count; f++) failed += job.failed[f];
+    for (int w = 0; w < workers; w++) render_state_free(&job.renders[w]);
+
+    resident_mode = 0;
+    snprintf(msg, sizeof(msg), "Batch: converted %d of %d files in %.3fs (line cache %zu entries, fragment cache %zu entries)",
+             job.file_count - failed, job.file_count, get_current_time() - start_time,
+             line_memory->entry_count, fragment_memory->entry_count);
+    progress_output(msg);
+    memory_caches_destroy();
+    free(job.renders);
+    free(job.files);
+    free(job.failed);
+
+    return failed > 0 ? -1 : 0;
+}
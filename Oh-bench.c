@@ -0,0 +1,542 @@
+/*
+ * Oh-bench.c - Benchmark harness
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * Besides the hash and scan comparisons, "suite" times each pipeline stage
+ * on generated corpora (plain log lines, heavy SGR, wide lines) and runs
+ * the Oh binary end to end on 1k/10k/100k-line corpora with a cold and a
+ * warm cache, printing one JSON document for tracking regressions.
+ */
+
+#include "Oh.h"
+
+#define BENCH_HASH_LINES 200
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_STAGE_LINES 1000
+#define BENCH_WIDE_CELLS 600
+
+enum { CORPUS_PLAIN, CORPUS_SGR, CORPUS_WIDE, CORPUS_KINDS };
+static const char *corpus_names[CORPUS_KINDS] = { "plain", "sgr", "wide" };
+static const char *corpus_words[] = {
+    "processed", "items", "request", "cache", "worker", "queue", "flushed", "retry", "build", "deploy",
+    "<ok>", "&done", "\"quoted\"", "latency", "bytes", "shard"
+};
+
+// The benchmark corpora: line views, their hashes and the text behind them
+static InputLine bench_lines[MAX_LINES];
+static char bench_hashes[MAX_LINES][MAX_HASH_LENGTH];
+static int bench_line_count = 0;
+static char *bench_text[MAX_LINES];
+
+static void bench_set_line(int index, const char *text) {
+    free(bench_text[index]);
+    bench_text[index] = strdup(text);
+    bench_lines[index].text = bench_text[index] ? bench_text[index] : "";
+    bench_lines[index].length = bench_text[index] ? strlen(bench_text[index]) : 0;
+}
+
+// Load up to max_lines lines from a file into bench_lines
+static int bench_load_lines(const char *path, int max_lines) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open benchmark input '%s'\n", path);
+        return -1;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    bench_line_count = 0;
+    while (bench_line_count < max_lines && fgets(line, sizeof(line), file)) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        // The popen reference path cannot quote embedded single quotes
+        if (strchr(line, '\'')) continue;
+        bench_set_line(bench_line_count++, line);
+    }
+    fclose(file);
+    return bench_line_count;
+}
+
+// Compare the in-process cksum engine against the popen(cksum) path
+static int bench_hash(const char *path) {
+    if (bench_load_lines(path, BENCH_HASH_LINES) <= 0) {
+        fprintf(stderr, "Error: No benchmark lines in '%s'\n", path);
+        return 1;
+    }
+
+    unsigned int reference_hashes[BENCH_HASH_LINES];
+    int mismatches = 0;
+
+    double start = get_current_time();
+    for (int i = 0; i < bench_line_count; i++) {
+        unsigned int hash = generate_hash_popen(bench_lines[i].text);
+        reference_hashes[i] = hash;
+    }
+    double popen_time = get_current_time() - start;
+
+    // Repeat the builtin pass so the timing is measurable
+    int rounds = 1000;
+    start = get_current_time();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < bench_line_count; i++) {
+            unsigned int hash = generate_hash_bytes(bench_lines[i].text, bench_lines[i].length);
+            if (r == 0 && hash != reference_hashes[i]) {
+                fprintf(stderr, "Mismatch on line %d: builtin=%u cksum=%u\n", i + 1, hash, reference_hashes[i]);
+                mismatches++;
+            }
+        }
+    }
+    double builtin_time = (get_current_time() - start) / rounds;
+
+    printf("bench-hash: %d lines from %s\n", bench_line_count, path);
+    printf("  popen(cksum): %10.6fs total, %10.3fus/line\n",
+           popen_time, popen_time * 1e6 / bench_line_count);
+    printf("  builtin:      %10.6fs total, %10.3fus/line\n",
+           builtin_time, builtin_time * 1e6 / bench_line_count);
+    if (builtin_time > 0) {
+        printf("  speedup:      %10.0fx\n", popen_time / builtin_time);
+    }
+    printf("  mismatches:   %d\n", mismatches);
+
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Run a scanner over every line, splitting at each ESC or tab like parse_ansi_line()
+static size_t bench_scan_pass(size_t (*scan)(const char *, size_t, int *), int *chars) {
+    size_t bytes = 0;
+    for (int i = 0; i < bench_line_count; i++) {
+        const char *ptr = bench_lines[i].text;
+        size_t remaining = bench_lines[i].length;
+        bytes += remaining;
+        while (remaining > 0) {
+            size_t run = scan(ptr, remaining, chars);
+            if (run == 0) run = 1;
+            ptr += run;
+            remaining -= run;
+        }
+    }
+    return bytes;
+}
+
+// Compare the runtime-selected text scanner against the scalar reference
+static int bench_scan(const char *path) {
+    if (bench_load_lines(path, MAX_LINES) <= 0) {
+        fprintf(stderr, "Error: No benchmark lines in '%s'\n", path);
+        return 1;
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < bench_line_count; i++) {
+        const char *line = bench_lines[i].text;
+        size_t length = bench_lines[i].length;
+        for (size_t start = 0; start < length; start++) {
+            int reference_chars = 0;
+            int chars = 0;
+            size_t reference = scan_text_run_scalar(line + start, length - start, &reference_chars);
+            size_t run = scan_text_run(line + start, length - start, &chars);
+            if (run != reference || chars != reference_chars) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    // The escaper must match its scalar reference byte for byte
+    static char escaped[XML_ESCAPE_MAX(MAX_LINE_LENGTH)];
+    static char reference_escaped[XML_ESCAPE_MAX(MAX_LINE_LENGTH)];
+    for (int i = 0; i < bench_line_count; i++) {
+        size_t length = bench_lines[i].length;
+        int reference_chars = 0;
+        int chars = 0;
+        size_t reference = xml_escape_run_scalar(reference_escaped, bench_lines[i].text, length, &reference_chars);
+        size_t written = xml_escape_run(escaped, bench_lines[i].text, length, &chars);
+        if (written != reference || chars != reference_chars || memcmp(escaped, reference_escaped, written) != 0) {
+            mismatches++;
+        }
+    }
+
+    int rounds = 2000;
+    int chars = 0;
+    size_t bytes = 0;
+    double start = get_current_time();
+    for (int r = 0; r < rounds; r++) bytes = bench_scan_pass(scan_text_run_scalar, &chars);
+    double scalar_time = get_current_time() - start;
+    start = get_current_time();
+    for (int r = 0; r < rounds; r++) bench_scan_pass(scan_text_run, &chars);
+    double vector_time = get_current_time() - start;
+    double megabytes = (double)bytes * rounds / (1024.0 * 1024.0);
+
+    printf("bench-scan: %d lines (%zu bytes) from %s\n", bench_line_count, bytes, path);
+    char backend_label[32];
+    snprintf(backend_label, sizeof(backend_label), "%s:", scan_text_backend());
+    printf("  scalar:       %10.1f MB/s\n", scalar_time > 0 ? megabytes / scalar_time : 0.0);
+    printf("  %-13s %10.1f MB/s\n", backend_label, vector_time > 0 ? megabytes / vector_time : 0.0);
+
+    start = get_current_time();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < bench_line_count; i++) {
+            xml_escape_run_scalar(escaped, bench_lines[i].text, bench_lines[i].length, &chars);
+        }
+    }
+    scalar_time = get_current_time() - start;
+    start = get_current_time();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < bench_line_count; i++) {
+            xml_escape_run(escaped, bench_lines[i].text, bench_lines[i].length, &chars);
+        }
+    }
+    vector_time = get_current_time() - start;
+    printf("  escape scalar:%10.1f MB/s\n", scalar_time > 0 ? megabytes / scalar_time : 0.0);
+    snprintf(backend_label, sizeof(backend_label), "escape %s:", scan_text_backend());
+    printf("  %-13s %10.1f MB/s\n", backend_label, vector_time > 0 ? megabytes / vector_time : 0.0);
+    printf("  mismatches:   %d\n", mismatches);
+
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Deterministic per-line pseudo-random numbers
+static uint32_t corpus_random(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Write line index of a corpus; every line is unique so cold runs miss
+static void corpus_line(int kind, long index, char *out, size_t size) {
+    uint32_t state = (uint32_t)index * 2654435761u + 1u;
+    size_t words = sizeof(corpus_words) / sizeof(corpus_words[0]);
+    int used = 0;
+
+    if (kind == CORPUS_PLAIN) {
+        snprintf(out, size, "%06ld 12:%02u:%02u INFO  worker-%u %s %u %s in %u ms (%s)",
+                 index, corpus_random(&state) % 60, corpus_random(&state) % 60, corpus_random(&state) % 32,
+                 corpus_words[corpus_random(&state) % words], corpus_random(&state) % 10000,
+                 corpus_words[corpus_random(&state) % words], corpus_random(&state) % 500,
+                 corpus_words[corpus_random(&state) % words]);
+        return;
+    }
+
+    int cells = kind == CORPUS_WIDE ? BENCH_WIDE_CELLS : 60;
+    used = snprintf(out, size, "\033[38;5;%um%06ld\033[0m ", 16 + corpus_random(&state) % 216, index);
+    int visible = 7;
+    while (visible < cells && used < (int)size - 64) {
+        const char *word = corpus_words[corpus_random(&state) % words];
+        switch (corpus_random(&state) % 4) {
+            case 0:
+                used += snprintf(out + used, size - used, "\033[1;3%um%s\033[0m ", corpus_random(&state) % 8, word);
+                break;
+            case 1:
+                used += snprintf(out + used, size - used, "\033[38;2;%u;%u;%um%s\033[39m ",
+                                 corpus_random(&state) % 256, corpus_random(&state) % 256, corpus_random(&state) % 256, word);
+                break;
+            case 2:
+                used += snprintf(out + used, size - used, "\033[48;5;%um %s \033[49m ", corpus_random(&state) % 256, word);
+                visible += 2;
+                break;
+            default:
+                used += snprintf(out + used, size - used, "%s ", word);
+                break;
+        }
+        visible += (int)strlen(word) + 1;
+    }
+}
+
+// Fill bench_lines with the first lines of a corpus
+static size_t corpus_load(int kind, int lines) {
+    size_t bytes = 0;
+    char line[MAX_LINE_LENGTH];
+    bench_line_count = 0;
+    for (int i = 0; i < lines && i < MAX_LINES; i++) {
+        corpus_line(kind, i, line, sizeof(line));
+        bench_set_line(i, line);
+        bytes += bench_lines[i].length + 1;
+        bench_line_count++;
+    }
+    return bytes;
+}
+
+static int corpus_write(int kind, long lines, const char *path, size_t *bytes) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+    char line[MAX_LINE_LENGTH];
+    *bytes = 0;
+    for (long i = 0; i < lines; i++) {
+        corpus_line(kind, i, line, sizeof(line));
+        *bytes += strlen(line) + 1;
+        fprintf(file, "%s\n", line);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// State shared by the stage benchmarks: the corpus parsed into one arena
+typedef struct {
+    Config config;
+    LineArena arena;
+    LineData *lines;
+    OutputWriter writer;
+    char config_hash[MAX_HASH_LENGTH];
+} StageContext;
+
+typedef void (*StageRound)(StageContext *ctx);
+
+static void stage_hash(StageContext *ctx) {
+    (void)ctx;
+    for (int i = 0; i < bench_line_count; i++) {
+        snprintf(bench_hashes[i], sizeof(bench_hashes[i]), "%u", generate_hash_bytes(bench_lines[i].text, bench_lines[i].length));
+    }
+}
+
+static void stage_parse(StageContext *ctx) {
+    line_arena_reset(&ctx->arena);
+    for (int i = 0; i < bench_line_count; i++) {
+        ctx->lines[i].arena = &ctx->arena;
+        parse_ansi_line(NULL, bench_lines[i].text, bench_lines[i].length, NULL, NULL, ctx->config.tab_size, &ctx->lines[i]);
+    }
+}
+
+static void stage_escape(StageContext *ctx) {
+    static char escaped[XML_ESCAPE_MAX(MAX_LINE_LENGTH)];
+    int chars = 0;
+    for (int i = 0; i < bench_line_count; i++) {
+        for (int j = 0; j < ctx->lines[i].segment_count; j++) {
+            const TextSegment *seg = LINE_SEGMENT(&ctx->lines[i], j);
+            xml_escape_run(escaped, SEGMENT_TEXT(&ctx->lines[i], seg), seg->text_length, &chars);
+        }
+    }
+}
+
+static void stage_render(StageContext *ctx) {
+    writer_reset(&ctx->writer);
+    for (int i = 0; i < bench_line_count; i++) {
+        render_line_svg(&ctx->writer, &ctx->config, &ctx->lines[i], i, ctx->config.font_width);
+    }
+}
+
+static void stage_save_cache(StageContext *ctx) {
+    char cache_key[MAX_CACHE_KEY_LENGTH];
+    for (int i = 0; i < bench_line_count; i++) {
+        get_cache_key(bench_hashes[i], ctx->config_hash, cache_key);
+        save_line_cache(cache_key, &ctx->lines[i]);
+    }
+}
+
+static void stage_load_cache(StageContext *ctx) {
+    static LineArena arena;
+    char cache_key[MAX_CACHE_KEY_LENGTH];
+    LineData line;
+    line_arena_reset(&arena);
+    for (int i = 0; i < bench_line_count; i++) {
+        line.arena = &arena;
+        get_cache_key(bench_hashes[i], ctx->config_hash, cache_key);
+        load_line_cache(cache_key, &line);
+    }
+}
+
+// Repeat a stage for at least BENCH_MIN_SECONDS and record its throughput
+static void stage_time(json_t *results, const char *stage, const char *corpus, size_t bytes,
+                       StageRound round, StageContext *ctx) {
+    int rounds = 0;
+    double start = get_current_time();
+    double elapsed;
+    do {
+        round(ctx);
+        rounds++;
+        elapsed = get_current_time() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    double seconds = elapsed / rounds;
+
+    json_t *result = json_object();
+    json_object_set_new(result, "stage", json_string(stage));
+    json_object_set_new(result, "corpus", json_string(corpus));
+    json_object_set_new(result, "lines", json_integer(bench_line_count));
+    json_object_set_new(result, "bytes", json_integer((json_int_t)bytes));
+    json_object_set_new(result, "rounds", json_integer(rounds));
+    json_object_set_new(result, "seconds", json_real(seconds));
+    json_object_set_new(result, "ns_per_line", json_real(seconds * 1e9 / bench_line_count));
+    json_object_set_new(result, "mb_per_s", json_real(seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0));
+    json_array_append_new(results, result);
+    fprintf(stderr, "  %-16s %-6s %12.1f ns/line\n", stage, corpus, seconds * 1e9 / bench_line_count);
+}
+
+// Per-stage microbenchmarks on BENCH_STAGE_LINES lines of each corpus; the
+// line cache stages read and write JSON files under work_dir
+static json_t* bench_stages(const char *work_dir) {
+    json_t *results = json_array();
+    StageContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    char *argv[] = { SCRIPT_NAME, NULL };
+    parse_arguments(1, argv, &ctx.config);
+    calculate_font_metrics(&ctx.config);
+    generate_config_hash(&ctx.config, ctx.config_hash);
+    line_arena_init(&ctx.arena);
+    ctx.lines = calloc(MAX_LINES, sizeof(LineData));
+    if (!ctx.lines || writer_open_memory(&ctx.writer) != 0) {
+        free(ctx.lines);
+        return results;
+    }
+    snprintf(cache_dir, sizeof(cache_dir), "%s/stage-cache", work_dir);
+    mkdir(cache_dir, 0755);
+
+    fprintf(stderr, "Stage benchmarks (%d lines per corpus)\n", BENCH_STAGE_LINES);
+    for (int kind = 0; kind < CORPUS_KINDS; kind++) {
+        size_t bytes = corpus_load(kind, BENCH_STAGE_LINES);
+        stage_time(results, "generate_hash", corpus_names[kind], bytes, stage_hash, &ctx);
+        stage_time(results, "parse_ansi_line", corpus_names[kind], bytes, stage_parse, &ctx);
+        stage_time(results, "xml_escape", corpus_names[kind], bytes, stage_escape, &ctx);
+        stage_time(results, "render_line_svg", corpus_names[kind], bytes, stage_render, &ctx);
+        stage_time(results, "save_line_cache", corpus_names[kind], bytes, stage_save_cache, &ctx);
+        stage_time(results, "load_line_cache", corpus_names[kind], bytes, stage_load_cache, &ctx);
+    }
+
+    writer_close(&ctx.writer);
+    line_arena_free(&ctx.arena);
+    free(ctx.lines);
+    return results;
+}
+
+// Time one command line; returns its exit status
+static int run_timed(const char *command, double *seconds) {
+    double start = get_current_time();
+    int status = system(command);
+    *seconds = get_current_time() - start;
+    return status;
+}
+
+// Convert one corpus file twice with a fresh HOME (cold cache), then again (warm cache)
+static void end_to_end(json_t *results, const char *tool, const char *run, const char *work_dir,
+                       const char *corpus, long lines, size_t bytes, const char *corpus_path, const char *extra) {
+    char home[MAX_PATH_LENGTH + 64];
+    char command[4 * MAX_PATH_LENGTH];
+    snprintf(home, sizeof(home), "%s/home-%s-%s", work_dir, tool, corpus);
+    mkdir(home, 0755);
+    snprintf(command, sizeof(command), "HOME='%s' %s %s -i '%s' -o '%s/out.svg' >/dev/null 2>&1",
+             home, run, extra, corpus_path, home);
+
+    double cold = 0.0;
+    double warm = 0.0;
+    int status = run_timed(command, &cold);
+    if (status == 0) status = run_timed(command, &warm);
+
+    json_t *result = json_object();
+    json_object_set_new(result, "tool", json_string(tool));
+    json_object_set_new(result, "corpus", json_string(corpus));
+    json_object_set_new(result, "lines", json_integer(lines));
+    json_object_set_new(result, "bytes", json_integer((json_int_t)bytes));
+    json_object_set_new(result, "options", json_string(extra));
+    json_object_set_new(result, "status", json_integer(status));
+    json_object_set_new(result, "cold_seconds", json_real(cold));
+    json_object_set_new(result, "warm_seconds", json_real(warm));
+    json_object_set_new(result, "cold_lines_per_s", json_real(cold > 0 ? lines / cold : 0.0));
+    json_object_set_new(result, "warm_lines_per_s", json_real(warm > 0 ? lines / warm : 0.0));
+    json_array_append_new(results, result);
+    fprintf(stderr, "  %-6s %-11s cold %8.3fs  warm %8.3fs%s\n", tool, corpus, cold, warm, status ? "  (failed)" : "");
+}
+
+// End-to-end runs of oh (and oh_sh, if given, on the 1k corpora) over every corpus size
+static json_t* bench_end_to_end(const char *work_dir, const char *oh, const char *oh_sh) {
+    static const long sizes[] = { 1000, 10000, 100000 };
+    json_t *results = json_array();
+
+    fprintf(stderr, "End-to-end runs\n");
+    for (int kind = 0; kind < CORPUS_KINDS; kind++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            // Wide lines stop at 10k: 100k of them is a 60 MB document
+            if (kind == CORPUS_WIDE && sizes[s] > 10000) continue;
+            char corpus[64];
+            char path[MAX_PATH_LENGTH];
+            size_t bytes = 0;
+            snprintf(corpus, sizeof(corpus), "%s-%ldk", corpus_names[kind], sizes[s] / 1000);
+            snprintf(path, sizeof(path), "%s/%s.ansi", work_dir, corpus);
+            if (corpus_write(kind, sizes[s], path, &bytes) != 0) {
+                fprintf(stderr, "Error: Cannot write corpus '%s'\n", path);
+                continue;
+            }
+
+            // Past MAX_LINES the suite times streaming, the mode meant for such inputs
+            char run[MAX_PATH_LENGTH + 16];
+            snprintf(run, sizeof(run), "'%s'", oh);
+            end_to_end(results, "Oh", run, work_dir, corpus, sizes[s], bytes, path,
+                       sizes[s] > MAX_LINES ? "--stream" : "");
+            if (oh_sh && sizes[s] == 1000) {
+                snprintf(run, sizeof(run), "bash '%s'", oh_sh);
+                end_to_end(results, "Oh.sh", run, work_dir, corpus, sizes[s], bytes, path, "");
+            }
+            unlink(path);
+        }
+    }
+    return results;
+}
+
+// Stage and end-to-end benchmarks as one JSON document on stdout
+static int bench_suite(int argc, char **argv) {
+    const char *oh = "./" SCRIPT_NAME;
+    const char *oh_sh = NULL;
+    int stages_only = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--oh") == 0 && i + 1 < argc) {
+            oh = argv[++i];
+        } else if (strcmp(argv[i], "--oh-sh") == 0 && i + 1 < argc) {
+            oh_sh = argv[++i];
+        } else if (strcmp(argv[i], "--stages-only") == 0) {
+            stages_only = 1;
+        } else {
+            fprintf(stderr, "Usage: %s suite [--oh PATH] [--oh-sh PATH] [--stages-only]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    char work_dir[] = "/tmp/oh-bench-XXXXXX";
+    if (!mkdtemp(work_dir)) {
+        fprintf(stderr, "Error: Cannot create a benchmark directory\n");
+        return 1;
+    }
+
+    json_t *root = json_object();
+    json_object_set_new(root, "version", json_string(SCRIPT_VERSION));
+    json_object_set_new(root, "scan_backend", json_string(scan_text_backend()));
+    json_object_set_new(root, "cpus", json_integer(sysconf(_SC_NPROCESSORS_ONLN)));
+    json_object_set_new(root, "timestamp", json_integer((json_int_t)time(NULL)));
+    json_object_set_new(root, "stages", bench_stages(work_dir));
+    if (!stages_only) {
+        json_object_set_new(root, "end_to_end", bench_end_to_end(work_dir, oh, oh_sh));
+    }
+
+    char command[MAX_PATH_LENGTH];
+    snprintf(command, sizeof(command), "rm -rf '%s'", work_dir);
+    int cleanup = system(command);
+
+    char *text = json_dumps(root, JSON_INDENT(2));
+    json_decref(root);
+    if (!text) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+    printf("%s\n", text);
+    free(text);
+    return cleanup == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    script_start_time = get_current_time();
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s hash|scan [input-file] | suite [--oh PATH] [--oh-sh PATH] [--stages-only]\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "suite") == 0) {
+        return bench_suite(argc, argv);
+    }
+
+    const char *input = argc > 2 ? argv[2] : "sample.ansi";
+    if (strcmp(argv[1], "hash") == 0) {
+        return bench_hash(input);
+    }
+    if (strcmp(argv[1], "scan") == 0) {
+        return bench_scan(input);
+    }
+
+    fprintf(stderr, "Error: Unknown benchmark '%s'\n", argv[1]);
+    return 1;
+}
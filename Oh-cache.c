@@ -5,30 +5,90 @@
 
 #include "Oh.h"
 
-// Generate hash using system cksum for exact compatibility
+// POSIX cksum CRC-32 (polynomial 0x04C11DB7, MSB-first) slice-by-8 tables
+static uint32_t cksum_table[8][256];
+static int cksum_table_ready = 0;
+static pthread_once_t cksum_table_once = PTHREAD_ONCE_INIT;
+
+static void cksum_build_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04C11DB7u : (crc << 1);
+        }
+        cksum_table[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t prev = cksum_table[k - 1][i];
+            cksum_table[k][i] = (prev << 8) ^ cksum_table[0][prev >> 24];
+        }
+    }
+    __atomic_store_n(&cksum_table_ready, 1, __ATOMIC_RELEASE);
+}
+
+// Build the slice-by-8 tables; safe to call more than once and from any thread
+void cksum_init_tables(void) {
+    if (!__atomic_load_n(&cksum_table_ready, __ATOMIC_ACQUIRE)) {
+        pthread_once(&cksum_table_once, cksum_build_tables);
+    }
+}
+
+// Feed bytes into a running cksum CRC (start with crc = 0)
+uint32_t cksum_update(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+    
+    cksum_init_tables();
+    
+    while (length >= 8) {
+        crc ^= ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        crc = cksum_table[7][crc >> 24] ^ cksum_table[6][(crc >> 16) & 0xFF] ^
+              cksum_table[5][(crc >> 8) & 0xFF] ^ cksum_table[4][crc & 0xFF] ^
+              cksum_table[3][p[4]] ^ cksum_table[2][p[5]] ^
+              cksum_table[1][p[6]] ^ cksum_table[0][p[7]];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc << 8) ^ cksum_table[0][(crc >> 24) ^ *p++];
+    }
+    return crc;
+}
+
+// Append cksum's length suffix (least significant byte first) and complement
+uint32_t cksum_finish(uint32_t crc, size_t total_length) {
+    cksum_init_tables();
+    
+    for (size_t n = total_length; n > 0; n >>= 8) {
+        crc = (crc << 8) ^ cksum_table[0][(crc >> 24) ^ (n & 0xFF)];
+    }
+    return ~crc;
+}
+
+// Generate hash in-process, returning the same value as `printf '%s' ... | cksum`
 unsigned int generate_hash(const char *input) {
+    return generate_hash_bytes(input, strlen(input));
+}
+
+// Hash length bytes of input, which need not be NUL-terminated
+unsigned int generate_hash_bytes(const char *input, size_t length) {
+    return (unsigned int)cksum_finish(cksum_update(0, input, length), length);
+}
+
+// Generate hash using system cksum (reference implementation, used by bench-hash)
+unsigned int generate_hash_popen(const char *input) {
     FILE *fp;
     char command[MAX_LINE_LENGTH + 50];
     char result[64];
     unsigned int hash = 0;
     
-    // Use system cksum for exact compatibility with bash version
     snprintf(command, sizeof(command), "printf '%%s' '%s' | cksum", input);
     
     fp = popen(command, "r");
     if (fp && fgets(result, sizeof(result), fp)) {
         hash = (unsigned int)strtoul(result, NULL, 10);
-        pclose(fp);
-    } else {
-        // Fallback to simple hash if cksum fails
-        const unsigned char *data = (const unsigned char *)input;
-        hash = 0;
-        while (*data) {
-            hash = hash * 31 + *data;
-            data++;
-        }
-        if (fp) pclose(fp);
     }
+    if (fp) pclose(fp);
     
     return hash;
 }
@@ -36,13 +96,15 @@ unsigned int generate_hash(const char *input) {
 // Generate configuration hash
 void generate_config_hash(const Config *config, char *hash_out) {
     char config_string[1024];
-    // Use "false"/"true" strings to match bash version
+    // Use "false"/"true" strings to match bash version; the segment version
+    // keeps caches written before the SGR parser rework (or by Oh.sh, whose
+    // segments differ) from being read
     const char *wrap_str = config->wrap ? "true" : "false";
     snprintf(config_string, sizeof(config_string), 
-             "%s|%d|%.2f|%.2f|%d|%d|%d|%s|%d|%s|%s|%d",
+             "%s|%d|%.2f|%.2f|%d|%d|%d|%s|%d|%s|%s|%d|segments %d",
              config->font_family, config->font_size, config->font_width, config->font_height,
              config->font_weight, config->width, config->height, wrap_str, config->tab_size,
-             BG_COLOR, TEXT_COLOR, DEFAULT_PADDING);
+             BG_COLOR, TEXT_COLOR, DEFAULT_PADDING, SEGMENT_CACHE_VERSION);
     
     unsigned int hash = generate_hash(config_string);
     snprintf(hash_out, MAX_HASH_LENGTH, "%u", hash);
@@ -56,6 +118,18 @@ void generate_config_hash(const Config *config, char *hash_out) {
     }
 }
 
+// Key for everything that shapes a rendered row except the grid height, so
+// rows stay reusable while a log grows; any change to the row markup must
+// change SCRIPT_VERSION or this key
+void generate_render_key(const Config *config, double cell_width, char *key_out) {
+    char render_string[1024];
+    snprintf(render_string, sizeof(render_string), "%s|%s|%d|%.2f|%.2f|%d|%s|%d|%.4f|%s|%s|%d|%s",
+             SCRIPT_VERSION, config->font_family, config->font_size, config->font_width, config->font_height,
+             config->font_weight, config->wrap ? "true" : "false", config->tab_size, cell_width,
+             BG_COLOR, TEXT_COLOR, DEFAULT_PADDING, config->compact ? "compact" : "text");
+    snprintf(key_out, MAX_HASH_LENGTH, "%u", generate_hash(render_string));
+}
+
 // Get cache key
 void get_cache_key(const char *line_hash, const char *config_hash, char *cache_key) {
     snprintf(cache_key, MAX_CACHE_KEY_LENGTH, "%s_%s", config_hash, line_hash);
@@ -68,11 +142,16 @@ void get_cache_key(const char *line_hash, const char *config_hash, char *cache_k
     }
 }
 
-// Save line cache to JSON file
-int save_line_cache(const char *cache_key, const LineData *line_data) {
+// Save line cache to JSON file (written to a temporary name, then renamed into
+// place so concurrent writers of the same key never leave a half-written file)
+static int save_line_cache_json(const char *cache_key, const LineData *line_data) {
+    static unsigned int save_counter = 0;
     char cache_file[MAX_PATH_LENGTH];
+    char temp_file[MAX_PATH_LENGTH];
     int ret = snprintf(cache_file, sizeof(cache_file), "%s/%s.json", cache_dir, cache_key);
-    if (ret >= (int)sizeof(cache_file)) {
+    int temp_ret = snprintf(temp_file, sizeof(temp_file), "%s.%ld.%u.tmp", cache_file, (long)getpid(),
+                            __atomic_fetch_add(&save_counter, 1, __ATOMIC_RELAXED));
+    if (ret >= (int)sizeof(cache_file) || temp_ret >= (int)sizeof(temp_file)) {
         if (debug_mode) {
             log_output("Cache file path too long, skipping save");
         }
@@ -103,11 +182,19 @@ int save_line_cache(const char *cache_key, const LineData *line_data) {
     // Create segments array
     json_t *segments_array = json_array();
     for (int i = 0; i < line_data->segment_count; i++) {
-        const TextSegment *seg = &line_data->segments[i];
-        char segment_string[MAX_LINE_LENGTH * 2];
-        snprintf(segment_string, sizeof(segment_string), "%s|%s|%s|%s|%d",
-                seg->text, seg->fg_color, seg->bg_color, 
-                seg->bold ? "true" : "false", seg->visible_pos);
+        const TextSegment *seg = LINE_SEGMENT(line_data, i);
+        // Segments are unbounded (lines are), so the string is sized to fit
+        const char *fields = "%s|%s|%s|%s|%d";
+        int needed = snprintf(NULL, 0, fields, SEGMENT_TEXT(line_data, seg), color_name(seg->fg),
+                              color_name(seg->bg), seg->bold ? "true" : "false", seg->visible_pos);
+        char *segment_string = needed >= 0 ? scratch_alloc((size_t)needed + 1) : NULL;
+        if (!segment_string) {
+            json_decref(segments_array);
+            json_decref(root);
+            return -1;
+        }
+        snprintf(segment_string, (size_t)needed + 1, fields, SEGMENT_TEXT(line_data, seg), color_name(seg->fg),
+                 color_name(seg->bg), seg->bold ? "true" : "false", seg->visible_pos);
         json_array_append_new(segments_array, json_string(segment_string));
     }
     json_object_set_new(root, "segments", segments_array);
@@ -117,18 +204,24 @@ int save_line_cache(const char *cache_key, const LineData *line_data) {
     json_object_set_new(root, "timestamp", json_integer(timestamp));
     
     // Write JSON to file
-    if (json_dump_file(root, cache_file, JSON_INDENT(2)) != 0) {
+    if (json_dump_file(root, temp_file, JSON_INDENT(2)) != 0 || rename(temp_file, cache_file) != 0) {
         if (debug_mode) {
             char msg[512];
             snprintf(msg, sizeof(msg), "Failed to write cache file: %.400s", cache_file);
             log_output(msg);
         }
+        unlink(temp_file);
         json_decref(root);
         return -1;
     }
     
     json_decref(root);
     
+    struct stat st;
+    if (cache_max_size > 0 && stat(cache_file, &st) == 0) {
+        cache_usage_add((size_t)st.st_size);
+    }
+    
     if (debug_mode) {
         char msg[256];
         snprintf(msg, sizeof(msg), "Cache saved to: %.200s", cache_file);
@@ -138,15 +231,23 @@ int save_line_cache(const char *cache_key, const LineData *line_data) {
     return 0;
 }
 
+// The JSON tree of a cache file, and the strings building it, come from the
+// thread's scratch arena and are released together when the save is done
+int save_line_cache(const char *cache_key, const LineData *line_data) {
+    scratch_begin();
+    int result = save_line_cache_json(cache_key, line_data);
+    scratch_end();
+    return result;
+}
+
 // Load line cache from JSON file
-int load_line_cache(const char *cache_key, LineData *line_data) {
+static int load_line_cache_json(const char *cache_key, LineData *line_data) {
     char cache_file[MAX_PATH_LENGTH];
     int ret = snprintf(cache_file, sizeof(cache_file), "%s/%s.json", cache_dir, cache_key);
     if (ret >= (int)sizeof(cache_file)) {
         if (debug_mode) {
             log_output("Cache file path too long, skipping load");
         }
-        cache_stats_segment_misses++;
         return -1;
     }
     
@@ -165,7 +266,6 @@ int load_line_cache(const char *cache_key, LineData *line_data) {
             snprintf(msg, sizeof(msg), "Cache miss: %.200s", cache_file);
             log_output(msg);
         }
-        cache_stats_segment_misses++;
         return -1;
     }
     
@@ -174,11 +274,10 @@ int load_line_cache(const char *cache_key, LineData *line_data) {
         snprintf(msg, sizeof(msg), "Cache hit: %.200s", cache_file);
         log_output(msg);
     }
-    cache_stats_segment_hits++;
+    cache_touch(cache_file);
     
     // Initialize line data
-    line_data->segment_count = 0;
-    line_data->visible_length = 0;
+    line_begin(line_data, line_data->arena);
     
     // Parse visible_length
     json_t *visible_length_obj = json_object_get(root, "visible_length");
@@ -190,7 +289,7 @@ int load_line_cache(const char *cache_key, LineData *line_data) {
     json_t *segments_array = json_object_get(root, "segments");
     if (json_is_array(segments_array)) {
         size_t array_size = json_array_size(segments_array);
-        for (size_t i = 0; i < array_size && line_data->segment_count < MAX_SEGMENTS; i++) {
+        for (size_t i = 0; i < array_size; i++) {
             json_t *segment_str = json_array_get(segments_array, i);
             if (json_is_string(segment_str)) {
                 const char *segment_data = json_string_value(segment_str);
@@ -202,76 +301,54 @@ int load_line_cache(const char *cache_key, LineData *line_data) {
                     log_output(raw_debug_msg);
                 }
                 
-                char segment_copy[MAX_LINE_LENGTH * 2];
-                strncpy(segment_copy, segment_data, sizeof(segment_copy) - 1);
-                segment_copy[sizeof(segment_copy) - 1] = '\0';
+                // Split in place on the first four pipes (fields may be empty)
+                const char *parts[5] = {NULL, NULL, NULL, NULL, NULL};
+                size_t part_lengths[5] = {0, 0, 0, 0, 0};
+                const char *current = segment_data;
                 
-                // Manual parsing to handle empty fields (strtok_r skips empty fields)
-                char *parts[5] = {NULL, NULL, NULL, NULL, NULL};
-                char *current = segment_copy;
-                int part_count = 0;
-                
-                for (int field = 0; field < 5 && part_count < 5; field++) {
-                    parts[part_count] = current;
-                    char *next_pipe = strchr(current, '|');
-                    if (next_pipe) {
-                        *next_pipe = '\0';
-                        current = next_pipe + 1;
+                for (int field = 0; field < 5; field++) {
+                    parts[field] = current;
+                    const char *next_pipe = field < 4 ? strchr(current, '|') : NULL;
+                    if (!next_pipe) {
+                        part_lengths[field] = strlen(current);
+                        break;
                     }
-                    part_count++;
-                    if (!next_pipe) break;
+                    part_lengths[field] = (size_t)(next_pipe - current);
+                    current = next_pipe + 1;
                 }
                 
                 // Parse each field
-                if (parts[0]) {
-                    strcpy(line_data->segments[line_data->segment_count].text, parts[0]);
-                    if (debug_mode) {
-                        char text_debug_msg[256];
-                        snprintf(text_debug_msg, sizeof(text_debug_msg), "    Parsed text: '%s'", parts[0]);
-                        log_output(text_debug_msg);
-                    }
-                }
+                char fg_color[MAX_COLOR_LENGTH] = "";
+                char bg_color[MAX_COLOR_LENGTH] = "";
+                int bold = 0;
+                int visible_pos = 0;
                 
                 if (parts[1]) {
-                    strcpy(line_data->segments[line_data->segment_count].fg_color, parts[1]);
-                    if (debug_mode) {
-                        char fg_debug_msg[256];
-                        snprintf(fg_debug_msg, sizeof(fg_debug_msg), "    Parsed fg_color: '%s'", parts[1]);
-                        log_output(fg_debug_msg);
-                    }
+                    snprintf(fg_color, sizeof(fg_color), "%.*s", (int)part_lengths[1], parts[1]);
                 }
-                
                 if (parts[2]) {
-                    strcpy(line_data->segments[line_data->segment_count].bg_color, parts[2]);
-                    if (debug_mode) {
-                        char bg_debug_msg[256];
-                        snprintf(bg_debug_msg, sizeof(bg_debug_msg), "    Parsed bg_color: '%s'", parts[2]);
-                        log_output(bg_debug_msg);
-                    }
+                    snprintf(bg_color, sizeof(bg_color), "%.*s", (int)part_lengths[2], parts[2]);
                 }
-                
                 if (parts[3]) {
-                    line_data->segments[line_data->segment_count].bold = (strcmp(parts[3], "true") == 0);
-                    if (debug_mode) {
-                        char bold_debug_msg[256];
-                        snprintf(bold_debug_msg, sizeof(bold_debug_msg), "    Parsed bold: '%s' -> %d", parts[3], line_data->segments[line_data->segment_count].bold);
-                        log_output(bold_debug_msg);
-                    }
+                    bold = (part_lengths[3] == 4 && strncmp(parts[3], "true", 4) == 0);
                 }
-                
                 if (parts[4]) {
-                    line_data->segments[line_data->segment_count].visible_pos = atoi(parts[4]);
-                    
-                    if (debug_mode) {
-                        char pos_debug_msg[256];
-                        snprintf(pos_debug_msg, sizeof(pos_debug_msg), "    Parsed visible_pos: '%s' -> %d for segment '%s'", 
-                                parts[4], line_data->segments[line_data->segment_count].visible_pos,
-                                line_data->segments[line_data->segment_count].text);
-                        log_output(pos_debug_msg);
-                    }
+                    visible_pos = atoi(parts[4]);
+                }
+                
+                if (debug_mode) {
+                    char field_debug_msg[512];
+                    snprintf(field_debug_msg, sizeof(field_debug_msg),
+                            "    Parsed text: '%.*s' fg_color: '%s' bg_color: '%s' bold: %d visible_pos: %d",
+                            (int)(part_lengths[0] < 200 ? part_lengths[0] : 200), parts[0],
+                            fg_color, bg_color, bold, visible_pos);
+                    log_output(field_debug_msg);
                 }
                 
-                line_data->segment_count++;
+                if (line_add_segment(line_data, parts[0], part_lengths[0],
+                                     intern_color(fg_color), intern_color(bg_color), bold, visible_pos) != 0) {
+                    break;
+                }
             }
         }
     }
@@ -288,6 +365,13 @@ int load_line_cache(const char *cache_key, LineData *line_data) {
     return 0;
 }
 
+int load_line_cache(const char *cache_key, LineData *line_data) {
+    scratch_begin();
+    int result = load_line_cache_json(cache_key, line_data);
+    scratch_end();
+    return result;
+}
+
 // Get SVG fragment cache key
 void get_svg_fragment_cache_key(const char *line_hash, const char *config_hash, int line_number, char *cache_key) {
     snprintf(cache_key, MAX_CACHE_KEY_LENGTH, "svg_%s_%d_%s", config_hash, line_number, line_hash);
@@ -333,7 +417,6 @@ char* load_svg_fragment_cache(const char *cache_key) {
         if (debug_mode) {
             log_output("SVG cache file path too long, skipping load");
         }
-        cache_stats_svg_misses++;
         return NULL;
     }
     
@@ -350,7 +433,6 @@ char* load_svg_fragment_cache(const char *cache_key) {
             snprintf(msg, sizeof(msg), "SVG fragment cache miss: %.200s", cache_file);
             log_output(msg);
         }
-        cache_stats_svg_misses++;
         return NULL;
     }
     
@@ -359,7 +441,6 @@ char* load_svg_fragment_cache(const char *cache_key) {
         snprintf(msg, sizeof(msg), "SVG fragment cache hit: %.200s", cache_file);
         log_output(msg);
     }
-    cache_stats_svg_hits++;
     
     // Read entire file
     fseek(file, 0, SEEK_END);
@@ -379,27 +460,69 @@ char* load_svg_fragment_cache(const char *cache_key) {
     return content;
 }
 
-// Generate global input hash
-void generate_global_input_hash(void) {
-    char combined_hashes[MAX_LINES * MAX_HASH_LENGTH];
-    combined_hashes[0] = '\0';
+// Generate global input hash (cksum of all line hashes concatenated)
+void generate_global_input_hash(RenderState *render) {
+    uint32_t crc = 0;
+    size_t total_length = 0;
     
-    for (int i = 0; i < input_line_count; i++) {
-        strcat(combined_hashes, hash_cache[i]);
+    for (int i = 0; i < render->line_count; i++) {
+        size_t length = strlen(render->line_hashes[i]);
+        crc = cksum_update(crc, render->line_hashes[i], length);
+        total_length += length;
     }
     
-    unsigned int hash = generate_hash(combined_hashes);
-    snprintf(global_input_hash, sizeof(global_input_hash), "%u", hash);
+    unsigned int hash = (unsigned int)cksum_finish(crc, total_length);
+    snprintf(render->input_hash, sizeof(render->input_hash), "%u", hash);
     
     if (debug_mode) {
         char msg[256];
-        snprintf(msg, sizeof(msg), "Generated global input hash: %s", global_input_hash);
+        snprintf(msg, sizeof(msg), "Generated global input hash: %s", render->input_hash);
         log_output(msg);
     }
 }
 
+void render_layout_free(RenderLayout *layout) {
+    free(layout->row_hashes);
+    free(layout->row_lengths);
+    memset(layout, 0, sizeof(*layout));
+}
+
+// Read the previous render's row layout; leaves previous empty when absent or inconsistent
+static void load_render_layout(json_t *root, RenderLayout *previous) {
+    json_t *layout = json_object_get(root, "render_layout");
+    if (!json_is_object(layout)) return;
+    
+    json_t *output_file = json_object_get(layout, "output_file");
+    json_t *render_key = json_object_get(layout, "render_key");
+    json_t *row_hashes = json_object_get(layout, "row_hashes");
+    json_t *row_lengths = json_object_get(layout, "row_lengths");
+    if (!json_is_string(output_file) || !json_is_string(render_key) ||
+        !json_is_array(row_hashes) || !json_is_array(row_lengths)) return;
+    
+    size_t rows = json_array_size(row_lengths);
+    if (rows == 0 || rows != json_array_size(row_hashes)) return;
+    
+    previous->row_hashes = malloc(rows * sizeof(uint32_t));
+    previous->row_lengths = malloc(rows * sizeof(uint32_t));
+    if (!previous->row_hashes || !previous->row_lengths) {
+        render_layout_free(previous);
+        return;
+    }
+    for (size_t i = 0; i < rows; i++) {
+        previous->row_hashes[i] = (uint32_t)json_integer_value(json_array_get(row_hashes, i));
+        previous->row_lengths[i] = (uint32_t)json_integer_value(json_array_get(row_lengths, i));
+    }
+    snprintf(previous->output_file, sizeof(previous->output_file), "%s", json_string_value(output_file));
+    snprintf(previous->render_key, sizeof(previous->render_key), "%s", json_string_value(render_key));
+    previous->output_size = json_integer_value(json_object_get(layout, "output_size"));
+    previous->output_mtime_sec = json_integer_value(json_object_get(layout, "output_mtime_sec"));
+    previous->output_mtime_nsec = json_integer_value(json_object_get(layout, "output_mtime_nsec"));
+    previous->body_offset = json_integer_value(json_object_get(layout, "body_offset"));
+    previous->row_count = (int)rows;
+}
+
 // Load incremental cache
-int load_incremental_cache(void) {
+int load_incremental_cache(RenderState *render) {
     // Load JSON from file using jansson
     json_error_t error;
     json_t *root = json_load_file(incremental_cache_file, 0, &error);
@@ -414,15 +537,16 @@ int load_incremental_cache(void) {
     json_t *hash_obj = json_object_get(root, "global_input_hash");
     if (json_is_string(hash_obj)) {
         const char *hash_value = json_string_value(hash_obj);
-        strncpy(previous_input_hash, hash_value, sizeof(previous_input_hash) - 1);
-        previous_input_hash[sizeof(previous_input_hash) - 1] = '\0';
+        snprintf(render->previous_input_hash, sizeof(render->previous_input_hash), "%s", hash_value);
     }
     
+    load_render_layout(root, &render->previous_layout);
     json_decref(root);
     
     if (debug_mode) {
         char msg[256];
-        snprintf(msg, sizeof(msg), "Loaded previous input hash: %s", previous_input_hash);
+        snprintf(msg, sizeof(msg), "Loaded previous input hash: %s (%d rows of render layout)",
+                render->previous_input_hash, render->previous_layout.row_count);
         log_output(msg);
     }
     
@@ -430,7 +554,9 @@ int load_incremental_cache(void) {
 }
 
 // Save incremental cache
-int save_incremental_cache(const char *config_hash) {
+int save_incremental_cache(const RenderState *render, const char *config_hash) {
+    const RenderLayout *current = &render->current_layout;
+    const CacheCounters *counts = &render->stats;
     if (debug_mode) {
         log_output("Saving incremental cache data");
     }
@@ -445,18 +571,18 @@ int save_incremental_cache(const char *config_hash) {
     }
     
     // Set global_input_hash
-    json_object_set_new(root, "global_input_hash", json_string(global_input_hash));
+    json_object_set_new(root, "global_input_hash", json_string(render->input_hash));
     
     // Set config_hash
     json_object_set_new(root, "config_hash", json_string(config_hash));
     
     // Set line_count
-    json_object_set_new(root, "line_count", json_integer(input_line_count));
+    json_object_set_new(root, "line_count", json_integer(render->line_count));
     
     // Create line_hashes array
     json_t *line_hashes_array = json_array();
-    for (int i = 0; i < input_line_count; i++) {
-        json_array_append_new(line_hashes_array, json_string(hash_cache[i]));
+    for (int i = 0; i < render->line_count; i++) {
+        json_array_append_new(line_hashes_array, json_string(render->line_hashes[i]));
     }
     json_object_set_new(root, "line_hashes", line_hashes_array);
     
@@ -466,12 +592,32 @@ int save_incremental_cache(const char *config_hash) {
     
     // Create cache_stats object
     json_t *cache_stats = json_object();
-    json_object_set_new(cache_stats, "segment_hits", json_integer(cache_stats_segment_hits));
-    json_object_set_new(cache_stats, "segment_misses", json_integer(cache_stats_segment_misses));
-    json_object_set_new(cache_stats, "svg_hits", json_integer(cache_stats_svg_hits));
-    json_object_set_new(cache_stats, "svg_misses", json_integer(cache_stats_svg_misses));
+    json_object_set_new(cache_stats, "segment_hits", json_integer(counts->segment_hits));
+    json_object_set_new(cache_stats, "segment_misses", json_integer(counts->segment_misses));
+    json_object_set_new(cache_stats, "svg_hits", json_integer(counts->svg_hits));
+    json_object_set_new(cache_stats, "svg_misses", json_integer(counts->svg_misses));
     json_object_set_new(root, "cache_stats", cache_stats);
     
+    // Row layout of the output just written (only for regular output files)
+    if (current->row_lengths && current->output_file[0] != '\0') {
+        json_t *layout = json_object();
+        json_t *row_hashes = json_array();
+        json_t *row_lengths = json_array();
+        for (int i = 0; i < current->row_count; i++) {
+            json_array_append_new(row_hashes, json_integer(current->row_hashes ? current->row_hashes[i] : 0));
+            json_array_append_new(row_lengths, json_integer(current->row_lengths[i]));
+        }
+        json_object_set_new(layout, "output_file", json_string(current->output_file));
+        json_object_set_new(layout, "render_key", json_string(current->render_key));
+        json_object_set_new(layout, "output_size", json_integer(current->output_size));
+        json_object_set_new(layout, "output_mtime_sec", json_integer(current->output_mtime_sec));
+        json_object_set_new(layout, "output_mtime_nsec", json_integer(current->output_mtime_nsec));
+        json_object_set_new(layout, "body_offset", json_integer(current->body_offset));
+        json_object_set_new(layout, "row_hashes", row_hashes);
+        json_object_set_new(layout, "row_lengths", row_lengths);
+        json_object_set_new(root, "render_layout", layout);
+    }
+    
     // Write JSON to file
     if (json_dump_file(root, incremental_cache_file, JSON_INDENT(2)) != 0) {
         if (debug_mode) {
@@ -0,0 +1,1022 @@
+/*
+ * Oh-cast.c - Animated SVG from asciicast recordings (--cast)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * An asciicast v2 recording is a JSON header line with the terminal size
+ * followed by one [time, "o", data] event per line. The output events are
+ * played through a screen emulator (cursor movement, erase, insert and
+ * delete, scroll regions, the alternate screen) and the screen is sampled
+ * into keyframes, events less than CAST_FRAME_INTERVAL apart sharing one.
+ * Only rows that changed since the previous keyframe are drawn in it, and
+ * each distinct row is rendered once as a <symbol> that every keyframe
+ * showing it references with <use>. Keyframes are stacked groups, each
+ * hidden until its time by a CSS animation looping over the recording, and
+ * every row draws its own background so later keyframes cover earlier ones.
+ */
+
+#include "Oh.h"
+
+#define CAST_FRAME_INTERVAL (1.0 / 30)  // events closer than this share a keyframe
+#define CAST_END_HOLD 2.0               // seconds the last keyframe shows before the loop restarts
+#define CAST_MAX_SIZE 1000              // largest terminal width or height accepted
+#define CAST_DEFAULT_HEIGHT 24
+
+// Emulator parser states
+#define CAST_GROUND       0
+#define CAST_ESCAPE       1
+#define CAST_ESCAPE_SKIP  2  // charset designation: one more byte follows
+#define CAST_CSI          3
+#define CAST_STRING       4  // OSC, DCS, APC, PM: skipped up to BEL or ST
+#define CAST_STRING_ESC   5
+
+// One screen cell. A wide character's first cell has width 2 and the cell
+// after it width 0; combining marks are appended to the character they follow.
+typedef struct {
+    char text[12];
+    uint8_t length;
+    uint8_t width;
+    uint8_t bold;
+    uint16_t fg;
+    uint16_t bg;
+} CastCell;
+
+typedef struct {
+    int columns;
+    int rows;
+    int tab_size;
+    CastCell *cells;
+    CastCell *main_cells;   // the main screen while the alternate screen is shown
+    uint8_t *dirty;         // rows changed since the last keyframe
+    int x;
+    int y;
+    int wrap_pending;       // a character was written in the last column
+    int top;                // scroll region, inclusive
+    int bottom;
+    int saved_x;
+    int saved_y;
+    SgrState sgr;
+    SgrState saved_sgr;
+    uint16_t default_fg;
+    int state;
+    int params[SGR_MAX_PARAMS];
+    uint8_t colon[SGR_MAX_PARAMS];
+    int param_count;
+    int value;
+    uint8_t value_colon;
+    char marker;            // private parameter marker ('?', '>', ...)
+    int intermediate;
+    unsigned char utf8[4];
+    int utf8_length;
+    int utf8_needed;
+} CastScreen;
+
+// A distinct row: its markup is a slice of the symbol buffer
+typedef struct {
+    size_t offset;
+    size_t length;
+    uint64_t hash;
+} CastRow;
+
+typedef struct {
+    const Config *config;
+    double cell_width;
+    LineArena arena;
+    OutputWriter markup;    // scratch for the row being rendered
+    OutputWriter symbols;   // <symbol> for every distinct row
+    OutputWriter frames;    // one group of <use> per keyframe
+    CastRow *row_table;
+    int row_count;
+    int row_capacity;
+    int *row_slots;         // open-addressed index into row_table, -1 when empty
+    int slot_count;
+    int *shown;             // row id each screen row shows
+    char *row_text;         // text of the run being built
+    double *frame_times;
+    int frame_count;
+    int frame_capacity;
+    long row_updates;
+    long long segments;
+    StylePalette palette;
+} CastFrames;
+
+int is_cast_file(const char *path) {
+    size_t length = strlen(path);
+    return length > 5 && strcmp(path + length - 5, ".cast") == 0;
+}
+
+// ---------------------------------------------------------------------------
+// Screen emulator
+// ---------------------------------------------------------------------------
+
+#define CAST_CELL(screen, row, column) (&(screen)->cells[(size_t)(row) * (screen)->columns + (column)])
+
+// Erased cells take the current background, as in xterm
+static CastCell cast_blank(const CastScreen *screen) {
+    CastCell cell;
+    memset(&cell, 0, sizeof(cell));
+    cell.text[0] = ' ';
+    cell.length = 1;
+    cell.width = 1;
+    cell.fg = screen->default_fg;
+    cell.bg = screen->sgr.bg;
+    return cell;
+}
+
+static void cast_erase(CastScreen *screen, int row, int from, int to) {
+    CastCell blank = cast_blank(screen);
+    if (from < 0) from = 0;
+    if (to > screen->columns) to = screen->columns;
+    for (int x = from; x < to; x++) *CAST_CELL(screen, row, x) = blank;
+    screen->dirty[row] = 1;
+}
+
+// Move rows [top, bottom] up by count (down when count < 0), blanking the rows uncovered
+static void cast_scroll(CastScreen *screen, int top, int bottom, int count) {
+    int height = bottom - top + 1;
+    if (top < 0 || bottom >= screen->rows || height <= 0 || count == 0) return;
+    int shift = abs(count) < height ? abs(count) : height;
+    size_t row_bytes = (size_t)screen->columns * sizeof(CastCell);
+
+    if (count > 0) {
+        memmove(CAST_CELL(screen, top, 0), CAST_CELL(screen, top + shift, 0), (height - shift) * row_bytes);
+        for (int y = bottom - shift + 1; y <= bottom; y++) cast_erase(screen, y, 0, screen->columns);
+    } else {
+        memmove(CAST_CELL(screen, top + shift, 0), CAST_CELL(screen, top, 0), (height - shift) * row_bytes);
+        for (int y = top; y < top + shift; y++) cast_erase(screen, y, 0, screen->columns);
+    }
+    memset(screen->dirty + top, 1, height);
+}
+
+static void cast_line_feed(CastScreen *screen) {
+    screen->wrap_pending = 0;
+    if (screen->y == screen->bottom) {
+        cast_scroll(screen, screen->top, screen->bottom, 1);
+    } else if (screen->y < screen->rows - 1) {
+        screen->y++;
+    }
+}
+
+static void cast_reverse_index(CastScreen *screen) {
+    screen->wrap_pending = 0;
+    if (screen->y == screen->top) {
+        cast_scroll(screen, screen->top, screen->bottom, -1);
+    } else if (screen->y > 0) {
+        screen->y--;
+    }
+}
+
+static void cast_move(CastScreen *screen, int x, int y) {
+    screen->x = x < 0 ? 0 : x >= screen->columns ? screen->columns - 1 : x;
+    screen->y = y < 0 ? 0 : y >= screen->rows ? screen->rows - 1 : y;
+    screen->wrap_pending = 0;
+}
+
+// Blank whatever remains of a wide character one of whose cells is overwritten
+static void cast_split_wide(CastScreen *screen, int x) {
+    CastCell *cell = CAST_CELL(screen, screen->y, x);
+    if (cell->width == 0 && x > 0) {
+        cast_erase(screen, screen->y, x - 1, x);
+    } else if (cell->width == 2 && x + 1 < screen->columns) {
+        cast_erase(screen, screen->y, x + 1, x + 2);
+    }
+}
+
+static void cast_put(CastScreen *screen, const char *text, int length, int width) {
+    if (width == 0) {
+        int x = screen->wrap_pending ? screen->x : screen->x - 1;
+        if (x > 0 && CAST_CELL(screen, screen->y, x)->width == 0) x--;
+        if (x < 0) return;
+        CastCell *cell = CAST_CELL(screen, screen->y, x);
+        if (cell->length + length <= (int)sizeof(cell->text)) {
+            memcpy(cell->text + cell->length, text, length);
+            cell->length += length;
+            screen->dirty[screen->y] = 1;
+        }
+        return;
+    }
+    if (width == 2 && screen->columns < 2) width = 1;
+
+    if (screen->wrap_pending) {
+        screen->x = 0;
+        cast_line_feed(screen);
+    }
+    if (width == 2 && screen->x == screen->columns - 1) {
+        cast_split_wide(screen, screen->x);
+        cast_erase(screen, screen->y, screen->x, screen->x + 1);
+        screen->x = 0;
+        cast_line_feed(screen);
+    }
+
+    for (int x = screen->x; x < screen->x + width; x++) cast_split_wide(screen, x);
+    CastCell *cell = CAST_CELL(screen, screen->y, screen->x);
+    memcpy(cell->text, text, length);
+    cell->length = (uint8_t)length;
+    cell->width = (uint8_t)width;
+    cell->fg = screen->sgr.fg;
+    cell->bg = screen->sgr.bg;
+    cell->bold = (uint8_t)screen->sgr.bold;
+    if (width == 2) {
+        cell[1] = cell[0];
+        cell[1].length = 0;
+        cell[1].width = 0;
+    }
+    screen->dirty[screen->y] = 1;
+
+    screen->x += width;
+    if (screen->x >= screen->columns) {
+        screen->x = screen->columns - 1;
+        screen->wrap_pending = 1;
+    }
+}
+
+static void cast_put_replacement(CastScreen *screen) {
+    cast_put(screen, "\xEF\xBF\xBD", 3, 1);
+}
+
+// Complete the UTF-8 character whose bytes have been collected
+static void cast_put_utf8(CastScreen *screen) {
+    const unsigned char *bytes = screen->utf8;
+    int length = screen->utf8_length;
+    uint32_t codepoint = bytes[0] & (0x7F >> length);
+    for (int i = 1; i < length; i++) codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+    screen->utf8_length = 0;
+
+    static const uint32_t shortest[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (codepoint < shortest[length] || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF) ||
+        codepoint == 0xFFFE || codepoint == 0xFFFF) {
+        cast_put_replacement(screen);
+        return;
+    }
+    cast_put(screen, (const char *)bytes, length, codepoint_width(codepoint));
+}
+
+static void cast_set_alternate(CastScreen *screen, int on) {
+    size_t size = (size_t)screen->rows * screen->columns * sizeof(CastCell);
+    if (on && !screen->main_cells) {
+        screen->main_cells = malloc(size);
+        if (!screen->main_cells) return;
+        memcpy(screen->main_cells, screen->cells, size);
+        for (int y = 0; y < screen->rows; y++) cast_erase(screen, y, 0, screen->columns);
+    } else if (!on && screen->main_cells) {
+        memcpy(screen->cells, screen->main_cells, size);
+        free(screen->main_cells);
+        screen->main_cells = NULL;
+        memset(screen->dirty, 1, screen->rows);
+    }
+}
+
+static void cast_reset(CastScreen *screen) {
+    sgr_reset(&screen->sgr);
+    screen->saved_sgr = screen->sgr;
+    screen->default_fg = screen->sgr.fg;
+    cast_set_alternate(screen, 0);
+    for (int y = 0; y < screen->rows; y++) cast_erase(screen, y, 0, screen->columns);
+    screen->x = 0;
+    screen->y = 0;
+    screen->saved_x = 0;
+    screen->saved_y = 0;
+    screen->wrap_pending = 0;
+    screen->top = 0;
+    screen->bottom = screen->rows - 1;
+    screen->state = CAST_GROUND;
+}
+
+static int cast_screen_init(CastScreen *screen, int columns, int rows, int tab_size) {
+    memset(screen, 0, sizeof(*screen));
+    screen->columns = columns;
+    screen->rows = rows;
+    screen->tab_size = tab_size > 0 ? tab_size : DEFAULT_TAB_SIZE;
+    screen->cells = malloc((size_t)rows * columns * sizeof(CastCell));
+    screen->dirty = malloc(rows);
+    if (!screen->cells || !screen->dirty) return -1;
+    cast_reset(screen);
+    return 0;
+}
+
+static void cast_screen_free(CastScreen *screen) {
+    free(screen->cells);
+    free(screen->main_cells);
+    free(screen->dirty);
+}
+
+// Parameter index of a CSI sequence, value_default when absent or zero
+static int cast_param(const CastScreen *screen, int index, int value_default) {
+    if (index >= screen->param_count || screen->params[index] == 0) return value_default;
+    return screen->params[index];
+}
+
+static void cast_private_mode(CastScreen *screen, int on) {
+    for (int i = 0; i < screen->param_count; i++) {
+        int mode = screen->params[i];
+        if (mode == 1049 || mode == 1047 || mode == 47) {
+            if (mode == 1049 && on) {
+                screen->saved_x = screen->x;
+                screen->saved_y = screen->y;
+                screen->saved_sgr = screen->sgr;
+            }
+            cast_set_alternate(screen, on);
+            if (mode == 1049 && !on) {
+                cast_move(screen, screen->saved_x, screen->saved_y);
+                screen->sgr = screen->saved_sgr;
+            }
+        }
+    }
+}
+
+static void cast_csi_dispatch(CastScreen *screen, unsigned char final) {
+    int n = cast_param(screen, 0, 1);
+    int y = screen->y;
+    int columns = screen->columns;
+
+    if (screen->marker == '?') {
+        if (final == 'h' || final == 'l') cast_private_mode(screen, final == 'h');
+        return;
+    }
+    if (screen->marker || screen->intermediate) return;
+
+    switch (final) {
+    case 'A': cast_move(screen, screen->x, y - n); break;
+    case 'B': case 'e': cast_move(screen, screen->x, y + n); break;
+    case 'C': case 'a': cast_move(screen, screen->x + n, y); break;
+    case 'D': cast_move(screen, screen->x - n, y); break;
+    case 'E': cast_move(screen, 0, y + n); break;
+    case 'F': cast_move(screen, 0, y - n); break;
+    case 'G': case '`': cast_move(screen, n - 1, y); break;
+    case 'd': cast_move(screen, screen->x, n - 1); break;
+    case 'H': case 'f': cast_move(screen, cast_param(screen, 1, 1) - 1, n - 1); break;
+    case 'J': {
+        int mode = cast_param(screen, 0, 0);
+        if (mode == 0) {
+            cast_erase(screen, y, screen->x, columns);
+            for (int row = y + 1; row < screen->rows; row++) cast_erase(screen, row, 0, columns);
+        } else if (mode == 1) {
+            for (int row = 0; row < y; row++) cast_erase(screen, row, 0, columns);
+            cast_erase(screen, y, 0, screen->x + 1);
+        } else {
+            for (int row = 0; row < screen->rows; row++) cast_erase(screen, row, 0, columns);
+        }
+        break;
+    }
+    case 'K': {
+        int mode = cast_param(screen, 0, 0);
+        if (mode == 0) cast_erase(screen, y, screen->x, columns);
+        else if (mode == 1) cast_erase(screen, y, 0, screen->x + 1);
+        else cast_erase(screen, y, 0, columns);
+        break;
+    }
+    case 'X':
+        cast_erase(screen, y, screen->x, screen->x + n);
+        break;
+    case 'P': case '@': {
+        // Delete (or insert) n cells at the cursor, shifting the rest of the row
+        if (n > columns - screen->x) n = columns - screen->x;
+        CastCell *row = CAST_CELL(screen, y, 0);
+        int keep = columns - screen->x - n;
+        if (final == 'P') {
+            memmove(row + screen->x, row + screen->x + n, keep * sizeof(CastCell));
+            cast_erase(screen, y, columns - n, columns);
+        } else {
+            memmove(row + screen->x + n, row + screen->x, keep * sizeof(CastCell));
+            cast_erase(screen, y, screen->x, screen->x + n);
+        }
+        screen->wrap_pending = 0;
+        break;
+    }
+    case 'L': case 'M':
+        if (y >= screen->top && y <= screen->bottom) {
+            cast_scroll(screen, y, screen->bottom, final == 'M' ? n : -n);
+            screen->x = 0;
+            screen->wrap_pending = 0;
+        }
+        break;
+    case 'S': cast_scroll(screen, screen->top, screen->bottom, n); break;
+    case 'T': cast_scroll(screen, screen->top, screen->bottom, -n); break;
+    case 'r': {
+        int top = n - 1;
+        int bottom = cast_param(screen, 1, screen->rows) - 1;
+        if (bottom >= screen->rows) bottom = screen->rows - 1;
+        if (top < bottom) {
+            screen->top = top;
+            screen->bottom = bottom;
+            cast_move(screen, 0, 0);
+        }
+        break;
+    }
+    case 'm':
+        sgr_apply(&screen->sgr, screen->params, screen->colon, screen->param_count);
+        break;
+    case 's':
+        screen->saved_x = screen->x;
+        screen->saved_y = y;
+        break;
+    case 'u':
+        cast_move(screen, screen->saved_x, screen->saved_y);
+        break;
+    default:
+        break;
+    }
+}
+
+static void cast_escape_dispatch(CastScreen *screen, unsigned char c) {
+    screen->state = CAST_GROUND;
+    switch (c) {
+    case '[':
+        screen->state = CAST_CSI;
+        screen->param_count = 0;
+        screen->value = 0;
+        screen->value_colon = 0;
+        screen->marker = 0;
+        screen->intermediate = 0;
+        break;
+    case ']': case 'P': case 'X': case '^': case '_':
+        screen->state = CAST_STRING;
+        break;
+    case '(': case ')': case '*': case '+': case '-': case '.': case '/': case '#': case '%':
+        screen->state = CAST_ESCAPE_SKIP;
+        break;
+    case '7':
+        screen->saved_x = screen->x;
+        screen->saved_y = screen->y;
+        screen->saved_sgr = screen->sgr;
+        break;
+    case '8':
+        cast_move(screen, screen->saved_x, screen->saved_y);
+        screen->sgr = screen->saved_sgr;
+        break;
+    case 'D': cast_line_feed(screen); break;
+    case 'E': screen->x = 0; cast_line_feed(screen); break;
+    case 'M': cast_reverse_index(screen); break;
+    case 'c': cast_reset(screen); break;
+    default: break;
+    }
+}
+
+static void cast_control(CastScreen *screen, unsigned char c) {
+    switch (c) {
+    case '\b':
+        if (screen->x > 0 && !screen->wrap_pending) screen->x--;
+        screen->wrap_pending = 0;
+        break;
+    case '\t': {
+        int stop = (screen->x / screen->tab_size + 1) * screen->tab_size;
+        cast_move(screen, stop, screen->y);
+        break;
+    }
+    case '\n': case '\v': case '\f':
+        cast_line_feed(screen);
+        break;
+    case '\r':
+        screen->x = 0;
+        screen->wrap_pending = 0;
+        break;
+    case 0x1B:
+        screen->state = CAST_ESCAPE;
+        break;
+    default:
+        break;
+    }
+}
+
+// Feed output bytes to the emulator; sequences may span calls
+static void cast_feed(CastScreen *screen, const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)data[i];
+
+        // A character cut short by anything but a continuation byte is replaced
+        if (screen->utf8_length > 0 && (c & 0xC0) != 0x80) {
+            screen->utf8_length = 0;
+            cast_put_replacement(screen);
+        }
+
+        switch (screen->state) {
+        case CAST_GROUND:
+            if (c < 0x20) {
+                cast_control(screen, c);
+            } else if (c < 0x7F) {
+                cast_put(screen, (const char *)&c, 1, 1);
+            } else if (c >= 0xC2 && c <= 0xF4) {
+                screen->utf8[0] = c;
+                screen->utf8_length = 1;
+                screen->utf8_needed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+            } else if ((c & 0xC0) == 0x80 && screen->utf8_length > 0) {
+                screen->utf8[screen->utf8_length++] = c;
+                if (screen->utf8_length == screen->utf8_needed) cast_put_utf8(screen);
+            } else if (c != 0x7F) {
+                cast_put_replacement(screen);
+            }
+            break;
+        case CAST_ESCAPE:
+            if (c == 0x1B) break;
+            if (c < 0x20) cast_control(screen, c); else cast_escape_dispatch(screen, c);
+            break;
+        case CAST_ESCAPE_SKIP:
+            screen->state = CAST_GROUND;
+            break;
+        case CAST_CSI:
+            if (c >= '0' && c <= '9') {
+                if (screen->value < 65536) screen->value = screen->value * 10 + (c - '0');
+            } else if (c == ';' || c == ':') {
+                if (screen->param_count < SGR_MAX_PARAMS) {
+                    screen->params[screen->param_count] = screen->value;
+                    screen->colon[screen->param_count++] = screen->value_colon;
+                }
+                screen->value = 0;
+                screen->value_colon = c == ':';
+            } else if (c >= 0x3C && c <= 0x3F) {
+                screen->marker = (char)c;
+            } else if (c >= 0x20 && c <= 0x2F) {
+                screen->intermediate = 1;
+            } else if (c >= 0x40 && c <= 0x7E) {
+                if (screen->param_count < SGR_MAX_PARAMS) {
+                    screen->params[screen->param_count] = screen->value;
+                    screen->colon[screen->param_count++] = screen->value_colon;
+                }
+                screen->state = CAST_GROUND;
+                cast_csi_dispatch(screen, c);
+            } else if (c == 0x1B) {
+                screen->state = CAST_ESCAPE;
+            } else if (c < 0x20) {
+                cast_control(screen, c);
+            } else {
+                screen->state = CAST_GROUND;
+            }
+            break;
+        case CAST_STRING:
+            if (c == 0x07) screen->state = CAST_GROUND;
+            else if (c == 0x1B) screen->state = CAST_STRING_ESC;
+            break;
+        case CAST_STRING_ESC:
+            screen->state = c == '\\' ? CAST_GROUND : CAST_STRING;
+            break;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Keyframes
+// ---------------------------------------------------------------------------
+
+static uint64_t cast_hash(const char *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static int cast_cell_blank(const CastCell *cell) {
+    return cell->length == 1 && cell->text[0] == ' ' && cell->bg == COLOR_NONE;
+}
+
+// Build a screen row as a line of style runs. Blank cells after a run
+// without a background join it whatever their colors, as spaces look the
+// same in any; other blank cells form runs of their own that, outside
+// --compact, carry no text at all. Trailing blanks are dropped.
+static int cast_row_line(const CastFrames *frames, const CastScreen *screen, int y, LineData *line) {
+    char *text = frames->row_text;
+
+    line_begin(line, line->arena);
+    line->visible_length = screen->columns;
+    for (int x = 0; x < screen->columns;) {
+        const CastCell *first = CAST_CELL(screen, y, x);
+        int blank = cast_cell_blank(first);
+        size_t length = 0;
+        int trailing = 0;
+        int end = x;
+        for (; end < screen->columns; end++) {
+            const CastCell *cell = CAST_CELL(screen, y, end);
+            int cell_blank = cast_cell_blank(cell);
+            int same = cell->fg == first->fg && cell->bg == first->bg && cell->bold == first->bold;
+            if (blank ? !cell_blank : !same && !(cell_blank && first->bg == COLOR_NONE)) break;
+            memcpy(text + length, cell->text, cell->length);
+            length += cell->length;
+            trailing = cell_blank ? trailing + 1 : 0;
+        }
+
+        if (end == screen->columns) {
+            if (blank) {
+                line->visible_length = x;
+                break;
+            }
+            length -= trailing;
+            line->visible_length = end - trailing;
+        }
+        if (blank && !frames->config->compact) length = 0;
+        if (line_add_segment(line, text, length, blank ? screen->default_fg : first->fg, first->bg,
+                             blank ? 0 : first->bold, x) != 0) {
+            return -1;
+        }
+        x = end;
+    }
+    return 0;
+}
+
+static int cast_frames_init(CastFrames *frames, const Config *config, const CastScreen *screen) {
+    memset(frames, 0, sizeof(*frames));
+    frames->config = config;
+    frames->cell_width = config->font_width;
+    line_arena_init(&frames->arena);
+    frames->slot_count = 1024;
+    frames->row_slots = malloc(frames->slot_count * sizeof(int));
+    frames->shown = malloc(screen->rows * sizeof(int));
+    frames->row_text = malloc((size_t)screen->columns * sizeof(((CastCell *)0)->text));
+    if (writer_open_memory(&frames->markup) != 0 || writer_open_memory(&frames->symbols) != 0 ||
+        writer_open_memory(&frames->frames) != 0 || !frames->row_slots || !frames->shown || !frames->row_text) {
+        return -1;
+    }
+    memset(frames->row_slots, -1, frames->slot_count * sizeof(int));
+    return 0;
+}
+
+static void cast_frames_free(CastFrames *frames) {
+    line_arena_free(&frames->arena);
+    writer_close(&frames->markup);
+    writer_close(&frames->symbols);
+    writer_close(&frames->frames);
+    free(frames->row_table);
+    free(frames->row_slots);
+    free(frames->shown);
+    free(frames->row_text);
+    free(frames->frame_times);
+    palette_free(&frames->palette);
+}
+
+static int cast_slot(const CastFrames *frames, uint64_t hash, const char *body, size_t length) {
+    size_t mask = (size_t)frames->slot_count - 1;
+    size_t slot = (size_t)hash & mask;
+    while (frames->row_slots[slot] >= 0) {
+        const CastRow *row = &frames->row_table[frames->row_slots[slot]];
+        if (row->hash == hash && row->length == length &&
+            memcmp(frames->symbols.buffer + row->offset, body, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return (int)slot;
+}
+
+// Id of the row whose markup is in frames->markup, adding a <symbol> for it
+// if no earlier row looked the same; returns -1 when out of memory
+static int cast_intern_row(CastFrames *frames) {
+    const char *body = frames->markup.buffer;
+    size_t length = frames->markup.length;
+    uint64_t hash = cast_hash(body, length);
+    int slot = cast_slot(frames, hash, body, length);
+    if (frames->row_slots[slot] >= 0) return frames->row_slots[slot];
+
+    if (frames->row_count == frames->row_capacity) {
+        int capacity = frames->row_capacity ? frames->row_capacity * 2 : 256;
+        CastRow *grown = realloc(frames->row_table, capacity * sizeof(CastRow));
+        if (!grown) return -1;
+        frames->row_table = grown;
+        frames->row_capacity = capacity;
+    }
+    int id = frames->row_count++;
+    CastRow *row = &frames->row_table[id];
+    writer_printf(&frames->symbols, "  <symbol id=\"r%d\">\n", id);
+    row->offset = frames->symbols.length;
+    row->length = length;
+    row->hash = hash;
+    writer_write(&frames->symbols, body, length);
+    writer_puts(&frames->symbols, "  </symbol>\n");
+    if (frames->symbols.error) return -1;
+    frames->row_slots[slot] = id;
+
+    // Keep the table at most half full
+    if (frames->row_count * 2 > frames->slot_count) {
+        int *slots = malloc(frames->slot_count * 2 * sizeof(int));
+        if (!slots) return -1;
+        free(frames->row_slots);
+        frames->row_slots = slots;
+        frames->slot_count *= 2;
+        memset(slots, -1, frames->slot_count * sizeof(int));
+        for (int i = 0; i < frames->row_count; i++) {
+            const CastRow *known = &frames->row_table[i];
+            slots[cast_slot(frames, known->hash, frames->symbols.buffer + known->offset, known->length)] = i;
+        }
+    }
+    return id;
+}
+
+// Render screen row y at the top of the screen, with an opaque background
+// so it hides whatever an earlier keyframe drew there; returns its row id
+static int cast_render_row(CastFrames *frames, const CastScreen *screen, int y) {
+    const Config *config = frames->config;
+    OutputWriter *markup = &frames->markup;
+    LineData line;
+
+    line_arena_reset(&frames->arena);
+    line.arena = &frames->arena;
+    if (cast_row_line(frames, screen, y, &line) != 0) return -1;
+
+    writer_reset(markup);
+    writer_printf(markup, "  <rect x=\"%d\" y=\"%d\" width=\"%.2f\" height=\"%.2f\" fill=\"%s\"/>\n",
+                  DEFAULT_PADDING, DEFAULT_PADDING, screen->columns * frames->cell_width, config->font_height, BG_COLOR);
+    BackgroundLayer layer;
+    background_begin(&layer, config, frames->cell_width, 0, markup);
+    background_add_row(&layer, &line, 0);
+    background_end(&layer);
+    render_line_svg(markup, config, &line, 0, frames->cell_width);
+    if (markup->error) return -1;
+
+    int known = frames->row_count;
+    int id = cast_intern_row(frames);
+    if (id >= known) {
+        palette_mark_line(&frames->palette, &line);
+        frames->segments += line.segment_count;
+    }
+    return id;
+}
+
+// Sample the screen as a keyframe at the given second: a group with the rows
+// that show something else than in the previous keyframe, if any do
+static int cast_keyframe(CastFrames *frames, CastScreen *screen, double seconds) {
+    OutputWriter *out = &frames->frames;
+    int started = 0;
+
+    for (int y = 0; y < screen->rows; y++) {
+        if (!screen->dirty[y]) continue;
+        screen->dirty[y] = 0;
+        int id = cast_render_row(frames, screen, y);
+        if (id < 0) return -1;
+        if (id == frames->shown[y]) continue;
+
+        if (!started) {
+            if (frames->frame_count == frames->frame_capacity) {
+                int capacity = frames->frame_capacity ? frames->frame_capacity * 2 : 256;
+                double *grown = realloc(frames->frame_times, capacity * sizeof(double));
+                if (!grown) return -1;
+                frames->frame_times = grown;
+                frames->frame_capacity = capacity;
+            }
+            frames->frame_times[frames->frame_count] = seconds;
+            // A keyframe at the start needs no animation
+            if (seconds > 0) {
+                writer_printf(out, "  <g class=\"f%d\">", frames->frame_count);
+            } else {
+                writer_puts(out, "  <g>");
+            }
+            started = 1;
+        }
+        writer_printf(out, "<use xlink:href=\"#r%d\" y=\"%.2f\"/>", id, y * frames->config->font_height);
+        frames->shown[y] = id;
+        frames->row_updates++;
+    }
+    if (started) {
+        writer_puts(out, "</g>\n");
+        frames->frame_count++;
+    }
+    return out->error ? -1 : 0;
+}
+
+// One animation per keyframe, hiding its group until the keyframe's time in
+// every loop; steps(1, end) keeps visibility from blending between keyframes
+static void cast_write_animations(OutputWriter *writer, const CastFrames *frames, double duration) {
+    for (int i = 0; i < frames->frame_count; i++) {
+        double seconds = frames->frame_times[i];
+        if (seconds <= 0) continue;
+        writer_printf(writer,
+            " .f%d { animation: k%d %.3fs steps(1, end) infinite; }"
+            " @keyframes k%d { 0%% { visibility: hidden; } %.3f%% { visibility: visible; } }",
+            i, i, duration, i, seconds * 100.0 / duration);
+    }
+}
+
+// Write the document: the usual header and styles, the animations and row
+// symbols, then the keyframe groups in time order
+static int cast_write_svg(const Config *config, const CastScreen *screen, const CastFrames *frames, double duration) {
+    OutputWriter writer;
+    FILE *output_file = stdout;
+
+    if (strlen(config->output_file) > 0) {
+        output_file = fopen(config->output_file, "w");
+        if (!output_file) {
+            fprintf(stderr, "Error: Cannot create output file '%s'\n", config->output_file);
+            return -1;
+        }
+    }
+    if (writer_open_file(&writer, output_file) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        if (output_file != stdout) fclose(output_file);
+        return -1;
+    }
+
+    XmlChecker checker;
+    FILE *dtd_pipe = NULL;
+    if (config->validate != VALIDATE_NONE) {
+        progress_output("SVG validation started");
+        xml_check_init(&checker);
+        writer.checker = &checker;
+        if (config->validate == VALIDATE_DTD) {
+            dtd_pipe = start_dtd_validation();
+            writer.tee = dtd_pipe;
+        }
+    }
+
+    long long render_start = STATS_START();
+    long long output_before = stats_output_ns();
+    double svg_width = (2 * DEFAULT_PADDING) + (screen->columns * config->font_width);
+    double svg_height = (2 * DEFAULT_PADDING) + (screen->rows * config->font_height);
+    write_svg_header(&writer, config, svg_width, svg_height, 0, NULL, &frames->palette);
+    writer_puts(&writer, "  <defs><style type=\"text/css\">");
+    cast_write_animations(&writer, frames, duration);
+    writer_puts(&writer, "</style>\n");
+    writer_write(&writer, frames->symbols.buffer, frames->symbols.length);
+    writer_puts(&writer, "  </defs>\n  <g xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
+    writer_write(&writer, frames->frames.buffer, frames->frames.length);
+    writer_puts(&writer, "  </g>\n</svg>\n");
+    if (stats_enabled) {
+        stats_add_time(STATS_RENDER, render_start + (stats_output_ns() - output_before));
+    }
+
+    int result = writer_close(&writer);
+    long long validate_start = STATS_START();
+    if (config->validate != VALIDATE_NONE) {
+        if (result == 0) {
+            finish_svg_validation(config, &checker, dtd_pipe, writer.tee_error);
+        } else if (dtd_pipe) {
+            pclose(dtd_pipe);
+            signal(SIGPIPE, SIG_DFL);
+        }
+        STATS_STOP(STATS_VALIDATE, validate_start);
+    }
+    long long write_start = STATS_START();
+    if (output_file != stdout) {
+        if (fclose(output_file) != 0) result = -1;
+    } else if (fflush(stdout) != 0) {
+        result = -1;
+    }
+    STATS_STOP(STATS_WRITE, write_start);
+    if (result != 0) {
+        fprintf(stderr, "Error: Failed to write SVG output\n");
+        return -1;
+    }
+    if (strlen(config->output_file) > 0) {
+        char msg[768];
+        snprintf(msg, sizeof(msg), "SVG written to: %.500s", config->output_file);
+        progress_output(msg);
+    }
+    return 0;
+}
+
+// Read the header line: terminal size (falling back to --width/--height)
+// and the idle time limit; returns -1 if this is not an asciicast v2 file
+static int cast_read_header(const Config *config, const char *line, int *columns, int *rows, double *idle_limit) {
+    json_error_t error;
+    json_t *header = json_loads(line, 0, &error);
+    if (!json_is_object(header)) {
+        if (header) json_decref(header);
+        return -1;
+    }
+    json_t *version = json_object_get(header, "version");
+    if (!json_is_integer(version) || json_integer_value(version) != 2) {
+        json_decref(header);
+        return -1;
+    }
+
+    json_t *width = json_object_get(header, "width");
+    json_t *height = json_object_get(header, "height");
+    json_t *idle = json_object_get(header, "idle_time_limit");
+    *columns = json_is_integer(width) ? (int)json_integer_value(width) : config->width;
+    *rows = json_is_integer(height) ? (int)json_integer_value(height) :
+            config->height > 0 ? config->height : CAST_DEFAULT_HEIGHT;
+    *idle_limit = json_is_number(idle) ? json_number_value(idle) : 0;
+    json_decref(header);
+    return 0;
+}
+
+// Convert an asciicast recording to an animated SVG
+int cast_svg(Config *config) {
+    char msg[768];
+    const char *name = strlen(config->input_file) > 0 ? config->input_file : "stdin";
+    if (output_backend(config)->render) {
+        fprintf(stderr, "Error: Recordings are written as animated SVG only, not %s\n", output_backend(config)->label);
+        return -1;
+    }
+    FILE *input = strlen(config->input_file) > 0 ? fopen(config->input_file, "r") : stdin;
+    if (!input) {
+        fprintf(stderr, "Error: Input file '%s' not found\n", config->input_file);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, input);
+    int columns = 0;
+    int rows = 0;
+    double idle_limit = 0;
+    if (length <= 0 || cast_read_header(config, line, &columns, &rows, &idle_limit) != 0) {
+        fprintf(stderr, "Error: '%s' is not an asciicast v2 recording\n", name);
+        free(line);
+        if (input != stdin) fclose(input);
+        return -1;
+    }
+    if (columns < 1 || columns > CAST_MAX_SIZE || rows < 1 || rows > CAST_MAX_SIZE) {
+        fprintf(stderr, "Error: Recording size %dx%d is outside 1x1 to %dx%d\n", columns, rows, CAST_MAX_SIZE, CAST_MAX_SIZE);
+        free(line);
+        if (input != stdin) fclose(input);
+        return -1;
+    }
+    STATS_ADD_BYTES(stats_bytes_in, length);
+
+    CastScreen screen;
+    CastFrames frames;
+    memset(&screen, 0, sizeof(screen));
+    memset(&frames, 0, sizeof(frames));
+    int status = 0;
+    int bad_event = 0;
+    if (cast_screen_init(&screen, columns, rows, config->tab_size) != 0 ||
+        cast_frames_init(&frames, config, &screen) != 0) {
+        status = -1;
+    }
+
+    // Every row starts out showing the blank row
+    int blank_id = status == 0 ? cast_render_row(&frames, &screen, 0) : -1;
+    if (blank_id < 0) status = -1;
+    for (int y = 0; y < rows && status == 0; y++) frames.shown[y] = blank_id;
+    if (status == 0) memset(screen.dirty, 0, rows);
+
+    // Events closer together than the frame interval are sampled once, at
+    // the last of them; gaps beyond the idle time limit are shortened to it
+    long events = 0;
+    long event_line = 1;
+    double last_time = 0;
+    double clock = 0;
+    double pending_start = 0;
+    int pending = 0;
+    long long parse_ns = 0;
+    long long render_ns = 0;
+    while (status == 0 && (length = getline(&line, &capacity, input)) > 0) {
+        event_line++;
+        STATS_ADD_BYTES(stats_bytes_in, length);
+        if (strspn(line, " \t\r\n") == (size_t)length) continue;
+
+        long long parse_start = STATS_START();
+        json_error_t error;
+        json_t *event = json_loads(line, 0, &error);
+        int valid = json_is_array(event) && json_array_size(event) >= 3;
+        json_t *stamp = valid ? json_array_get(event, 0) : NULL;
+        json_t *type = valid ? json_array_get(event, 1) : NULL;
+        json_t *data = valid ? json_array_get(event, 2) : NULL;
+        if (!json_is_number(stamp) || !json_is_string(type) || !json_is_string(data)) {
+            fprintf(stderr, "Error: %s:%ld: Not an asciicast event\n", name, event_line);
+            if (event) json_decref(event);
+            status = -1;
+            bad_event = 1;
+            break;
+        }
+        if (strcmp(json_string_value(type), "o") != 0) {
+            json_decref(event);
+            continue;
+        }
+
+        double gap = json_number_value(stamp) - last_time;
+        last_time = json_number_value(stamp);
+        if (gap < 0) gap = 0;
+        if (idle_limit > 0 && gap > idle_limit) gap = idle_limit;
+        long long keyframe_ns = 0;
+        if (pending && clock + gap - pending_start >= CAST_FRAME_INTERVAL) {
+            long long render_start = STATS_START();
+            status = cast_keyframe(&frames, &screen, clock);
+            if (stats_enabled) keyframe_ns = stats_clock_ns() - render_start;
+            render_ns += keyframe_ns;
+            pending = 0;
+        }
+        clock += gap;
+        if (!pending) {
+            pending = 1;
+            pending_start = clock;
+        }
+        cast_feed(&screen, json_string_value(data), json_string_length(data));
+        events++;
+        json_decref(event);
+        if (stats_enabled) parse_ns += stats_clock_ns() - parse_start - keyframe_ns;
+    }
+    if (status == 0 && pending) {
+        long long render_start = STATS_START();
+        status = cast_keyframe(&frames, &screen, clock);
+        if (stats_enabled) render_ns += stats_clock_ns() - render_start;
+    }
+    if (status != 0 && !bad_event) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+    free(line);
+    if (input != stdin) fclose(input);
+    if (stats_enabled) {
+        stats_add_time(STATS_PARSE, stats_clock_ns() - parse_ns);
+        stats_add_time(STATS_RENDER, stats_clock_ns() - render_ns);
+    }
+
+    if (status == 0) {
+        double duration = clock + CAST_END_HOLD;
+        snprintf(msg, sizeof(msg), "Cast: %dx%d terminal, %ld events into %d keyframes over %.2fs (%d distinct rows, %ld row updates)",
+                 columns, rows, events, frames.frame_count, clock, frames.row_count, frames.row_updates);
+        progress_output(msg);
+        status = cast_write_svg(config, &screen, &frames, duration);
+        stats_add_document(NULL, (int)events, (int)frames.row_updates, frames.segments);
+    }
+    cast_frames_free(&frames);
+    cast_screen_free(&screen);
+    return status;
+}
@@ -0,0 +1,206 @@
+/*
+ * Oh-diff.c - Line hash alignment for incremental re-rendering
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * Aligns the previous run's line hashes with the current ones the way
+ * patience diff does: trim the common prefix and suffix, anchor on lines
+ * that occur exactly once on both sides, keep the longest run of anchors
+ * that appears in the same order (LIS), and recurse between anchors. An
+ * inserted or deleted line therefore only invalidates itself, and the cost
+ * is O(n log n) in the size of the changed region. The same sorted hash
+ * positions find repeated lines and rows within one document (--dedup).
+ */
+
+#include "Oh.h"
+
+#define ALIGN_MAX_DEPTH 64
+
+typedef struct {
+    uint32_t hash;
+    int index;
+} HashPosition;
+
+static int compare_hash_position(const void *a, const void *b) {
+    const HashPosition *left = (const HashPosition *)a;
+    const HashPosition *right = (const HashPosition *)b;
+    if (left->hash != right->hash) return left->hash < right->hash ? -1 : 1;
+    return left->index - right->index;
+}
+
+// Sort hashes[lo..hi) by value, keeping positions
+static HashPosition* sorted_positions(const uint32_t *hashes, int lo, int hi) {
+    HashPosition *positions = malloc((size_t)(hi - lo) * sizeof(HashPosition));
+    if (!positions) return NULL;
+    for (int i = lo; i < hi; i++) {
+        positions[i - lo].hash = hashes[i];
+        positions[i - lo].index = i;
+    }
+    qsort(positions, (size_t)(hi - lo), sizeof(HashPosition), compare_hash_position);
+    return positions;
+}
+
+// Collect (old, new) pairs for hashes occurring exactly once in both ranges, ordered by new index
+static int unique_anchors(const uint32_t *old_hashes, int old_lo, int old_hi,
+                          const uint32_t *new_hashes, int new_lo, int new_hi,
+                          int *anchor_old, int *anchor_new) {
+    HashPosition *old_sorted = sorted_positions(old_hashes, old_lo, old_hi);
+    HashPosition *new_sorted = sorted_positions(new_hashes, new_lo, new_hi);
+    int old_count = old_hi - old_lo;
+    int new_count = new_hi - new_lo;
+    int anchors = 0;
+
+    if (old_sorted && new_sorted) {
+        int i = 0;
+        int j = 0;
+        while (i < old_count && j < new_count) {
+            uint32_t hash = old_sorted[i].hash;
+            if (hash < new_sorted[j].hash) { i++; continue; }
+            if (hash > new_sorted[j].hash) { j++; continue; }
+            int old_run = 1;
+            int new_run = 1;
+            while (i + old_run < old_count && old_sorted[i + old_run].hash == hash) old_run++;
+            while (j + new_run < new_count && new_sorted[j + new_run].hash == hash) new_run++;
+            if (old_run == 1 && new_run == 1) {
+                anchor_old[new_sorted[j].index - new_lo] = old_sorted[i].index;
+            }
+            i += old_run;
+            j += new_run;
+        }
+    }
+    free(old_sorted);
+    free(new_sorted);
+
+    // Compact in new-index order (anchor_old was indexed by new offset, -1 when unused)
+    for (int k = 0; k < new_count; k++) {
+        if (anchor_old[k] >= 0) {
+            anchor_new[anchors] = new_lo + k;
+            anchor_old[anchors] = anchor_old[k];
+            if (anchors != k) anchor_old[k] = -1;
+            anchors++;
+        }
+    }
+    return anchors;
+}
+
+// Longest increasing subsequence of values[0..count); returns its length and
+// writes the chosen positions (ascending) to chain
+static int longest_increasing(const int *values, int count, int *chain) {
+    int *tails = malloc((size_t)count * sizeof(int));
+    int *previous = malloc((size_t)count * sizeof(int));
+    int length = 0;
+
+    if (tails && previous) {
+        for (int i = 0; i < count; i++) {
+            int lo = 0;
+            int hi = length;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (values[tails[mid]] < values[i]) lo = mid + 1; else hi = mid;
+            }
+            previous[i] = lo > 0 ? tails[lo - 1] : -1;
+            tails[lo] = i;
+            if (lo == length) length++;
+        }
+        for (int k = length - 1, i = length > 0 ? tails[length - 1] : -1; k >= 0; k--, i = previous[i]) {
+            chain[k] = i;
+        }
+    } else {
+        length = 0;
+    }
+    free(tails);
+    free(previous);
+    return length;
+}
+
+static void align_range(const uint32_t *old_hashes, int old_lo, int old_hi,
+                        const uint32_t *new_hashes, int new_lo, int new_hi,
+                        int *match, int depth) {
+    while (old_lo < old_hi && new_lo < new_hi && old_hashes[old_lo] == new_hashes[new_lo]) {
+        match[new_lo++] = old_lo++;
+    }
+    while (old_lo < old_hi && new_lo < new_hi && old_hashes[old_hi - 1] == new_hashes[new_hi - 1]) {
+        match[--new_hi] = --old_hi;
+    }
+    if (old_lo == old_hi || new_lo == new_hi || depth >= ALIGN_MAX_DEPTH) return;
+
+    int new_count = new_hi - new_lo;
+    int *anchor_old = malloc((size_t)new_count * sizeof(int));
+    int *anchor_new = malloc((size_t)new_count * sizeof(int));
+    int *chain = malloc((size_t)new_count * sizeof(int));
+    if (!anchor_old || !anchor_new || !chain) {
+        free(anchor_old);
+        free(anchor_new);
+        free(chain);
+        return;
+    }
+    for (int k = 0; k < new_count; k++) anchor_old[k] = -1;
+
+    int anchors = unique_anchors(old_hashes, old_lo, old_hi, new_hashes, new_lo, new_hi, anchor_old, anchor_new);
+    int kept = anchors > 0 ? longest_increasing(anchor_old, anchors, chain) : 0;
+
+    int old_start = old_lo;
+    int new_start = new_lo;
+    for (int k = 0; k < kept; k++) {
+        int old_anchor = anchor_old[chain[k]];
+        int new_anchor = anchor_new[chain[k]];
+        align_range(old_hashes, old_start, old_anchor, new_hashes, new_start, new_anchor, match, depth + 1);
+        match[new_anchor] = old_anchor;
+        old_start = old_anchor + 1;
+        new_start = new_anchor + 1;
+    }
+    if (kept > 0) {
+        align_range(old_hashes, old_start, old_hi, new_hashes, new_start, new_hi, match, depth + 1);
+    }
+
+    free(anchor_old);
+    free(anchor_new);
+    free(chain);
+}
+
+// For each current line, set match[i] to the previous line it is unchanged
+// from, or -1; returns the number of matched lines
+int align_line_hashes(const uint32_t *old_hashes, int old_count,
+                      const uint32_t *new_hashes, int new_count, int *match) {
+    for (int i = 0; i < new_count; i++) match[i] = -1;
+    align_range(old_hashes, 0, old_count, new_hashes, 0, new_count, match, 0);
+
+    int matched = 0;
+    for (int i = 0; i < new_count; i++) {
+        if (match[i] >= 0) matched++;
+    }
+    return matched;
+}
+
+// For each of count items set first[i] to the earliest item that is the same
+// as item i, or to i itself. Items sharing a hash are told apart by same();
+// items whose first[] is -1 on entry take no part and stay -1. Returns the
+// number of duplicates found, or -1 when out of memory.
+int find_duplicates(const uint32_t *hashes, int count, DuplicateTest same, const void *context, int *first) {
+    HashPosition *sorted = sorted_positions(hashes, 0, count);
+    if (!sorted && count > 0) return -1;
+
+    int duplicates = 0;
+    for (int i = 0; i < count; i++) {
+        if (first[i] != -1) first[i] = i;
+    }
+    for (int start = 0; start < count;) {
+        int end = start + 1;
+        while (end < count && sorted[end].hash == sorted[start].hash) end++;
+        // Positions ascend within a run, so each item only meets earlier ones
+        for (int k = start + 1; k < end; k++) {
+            int index = sorted[k].index;
+            if (first[index] < 0) continue;
+            for (int p = start; p < k; p++) {
+                int earlier = sorted[p].index;
+                if (first[earlier] == earlier && same(earlier, index, context)) {
+                    first[index] = earlier;
+                    duplicates++;
+                    break;
+                }
+            }
+        }
+        start = end;
+    }
+    free(sorted);
+    return duplicates;
+}
@@ -0,0 +1,321 @@
+/*
+ * Oh-font.c - Inline Google fonts as subset @font-face rules (--embed-font)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * An @import of Google Fonts costs every viewer extra round-trips, and
+ * GitHub's image proxy blocks it, so the font never loads there. With
+ * --embed-font the characters the rows draw are sent as the css2 API's
+ * text= parameter, which makes Google serve a font holding only those
+ * glyphs; the font files are fetched with curl and inlined as base64 data
+ * URIs in the @font-face rules that replace the @import. The result is
+ * cached in ~/.cache/Oh/fonts keyed by font and glyph set, so a repeat
+ * render of the same characters fetches nothing. OH_FONTS_URL replaces
+ * the API base (a mirror, which may be a file:// directory) and is part of
+ * the cache key. Any failure links the font as before.
+ */
+
+#include "Oh.h"
+
+#define GOOGLE_FONTS_API "https://fonts.googleapis.com"
+#define FONT_USER_AGENT "Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0"
+#define FONT_FETCH_MAX (16 * 1024 * 1024)
+#define FONT_TEXT_MAX 6000              // longest text= parameter sent to the API
+#define FONT_CODEPOINTS 0x110000
+
+// Tell whether url names a file under OH_FONTS_URL when that mirror is
+// itself a file:// URL; the path may not step out of it with ".."
+static int font_local_url(const char *url) {
+    const char *mirror = getenv("OH_FONTS_URL");
+    if (!mirror || strncmp(mirror, "file://", 7) != 0) return 0;
+    size_t length = strlen(mirror);
+    while (length > 7 && mirror[length - 1] == '/') length--;
+    if (strncmp(url, mirror, length) != 0 || (url[length] != '/' && url[length] != '?')) return 0;
+    for (const char *c = url + length; *c && *c != '?'; c++) {
+        if ((c[0] == '/' && c[1] == '.' && c[2] == '.') || (c[0] == '%' && c[1] == '2' && (c[2] == 'e' || c[2] == 'E'))) return 0;
+    }
+    return 1;
+}
+
+// Fetch a URL with curl; returns a malloc'd buffer or NULL. URLs are single
+// quoted for the shell, so one holding a quote is refused. Font URLs come
+// from the fetched CSS, so curl fetches and follows https only, and file://
+// only for files under a file:// mirror set with OH_FONTS_URL.
+static char* font_fetch(const char *url, size_t *length) {
+    if (strchr(url, '\'') || url[0] == '-') return NULL;
+    for (const char *c = url; *c; c++) {
+        if ((unsigned char)*c < 0x20) return NULL;
+    }
+    int local = font_local_url(url);
+    if (strncmp(url, "https://", 8) != 0 && !local) return NULL;
+
+    size_t command_size = strlen(url) + 256;
+    char *command = malloc(command_size);
+    if (!command) return NULL;
+    snprintf(command, command_size, "curl -fsSL --proto '%s' --proto-redir '=https' --max-time 30 -A '%s' '%s' 2>/dev/null",
+             local ? "=https,file" : "=https", FONT_USER_AGENT, url);
+    FILE *pipe = popen(command, "r");
+    free(command);
+    if (!pipe) return NULL;
+
+    size_t capacity = 64 * 1024;
+    size_t used = 0;
+    char *data = malloc(capacity + 1);
+    while (data) {
+        if (used == capacity) {
+            char *grown = capacity < FONT_FETCH_MAX ? realloc(data, capacity * 2 + 1) : NULL;
+            if (!grown) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        size_t n = fread(data + used, 1, capacity - used, pipe);
+        if (n == 0) break;
+        used += n;
+    }
+    if (pclose(pipe) != 0 || used == 0) {
+        free(data);
+        return NULL;
+    }
+    data[used] = '\0';
+    *length = used;
+    return data;
+}
+
+// Percent-encode every distinct character the rows draw, in codepoint
+// order; returns NULL when out of memory
+static char* font_glyph_text(const LineData *rows, int row_count, int *glyphs) {
+    uint8_t *seen = calloc(FONT_CODEPOINTS / 8, 1);
+    if (!seen) return NULL;
+    *glyphs = 0;
+    for (int r = 0; r < row_count; r++) {
+        for (int j = 0; j < rows[r].segment_count; j++) {
+            const TextSegment *segment = LINE_SEGMENT(&rows[r], j);
+            const char *text = SEGMENT_TEXT(&rows[r], segment);
+            size_t i = 0;
+            while (i < segment->text_length) {
+                uint32_t codepoint = utf8_next_codepoint(text, segment->text_length, &i);
+                if (codepoint > ' ' && !(seen[codepoint / 8] & (1 << (codepoint % 8)))) {
+                    seen[codepoint / 8] |= 1 << (codepoint % 8);
+                    (*glyphs)++;
+                }
+            }
+        }
+    }
+
+    // At most four UTF-8 bytes of three characters each per glyph
+    char *encoded = malloc((size_t)*glyphs * 12 + 1);
+    size_t used = 0;
+    for (uint32_t codepoint = 0; encoded && codepoint < FONT_CODEPOINTS; codepoint++) {
+        if (!(seen[codepoint / 8] & (1 << (codepoint % 8)))) continue;
+        unsigned char bytes[4];
+        int count = 1;
+        if (codepoint < 0x80) {
+            bytes[0] = (unsigned char)codepoint;
+        } else if (codepoint < 0x800) {
+            bytes[0] = 0xC0 | (codepoint >> 6);
+            bytes[1] = 0x80 | (codepoint & 0x3F);
+            count = 2;
+        } else if (codepoint < 0x10000) {
+            bytes[0] = 0xE0 | (codepoint >> 12);
+            bytes[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+            bytes[2] = 0x80 | (codepoint & 0x3F);
+            count = 3;
+        } else {
+            bytes[0] = 0xF0 | (codepoint >> 18);
+            bytes[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+            bytes[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+            bytes[3] = 0x80 | (codepoint & 0x3F);
+            count = 4;
+        }
+        for (int k = 0; k < count; k++) {
+            if (isalnum(bytes[k])) {
+                encoded[used++] = (char)bytes[k];
+            } else {
+                used += sprintf(encoded + used, "%%%02X", bytes[k]);
+            }
+        }
+    }
+    if (encoded) encoded[used] = '\0';
+    free(seen);
+    return encoded;
+}
+
+static void font_write_base64(OutputWriter *writer, const unsigned char *data, size_t length) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char chunk[4096];
+    size_t used = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)data[i] << 16;
+        if (i + 1 < length) group |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < length) group |= data[i + 2];
+        chunk[used++] = alphabet[(group >> 18) & 0x3F];
+        chunk[used++] = alphabet[(group >> 12) & 0x3F];
+        chunk[used++] = i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+        chunk[used++] = i + 2 < length ? alphabet[group & 0x3F] : '=';
+        if (used == sizeof(chunk)) {
+            writer_write(writer, chunk, used);
+            used = 0;
+        }
+    }
+    writer_write(writer, chunk, used);
+}
+
+static const char* font_mime_type(const char *format) {
+    if (strncmp(format, "woff2'", 6) == 0) return "font/woff2";
+    if (strncmp(format, "woff'", 5) == 0) return "font/woff";
+    if (strncmp(format, "opentype'", 9) == 0) return "font/otf";
+    return "font/ttf";
+}
+
+// Replace every url(...) of the API's CSS with the fetched font as a data
+// URI; returns NULL if a font cannot be fetched. The rules end up inside
+// <style>, so markup characters left in them are refused as well.
+static char* font_inline_css(const char *css, size_t *fetched) {
+    OutputWriter out;
+    if (writer_open_memory(&out) != 0) return NULL;
+
+    const char *at = css;
+    const char *url;
+    while (!out.error && (url = strstr(at, "url(")) != NULL) {
+        const char *end = strchr(url, ')');
+        if (!end) break;
+        writer_write(&out, at, url - at);
+        const char *start = url + 4;
+        size_t length = end - start;
+        if (length >= 2 && (*start == '\'' || *start == '"')) {
+            start++;
+            length -= 2;
+        }
+        char *source = strndup(start, length);
+        size_t size = 0;
+        char *font = source ? font_fetch(source, &size) : NULL;
+        free(source);
+        if (!font) {
+            out.error = 1;
+            break;
+        }
+        const char *format = strstr(end, "format('");
+        const char *next_url = strstr(end, "url(");
+        const char *mime = format && (!next_url || format < next_url) ? font_mime_type(format + 8) : "font/ttf";
+        writer_printf(&out, "url(data:%s;base64,", mime);
+        font_write_base64(&out, (const unsigned char *)font, size);
+        writer_puts(&out, ")");
+        *fetched += size;
+        free(font);
+        at = end + 1;
+    }
+    writer_puts(&out, at);
+
+    if (out.error || strpbrk(out.buffer, "<&") || !strstr(out.buffer, "@font-face")) {
+        writer_close(&out);
+        return NULL;
+    }
+    // The memory writer's buffer becomes the result
+    char *result = out.buffer;
+    out.buffer = NULL;
+    writer_close(&out);
+    return result;
+}
+
+static char* font_read_cache(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return NULL;
+    char *data = NULL;
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0 && st.st_size < FONT_FETCH_MAX * 2) {
+        data = malloc(st.st_size + 1);
+        if (data && fread(data, 1, st.st_size, file) == (size_t)st.st_size) {
+            data[st.st_size] = '\0';
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+// The temporary name is unique per write, as renders may run at once
+static void font_write_cache(const char *path, const char *css) {
+    static unsigned int save_counter = 0;
+    char temp_path[MAX_PATH_LENGTH + MAX_HASH_LENGTH + 40];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.%u.tmp", path, (long)getpid(),
+             __atomic_fetch_add(&save_counter, 1, __ATOMIC_RELAXED));
+    FILE *file = fopen(temp_path, "w");
+    if (!file) return;
+    size_t length = strlen(css);
+    int written = fwrite(css, 1, length, file) == length;
+    if (fclose(file) != 0) written = 0;
+    if (!written || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return;
+    }
+    cache_usage_add(length);
+}
+
+// @font-face rules for the characters the rows draw, malloc'd; returns NULL
+// (the font stays linked) when the font cannot be embedded
+char* font_embed_prepare(const Config *config, const LineData *rows, int row_count) {
+    char msg[512];
+    const char *google_url = get_google_font_url(config->font_family);
+    if (!google_url) {
+        snprintf(msg, sizeof(msg), "Warning: --embed-font: '%s' is not a Google font, nothing to embed", config->font_family);
+        progress_output(msg);
+        return NULL;
+    }
+
+    int glyphs = 0;
+    char *text = font_glyph_text(rows, row_count, &glyphs);
+    if (!text || strlen(text) > FONT_TEXT_MAX) {
+        snprintf(msg, sizeof(msg), "Warning: Too many distinct characters (%d) to embed %s, linking it instead",
+                 glyphs, config->font_family);
+        progress_output(msg);
+        free(text);
+        return NULL;
+    }
+
+    const char *api = getenv("OH_FONTS_URL");
+    size_t url_size = strlen(google_url) + strlen(text) + (api ? strlen(api) : 0) + 16;
+    char *url = malloc(url_size);
+    if (!url) {
+        free(text);
+        return NULL;
+    }
+    snprintf(url, url_size, "%s%s&text=%s", api ? api : GOOGLE_FONTS_API, google_url + strlen(GOOGLE_FONTS_API), text);
+    // The key covers the API base too, so a mirror's fonts stay apart from Google's
+    char key[MAX_HASH_LENGTH];
+    snprintf(key, sizeof(key), "%u", generate_hash(url));
+    free(text);
+
+    char path[MAX_PATH_LENGTH + MAX_HASH_LENGTH + 8];
+    snprintf(path, sizeof(path), "%s/%s.css", font_cache_dir, key);
+    char *font_faces = font_read_cache(path);
+    if (font_faces) {
+        cache_touch(path);
+        snprintf(msg, sizeof(msg), "Font: embedding %s subset of %d glyphs from the font cache", config->font_family, glyphs);
+        progress_output(msg);
+        free(url);
+        return font_faces;
+    }
+
+    size_t length = 0;
+    size_t fetched = 0;
+    char *css = font_fetch(url, &length);
+    free(url);
+    if (css) {
+        font_faces = font_inline_css(css, &fetched);
+        free(css);
+    }
+    if (!font_faces) {
+        snprintf(msg, sizeof(msg), "Warning: Cannot fetch %s for embedding, linking it instead", config->font_family);
+        progress_output(msg);
+        return NULL;
+    }
+    font_write_cache(path, font_faces);
+    snprintf(msg, sizeof(msg), "Font: embedding %s subset of %d glyphs (%zu bytes fetched)", config->font_family, glyphs, fetched);
+    progress_output(msg);
+    return font_faces;
+}
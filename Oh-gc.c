@@ -0,0 +1,217 @@
+/*
+ * Oh-gc.c - Disk cache size budget and eviction
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * The cache directory is bounded by --cache-max-size. Every file in it is
+ * an entry costing the blocks it occupies (so a budget also bounds the
+ * inode count of many small JSON files) and aged by its mtime: a line
+ * cache file's mtime is its "timestamp" until a hit refreshes it, and a
+ * pack's moves whenever it is opened under a budget, so age is time since
+ * last use. Collection sorts entries oldest first and unlinks until usage
+ * is under 90% of the budget. Runs do not scan the directory each time:
+ * they add what they wrote to an estimate kept in the "usage" file and
+ * only collect once the estimate passes the budget.
+ */
+
+#include "Oh.h"
+#include <dirent.h>
+#include <fcntl.h>
+
+#define CACHE_USAGE_FILE "usage"
+#define CACHE_GC_LOW_WATER(max) ((max) / 10 * 9)
+#define CACHE_TEMP_MAX_AGE 3600
+#define CACHE_BLOCK_SIZE 4096
+#define CACHE_DIRS 3                // the cache directory, svg/ and fonts/
+
+long long cache_max_size = 0;
+static long long cache_bytes_added = 0;
+
+typedef struct {
+    long long mtime;
+    long long bytes;
+    size_t name_offset;
+    int dir;
+} CacheEntry;
+
+typedef struct {
+    CacheEntry *entries;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_used;
+    size_t names_capacity;
+    long long total_bytes;
+} CacheListing;
+
+// Record bytes a run wrote to the cache (approximated to whole blocks)
+void cache_usage_add(size_t bytes) {
+    long long blocks = ((long long)bytes + CACHE_BLOCK_SIZE - 1) / CACHE_BLOCK_SIZE;
+    __atomic_fetch_add(&cache_bytes_added, blocks * CACHE_BLOCK_SIZE, __ATOMIC_RELAXED);
+}
+
+// Mark a cache file as just used so collection evicts it last
+void cache_touch(const char *path) {
+    if (cache_max_size > 0) {
+        utimensat(AT_FDCWD, path, NULL, 0);
+    }
+}
+
+static int is_protected_entry(int dir, const char *name) {
+    return dir == 0 && (strcmp(name, CACHE_USAGE_FILE) == 0 || strcmp(name, "incremental.json") == 0);
+}
+
+static int listing_add(CacheListing *listing, int dir, const char *name, const struct stat *st) {
+    size_t name_length = strlen(name) + 1;
+    if (listing->count == listing->capacity) {
+        size_t capacity = listing->capacity ? listing->capacity * 2 : 4096;
+        CacheEntry *entries = realloc(listing->entries, capacity * sizeof(CacheEntry));
+        if (!entries) return -1;
+        listing->entries = entries;
+        listing->capacity = capacity;
+    }
+    if (listing->names_used + name_length > listing->names_capacity) {
+        size_t capacity = listing->names_capacity ? listing->names_capacity * 2 : 256 * 1024;
+        while (capacity < listing->names_used + name_length) capacity *= 2;
+        char *names = realloc(listing->names, capacity);
+        if (!names) return -1;
+        listing->names = names;
+        listing->names_capacity = capacity;
+    }
+    CacheEntry *entry = &listing->entries[listing->count++];
+    entry->mtime = (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    entry->bytes = (long long)st->st_blocks * 512;
+    entry->name_offset = listing->names_used;
+    entry->dir = dir;
+    memcpy(listing->names + listing->names_used, name, name_length);
+    listing->names_used += name_length;
+    listing->total_bytes += entry->bytes;
+    return 0;
+}
+
+// List the regular files of a cache directory; temporary files left by
+// interrupted writers are removed once they are old enough to be abandoned
+static int list_cache_dir(CacheListing *listing, int dir, DIR *handle, long *temps_removed) {
+    int fd = dirfd(handle);
+    time_t now = time(NULL);
+    struct dirent *item;
+    while ((item = readdir(handle)) != NULL) {
+        struct stat st;
+        if (item->d_name[0] == '.' || is_protected_entry(dir, item->d_name) ||
+            fstatat(fd, item->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        size_t length = strlen(item->d_name);
+        if (length > 4 && strcmp(item->d_name + length - 4, ".tmp") == 0) {
+            if (now - st.st_mtime > CACHE_TEMP_MAX_AGE && unlinkat(fd, item->d_name, 0) == 0) {
+                (*temps_removed)++;
+            }
+            continue;
+        }
+        if (listing_add(listing, dir, item->d_name, &st) != 0) return -1;
+    }
+    return 0;
+}
+
+static int compare_entry_age(const void *a, const void *b) {
+    const CacheEntry *left = (const CacheEntry *)a;
+    const CacheEntry *right = (const CacheEntry *)b;
+    if (left->mtime != right->mtime) return left->mtime < right->mtime ? -1 : 1;
+    return 0;
+}
+
+static void write_usage_estimate(long long bytes) {
+    char path[MAX_PATH_LENGTH];
+    if (snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_USAGE_FILE) >= (int)sizeof(path)) return;
+    FILE *file = fopen(path, "w");
+    if (file) {
+        fprintf(file, "%lld\n", bytes);
+        fclose(file);
+    }
+}
+
+static long long read_usage_estimate(void) {
+    char path[MAX_PATH_LENGTH];
+    long long bytes = -1;
+    if (snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_USAGE_FILE) >= (int)sizeof(path)) return -1;
+    FILE *file = fopen(path, "r");
+    if (file) {
+        if (fscanf(file, "%lld", &bytes) != 1) bytes = -1;
+        fclose(file);
+    }
+    return bytes;
+}
+
+// Evict least recently used cache files until usage is under 90% of
+// max_bytes; returns -1 if the cache directory cannot be read
+int cache_gc(long long max_bytes) {
+    char msg[256];
+    CacheListing listing;
+    memset(&listing, 0, sizeof(listing));
+    long temps_removed = 0;
+
+    DIR *dirs[CACHE_DIRS] = { opendir(cache_dir), opendir(svg_cache_dir), opendir(font_cache_dir) };
+    if (!dirs[0]) {
+        fprintf(stderr, "Error: Cannot read cache directory '%s'\n", cache_dir);
+        for (int d = 1; d < CACHE_DIRS; d++) {
+            if (dirs[d]) closedir(dirs[d]);
+        }
+        return -1;
+    }
+    int result = 0;
+    for (int d = 0; d < CACHE_DIRS && result == 0; d++) {
+        if (dirs[d]) result = list_cache_dir(&listing, d, dirs[d], &temps_removed);
+    }
+    if (result != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    long removed = 0;
+    long long removed_bytes = 0;
+    long long in_use = listing.total_bytes;
+    if (result == 0 && in_use > max_bytes) {
+        qsort(listing.entries, listing.count, sizeof(CacheEntry), compare_entry_age);
+        for (size_t i = 0; i < listing.count && in_use > CACHE_GC_LOW_WATER(max_bytes); i++) {
+            const CacheEntry *entry = &listing.entries[i];
+            if (!dirs[entry->dir] || unlinkat(dirfd(dirs[entry->dir]), listing.names + entry->name_offset, 0) != 0) {
+                continue;
+            }
+            in_use -= entry->bytes;
+            removed_bytes += entry->bytes;
+            removed++;
+        }
+    }
+    if (result == 0) {
+        write_usage_estimate(in_use);
+        __atomic_store_n(&cache_bytes_added, 0, __ATOMIC_RELAXED);
+    }
+
+    snprintf(msg, sizeof(msg), "Cache GC: %zu entries using %.1f MB (limit %.1f MB); evicted %ld entries (%.1f MB), removed %ld stale temporary files",
+             listing.count, listing.total_bytes / 1048576.0, max_bytes / 1048576.0,
+             removed, removed_bytes / 1048576.0, temps_removed);
+    status_output(msg);
+
+    for (int d = 0; d < CACHE_DIRS; d++) {
+        if (dirs[d]) closedir(dirs[d]);
+    }
+    free(listing.entries);
+    free(listing.names);
+    return result;
+}
+
+// After a run: add what it wrote to the usage estimate and collect once
+// the estimate passes the budget (or when there is no estimate yet)
+void cache_enforce_limit(void) {
+    static pthread_mutex_t enforce_mutex = PTHREAD_MUTEX_INITIALIZER;
+    if (cache_max_size <= 0) return;
+
+    // Renders finishing at once update the estimate one after another
+    pthread_mutex_lock(&enforce_mutex);
+    long long added = __atomic_exchange_n(&cache_bytes_added, 0, __ATOMIC_RELAXED);
+    long long estimate = read_usage_estimate();
+    if (estimate >= 0 && estimate + added <= cache_max_size) {
+        if (added > 0) write_usage_estimate(estimate + added);
+    } else {
+        cache_gc(cache_max_size);
+    }
+    pthread_mutex_unlock(&enforce_mutex);
+}
@@ -0,0 +1,65 @@
+/*
+ * Oh-html.c - HTML output backend (--format html)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * Writes the parsed grid as one <pre> of styled <span>s, for mail and chat
+ * previews that take HTML but not SVG. Text styles use the SVG's class
+ * names (setting color instead of fill), backgrounds are inline, and cells
+ * between segments become spaces, so columns line up without positioning.
+ * The font is linked, or embedded with --embed-font, as in the SVG.
+ */
+
+#include "Oh.h"
+
+int html_render(const Config *config, const BackendGrid *grid, OutputWriter *writer) {
+    char font_css[1024];
+    StylePalette palette = { 0 };
+    for (int r = 0; r < grid->row_count; r++) {
+        palette_mark_line(&palette, &grid->rows[r]);
+    }
+
+    build_font_css(config, font_css, sizeof(font_css));
+    writer_puts(writer, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<style>\n");
+    if (config->font_faces) {
+        writer_puts(writer, config->font_faces);
+        writer_puts(writer, "\n");
+    }
+    writer_printf(writer, "%s .terminal-text { font-size: %dpx; line-height: %.2fpx; color: %s; }",
+                  font_css, config->font_size, config->font_height, TEXT_COLOR);
+    writer_printf(writer, " pre.terminal-text { display: inline-block; margin: 0; padding: %dpx; background: %s; border-radius: 6px; }",
+                  DEFAULT_PADDING, BG_COLOR);
+    palette_write_rules(writer, &palette, "color");
+    palette_free(&palette);
+    writer_puts(writer, "\n</style>\n</head>\n<body>\n<pre class=\"terminal-text\">");
+
+    for (int r = 0; r < grid->row_count; r++) {
+        const LineData *line = &grid->rows[r];
+        int column = 0;
+        for (int j = 0; j < line->segment_count; j++) {
+            const TextSegment *seg = LINE_SEGMENT(line, j);
+            if (seg->text_length == 0) continue;
+            for (; column < seg->visible_pos; column++) {
+                writer_puts(writer, " ");
+            }
+
+            char style_class[STYLE_CLASS_LENGTH];
+            int styled = style_class_name(seg->fg, seg->bold, style_class) > 0;
+            int background = seg->bg != COLOR_NONE;
+            if (styled || background) {
+                writer_puts(writer, "<span");
+                if (styled) writer_printf(writer, " class=\"%s\"", style_class);
+                if (background) writer_printf(writer, " style=\"background: %s\"", color_name(seg->bg));
+                writer_puts(writer, ">");
+            }
+            writer_write_escaped(writer, SEGMENT_TEXT(line, seg), seg->text_length, NULL, NULL);
+            if (styled || background) {
+                writer_puts(writer, "</span>");
+            }
+            column = seg->visible_pos + segment_cells(line, j);
+        }
+        writer_puts(writer, "\n");
+    }
+    writer_puts(writer, "</pre>\n</body>\n</html>\n");
+
+    return writer->error ? -1 : 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Oh-lib.c - Resident rendering and the embeddable API (liboh.h)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * Rendering a document from memory in a long-lived process, as --serve and
+ * programs linking liboh do: options are parsed into a Config once, and each
+ * render loads its input as line views into its own RenderState, renders
+ * into a memory writer and checks the result, leaving parsed lines and
+ * fragments in the shared in-memory caches for the next render. Renders on
+ * different states run at the same time. The first context a program
+ * creates sets up what main() sets up for the CLI: the cache directories,
+ * the memory caches and the worker pool. It leaves jansson's allocator to
+ * the program; only the CLI routes it to the scratch arenas.
+ */
+
+#include "Oh.h"
+#include "liboh.h"
+
+#define RENDER_MAX_ARGS 64
+
+struct oh_context {
+    Config config;
+    RenderState render;
+    char error[256];
+};
+
+// Options that belong to a process rather than to one render, and
+// --embed-font, which would fetch from the network on a server's behalf
+static const char *render_rejected_options[] = {
+    "-i", "--input", "-o", "--output", "--stream", "-j", "--jobs", "--debug", "--cache-format",
+    "--serve", "--connect", "--batch", "--cast", "--page-height", "--memory-cache", "--cache-max-size", "--cache-gc", "--stats",
+    "--embed-font", "-h", "--help", "-v", "--version", NULL
+};
+
+// Split an options line into words; single or double quotes group a word
+static int split_options(char *line, char **argv, int max_args) {
+    static char program_name[] = SCRIPT_NAME;
+    int argc = 0;
+    argv[argc++] = program_name;
+    char *p = line;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        if (argc >= max_args) return -1;
+        char *out = p;
+        argv[argc++] = out;
+        while (*p && *p != ' ' && *p != '\t') {
+            if (*p == '\'' || *p == '"') {
+                char quote = *p++;
+                while (*p && *p != quote) *out++ = *p++;
+                if (*p != quote) return -1;
+                p++;
+            } else {
+                *out++ = *p++;
+            }
+        }
+        if (*p) p++;
+        *out = '\0';
+    }
+    return argc;
+}
+
+// Build one render's configuration from an options line (modified in place)
+int parse_render_options(char *line, Config *config, char *error, size_t error_size) {
+    char *argv[RENDER_MAX_ARGS];
+    int argc = split_options(line, argv, RENDER_MAX_ARGS);
+    if (argc < 0) {
+        snprintf(error, error_size, "malformed options line");
+        return -1;
+    }
+    for (int i = 1; i < argc; i++) {
+        for (int r = 0; render_rejected_options[r]; r++) {
+            size_t length = strlen(render_rejected_options[r]);
+            if (strncmp(argv[i], render_rejected_options[r], length) == 0 &&
+                (argv[i][length] == '\0' || argv[i][length] == '=')) {
+                snprintf(error, error_size, "option '%.64s' is not accepted in a request", argv[i]);
+                return -1;
+            }
+        }
+    }
+    if (parse_arguments(argc, argv, config) != 0) {
+        snprintf(error, error_size, "invalid options");
+        return -1;
+    }
+    if (!config->font_width_explicit || !config->font_height_explicit) {
+        calculate_font_metrics(config);
+    }
+    return 0;
+}
+
+// Render input into writer with config's options on render, which no other
+// thread is using; returns 0 and fills summary, or -1 with the reason in error
+int render_resident(RenderState *render, const Config *config, const char *input, size_t length,
+                    OutputWriter *writer, RenderSummary *summary, char *error, size_t error_size) {
+    // Rendering settles defaults (the height, for one) in the config it is given
+    Config render_config = *config;
+    int result = -1;
+
+    // The lines are views into the input, which outlives the render
+    if (load_input_lines(render, &render_config, input, length, "request") != 0) {
+        snprintf(error, error_size, "no input");
+    } else if (process_lines_single_pass(render, &render_config, writer) != 0) {
+        snprintf(error, error_size, "rendering failed");
+    } else {
+        result = 0;
+        summary->lines = render->line_count;
+    }
+    render->line_count = 0;
+    render_layout_free(&render->current_layout);
+
+    // The document is in memory, so even --validate=dtd gets the in-process check only
+    if (result == 0 && render_config.validate != VALIDATE_NONE && !output_backend(&render_config)->render) {
+        long long validate_start = STATS_START();
+        XmlChecker checker;
+        xml_check_init(&checker);
+        xml_check_feed(&checker, writer->buffer, writer->length);
+        if (xml_check_finish(&checker) != 0) {
+            snprintf(error, error_size, "output is not well-formed (line %ld, column %ld: %s)",
+                     checker.error_line, checker.error_column, checker.error);
+            result = -1;
+        }
+        STATS_STOP(STATS_VALIDATE, validate_start);
+    }
+
+    if (result == 0) {
+        STATS_ADD_BYTES(stats_bytes_out, writer->length);
+        summary->segment_hits = render->stats.segment_hits;
+        summary->segment_misses = render->stats.segment_misses;
+        summary->fragment_hits = render->stats.svg_hits;
+        summary->fragment_misses = render->stats.svg_misses;
+    }
+    cache_enforce_limit();
+    return result;
+}
+
+// Process-wide setup for programs using the library, done once
+static pthread_once_t library_once = PTHREAD_ONCE_INIT;
+static int library_status = -1;
+
+static void library_init(void) {
+    script_start_time = get_current_time();
+    if (!getenv("HOME")) return;
+    setup_cache_directories();
+
+    const char *jobs_value = getenv("OH_JOBS");
+    int jobs = jobs_value ? atoi(jobs_value) : 1;
+    if (jobs <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cores < 1 ? 1 : (int)cores;
+    }
+    const char *cache_value = getenv("OH_MEMORY_CACHE");
+    int megabytes = cache_value ? atoi(cache_value) : DEFAULT_MEMORY_CACHE_MB;
+    if (megabytes < 1 || megabytes > 65536) megabytes = DEFAULT_MEMORY_CACHE_MB;
+
+    worker_pool = pool_create(jobs > MAX_JOBS ? MAX_JOBS : jobs);
+    if (!worker_pool || memory_caches_create(megabytes, 1) != 0) return;
+    resident_mode = 1;
+    library_status = 0;
+}
+
+oh_context* oh_context_new(const char *options, char *error, size_t error_size) {
+    pthread_once(&library_once, library_init);
+    if (library_status != 0) {
+        snprintf(error, error_size, "cannot start: HOME is not set or memory is short");
+        return NULL;
+    }
+
+    char *line = strdup(options ? options : "");
+    oh_context *ctx = calloc(1, sizeof(oh_context));
+    if (!line || !ctx) {
+        snprintf(error, error_size, "out of memory");
+        free(line);
+        free(ctx);
+        return NULL;
+    }
+    if (strchr(line, '\n')) {
+        snprintf(error, error_size, "malformed options line");
+        free(line);
+        free(ctx);
+        return NULL;
+    }
+    // The options that set process-wide state (--debug, --cache-format, ...) are refused
+    int parsed = parse_render_options(line, &ctx->config, error, error_size);
+    free(line);
+    if (parsed != 0) {
+        free(ctx);
+        return NULL;
+    }
+    render_state_init(&ctx->render);
+    return ctx;
+}
+
+int oh_render(oh_context *ctx, const char *input, size_t length, const oh_writer *writer) {
+    OutputWriter out;
+    RenderSummary summary;
+    ctx->error[0] = '\0';
+    if (!input || length == 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "no input");
+        return -1;
+    }
+    if (writer_open_memory(&out) != 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "out of memory");
+        return -1;
+    }
+    int result = render_resident(&ctx->render, &ctx->config, input, length, &out, &summary,
+                                 ctx->error, sizeof(ctx->error));
+    if (result == 0 && writer->write(writer->user, out.buffer, out.length) != 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "writer failed");
+        result = -1;
+    }
+    writer_close(&out);
+    return result;
+}
+
+const char* oh_context_error(const oh_context *ctx) {
+    return ctx->error;
+}
+
+void oh_context_free(oh_context *ctx) {
+    if (!ctx) return;
+    render_state_free(&ctx->render);
+    free(ctx);
+}
+
+const char* oh_version(void) {
+    return SCRIPT_VERSION;
+}
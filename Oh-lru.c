@@ -0,0 +1,221 @@
+/*
+ * Oh-lru.c - In-memory LRU caches for parsed lines and SVG fragments
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * A memory cache maps a 128-bit key to an opaque payload under a byte
+ * budget. Entries live in a chained hash table and on a recency list; a hit
+ * moves the entry to the front and a store past the budget evicts from the
+ * back. Every run keeps one for parsed lines (payloads in the line pack
+ * format) in front of the disk line cache; a process rendering many
+ * documents (--serve, --batch) also keeps one for SVG fragments, so content
+ * repeated across documents never touches disk.
+ */
+
+#include "Oh.h"
+
+#define MEMORY_CACHE_INITIAL_BUCKETS 1024
+
+MemoryCache *line_memory = NULL;
+MemoryCache *fragment_memory = NULL;
+
+static size_t memory_bucket(uint64_t key_hi, uint64_t key_lo, size_t mask) {
+    uint64_t mixed = (key_hi * 0x9E3779B97F4A7C15ull) ^ key_lo;
+    mixed ^= mixed >> 29;
+    mixed *= 0xBF58476D1CE4E5B9ull;
+    mixed ^= mixed >> 32;
+    return (size_t)mixed & mask;
+}
+
+MemoryCache* memory_cache_create(size_t max_bytes) {
+    MemoryCache *cache = calloc(1, sizeof(MemoryCache));
+    if (!cache) return NULL;
+    cache->buckets = calloc(MEMORY_CACHE_INITIAL_BUCKETS, sizeof(MemoryCacheEntry *));
+    if (!cache->buckets) {
+        free(cache);
+        return NULL;
+    }
+    cache->bucket_count = MEMORY_CACHE_INITIAL_BUCKETS;
+    cache->max_bytes = max_bytes;
+    pthread_mutex_init(&cache->mutex, NULL);
+    return cache;
+}
+
+void memory_cache_destroy(MemoryCache *cache) {
+    if (!cache) return;
+    MemoryCacheEntry *entry = cache->newest;
+    while (entry) {
+        MemoryCacheEntry *older = entry->older;
+        free(entry);
+        entry = older;
+    }
+    free(cache->buckets);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+static void memory_unlink(MemoryCache *cache, MemoryCacheEntry *entry) {
+    if (entry->newer) entry->newer->older = entry->older; else cache->newest = entry->older;
+    if (entry->older) entry->older->newer = entry->newer; else cache->oldest = entry->newer;
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+static void memory_push_front(MemoryCache *cache, MemoryCacheEntry *entry) {
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if (cache->newest) cache->newest->newer = entry; else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+static void memory_evict_oldest(MemoryCache *cache) {
+    MemoryCacheEntry *victim = cache->oldest;
+    MemoryCacheEntry **slot = &cache->buckets[memory_bucket(victim->key_hi, victim->key_lo, cache->bucket_count - 1)];
+    while (*slot != victim) slot = &(*slot)->hash_next;
+    *slot = victim->hash_next;
+    memory_unlink(cache, victim);
+    cache->bytes -= sizeof(MemoryCacheEntry) + victim->length;
+    cache->entry_count--;
+    cache->evictions++;
+    free(victim);
+}
+
+// Double the bucket array once the table is fuller than one entry per bucket
+static void memory_grow(MemoryCache *cache) {
+    size_t new_count = cache->bucket_count * 2;
+    MemoryCacheEntry **buckets = calloc(new_count, sizeof(MemoryCacheEntry *));
+    if (!buckets) return;
+    for (MemoryCacheEntry *entry = cache->newest; entry; entry = entry->older) {
+        size_t b = memory_bucket(entry->key_hi, entry->key_lo, new_count - 1);
+        entry->hash_next = buckets[b];
+        buckets[b] = entry;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = new_count;
+}
+
+// Find key and mark it most recently used; the caller holds cache->mutex
+// for as long as it reads the returned payload
+const void* memory_cache_lookup(MemoryCache *cache, uint64_t key_hi, uint64_t key_lo, uint32_t *length) {
+    MemoryCacheEntry *entry = cache->buckets[memory_bucket(key_hi, key_lo, cache->bucket_count - 1)];
+    while (entry && (entry->key_hi != key_hi || entry->key_lo != key_lo)) entry = entry->hash_next;
+    if (!entry) {
+        cache->misses++;
+        return NULL;
+    }
+    if (cache->newest != entry) {
+        memory_unlink(cache, entry);
+        memory_push_front(cache, entry);
+    }
+    cache->hits++;
+    *length = entry->length;
+    return entry->data;
+}
+
+// Store a copy of data under key, evicting least recently used entries to
+// stay within the budget; an existing entry for key is kept. The caller
+// holds cache->mutex.
+int memory_cache_store(MemoryCache *cache, uint64_t key_hi, uint64_t key_lo, const void *data, uint32_t length) {
+    size_t cost = sizeof(MemoryCacheEntry) + length;
+    if (cost > cache->max_bytes) return -1;
+
+    size_t b = memory_bucket(key_hi, key_lo, cache->bucket_count - 1);
+    for (MemoryCacheEntry *entry = cache->buckets[b]; entry; entry = entry->hash_next) {
+        if (entry->key_hi == key_hi && entry->key_lo == key_lo) return 0;
+    }
+
+    while (cache->oldest && cache->bytes + cost > cache->max_bytes) {
+        memory_evict_oldest(cache);
+    }
+
+    MemoryCacheEntry *entry = malloc(cost);
+    if (!entry) return -1;
+    entry->key_hi = key_hi;
+    entry->key_lo = key_lo;
+    entry->length = length;
+    memcpy(entry->data, data, length);
+
+    if (cache->entry_count >= cache->bucket_count) {
+        memory_grow(cache);
+        b = memory_bucket(key_hi, key_lo, cache->bucket_count - 1);
+    }
+    entry->hash_next = cache->buckets[b];
+    cache->buckets[b] = entry;
+    memory_push_front(cache, entry);
+    cache->bytes += cost;
+    cache->entry_count++;
+    return 0;
+}
+
+// Create the line cache, and with fragments the fragment cache, splitting a
+// budget of megabytes between them. A single run keeps only lines in memory
+// (repeated lines are parsed once) and leaves fragments to the fragment pack.
+int memory_caches_create(int megabytes, int fragments) {
+    size_t budget = (size_t)megabytes * 1024 * 1024;
+    line_memory = memory_cache_create(fragments ? budget / 2 : budget);
+    fragment_memory = fragments ? memory_cache_create(budget - budget / 2) : NULL;
+    if (!line_memory || (fragments && !fragment_memory)) {
+        memory_caches_destroy();
+        return -1;
+    }
+    return 0;
+}
+
+void memory_caches_destroy(void) {
+    memory_cache_destroy(line_memory);
+    memory_cache_destroy(fragment_memory);
+    line_memory = NULL;
+    fragment_memory = NULL;
+}
+
+// Load a parsed line from the line memory cache; returns -1 on a miss
+int load_line_memory(const char *line_hash, const char *config_hash, LineData *line_data) {
+    if (!line_memory) return -1;
+
+    uint32_t length = 0;
+    pthread_mutex_lock(&line_memory->mutex);
+    const unsigned char *payload = memory_cache_lookup(line_memory, strtoul(config_hash, NULL, 10),
+                                                       strtoul(line_hash, NULL, 10), &length);
+    int result = payload ? line_payload_decode(payload, length, line_data) : -1;
+    pthread_mutex_unlock(&line_memory->mutex);
+
+    return result;
+}
+
+int save_line_memory(const char *line_hash, const char *config_hash, const LineData *line_data) {
+    if (!line_memory) return -1;
+
+    size_t payload_size = 0;
+    unsigned char *payload = line_payload_encode(line_data, &payload_size);
+    if (!payload) return -1;
+
+    pthread_mutex_lock(&line_memory->mutex);
+    int result = memory_cache_store(line_memory, strtoul(config_hash, NULL, 10), strtoul(line_hash, NULL, 10),
+                                    payload, (uint32_t)payload_size);
+    pthread_mutex_unlock(&line_memory->mutex);
+    free(payload);
+    return result;
+}
+
+// Append a cached fragment to writer; returns -1 on a miss
+int load_fragment_memory(uint64_t render_key, uint64_t fragment_key, OutputWriter *writer) {
+    if (!fragment_memory) return -1;
+
+    uint32_t length = 0;
+    pthread_mutex_lock(&fragment_memory->mutex);
+    const char *fragment = memory_cache_lookup(fragment_memory, render_key, fragment_key, &length);
+    if (fragment) {
+        writer_write(writer, fragment, length);
+    }
+    pthread_mutex_unlock(&fragment_memory->mutex);
+    return fragment ? 0 : -1;
+}
+
+int save_fragment_memory(uint64_t render_key, uint64_t fragment_key, const char *fragment, size_t length) {
+    if (!fragment_memory || length > UINT32_MAX) return -1;
+
+    pthread_mutex_lock(&fragment_memory->mutex);
+    int result = memory_cache_store(fragment_memory, render_key, fragment_key, fragment, (uint32_t)length);
+    pthread_mutex_unlock(&fragment_memory->mutex);
+    return result;
+}
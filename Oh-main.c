@@ -0,0 +1,114 @@
+/*
+ * Oh-main.c - Command-line entry point
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * The Oh executable is this file linked against liboh.a: it parses the
+ * command line, sets up the caches and worker pool, and hands off to the
+ * mode the options select.
+ */
+
+#include "Oh.h"
+
+// Main function
+int main(int argc, char **argv) {
+    script_start_time = get_current_time();
+    scratch_install();
+    
+    Config config;
+    
+    if (argc == 1 && isatty(STDIN_FILENO)) {
+        show_help();
+        return 0;
+    }
+    
+    if (parse_arguments(argc, argv, &config) != 0) {
+        return 1;
+    }
+    stats_enabled = config.stats != STATS_NONE || strlen(config.stats_file) > 0;
+    
+    setup_cache_directories();
+    
+    if (!config.font_width_explicit || !config.font_height_explicit) {
+        calculate_font_metrics(&config);
+    }
+    
+    char msg[768];  // Larger buffer to accommodate long paths
+    progress_output("Parsed options:");
+    const char *input_name = strlen(config.input_file) > 0 ? config.input_file : "stdin";
+    const char *output_name = strlen(config.output_file) > 0 ? config.output_file : "stdout";
+    snprintf(msg, sizeof(msg), "  Input: %.500s", input_name);
+    progress_output(msg);
+    snprintf(msg, sizeof(msg), "  Output: %.500s", output_name);
+    progress_output(msg);
+    snprintf(msg, sizeof(msg), "  Font: %s %dpx (width: %.2f, line height: %.2f, weight: %d)", 
+            config.font_family, config.font_size, config.font_width, config.font_height, config.font_weight);
+    progress_output(msg);
+    snprintf(msg, sizeof(msg), "  Grid: %dx%d", config.width, config.height);
+    progress_output(msg);
+    snprintf(msg, sizeof(msg), "  Wrap: %s", config.wrap ? "true" : "false");
+    progress_output(msg);
+    snprintf(msg, sizeof(msg), "  Tab size: %d", config.tab_size);
+    progress_output(msg);
+    snprintf(msg, sizeof(msg), "  Jobs: %d", config.jobs);
+    progress_output(msg);
+    
+    // A server waits for SIGINT/SIGTERM itself, so every thread (the pool's
+    // included) must be created with them blocked
+    if (strlen(config.serve_socket) > 0) {
+        sigset_t stop_signals;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    }
+    
+    worker_pool = pool_create(config.jobs);
+    
+    int status = 0;
+    if (config.cache_gc) {
+        status = cache_gc(cache_max_size > 0 ? cache_max_size : DEFAULT_CACHE_MAX_SIZE);
+    } else if (strlen(config.connect_socket) > 0) {
+        status = connect_svg(&config, argc, argv);
+    } else if (strlen(config.serve_socket) > 0) {
+        status = serve_svg(&config);
+    } else if (strlen(config.batch_file) > 0 || config.file_pair_count > 0) {
+        status = batch_svg(&config);
+    } else if (config.cast || is_cast_file(config.input_file)) {
+        status = cast_svg(&config);
+    } else {
+        // Lines repeated within the input are parsed (or read from disk) once
+        if (memory_caches_create(config.memory_cache_mb, 0) != 0 && debug_mode) {
+            log_output("Line memory cache unavailable, using the disk cache only");
+        }
+        RenderState render;
+        render_state_init(&render);
+        if (config.stream) {
+            status = stream_svg(&render, &config);
+        } else {
+            status = read_input(&render, &config);
+            if (status == 0) {
+                status = output_svg(&render, &config);
+            }
+        }
+        render_state_free(&render);
+        memory_caches_destroy();
+    }
+    if (!config.cache_gc) {
+        cache_enforce_limit();
+    }
+    
+    pool_destroy(worker_pool);
+    worker_pool = NULL;
+    free(config.file_pairs);
+    if (status == 0) {
+        char done_msg[128];
+        snprintf(done_msg, sizeof(done_msg), "%s v%s SVG generation complete! 🎯", SCRIPT_NAME, SCRIPT_VERSION);
+        progress_output(done_msg);
+    }
+    
+    // Statistics come last, so a scraper finds them on the final line of stderr
+    if (stats_report(&config, status) != 0) {
+        status = -1;
+    }
+    return status != 0 ? 1 : 0;
+}
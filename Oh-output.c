@@ -0,0 +1,190 @@
+/*
+ * Oh-output.c - Buffered output writer
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * A writer either streams through a fixed buffer to a FILE, keeping memory
+ * constant regardless of document size, or accumulates the whole document
+ * in a geometrically growing, NUL-terminated buffer (fragment capture).
+ * Streamed bytes can also be checked for well-formedness and copied to a
+ * second FILE (a DTD validator) on their way out.
+ */
+
+#include "Oh.h"
+#include <stdarg.h>
+
+#define WRITER_STREAM_BUFFER (256 * 1024)
+#define WRITER_MEMORY_INITIAL (64 * 1024)
+
+static int writer_init(OutputWriter *writer, FILE *file, size_t capacity) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = file;
+    writer->buffer = malloc(capacity + 1);
+    if (!writer->buffer) {
+        writer->error = 1;
+        return -1;
+    }
+    writer->capacity = capacity;
+    writer->buffer[0] = '\0';
+    return 0;
+}
+
+// Stream to an already-open FILE through a large buffer
+int writer_open_file(OutputWriter *writer, FILE *file) {
+    return writer_init(writer, file, WRITER_STREAM_BUFFER);
+}
+
+// Keep the whole document in memory
+int writer_open_memory(OutputWriter *writer) {
+    return writer_init(writer, NULL, WRITER_MEMORY_INITIAL);
+}
+
+// Push buffered bytes to the FILE (no-op for memory writers)
+int writer_flush(OutputWriter *writer) {
+    if (!writer->file || writer->length == 0) return writer->error ? -1 : 0;
+
+    long long start = STATS_START();
+    if (writer->checker) {
+        xml_check_feed(writer->checker, writer->buffer, writer->length);
+    }
+    if (writer->tee && !writer->tee_error &&
+        fwrite(writer->buffer, 1, writer->length, writer->tee) != writer->length) {
+        writer->tee_error = 1;
+    }
+    if (writer->checker || writer->tee) {
+        STATS_STOP(STATS_VALIDATE, start);
+        start = STATS_START();
+    }
+
+    if (fwrite(writer->buffer, 1, writer->length, writer->file) != writer->length) {
+        writer->error = 1;
+    }
+    STATS_STOP(STATS_WRITE, start);
+    STATS_ADD_BYTES(stats_bytes_out, writer->length);
+    writer->length = 0;
+    writer->buffer[0] = '\0';
+    return writer->error ? -1 : 0;
+}
+
+// Make room for at least needed more bytes
+static int writer_reserve(OutputWriter *writer, size_t needed) {
+    if (writer->length + needed <= writer->capacity) return 0;
+
+    if (writer->file) {
+        writer_flush(writer);
+        if (needed <= writer->capacity) return 0;
+    }
+
+    size_t new_capacity = writer->capacity ? writer->capacity : WRITER_MEMORY_INITIAL;
+    while (new_capacity < writer->length + needed) new_capacity *= 2;
+    char *grown = realloc(writer->buffer, new_capacity + 1);
+    if (!grown) {
+        writer->error = 1;
+        return -1;
+    }
+    writer->buffer = grown;
+    writer->capacity = new_capacity;
+    return 0;
+}
+
+int writer_write(OutputWriter *writer, const char *data, size_t length) {
+    if (writer->error || writer_reserve(writer, length) != 0) return -1;
+
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+    writer->buffer[writer->length] = '\0';
+    writer->bytes_written += length;
+    return 0;
+}
+
+int writer_puts(OutputWriter *writer, const char *text) {
+    return writer_write(writer, text, strlen(text));
+}
+
+// Write text with the five XML special characters escaped. Room for the
+// worst case is reserved up front so clean runs are copied in bulk straight
+// into the buffer; the escaped length and visible characters are optional outputs.
+int writer_write_escaped(OutputWriter *writer, const char *text, size_t length,
+                         size_t *escaped_length, int *chars) {
+    int visible = 0;
+    if (writer->error || writer_reserve(writer, XML_ESCAPE_MAX(length)) != 0) return -1;
+
+    size_t written = xml_escape_run(writer->buffer + writer->length, text, length, &visible);
+    writer->length += written;
+    writer->buffer[writer->length] = '\0';
+    writer->bytes_written += written;
+
+    if (escaped_length) *escaped_length = written;
+    if (chars) *chars += visible;
+    return 0;
+}
+
+// Write data with every occurrence of from (which must be non-empty) replaced by to
+int writer_write_replacing(OutputWriter *writer, const char *data, size_t length,
+                           const char *from, const char *to) {
+    size_t from_length = strlen(from);
+    size_t to_length = strlen(to);
+    size_t run_start = 0;
+    size_t i = 0;
+
+    while (from_length <= length && i <= length - from_length) {
+        const char *hit = memchr(data + i, from[0], length - from_length - i + 1);
+        if (!hit) break;
+        i = (size_t)(hit - data);
+        if (memcmp(hit, from, from_length) == 0) {
+            writer_write(writer, data + run_start, i - run_start);
+            writer_write(writer, to, to_length);
+            i += from_length;
+            run_start = i;
+        } else {
+            i++;
+        }
+    }
+    writer_write(writer, data + run_start, length - run_start);
+
+    return writer->error ? -1 : 0;
+}
+
+int writer_printf(OutputWriter *writer, const char *format, ...) {
+    if (writer->error) return -1;
+
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(writer->buffer + writer->length, writer->capacity - writer->length + 1, format, args);
+    va_end(args);
+    if (needed < 0) {
+        writer->error = 1;
+        return -1;
+    }
+
+    // Did not fit: make room and format again
+    if ((size_t)needed > writer->capacity - writer->length) {
+        writer->buffer[writer->length] = '\0';
+        if (writer_reserve(writer, (size_t)needed) != 0) return -1;
+        va_start(args, format);
+        vsnprintf(writer->buffer + writer->length, writer->capacity - writer->length + 1, format, args);
+        va_end(args);
+    }
+
+    writer->length += (size_t)needed;
+    writer->bytes_written += (size_t)needed;
+    return 0;
+}
+
+// Discard buffered content but keep the allocation (memory writers)
+void writer_reset(OutputWriter *writer) {
+    writer->length = 0;
+    writer->bytes_written = 0;
+    writer->error = 0;
+    if (writer->buffer) writer->buffer[0] = '\0';
+}
+
+// Flush and release the buffer; returns -1 if any write failed
+int writer_close(OutputWriter *writer) {
+    writer_flush(writer);
+    int result = writer->error ? -1 : 0;
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+    return result;
+}
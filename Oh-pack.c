@@ -0,0 +1,480 @@
+/*
+ * Oh-pack.c - Packed binary cache backend
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * A pack file is a header followed by append-only entries. Each entry is a
+ * fixed 16-byte header (64-bit key, payload length, payload cksum) and the
+ * payload padded to 8 bytes, so the whole file can be mmap'd and walked
+ * without parsing. The key->offset index is rebuilt in memory on open.
+ */
+
+#include "Oh.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define PACK_MAGIC "OHPK"
+#define PACK_VERSION 1
+#define PACK_ALIGN(n) (((n) + 7u) & ~(size_t)7u)
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} PackFileHeader;
+
+typedef struct {
+    uint64_t key;
+    uint32_t length;
+    uint32_t crc;
+} PackEntryHeader;
+
+// Line cache payload: header, fixed-width segment records, then text bytes
+typedef struct {
+    uint32_t visible_length;
+    uint32_t segment_count;
+    uint32_t text_bytes;
+    uint32_t reserved;
+} PackLineHeader;
+
+typedef struct {
+    uint32_t text_offset;
+    uint32_t text_length;
+    uint32_t fg_rgb;
+    uint32_t bg_rgb;
+    int32_t visible_pos;
+    uint32_t flags;
+} PackSegment;
+
+#define PACK_SEGMENT_BOLD 0x1u
+#define PACK_COLOR_NONE 0xFFFFFFFFu
+
+int cache_format = CACHE_FORMAT_JSON;
+
+// Renders running at once may append to the same pack through their own
+// descriptors, which a process's fcntl lock does not tell apart
+static pthread_mutex_t pack_append_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t pack_crc(const void *data, size_t length) {
+    return cksum_finish(cksum_update(0, data, length), length);
+}
+
+// Mix a 64-bit key into a table slot
+static size_t pack_slot(uint64_t key, size_t mask) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key & mask;
+}
+
+static int pack_index_grow(PackFile *pack);
+
+static int pack_index_put(PackFile *pack, uint64_t key, size_t offset, int pending) {
+    if ((pack->index_count + 1) * 2 > pack->index_capacity && pack_index_grow(pack) != 0) {
+        return -1;
+    }
+    size_t mask = pack->index_capacity - 1;
+    size_t slot = pack_slot(key, mask);
+    while (pack->index[slot].used && pack->index[slot].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    if (!pack->index[slot].used) {
+        pack->index_count++;
+    }
+    pack->index[slot].used = 1;
+    pack->index[slot].pending = pending;
+    pack->index[slot].key = key;
+    pack->index[slot].offset = offset;
+    return 0;
+}
+
+static int pack_index_grow(PackFile *pack) {
+    size_t new_capacity = pack->index_capacity ? pack->index_capacity * 2 : 1024;
+    PackIndexEntry *old_index = pack->index;
+    size_t old_capacity = pack->index_capacity;
+
+    pack->index = calloc(new_capacity, sizeof(PackIndexEntry));
+    if (!pack->index) {
+        pack->index = old_index;
+        return -1;
+    }
+    pack->index_capacity = new_capacity;
+    pack->index_count = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_index[i].used) {
+            pack_index_put(pack, old_index[i].key, old_index[i].offset, old_index[i].pending);
+        }
+    }
+    free(old_index);
+    return 0;
+}
+
+// Write a fresh header into an empty (or unusable) pack file
+static int pack_write_header(int fd) {
+    PackFileHeader header;
+    memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    if (ftruncate(fd, 0) != 0) return -1;
+    return pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+// Walk the mapped entries and index every complete, intact one
+static void pack_build_index(PackFile *pack) {
+    size_t offset = sizeof(PackFileHeader);
+    while (offset + sizeof(PackEntryHeader) <= pack->map_size) {
+        const PackEntryHeader *entry = (const PackEntryHeader *)(pack->map + offset);
+        size_t payload_offset = offset + sizeof(PackEntryHeader);
+        if (entry->length > pack->map_size - payload_offset) break;
+        if (pack_crc(pack->map + payload_offset, entry->length) != entry->crc) break;
+        pack_index_put(pack, entry->key, offset, 0);
+        offset = payload_offset + PACK_ALIGN(entry->length);
+    }
+    pack->valid_size = offset < pack->map_size ? offset : pack->map_size;
+}
+
+// Open (creating if needed) and map a pack file
+int pack_open(PackFile *pack, const char *path) {
+    memset(pack, 0, sizeof(*pack));
+    pack->fd = -1;
+    pthread_mutex_init(&pack->mutex, NULL);
+    snprintf(pack->path, sizeof(pack->path), "%s", path);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        if (debug_mode) {
+            char msg[768];
+            snprintf(msg, sizeof(msg), "Cannot open pack file: %.500s", path);
+            log_output(msg);
+        }
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    PackFileHeader header;
+    if (st.st_size < (off_t)sizeof(header) ||
+        pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, PACK_MAGIC, 4) != 0 || header.version != PACK_VERSION) {
+        if (pack_write_header(fd) != 0) {
+            close(fd);
+            return -1;
+        }
+        st.st_size = sizeof(header);
+    }
+
+    pack->fd = fd;
+    cache_touch(path);
+    pack->map_size = (size_t)st.st_size;
+    pack->map = mmap(NULL, pack->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (pack->map == MAP_FAILED) {
+        pack->map = NULL;
+        pack->map_size = 0;
+    } else {
+        pack_build_index(pack);
+    }
+
+    if (debug_mode) {
+        char msg[768];
+        snprintf(msg, sizeof(msg), "Opened pack file %.500s (%zu entries, %zu bytes)",
+                path, pack->index_count, pack->map_size);
+        log_output(msg);
+    }
+    return 0;
+}
+
+// Find a payload by key; returns NULL when absent
+const void* pack_lookup(const PackFile *pack, uint64_t key, uint32_t *length) {
+    if (!pack->index_capacity) return NULL;
+
+    size_t mask = pack->index_capacity - 1;
+    size_t slot = pack_slot(key, mask);
+    while (pack->index[slot].used) {
+        if (pack->index[slot].key == key) {
+            const unsigned char *base = pack->index[slot].pending ? pack->pending : pack->map;
+            const PackEntryHeader *entry = (const PackEntryHeader *)(base + pack->index[slot].offset);
+            *length = entry->length;
+            return entry + 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// Queue an entry; it becomes visible to pack_lookup immediately and hits disk on pack_close
+int pack_append(PackFile *pack, uint64_t key, const void *data, uint32_t length) {
+    size_t needed = sizeof(PackEntryHeader) + PACK_ALIGN(length);
+    if (pack->pending_size + needed > pack->pending_capacity) {
+        size_t new_capacity = pack->pending_capacity ? pack->pending_capacity : 65536;
+        while (new_capacity < pack->pending_size + needed) new_capacity *= 2;
+        unsigned char *grown = realloc(pack->pending, new_capacity);
+        if (!grown) return -1;
+        pack->pending = grown;
+        pack->pending_capacity = new_capacity;
+    }
+
+    size_t offset = pack->pending_size;
+    PackEntryHeader *entry = (PackEntryHeader *)(pack->pending + offset);
+    entry->key = key;
+    entry->length = length;
+    entry->crc = pack_crc(data, length);
+    memcpy(entry + 1, data, length);
+    memset((unsigned char *)(entry + 1) + length, 0, PACK_ALIGN(length) - length);
+    pack->pending_size += needed;
+
+    return pack_index_put(pack, key, offset, 1);
+}
+
+// Append queued entries under an exclusive lock, then unmap and close
+int pack_close(PackFile *pack) {
+    int result = 0;
+
+    if (pack->fd >= 0 && pack->pending_size > 0) {
+        pthread_mutex_lock(&pack_append_mutex);
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        fcntl(pack->fd, F_SETLKW, &lock);
+
+        // Drop a torn tail left by an interrupted writer before appending
+        struct stat st;
+        off_t end = 0;
+        if (fstat(pack->fd, &st) == 0) {
+            end = st.st_size;
+            if ((size_t)end == pack->map_size && pack->valid_size < pack->map_size) {
+                end = (off_t)pack->valid_size;
+                if (ftruncate(pack->fd, end) != 0) result = -1;
+            }
+        }
+        if (pwrite(pack->fd, pack->pending, pack->pending_size, end) != (ssize_t)pack->pending_size) {
+            result = -1;
+        } else {
+            cache_usage_add(pack->pending_size);
+        }
+
+        lock.l_type = F_UNLCK;
+        fcntl(pack->fd, F_SETLK, &lock);
+        pthread_mutex_unlock(&pack_append_mutex);
+
+        if (debug_mode) {
+            char msg[768];
+            snprintf(msg, sizeof(msg), "Appended %zu bytes to pack file %.500s", pack->pending_size, pack->path);
+            log_output(msg);
+        }
+    }
+
+    if (pack->map) munmap((void *)pack->map, pack->map_size);
+    if (pack->fd >= 0) close(pack->fd);
+    free(pack->pending);
+    free(pack->index);
+    pthread_mutex_destroy(&pack->mutex);
+    memset(pack, 0, sizeof(*pack));
+    pack->fd = -1;
+    return result;
+}
+
+// Convert "#rrggbb" to a packed RGB value
+static uint32_t pack_color_from_string(const char *color) {
+    if (!color || color[0] != '#') return PACK_COLOR_NONE;
+    return (uint32_t)strtoul(color + 1, NULL, 16);
+}
+
+static void pack_color_to_string(uint32_t rgb, char *color) {
+    if (rgb == PACK_COLOR_NONE) {
+        color[0] = '\0';
+    } else {
+        snprintf(color, MAX_COLOR_LENGTH, "#%06x", rgb & 0xFFFFFFu);
+    }
+}
+
+// Open a render's line pack for a configuration hash
+int open_line_pack(RenderState *render, const char *config_hash) {
+    char pack_path[MAX_PATH_LENGTH];
+    int ret = snprintf(pack_path, sizeof(pack_path), "%s/%s.pack", cache_dir, config_hash);
+    if (ret >= (int)sizeof(pack_path)) {
+        return -1;
+    }
+    return pack_open(&render->line_pack, pack_path);
+}
+
+void close_line_pack(RenderState *render) {
+    if (render->line_pack.fd >= 0) pack_close(&render->line_pack);
+}
+
+// Encode parsed line data as a line payload (malloc'd; NULL on failure)
+unsigned char* line_payload_encode(const LineData *line_data, size_t *payload_size) {
+    size_t text_bytes = 0;
+    for (int i = 0; i < line_data->segment_count; i++) {
+        text_bytes += LINE_SEGMENT(line_data, i)->text_length;
+    }
+
+    *payload_size = sizeof(PackLineHeader) + line_data->segment_count * sizeof(PackSegment) + text_bytes;
+    unsigned char *payload = malloc(*payload_size);
+    if (!payload) return NULL;
+
+    PackLineHeader *header = (PackLineHeader *)payload;
+    PackSegment *records = (PackSegment *)(header + 1);
+    char *text = (char *)(records + line_data->segment_count);
+
+    header->visible_length = (uint32_t)line_data->visible_length;
+    header->segment_count = (uint32_t)line_data->segment_count;
+    header->text_bytes = (uint32_t)text_bytes;
+    header->reserved = 0;
+
+    uint32_t text_offset = 0;
+    for (int i = 0; i < line_data->segment_count; i++) {
+        const TextSegment *seg = LINE_SEGMENT(line_data, i);
+        uint32_t length = seg->text_length;
+        records[i].text_offset = text_offset;
+        records[i].text_length = length;
+        records[i].fg_rgb = pack_color_from_string(color_name(seg->fg));
+        records[i].bg_rgb = pack_color_from_string(color_name(seg->bg));
+        records[i].visible_pos = seg->visible_pos;
+        records[i].flags = seg->bold ? PACK_SEGMENT_BOLD : 0;
+        memcpy(text + text_offset, SEGMENT_TEXT(line_data, seg), length);
+        text_offset += length;
+    }
+    return payload;
+}
+
+// Save parsed line data to a line pack
+int save_line_pack(PackFile *pack, const char *line_hash, const LineData *line_data) {
+    if (pack->fd < 0) return -1;
+
+    size_t payload_size = 0;
+    unsigned char *payload = line_payload_encode(line_data, &payload_size);
+    if (!payload) return -1;
+
+    // Worker threads share the pack; a line already queued by another worker is skipped
+    uint64_t key = strtoul(line_hash, NULL, 10);
+    uint32_t existing_length = 0;
+    int result = 0;
+    pthread_mutex_lock(&pack->mutex);
+    if (!pack_lookup(pack, key, &existing_length)) {
+        result = pack_append(pack, key, payload, (uint32_t)payload_size);
+    }
+    pthread_mutex_unlock(&pack->mutex);
+    free(payload);
+    return result;
+}
+
+// Decode a line payload into line_data's arena
+int line_payload_decode(const unsigned char *payload, uint32_t length, LineData *line_data) {
+    if (!payload || length < sizeof(PackLineHeader)) {
+        return -1;
+    }
+
+    const PackLineHeader *header = (const PackLineHeader *)payload;
+    size_t records_size = (size_t)header->segment_count * sizeof(PackSegment);
+    if (sizeof(PackLineHeader) + records_size + header->text_bytes > length) {
+        return -1;
+    }
+
+    const PackSegment *records = (const PackSegment *)(header + 1);
+    const char *text = (const char *)(records + header->segment_count);
+
+    line_begin(line_data, line_data->arena);
+    line_data->visible_length = (int)header->visible_length;
+    for (uint32_t i = 0; i < header->segment_count; i++) {
+        if (records[i].text_offset + (size_t)records[i].text_length > header->text_bytes) {
+            break;
+        }
+        char fg_color[MAX_COLOR_LENGTH];
+        char bg_color[MAX_COLOR_LENGTH];
+        pack_color_to_string(records[i].fg_rgb, fg_color);
+        pack_color_to_string(records[i].bg_rgb, bg_color);
+        if (line_add_segment(line_data, text + records[i].text_offset, records[i].text_length,
+                             intern_color(fg_color), intern_color(bg_color),
+                             (records[i].flags & PACK_SEGMENT_BOLD) != 0, records[i].visible_pos) != 0) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// Load parsed line data from a line pack
+int load_line_pack(PackFile *pack, const char *line_hash, LineData *line_data) {
+    if (pack->fd < 0) return -1;
+
+    // Hold the lock while copying: pending entries move when another worker appends
+    uint32_t length = 0;
+    uint64_t key = strtoul(line_hash, NULL, 10);
+    pthread_mutex_lock(&pack->mutex);
+    const unsigned char *payload = pack_lookup(pack, key, &length);
+    int result = line_payload_decode(payload, length, line_data);
+    pthread_mutex_unlock(&pack->mutex);
+    return result;
+}
+
+// Open the SVG fragment pack for a render key. The key covers everything that
+// shapes a row's markup (fonts, cell width, output mode, version) except the
+// grid height, so each layout gets its own pack and a growing log keeps its hits.
+// The render server keeps fragments in memory instead, under the same key.
+int open_fragment_pack(RenderState *render, const char *render_key) {
+    render->fragment_namespace = strtoul(render_key, NULL, 10);
+    if (fragment_memory) return 0;
+
+    char pack_path[MAX_PATH_LENGTH];
+    int ret = snprintf(pack_path, sizeof(pack_path), "%s/%s.pack", svg_cache_dir, render_key);
+    if (ret >= (int)sizeof(pack_path)) {
+        return -1;
+    }
+    return pack_open(&render->fragment_pack, pack_path);
+}
+
+void close_fragment_pack(RenderState *render) {
+    if (render->fragment_pack.fd >= 0) pack_close(&render->fragment_pack);
+}
+
+// Fragments are keyed by row as well as content hash: the y coordinate is baked in
+static uint64_t fragment_key(uint32_t row_hash, int row) {
+    return ((uint64_t)(uint32_t)row << 32) | row_hash;
+}
+
+// Append a cached fragment for (row_hash, row) to writer; returns -1 on a miss
+int load_svg_fragment_pack(RenderState *render, uint32_t row_hash, int row, OutputWriter *writer) {
+    if (fragment_memory) {
+        if (load_fragment_memory(render->fragment_namespace, fragment_key(row_hash, row), writer) != 0) {
+            CACHE_STAT_INC(render->stats.svg_misses);
+            return -1;
+        }
+        CACHE_STAT_INC(render->stats.svg_hits);
+        CACHE_STAT_INC(render->stats.fragment_memory_hits);
+        return 0;
+    }
+    PackFile *pack = &render->fragment_pack;
+    if (pack->fd < 0) return -1;
+
+    uint32_t length = 0;
+    pthread_mutex_lock(&pack->mutex);
+    const char *fragment = pack_lookup(pack, fragment_key(row_hash, row), &length);
+    if (fragment) {
+        writer_write(writer, fragment, length);
+    }
+    pthread_mutex_unlock(&pack->mutex);
+
+    if (!fragment) {
+        CACHE_STAT_INC(render->stats.svg_misses);
+        return -1;
+    }
+    CACHE_STAT_INC(render->stats.svg_hits);
+    return 0;
+}
+
+// Queue a rendered fragment for (row_hash, row)
+int save_svg_fragment_pack(RenderState *render, uint32_t row_hash, int row, const char *fragment, size_t length) {
+    if (fragment_memory) {
+        return save_fragment_memory(render->fragment_namespace, fragment_key(row_hash, row), fragment, length);
+    }
+    PackFile *pack = &render->fragment_pack;
+    if (pack->fd < 0 || length > UINT32_MAX) return -1;
+
+    pthread_mutex_lock(&pack->mutex);
+    int result = pack_append(pack, fragment_key(row_hash, row), fragment, (uint32_t)length);
+    pthread_mutex_unlock(&pack->mutex);
+    return result;
+}
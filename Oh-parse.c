@@ -5,24 +5,6 @@
 
 #include "Oh.h"
 
-// Expand tabs to spaces
-void expand_tabs(const char *input, char *output, int tab_size) {
-    const char *src = input;
-    char *dst = output;
-    
-    while (*src) {
-        if (*src == '\t') {
-            for (int i = 0; i < tab_size; i++) {
-                *dst++ = ' ';
-            }
-        } else {
-            *dst++ = *src;
-        }
-        src++;
-    }
-    *dst = '\0';
-}
-
 // XML escape function
 void xml_escape(const char *input, char *output, size_t output_size) {
     const char *src = input;
@@ -91,182 +73,636 @@ void xml_escape_url(const char *input, char *output, size_t output_size) {
     *dst = '\0';
 }
 
-#include <stdint.h>
-
 // UTF-8 character length function
 int utf8_strlen(const char *str) {
-    int len = 0;
-    const uint8_t *p = (const uint8_t *)str;
-    while (*p) {
-        if ((*p & 0xC0) != 0x80) len++;
-        p++;
+    return utf8_count(str, strlen(str));
+}
+
+// Interned color strings; segments store a 16-bit index instead of the string.
+// Names live in fixed-size chunks that never move, so color_name() can read
+// them without the lock while other workers intern new colors.
+#define COLOR_CHUNK_SIZE 256
+static char (*color_chunks[(COLOR_NONE + COLOR_CHUNK_SIZE - 1) / COLOR_CHUNK_SIZE])[MAX_COLOR_LENGTH];
+static uint16_t *color_slots = NULL;
+static size_t color_slot_capacity = 0;
+static size_t color_count = 0;
+static pthread_mutex_t color_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t color_slot(const char *color, size_t mask) {
+    return (size_t)generate_hash(color) & mask;
+}
+
+static const char* color_entry(size_t index) {
+    return color_chunks[index / COLOR_CHUNK_SIZE][index % COLOR_CHUNK_SIZE];
+}
+
+// Rehash every color into a slot array of new_capacity entries
+static int color_slots_grow(size_t new_capacity) {
+    uint16_t *new_slots = malloc(new_capacity * sizeof(uint16_t));
+    if (!new_slots) return -1;
+    memset(new_slots, 0xFF, new_capacity * sizeof(uint16_t));
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < color_count; i++) {
+        size_t slot = color_slot(color_entry(i), mask);
+        while (new_slots[slot] != COLOR_NONE) slot = (slot + 1) & mask;
+        new_slots[slot] = (uint16_t)i;
+    }
+    free(color_slots);
+    color_slots = new_slots;
+    color_slot_capacity = new_capacity;
+    return 0;
+}
+
+static uint16_t intern_color_locked(const char *color) {
+    if (color_slot_capacity > 0) {
+        size_t mask = color_slot_capacity - 1;
+        for (size_t slot = color_slot(color, mask); color_slots[slot] != COLOR_NONE; slot = (slot + 1) & mask) {
+            if (strcmp(color_entry(color_slots[slot]), color) == 0) {
+                return color_slots[slot];
+            }
+        }
+    }
+    
+    if (color_count >= COLOR_NONE) {
+        return strcmp(color, TEXT_COLOR) == 0 ? 0 : intern_color_locked(TEXT_COLOR);
+    }
+    
+    // Keep the slot array at most half full
+    if ((color_count + 1) * 2 > color_slot_capacity &&
+        color_slots_grow(color_slot_capacity ? color_slot_capacity * 2 : 128) != 0) {
+        return color_count > 0 ? 0 : COLOR_NONE;
+    }
+    
+    size_t chunk = color_count / COLOR_CHUNK_SIZE;
+    if (!color_chunks[chunk]) {
+        color_chunks[chunk] = calloc(COLOR_CHUNK_SIZE, MAX_COLOR_LENGTH);
+        if (!color_chunks[chunk]) return color_count > 0 ? 0 : COLOR_NONE;
+    }
+    
+    uint16_t index = (uint16_t)color_count;
+    snprintf(color_chunks[chunk][index % COLOR_CHUNK_SIZE], MAX_COLOR_LENGTH, "%s", color);
+    size_t mask = color_slot_capacity - 1;
+    size_t slot = color_slot(color, mask);
+    while (color_slots[slot] != COLOR_NONE) slot = (slot + 1) & mask;
+    color_slots[slot] = index;
+    __atomic_store_n(&color_count, color_count + 1, __ATOMIC_RELEASE);
+    return index;
+}
+
+// Return the index for a color string, adding it on first use
+uint16_t intern_color(const char *color) {
+    if (!color || color[0] == '\0') return COLOR_NONE;
+    
+    pthread_mutex_lock(&color_mutex);
+    uint16_t index = intern_color_locked(color);
+    pthread_mutex_unlock(&color_mutex);
+    return index;
+}
+
+// Return the color string for an interned index ("" for COLOR_NONE)
+const char* color_name(uint16_t index) {
+    if (index == COLOR_NONE || index >= __atomic_load_n(&color_count, __ATOMIC_ACQUIRE)) return "";
+    return color_entry(index);
+}
+
+// Palette entries and the default text color are interned once and then found
+// by number; slots hold index + 1 so that 0 means "not interned yet"
+static uint16_t palette_slots[256];
+static uint16_t default_color_slot;
+
+static uint16_t cached_color(uint16_t *slot, const char *color) {
+    uint16_t cached = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (cached) return (uint16_t)(cached - 1);
+    uint16_t index = intern_color(color);
+    if (index != COLOR_NONE) __atomic_store_n(slot, (uint16_t)(index + 1), __ATOMIC_RELEASE);
+    return index;
+}
+
+static uint16_t default_text_color(void) {
+    return cached_color(&default_color_slot, TEXT_COLOR);
+}
+
+// Interned index of xterm palette color n (0-255)
+static uint16_t palette_color(int n) {
+    return cached_color(&palette_slots[n], ansi_palette[n]);
+}
+
+// Interned index of a 24-bit color
+static uint16_t truecolor_color(int r, int g, int b) {
+    static const char hex[] = "0123456789abcdef";
+    char color[8];
+    color[0] = '#';
+    color[1] = hex[(r >> 4) & 15];
+    color[2] = hex[r & 15];
+    color[3] = hex[(g >> 4) & 15];
+    color[4] = hex[g & 15];
+    color[5] = hex[(b >> 4) & 15];
+    color[6] = hex[b & 15];
+    color[7] = '\0';
+    return intern_color(color);
+}
+
+void sgr_reset(SgrState *state) {
+    state->fg = default_text_color();
+    state->bg = COLOR_NONE;
+    state->bold = 0;
+}
+
+// Color selected by the parameters after 38/48 (5;n or 2;r;g;b, with ';' or
+// ':' separators, the latter optionally carrying a color space id); advances *i
+// past them and returns COLOR_NONE when they do not name a color
+static uint16_t sgr_extended_color(const int *params, const uint8_t *colon, int count, int *i) {
+    int first = *i + 1;
+    if (first >= count) return COLOR_NONE;
+
+    if (colon[first]) {
+        int end = first;
+        while (end < count && colon[end]) end++;
+        int n = end - first;
+        const int *args = params + first;
+        *i = end - 1;
+        if (args[0] == 5 && n >= 2 && args[1] <= 255) return palette_color(args[1]);
+        if (args[0] == 2 && n >= 4) {
+            const int *rgb = args + (n >= 5 ? 2 : 1);
+            if (rgb[0] <= 255 && rgb[1] <= 255 && rgb[2] <= 255) return truecolor_color(rgb[0], rgb[1], rgb[2]);
+        }
+        return COLOR_NONE;
+    }
+
+    if (params[first] == 5 && first + 1 < count) {
+        *i = first + 1;
+        return params[first + 1] <= 255 ? palette_color(params[first + 1]) : COLOR_NONE;
+    }
+    if (params[first] == 2 && first + 3 < count) {
+        *i = first + 3;
+        const int *rgb = params + first + 1;
+        if (rgb[0] <= 255 && rgb[1] <= 255 && rgb[2] <= 255) return truecolor_color(rgb[0], rgb[1], rgb[2]);
+        return COLOR_NONE;
+    }
+    *i = first;
+    return COLOR_NONE;
+}
+
+// Apply the parameters of one SGR sequence (colon[i] marks a ':' before params[i])
+void sgr_apply(SgrState *state, const int *params, const uint8_t *colon, int count) {
+    for (int i = 0; i < count; i++) {
+        int code = params[i];
+        uint16_t color;
+        
+        if (code == 0) {
+            sgr_reset(state);
+        } else if (code == 1) {
+            state->bold = 1;
+        } else if (code == 22) {
+            state->bold = 0;
+        } else if (code >= 30 && code <= 37) {
+            state->fg = palette_color(code - 30);
+        } else if (code >= 90 && code <= 97) {
+            state->fg = palette_color(code - 90 + 8);
+        } else if (code == 39) {
+            state->fg = default_text_color();
+        } else if (code >= 40 && code <= 47) {
+            state->bg = palette_color(code - 40);
+        } else if (code >= 100 && code <= 107) {
+            state->bg = palette_color(code - 100 + 8);
+        } else if (code == 49) {
+            state->bg = COLOR_NONE;
+        } else if (code == 38 || code == 48) {
+            color = sgr_extended_color(params, colon, count, &i);
+            if (color != COLOR_NONE) {
+                if (code == 38) state->fg = color; else state->bg = color;
+            }
+        }
+    }
+}
+
+// Parse the control sequence after "ESC[" in place and return the first byte
+// past it. SGR sequences (final byte 'm') update state; other sequences
+// (cursor movement, erase, private modes) have no place in a static render and
+// are dropped. A sequence cut off by a byte that cannot belong to it ends there.
+static const char* parse_csi(const char *ptr, const char *end, SgrState *state) {
+    int params[SGR_MAX_PARAMS];
+    uint8_t colon[SGR_MAX_PARAMS];
+    int count = 0;
+    int value = 0;
+    uint8_t value_colon = 0;
+    int plain = 1;
+    
+    while (ptr < end) {
+        unsigned char c = (unsigned char)*ptr;
+        if (c >= '0' && c <= '9') {
+            if (value < 65536) value = value * 10 + (c - '0');
+        } else if (c == ';' || c == ':') {
+            if (count < SGR_MAX_PARAMS) {
+                params[count] = value;
+                colon[count++] = value_colon;
+            }
+            value = 0;
+            value_colon = c == ':';
+        } else if (c >= 0x3C && c <= 0x3F) {
+            plain = 0;   // private parameter marker
+        } else if (c >= 0x20 && c <= 0x2F) {
+            plain = 0;   // intermediate byte
+        } else if (c >= 0x40 && c <= 0x7E) {
+            if (c == 'm' && plain) {
+                if (count < SGR_MAX_PARAMS) {
+                    params[count] = value;
+                    colon[count++] = value_colon;
+                }
+                sgr_apply(state, params, colon, count);
+            }
+            return ptr + 1;
+        } else {
+            return ptr;
+        }
+        ptr++;
+    }
+    return ptr;
+}
+
+void line_arena_init(LineArena *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+void line_arena_free(LineArena *arena) {
+    free(arena->text);
+    free(arena->segments);
+    memset(arena, 0, sizeof(*arena));
+}
+
+// Drop all lines but keep the allocations for reuse
+void line_arena_reset(LineArena *arena) {
+    arena->text_size = 0;
+    arena->segment_count = 0;
+}
+
+// Start a new (empty) line at the end of the arena
+void line_begin(LineData *line_data, LineArena *arena) {
+    line_data->arena = arena;
+    line_data->first_segment = (uint32_t)arena->segment_count;
+    line_data->segment_count = 0;
+    line_data->visible_length = 0;
+}
+
+// Reserve room for length more text bytes (plus NUL) in the arena
+static int line_arena_reserve_text(LineArena *arena, size_t length) {
+    if (arena->text_size + length + 1 <= arena->text_capacity) return 0;
+    
+    size_t new_capacity = arena->text_capacity ? arena->text_capacity : 65536;
+    while (new_capacity < arena->text_size + length + 1) new_capacity *= 2;
+    char *grown = realloc(arena->text, new_capacity);
+    if (!grown) return -1;
+    arena->text = grown;
+    arena->text_capacity = new_capacity;
+    return 0;
+}
+
+// Reserve room for count more segments in the arena
+static int line_arena_reserve_segments(LineArena *arena, size_t count) {
+    if (arena->segment_count + count <= arena->segment_capacity) return 0;
+    
+    size_t new_capacity = arena->segment_capacity ? arena->segment_capacity * 2 : 1024;
+    while (new_capacity < arena->segment_count + count) new_capacity *= 2;
+    TextSegment *grown = realloc(arena->segments, new_capacity * sizeof(TextSegment));
+    if (!grown) return -1;
+    arena->segments = grown;
+    arena->segment_capacity = new_capacity;
+    return 0;
+}
+
+// Append a segment to the line currently being built (the last line in its arena)
+int line_add_segment(LineData *line_data, const char *text, size_t length,
+                     uint16_t fg, uint16_t bg, int bold, int visible_pos) {
+    LineArena *arena = line_data->arena;
+    
+    if (line_arena_reserve_segments(arena, 1) != 0) return -1;
+    if (text && line_arena_reserve_text(arena, length) != 0) return -1;
+    
+    TextSegment *seg = &arena->segments[arena->segment_count++];
+    seg->text_offset = (uint32_t)arena->text_size;
+    seg->text_length = (uint32_t)length;
+    seg->fg = fg;
+    seg->bg = bg;
+    seg->bold = (uint8_t)bold;
+    seg->visible_pos = visible_pos;
+    
+    // text == NULL means the bytes were already written in place at text_size
+    if (text) memcpy(arena->text + arena->text_size, text, length);
+    arena->text[arena->text_size + length] = '\0';
+    arena->text_size += length + 1;
+    line_data->segment_count++;
+    return 0;
+}
+
+// Merge adjacent segments of the line that share fg, bg and bold. Redundant
+// SGR sequences (ESC[0mESC[0m, a color set twice) would otherwise split a run
+// of identically styled text into several <text> elements. Segment text is
+// laid out in ascending order, so each merged run is moved down in place.
+void coalesce_line_segments(LineData *line_data) {
+    LineArena *arena = line_data->arena;
+    int count = line_data->segment_count;
+    if (count < 2) return;
+    
+    TextSegment *segs = arena->segments + line_data->first_segment;
+    int kept = 0;
+    for (int j = 1; j < count; j++) {
+        TextSegment *prev = &segs[kept];
+        const TextSegment *seg = &segs[j];
+        if (seg->fg == prev->fg && seg->bg == prev->bg && seg->bold == prev->bold &&
+            seg->text_offset > prev->text_offset + prev->text_length) {
+            memmove(arena->text + prev->text_offset + prev->text_length,
+                    arena->text + seg->text_offset, seg->text_length);
+            prev->text_length += seg->text_length;
+            arena->text[prev->text_offset + prev->text_length] = '\0';
+        } else {
+            segs[++kept] = *seg;
+        }
+    }
+    
+    if (arena->segment_count == line_data->first_segment + (size_t)count) {
+        arena->segment_count = line_data->first_segment + (size_t)(kept + 1);
+    }
+    line_data->segment_count = kept + 1;
+}
+
+// Cells covered by segment index of a line: positions are in cells, so it is
+// the distance to the next segment (or to the end of the line)
+int segment_cells(const LineData *line, int index) {
+    int end = index + 1 < line->segment_count ? LINE_SEGMENT(line, index + 1)->visible_pos : line->visible_length;
+    return end - LINE_SEGMENT(line, index)->visible_pos;
+}
+
+// Most rows a line can take up when wrapped at width columns: a wide
+// character that does not fit at the end of a row moves to the next one, so
+// a row holds at least width - 1 cells
+int wrap_row_bound(const LineData *line, int width) {
+    if (width <= 0 || line->visible_length <= width) return 1;
+    return line->visible_length / (width > 1 ? width - 1 : 1) + 1;
+}
+
+// Split a line into rows of at most width cells, appended to its arena as
+// lines of their own; rows must hold wrap_row_bound() entries. Returns the
+// number of rows, or -1 when out of memory. Segments already know the cell
+// they start at, so a row boundary lands in a known segment and only that
+// segment's bytes are walked (once, however many boundaries it holds) to find
+// the cut; every row is a slice of the parsed line, never a rescan of the input.
+int wrap_line(const LineData *line, int width, LineData *rows) {
+    if (width <= 0 || line->visible_length <= width) {
+        rows[0] = *line;
+        return 1;
+    }
+    
+    // Reserve everything first so the source segments and text stay put while rows copy from them
+    LineArena *arena = line->arena;
+    int bound = wrap_row_bound(line, width);
+    size_t text_needed = (size_t)line->segment_count + bound;
+    for (int j = 0; j < line->segment_count; j++) {
+        text_needed += LINE_SEGMENT(line, j)->text_length;
+    }
+    if (line_arena_reserve_text(arena, text_needed) != 0 ||
+        line_arena_reserve_segments(arena, (size_t)line->segment_count + bound) != 0) {
+        return -1;
+    }
+    
+    int row = 0;
+    int row_start = 0;
+    line_begin(&rows[0], arena);
+    for (int j = 0; j < line->segment_count; j++) {
+        const TextSegment seg = *LINE_SEGMENT(line, j);
+        const char *text = arena->text + seg.text_offset;
+        int column = seg.visible_pos;
+        size_t offset = 0;
+        
+        while (offset < seg.text_length) {
+            if (column - row_start >= width && row + 1 < bound) {
+                rows[row++].visible_length = column - row_start;
+                line_begin(&rows[row], arena);
+                row_start = column;
+            }
+            int used = column - row_start;
+            size_t cut = seg.text_length;
+            int cells = segment_cells(line, j) - (column - seg.visible_pos);
+            if (used + cells > width && row + 1 < bound) {
+                // Take characters while they fit; zero-width ones stay with the character before
+                cut = offset;
+                cells = 0;
+                while (cut < seg.text_length) {
+                    size_t next = cut;
+                    int w = utf8_next_width(text, seg.text_length, &next);
+                    if (used + cells + w > width && used + cells > 0) break;
+                    cells += w;
+                    cut = next;
+                }
+            }
+            if (cut > offset &&
+                line_add_segment(&rows[row], text + offset, cut - offset, seg.fg, seg.bg, seg.bold, used) != 0) {
+                return -1;
+            }
+            column += cells;
+            offset = cut;
+            if (offset < seg.text_length) {
+                rows[row++].visible_length = column - row_start;
+                line_begin(&rows[row], arena);
+                row_start = column;
+            }
+        }
+    }
+    rows[row].visible_length = line->visible_length - row_start;
+    return row + 1;
+}
+
+// Recompute positions from the segment text. Entries cached by Oh.sh and
+// earlier versions counted characters rather than cells.
+static void recount_line_cells(LineData *line_data) {
+    int position = 0;
+    for (int j = 0; j < line_data->segment_count; j++) {
+        TextSegment *seg = LINE_SEGMENT(line_data, j);
+        seg->visible_pos = position;
+        position += utf8_cells(SEGMENT_TEXT(line_data, seg), seg->text_length);
     }
-    return len;
+    line_data->visible_length = position;
 }
 
-// Parse ANSI line (matching bash logic exactly)
-int parse_ansi_line(const char *line, const char *line_hash, const char *config_hash, LineData *line_data) {
+// Parse ANSI line (matching bash logic exactly). Tabs advance to the next
+// multiple of tab_size and positions count terminal cells, both in the same
+// scan that splits the line into segments. The line is line_length bytes and
+// need not be NUL-terminated (it may be a view into the mapped input).
+// Lines are cached for the render, which counts the lookups, when it gives
+// the line and config hashes; the render's line pack is used when it has
+// one open, the JSON cache otherwise.
+int parse_ansi_line(RenderState *render, const char *line, size_t line_length, const char *line_hash,
+                    const char *config_hash, int tab_size, LineData *line_data) {
+    LineArena *arena = line_data->arena;
+    int cached = render && line_hash && config_hash && strlen(line_hash) > 0 && strlen(config_hash) > 0;
+    
     // Try cache first
-    if (line_hash && config_hash && strlen(line_hash) > 0 && strlen(config_hash) > 0) {
-        char cache_key[MAX_CACHE_KEY_LENGTH];
-        get_cache_key(line_hash, config_hash, cache_key);
+    if (cached) {
+        int cache_loaded;
+        long long lookup_start = STATS_START();
+        line_begin(line_data, arena);
+        if (load_line_memory(line_hash, config_hash, line_data) == 0) {
+            cache_loaded = 0;
+            CACHE_STAT_INC(render->stats.line_memory_hits);
+        } else {
+            if (render->line_pack.fd >= 0) {
+                cache_loaded = load_line_pack(&render->line_pack, line_hash, line_data);
+            } else {
+                char cache_key[MAX_CACHE_KEY_LENGTH];
+                get_cache_key(line_hash, config_hash, cache_key);
+                cache_loaded = load_line_cache(cache_key, line_data);
+            }
+            if (cache_loaded == 0) {
+                save_line_memory(line_hash, config_hash, line_data);
+            }
+        }
+        if (cache_loaded == 0) {
+            CACHE_STAT_INC(render->stats.segment_hits);
+        } else {
+            CACHE_STAT_INC(render->stats.segment_misses);
+        }
+        STATS_STOP(STATS_CACHE_LOOKUP, lookup_start);
         
-        if (load_line_cache(cache_key, line_data) == 0) {
+        if (cache_loaded == 0) {
+            // Entries written before coalescing (or by Oh.sh) may still be split
+            coalesce_line_segments(line_data);
+            if (utf8_count(line, line_length) != (int)line_length) {
+                recount_line_cells(line_data);
+            }
             if (debug_mode) {
                 char msg[256];
-                snprintf(msg, sizeof(msg), "Cache hit for line: %.50s... (loaded %d segments)", 
-                        line, line_data->segment_count);
+                snprintf(msg, sizeof(msg), "Cache hit for line: %.*s... (loaded %d segments)", 
+                        line_length < 50 ? (int)line_length : 50, line, line_data->segment_count);
                 log_output(msg);
                 // Debug: show loaded visible_pos values
                 for (int i = 0; i < line_data->segment_count; i++) {
+                    const TextSegment *seg = LINE_SEGMENT(line_data, i);
                     char debug_msg[512];
                     snprintf(debug_msg, sizeof(debug_msg), "  Loaded segment %d: text='%.20s' visible_pos=%d", 
-                            i, line_data->segments[i].text, line_data->segments[i].visible_pos);
+                            i, SEGMENT_TEXT(line_data, seg), seg->visible_pos);
                     log_output(debug_msg);
                 }
             }
             return 0;
         }
         
+        // Discard anything a failed cache load may have appended
+        arena->segment_count = line_data->first_segment;
+        
         if (debug_mode) {
             char msg[256];
-            snprintf(msg, sizeof(msg), "Cache miss for line: %.50s...", line);
+            snprintf(msg, sizeof(msg), "Cache miss for line: %.*s...", line_length < 50 ? (int)line_length : 50, line);
             log_output(msg);
         }
     }
     
     // Initialize line data
-    line_data->segment_count = 0;
-    line_data->visible_length = 0;
+    line_begin(line_data, arena);
     
     // Current state
-    const char *fg = TEXT_COLOR;
-    const char *bg = "";
-    int bold = 0;
+    SgrState state;
+    sgr_reset(&state);
     int visible_pos = 0;
     
-    // Working variables for current segment
-    char current_text[MAX_LINE_LENGTH] = "";
+    // Text for the current segment accumulates in place at the end of the arena;
+    // each tab becomes at most tab_size spaces
+    size_t text_needed = line_length;
+    for (const char *tab = memchr(line, '\t', line_length); tab; tab = memchr(tab + 1, '\t', line + line_length - tab - 1)) {
+        text_needed += tab_size - 1;
+    }
+    if (line_arena_reserve_text(arena, text_needed) != 0) {
+        return -1;
+    }
+    char *current_text = arena->text + arena->text_size;
     int current_text_pos = 0;
+    int current_cells = 0;
     
     const char *ptr = line;
+    const char *line_end = line + line_length;
     
-    while (*ptr) {
-        if (*ptr == '\033' && *(ptr + 1) == '[') {
-            // Save any accumulated text before processing escape sequence
-            if (current_text_pos > 0 && line_data->segment_count < MAX_SEGMENTS) {
-                current_text[current_text_pos] = '\0';
-                
-                TextSegment *seg = &line_data->segments[line_data->segment_count];
-                strcpy(seg->text, current_text);
-                strcpy(seg->fg_color, fg);
-                strcpy(seg->bg_color, bg);
-                seg->bold = bold;
-                seg->visible_pos = visible_pos;
-                
+    while (ptr < line_end) {
+        if (*ptr == '\033' && ptr + 1 < line_end && ptr[1] == '[') {
+            SgrState previous = state;
+            ptr = parse_csi(ptr + 2, line_end, &state);
+            
+            // Accumulated text becomes a segment only when the style actually changes
+            int changed = state.fg != previous.fg || state.bg != previous.bg || state.bold != previous.bold;
+            if (changed && current_text_pos > 0) {
                 if (debug_mode) {
                     char debug_msg[512];
-                    snprintf(debug_msg, sizeof(debug_msg), "  Created segment %d: text='%.20s' visible_pos=%d", 
-                            line_data->segment_count, current_text, visible_pos);
+                    snprintf(debug_msg, sizeof(debug_msg), "  Created segment %d: text='%.*s' visible_pos=%d", 
+                            line_data->segment_count,
+                            current_text_pos < 20 ? current_text_pos : 20, current_text, visible_pos);
                     log_output(debug_msg);
                 }
                 
-                int char_len = utf8_strlen(current_text);
-                visible_pos += char_len;
-                line_data->segment_count++;
+                if (line_add_segment(line_data, NULL, current_text_pos, previous.fg, previous.bg,
+                                     previous.bold, visible_pos) != 0) {
+                    return -1;
+                }
+                visible_pos += current_cells;
                 
                 // Reset for next segment
+                current_text = arena->text + arena->text_size;
                 current_text_pos = 0;
+                current_cells = 0;
             }
-            
-            // Skip ESC[
-            ptr += 2;
-            
-            // Parse numeric codes
-            char codes[64] = "";
-            int codes_pos = 0;
-            
-            while (*ptr && *ptr != 'm' && codes_pos < (int)sizeof(codes) - 1) {
-                codes[codes_pos++] = *ptr++;
-            }
-            codes[codes_pos] = '\0';
-            
-            // Skip 'm'
-            if (*ptr == 'm') ptr++;
-            
-            // Process codes (handle semicolon-separated values)
-            if (strlen(codes) == 0) {
-                // Empty code means reset (ESC[m)
-                fg = TEXT_COLOR;
-                bg = "";
-                bold = 0;
-            } else {
-                char *code_str = strtok(codes, ";");
-                while (code_str) {
-                    int code = atoi(code_str);
-                    
-                    if (code == 0) {
-                        // Reset all
-                        fg = TEXT_COLOR;
-                        bg = "";
-                        bold = 0;
-                    } else if (code == 1) {
-                        // Bold
-                        bold = 1;
-                    } else if (code >= 30 && code <= 37) {
-                        // Foreground colors
-                        fg = get_ansi_color(code);
-                    } else if (code >= 90 && code <= 97) {
-                        // Bright foreground colors
-                        fg = get_ansi_color(code);
-                    } else if (code >= 40 && code <= 47) {
-                        // Background colors (basic implementation)
-                        bg = get_ansi_color(code - 10);
-                    }
-                    
-                    code_str = strtok(NULL, ";");
-                }
-            }
+        } else if (*ptr == '\t') {
+            int column = visible_pos + current_cells;
+            int spaces = tab_size - column % tab_size;
+            memset(current_text + current_text_pos, ' ', spaces);
+            current_text_pos += spaces;
+            current_cells += spaces;
+            ptr++;
         } else {
-            // Regular character - add to current text
-            if (current_text_pos < MAX_LINE_LENGTH - 1) {
-                current_text[current_text_pos++] = *ptr;
+            // Plain text - copy the whole run up to the next ESC or tab at once,
+            // counting UTF-8 lead bytes in the same vectorized pass. A run that
+            // is not pure ASCII is measured again in cells. An ESC not followed
+            // by '[' is kept as an ordinary character.
+            int run_chars = 0;
+            size_t run = scan_text_run(ptr, line_end - ptr, &run_chars);
+            if (run == 0) {
+                run_chars = 1;
+                run = 1;
+            } else if ((size_t)run_chars != run) {
+                run_chars = utf8_cells(ptr, run);
             }
-            ptr++;
+            memcpy(current_text + current_text_pos, ptr, run);
+            current_text_pos += run;
+            current_cells += run_chars;
+            ptr += run;
         }
     }
     
     // Save any remaining text
-    if (current_text_pos > 0 && line_data->segment_count < MAX_SEGMENTS) {
-        current_text[current_text_pos] = '\0';
-        
-        TextSegment *seg = &line_data->segments[line_data->segment_count];
-        strcpy(seg->text, current_text);
-        strcpy(seg->fg_color, fg);
-        strcpy(seg->bg_color, bg);
-        seg->bold = bold;
-        seg->visible_pos = visible_pos;
-        
+    if (current_text_pos > 0) {
         if (debug_mode) {
             char debug_msg[512];
-            snprintf(debug_msg, sizeof(debug_msg), "  Final segment %d: text='%.20s' visible_pos=%d", 
-                    line_data->segment_count, current_text, visible_pos);
+            snprintf(debug_msg, sizeof(debug_msg), "  Final segment %d: text='%.*s' visible_pos=%d", 
+                    line_data->segment_count,
+                    current_text_pos < 20 ? current_text_pos : 20, current_text, visible_pos);
             log_output(debug_msg);
         }
         
-        int char_len = utf8_strlen(current_text);
-        visible_pos += char_len;
-        line_data->segment_count++;
+        if (line_add_segment(line_data, NULL, current_text_pos, state.fg, state.bg, state.bold, visible_pos) != 0) {
+            return -1;
+        }
+        visible_pos += current_cells;
     }
     
     // Set final visible length
     line_data->visible_length = visible_pos;
+    coalesce_line_segments(line_data);
     
     // Save to cache
-    if (line_hash && config_hash) {
-        char cache_key[MAX_CACHE_KEY_LENGTH];
-        get_cache_key(line_hash, config_hash, cache_key);
-        save_line_cache(cache_key, line_data);
+    if (cached) {
+        save_line_memory(line_hash, config_hash, line_data);
+        if (render->line_pack.fd >= 0) {
+            save_line_pack(&render->line_pack, line_hash, line_data);
+        } else {
+            char cache_key[MAX_CACHE_KEY_LENGTH];
+            get_cache_key(line_hash, config_hash, cache_key);
+            save_line_cache(cache_key, line_data);
+        }
     }
     
     if (debug_mode) {
@@ -0,0 +1,379 @@
+/*
+ * Oh-png.c - PNG output backend (--format png)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * Rasterizes the parsed grid directly, for previews in chat and mail that
+ * show images but not SVG, without writing and re-parsing an SVG first. The
+ * geometry is the SVG's: the same padding, rounded background, cell
+ * positions, background rects and baselines. Glyphs come from the font file
+ * named by --font-file through FreeType, bold ones emboldened from the same
+ * outlines, and are kept in an atlas for the font, size and weight, so each
+ * glyph is rasterized once per process (--batch and --serve included). The
+ * image is RGBA compressed with zlib. Without FreeType and zlib at build
+ * time the backend only reports that it is unavailable.
+ */
+
+#include "Oh.h"
+
+#ifdef OH_PNG
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+#include <zlib.h>
+
+#define PNG_MAX_DIMENSION 32768
+#define ATLAS_INITIAL_SLOTS 1024
+#define ATLAS_INITIAL_PIXELS (256 * 1024)
+#define BACKGROUND_RADIUS 6.0
+
+// A rasterized glyph: its coverage pixels in the atlas and where they go
+// relative to the pen position on the baseline
+typedef struct {
+    uint32_t key;           // codepoint * 2 + bold + 1; 0 marks an empty slot
+    int width;
+    int rows;
+    int left;
+    int top;
+    size_t offset;
+} AtlasGlyph;
+
+// Glyphs of one font file and size, both weights, kept for the process
+typedef struct {
+    char font_file[MAX_PATH_LENGTH];
+    int font_size;
+    FT_Library library;
+    FT_Face face;
+    AtlasGlyph *slots;
+    size_t slot_count;      // a power of two, at most half full
+    size_t glyph_count;
+    unsigned char *pixels;
+    size_t pixels_used;
+    size_t pixels_capacity;
+} GlyphAtlas;
+
+static GlyphAtlas atlas;
+static pthread_mutex_t atlas_mutex = PTHREAD_MUTEX_INITIALIZER;  // renders at once share the atlas
+
+typedef struct {
+    int width;
+    int height;
+    unsigned char *rgba;
+} Canvas;
+
+static void atlas_close(void) {
+    if (atlas.face) FT_Done_Face(atlas.face);
+    if (atlas.library) FT_Done_FreeType(atlas.library);
+    free(atlas.slots);
+    free(atlas.pixels);
+    memset(&atlas, 0, sizeof(atlas));
+}
+
+// Open the font for this size, keeping the atlas when it already holds it
+static int atlas_open(const Config *config) {
+    if (atlas.face && atlas.font_size == config->font_size && strcmp(atlas.font_file, config->font_file) == 0) {
+        return 0;
+    }
+    atlas_close();
+    atlas.slots = calloc(ATLAS_INITIAL_SLOTS, sizeof(AtlasGlyph));
+    atlas.pixels = malloc(ATLAS_INITIAL_PIXELS);
+    if (!atlas.slots || !atlas.pixels) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        atlas_close();
+        return -1;
+    }
+    atlas.slot_count = ATLAS_INITIAL_SLOTS;
+    atlas.pixels_capacity = ATLAS_INITIAL_PIXELS;
+    if (FT_Init_FreeType(&atlas.library) != 0 ||
+        FT_New_Face(atlas.library, config->font_file, 0, &atlas.face) != 0 ||
+        FT_Set_Pixel_Sizes(atlas.face, 0, config->font_size) != 0) {
+        fprintf(stderr, "Error: Cannot load font file '%s'\n", config->font_file);
+        atlas_close();
+        return -1;
+    }
+    snprintf(atlas.font_file, sizeof(atlas.font_file), "%s", config->font_file);
+    atlas.font_size = config->font_size;
+    return 0;
+}
+
+static AtlasGlyph* atlas_slot(AtlasGlyph *slots, size_t slot_count, uint32_t key) {
+    size_t slot = (key * 2654435761u) & (slot_count - 1);
+    while (slots[slot].key != 0 && slots[slot].key != key) slot = (slot + 1) & (slot_count - 1);
+    return &slots[slot];
+}
+
+static int atlas_grow(void) {
+    size_t new_count = atlas.slot_count * 2;
+    AtlasGlyph *slots = calloc(new_count, sizeof(AtlasGlyph));
+    if (!slots) return -1;
+    for (size_t s = 0; s < atlas.slot_count; s++) {
+        if (atlas.slots[s].key != 0) *atlas_slot(slots, new_count, atlas.slots[s].key) = atlas.slots[s];
+    }
+    free(atlas.slots);
+    atlas.slots = slots;
+    atlas.slot_count = new_count;
+    return 0;
+}
+
+// Find a glyph, rasterizing it on first use; a glyph the font cannot draw
+// is kept empty so it is not tried again. Returns NULL when out of memory.
+static const AtlasGlyph* atlas_glyph(uint32_t codepoint, int bold, size_t *rasterized) {
+    uint32_t key = codepoint * 2 + (bold ? 1 : 0) + 1;
+    AtlasGlyph *glyph = atlas_slot(atlas.slots, atlas.slot_count, key);
+    if (glyph->key == key) return glyph;
+    if ((atlas.glyph_count + 1) * 2 > atlas.slot_count) {
+        if (atlas_grow() != 0) return NULL;
+        glyph = atlas_slot(atlas.slots, atlas.slot_count, key);
+    }
+
+    AtlasGlyph entry = { key, 0, 0, 0, 0, 0 };
+    FT_GlyphSlot slot = atlas.face->glyph;
+    if (FT_Load_Char(atlas.face, codepoint, FT_LOAD_NO_BITMAP) == 0) {
+        if (bold && slot->format == FT_GLYPH_FORMAT_OUTLINE) {
+            FT_Outline_Embolden(&slot->outline, atlas.face->size->metrics.x_ppem * 64 / 24);
+        }
+        if (FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) == 0) {
+            const FT_Bitmap *bitmap = &slot->bitmap;
+            size_t size = (size_t)bitmap->width * bitmap->rows;
+            if (atlas.pixels_used + size > atlas.pixels_capacity) {
+                size_t new_capacity = atlas.pixels_capacity * 2;
+                while (new_capacity < atlas.pixels_used + size) new_capacity *= 2;
+                unsigned char *pixels = realloc(atlas.pixels, new_capacity);
+                if (!pixels) return NULL;
+                atlas.pixels = pixels;
+                atlas.pixels_capacity = new_capacity;
+            }
+            for (unsigned int y = 0; y < bitmap->rows; y++) {
+                memcpy(atlas.pixels + atlas.pixels_used + (size_t)y * bitmap->width,
+                       bitmap->buffer + (ptrdiff_t)y * bitmap->pitch, bitmap->width);
+            }
+            entry.width = (int)bitmap->width;
+            entry.rows = (int)bitmap->rows;
+            entry.left = slot->bitmap_left;
+            entry.top = slot->bitmap_top;
+            entry.offset = atlas.pixels_used;
+            atlas.pixels_used += size;
+        }
+    }
+    *glyph = entry;
+    atlas.glyph_count++;
+    (*rasterized)++;
+    return glyph;
+}
+
+static void parse_color(const char *name, unsigned char rgb[3]) {
+    unsigned int r = 255, g = 255, b = 255;
+    if (name[0] != '#' || sscanf(name + 1, "%2x%2x%2x", &r, &g, &b) != 3) {
+        sscanf(TEXT_COLOR + 1, "%2x%2x%2x", &r, &g, &b);
+    }
+    rgb[0] = (unsigned char)r;
+    rgb[1] = (unsigned char)g;
+    rgb[2] = (unsigned char)b;
+}
+
+// The document background with its rounded corners antialiased
+static void canvas_fill_background(Canvas *canvas) {
+    unsigned char rgb[3];
+    parse_color(BG_COLOR, rgb);
+    for (int y = 0; y < canvas->height; y++) {
+        unsigned char *pixel = canvas->rgba + (size_t)y * canvas->width * 4;
+        for (int x = 0; x < canvas->width; x++, pixel += 4) {
+            double cx = x + 0.5 < BACKGROUND_RADIUS ? BACKGROUND_RADIUS :
+                        x + 0.5 > canvas->width - BACKGROUND_RADIUS ? canvas->width - BACKGROUND_RADIUS : x + 0.5;
+            double cy = y + 0.5 < BACKGROUND_RADIUS ? BACKGROUND_RADIUS :
+                        y + 0.5 > canvas->height - BACKGROUND_RADIUS ? canvas->height - BACKGROUND_RADIUS : y + 0.5;
+            // Inside a corner square the edge is the arc around (cx, cy)
+            double coverage = BACKGROUND_RADIUS + 0.5 - hypot(x + 0.5 - cx, y + 0.5 - cy);
+            pixel[0] = rgb[0];
+            pixel[1] = rgb[1];
+            pixel[2] = rgb[2];
+            pixel[3] = (unsigned char)(255 * (coverage < 0 ? 0 : coverage > 1 ? 1 : coverage));
+        }
+    }
+}
+
+static void canvas_fill_rect(Canvas *canvas, double x0, double y0, double x1, double y1, const unsigned char rgb[3]) {
+    int left = (int)floor(x0 + 0.5);
+    int top = (int)floor(y0 + 0.5);
+    int right = (int)floor(x1 + 0.5);
+    int bottom = (int)floor(y1 + 0.5);
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (right > canvas->width) right = canvas->width;
+    if (bottom > canvas->height) bottom = canvas->height;
+    for (int y = top; y < bottom; y++) {
+        unsigned char *pixel = canvas->rgba + ((size_t)y * canvas->width + left) * 4;
+        for (int x = left; x < right; x++, pixel += 4) {
+            pixel[0] = rgb[0];
+            pixel[1] = rgb[1];
+            pixel[2] = rgb[2];
+        }
+    }
+}
+
+// Blend a glyph's coverage in the text color onto the canvas, pen at (x, baseline)
+static void canvas_draw_glyph(Canvas *canvas, const AtlasGlyph *glyph, int x, int baseline, const unsigned char rgb[3]) {
+    for (int gy = 0; gy < glyph->rows; gy++) {
+        int y = baseline - glyph->top + gy;
+        if (y < 0 || y >= canvas->height) continue;
+        const unsigned char *coverage = atlas.pixels + glyph->offset + (size_t)gy * glyph->width;
+        for (int gx = 0; gx < glyph->width; gx++) {
+            int px = x + glyph->left + gx;
+            if (px < 0 || px >= canvas->width || coverage[gx] == 0) continue;
+            unsigned char *pixel = canvas->rgba + ((size_t)y * canvas->width + px) * 4;
+            for (int c = 0; c < 3; c++) {
+                pixel[c] = (unsigned char)(pixel[c] + ((rgb[c] - pixel[c]) * coverage[gx] + 127) / 255);
+            }
+        }
+    }
+}
+
+// Draw one row: background rects as in the SVG (font size + 2px from 2px
+// below the top of the em box), then each character at its cell
+static int draw_row(Canvas *canvas, const Config *config, const BackendGrid *grid, int row, size_t *rasterized) {
+    const LineData *line = &grid->rows[row];
+    double baseline = DEFAULT_PADDING + config->font_size + (row * config->font_height);
+    double top = DEFAULT_PADDING + 2 + (row * config->font_height);
+    for (int j = 0; j < line->segment_count; j++) {
+        const TextSegment *seg = LINE_SEGMENT(line, j);
+        if (seg->bg == COLOR_NONE || seg->text_length == 0) continue;
+        unsigned char rgb[3];
+        parse_color(color_name(seg->bg), rgb);
+        double x = DEFAULT_PADDING + (seg->visible_pos * grid->cell_width);
+        canvas_fill_rect(canvas, x, top, x + segment_cells(line, j) * grid->cell_width,
+                         top + config->font_size + 2, rgb);
+    }
+
+    for (int j = 0; j < line->segment_count; j++) {
+        const TextSegment *seg = LINE_SEGMENT(line, j);
+        const char *text = SEGMENT_TEXT(line, seg);
+        unsigned char rgb[3];
+        parse_color(seg->fg == COLOR_NONE ? TEXT_COLOR : color_name(seg->fg), rgb);
+        int cell = seg->visible_pos;
+        int previous = cell;
+        size_t i = 0;
+        while (i < seg->text_length) {
+            uint32_t codepoint = utf8_next_codepoint(text, seg->text_length, &i);
+            int width = codepoint ? codepoint_width(codepoint) : 1;
+            // Zero-width characters combine with the cell before them
+            int at = width == 0 ? previous : cell;
+            if (codepoint > ' ') {
+                const AtlasGlyph *glyph = atlas_glyph(codepoint, seg->bold, rasterized);
+                if (!glyph) return -1;
+                canvas_draw_glyph(canvas, glyph, (int)floor(DEFAULT_PADDING + at * grid->cell_width + 0.5),
+                                  (int)floor(baseline + 0.5), rgb);
+            }
+            if (width > 0) {
+                previous = cell;
+                cell += width;
+            }
+        }
+    }
+    return 0;
+}
+
+static void png_chunk(OutputWriter *writer, const char *type, const unsigned char *data, size_t length) {
+    unsigned char header[8] = {
+        (unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length,
+        (unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3]
+    };
+    uLong crc = crc32(0, header + 4, 4);
+    if (length > 0) crc = crc32(crc, data, (uInt)length);
+    unsigned char trailer[4] = {
+        (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc
+    };
+    writer_write(writer, (const char *)header, sizeof(header));
+    if (length > 0) writer_write(writer, (const char *)data, length);
+    writer_write(writer, (const char *)trailer, sizeof(trailer));
+}
+
+// Encode the canvas as an 8-bit RGBA PNG, every scanline unfiltered
+static int png_write(OutputWriter *writer, const Canvas *canvas) {
+    size_t stride = (size_t)canvas->width * 4 + 1;
+    size_t raw_size = stride * canvas->height;
+    unsigned char *raw = malloc(raw_size);
+    uLongf packed_size = compressBound((uLong)raw_size);
+    unsigned char *packed = malloc(packed_size);
+    int result = -1;
+    if (raw && packed) {
+        for (int y = 0; y < canvas->height; y++) {
+            raw[y * stride] = 0;
+            memcpy(raw + y * stride + 1, canvas->rgba + (size_t)y * canvas->width * 4, stride - 1);
+        }
+        if (compress2(packed, &packed_size, raw, (uLong)raw_size, 6) == Z_OK) {
+            unsigned char ihdr[13] = {
+                (unsigned char)(canvas->width >> 24), (unsigned char)(canvas->width >> 16),
+                (unsigned char)(canvas->width >> 8), (unsigned char)canvas->width,
+                (unsigned char)(canvas->height >> 24), (unsigned char)(canvas->height >> 16),
+                (unsigned char)(canvas->height >> 8), (unsigned char)canvas->height,
+                8, 6, 0, 0, 0
+            };
+            writer_write(writer, "\x89PNG\r\n\x1a\n", 8);
+            png_chunk(writer, "IHDR", ihdr, sizeof(ihdr));
+            png_chunk(writer, "IDAT", packed, packed_size);
+            png_chunk(writer, "IEND", NULL, 0);
+            result = writer->error ? -1 : 0;
+        }
+    }
+    free(raw);
+    free(packed);
+    return result;
+}
+
+int png_render(const Config *config, const BackendGrid *grid, OutputWriter *writer) {
+    char msg[256];
+    if (strlen(config->font_file) == 0) {
+        fprintf(stderr, "Error: PNG output requires --font-file with a TrueType or OpenType font\n");
+        return -1;
+    }
+    Canvas canvas = { (int)ceil(grid->width), (int)ceil(grid->height), NULL };
+    if (canvas.width > PNG_MAX_DIMENSION || canvas.height > PNG_MAX_DIMENSION) {
+        fprintf(stderr, "Error: A %dx%d pixel PNG is larger than %d pixels a side; limit the rows with --height\n",
+                canvas.width, canvas.height, PNG_MAX_DIMENSION);
+        return -1;
+    }
+    canvas.rgba = malloc((size_t)canvas.width * canvas.height * 4);
+    if (!canvas.rgba) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+
+    canvas_fill_background(&canvas);
+    pthread_mutex_lock(&atlas_mutex);
+    if (atlas_open(config) != 0) {
+        pthread_mutex_unlock(&atlas_mutex);
+        free(canvas.rgba);
+        return -1;
+    }
+    size_t rasterized = 0;
+    int result = 0;
+    for (int r = 0; r < grid->row_count && result == 0; r++) {
+        result = draw_row(&canvas, config, grid, r, &rasterized);
+    }
+    size_t glyph_count = atlas.glyph_count;
+    pthread_mutex_unlock(&atlas_mutex);
+    if (result == 0) {
+        result = png_write(writer, &canvas);
+    }
+    if (result != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+    free(canvas.rgba);
+
+    snprintf(msg, sizeof(msg), "PNG: %dx%d pixels, %zu glyphs in the atlas (%zu rasterized for this image)",
+             canvas.width, canvas.height, glyph_count, rasterized);
+    progress_output(msg);
+    return result;
+}
+
+#else
+
+int png_render(const Config *config, const BackendGrid *grid, OutputWriter *writer) {
+    (void)config;
+    (void)grid;
+    (void)writer;
+    fprintf(stderr, "Error: PNG output is unavailable: Oh was built without FreeType and zlib\n");
+    return -1;
+}
+
+#endif // OH_PNG
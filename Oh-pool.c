@@ -0,0 +1,135 @@
+/*
+ * Oh-pool.c - Worker thread pool
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * pool_run() hands out task indices to the pool threads and to the calling
+ * thread (worker 0) until all are done, then returns. A pool of one thread
+ * runs everything inline on the caller, and so does a pool already running
+ * another caller's job: renders on several threads at once each keep their
+ * own per-worker state, so the one that finds the threads taken works alone.
+ */
+
+#include "Oh.h"
+
+ThreadPool *worker_pool = NULL;
+
+static void *pool_worker(void *arg) {
+    ThreadPoolWorker *self = (ThreadPoolWorker *)arg;
+    ThreadPool *pool = self->pool;
+    unsigned int seen_generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+        }
+        if (pool->shutdown) break;
+        seen_generation = pool->generation;
+
+        while (pool->next_task < pool->task_count) {
+            int task = pool->next_task++;
+            pthread_mutex_unlock(&pool->mutex);
+            pool->task(pool->context, task, self->index);
+            pthread_mutex_lock(&pool->mutex);
+        }
+        if (--pool->active == 0) {
+            pthread_cond_broadcast(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+// Create a pool with thread_count workers in total (including the caller)
+ThreadPool* pool_create(int thread_count) {
+    if (thread_count < 1) thread_count = 1;
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->thread_count = thread_count;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    if (thread_count > 1) {
+        pool->workers = calloc(thread_count, sizeof(ThreadPoolWorker));
+        if (!pool->workers) {
+            pool_destroy(pool);
+            return NULL;
+        }
+        for (int i = 1; i < thread_count; i++) {
+            pool->workers[i].pool = pool;
+            pool->workers[i].index = i;
+            if (pthread_create(&pool->workers[i].thread, NULL, pool_worker, &pool->workers[i]) != 0) {
+                pool->thread_count = i;
+                break;
+            }
+        }
+    }
+    return pool;
+}
+
+// Run task(context, 0..task_count-1, worker) across the pool and wait for completion
+void pool_run(ThreadPool *pool, PoolTask task, void *context, int task_count) {
+    if (!pool || pool->thread_count <= 1 || task_count <= 1) {
+        for (int i = 0; i < task_count; i++) {
+            task(context, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->busy) {
+        pthread_mutex_unlock(&pool->mutex);
+        for (int i = 0; i < task_count; i++) {
+            task(context, i, 0);
+        }
+        return;
+    }
+    pool->busy = 1;
+    pool->task = task;
+    pool->context = context;
+    pool->task_count = task_count;
+    pool->next_task = 0;
+    pool->active = pool->thread_count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    // The calling thread works as worker 0
+    while (pool->next_task < pool->task_count) {
+        int next = pool->next_task++;
+        pthread_mutex_unlock(&pool->mutex);
+        task(context, next, 0);
+        pthread_mutex_lock(&pool->mutex);
+    }
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pool->busy = 0;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void pool_destroy(ThreadPool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (pool->workers) {
+        for (int i = 1; i < pool->thread_count; i++) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+        free(pool->workers);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool);
+}
+
+// Number of workers callers should size per-worker state for
+int pool_size(const ThreadPool *pool) {
+    return pool ? pool->thread_count : 1;
+}
@@ -0,0 +1,336 @@
+/*
+ * Oh-render.c - SVG rendering module
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ */
+
+#include "Oh.h"
+
+// Grid width in characters (auto-detected, capped at 100 to match bash version;
+// wrapped rows always fit the requested width)
+int get_grid_width(const Config *config, int max_width) {
+    if (!config->wrap && config->width == 80 && max_width > 80) {
+        return max_width > 100 ? 100 : max_width;
+    }
+    return config->width;
+}
+
+// Format the width/height/viewBox attributes of the root <svg> element; a
+// height of 0 (a stream to a pipe, whose length is not known) leaves the
+// height and viewBox out
+int format_svg_dimensions(char *output, size_t output_size, double svg_width, double svg_height) {
+    if (svg_height <= 0) {
+        return snprintf(output, output_size, "width=\"%.2f\"", svg_width);
+    }
+    return snprintf(output, output_size, "width=\"%.2f\" height=\"%.2f\" viewBox=\"0 0 %.2f %.2f\"",
+                    svg_width, svg_height, svg_width, svg_height);
+}
+
+// CSS class for a text style: 'c', the color's hex digits, and 'b' when bold.
+// Names depend only on the style, never on intern order, so cached and reused
+// rows stay valid in later documents. Returns 0 for the default style, which
+// needs no class beyond terminal-text.
+int style_class_name(uint16_t fg, int bold, char *class_out) {
+    const char *color = color_name(fg);
+    size_t length = 0;
+
+    if (!bold && strcmp(color, TEXT_COLOR) == 0) {
+        class_out[0] = '\0';
+        return 0;
+    }
+    class_out[length++] = 'c';
+    for (; *color && length < STYLE_CLASS_LENGTH - 2; color++) {
+        if (isalnum((unsigned char)*color)) class_out[length++] = (char)tolower((unsigned char)*color);
+    }
+    if (bold) class_out[length++] = 'b';
+    class_out[length] = '\0';
+    return (int)length;
+}
+
+// Record the styles a row uses
+void palette_mark_line(StylePalette *palette, const LineData *line) {
+    for (int j = 0; j < line->segment_count; j++) {
+        const TextSegment *seg = LINE_SEGMENT(line, j);
+        if (seg->text_length == 0 || seg->fg == COLOR_NONE) continue;
+
+        size_t slot = (size_t)seg->fg * 2 + (seg->bold ? 1 : 0);
+        if (slot >= palette->capacity) {
+            size_t new_capacity = palette->capacity ? palette->capacity : 64;
+            while (new_capacity <= slot) new_capacity *= 2;
+            uint8_t *grown = realloc(palette->used, new_capacity);
+            if (!grown) continue;
+            memset(grown + palette->capacity, 0, new_capacity - palette->capacity);
+            palette->used = grown;
+            palette->capacity = new_capacity;
+        }
+        palette->used[slot] = 1;
+    }
+}
+
+typedef struct {
+    char name[STYLE_CLASS_LENGTH];
+    uint16_t fg;
+    int bold;
+} StyleRule;
+
+static int compare_style_rule(const void *a, const void *b) {
+    return strcmp(((const StyleRule *)a)->name, ((const StyleRule *)b)->name);
+}
+
+// Write one rule per style in use, setting the color through property (fill
+// for SVG text, color for HTML), sorted by class name so the output does not
+// depend on the order workers interned the colors in
+int palette_write_rules(OutputWriter *writer, const StylePalette *palette, const char *property) {
+    StyleRule *rules = NULL;
+    size_t count = 0;
+
+    if (palette && palette->capacity > 0) {
+        rules = malloc(palette->capacity * sizeof(StyleRule));
+        if (!rules) return -1;
+        for (size_t slot = 0; slot < palette->capacity; slot++) {
+            if (!palette->used[slot]) continue;
+            rules[count].fg = (uint16_t)(slot / 2);
+            rules[count].bold = (int)(slot % 2);
+            if (style_class_name(rules[count].fg, rules[count].bold, rules[count].name) > 0) count++;
+        }
+        qsort(rules, count, sizeof(StyleRule), compare_style_rule);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        writer_printf(writer, " .%s { %s: %s;%s }", rules[i].name, property, color_name(rules[i].fg),
+                      rules[i].bold ? " font-weight: bold;" : "");
+    }
+    free(rules);
+    return writer->error ? -1 : 0;
+}
+
+int palette_write_css(OutputWriter *writer, const StylePalette *palette) {
+    return palette_write_rules(writer, palette, "fill");
+}
+
+void palette_free(StylePalette *palette) {
+    free(palette->used);
+    palette->used = NULL;
+    palette->capacity = 0;
+}
+
+// Write the SVG prologue, root element, styles and background.
+// When reserve > 0 the dimension attributes are padded with spaces to exactly
+// reserve bytes so they can be patched in place later; the offset of that
+// region (relative to the writer's first byte) is returned through dims_offset.
+// The palette's style classes go in the same <style> block; pass NULL when the
+// styles are not known yet (stream mode writes them at the end instead).
+int write_svg_header(OutputWriter *writer, const Config *config, double svg_width, double svg_height,
+                     size_t reserve, size_t *dims_offset, const StylePalette *palette) {
+    char font_css[1024];
+    char dimensions[SVG_DIMENSIONS_RESERVE + 1];
+
+    build_font_css(config, font_css, sizeof(font_css));
+    int length = format_svg_dimensions(dimensions, sizeof(dimensions), svg_width, svg_height);
+    if (reserve > 0) {
+        if (reserve > SVG_DIMENSIONS_RESERVE || length < 0 || (size_t)length > reserve) return -1;
+        memset(dimensions + length, ' ', reserve - length);
+        dimensions[reserve] = '\0';
+    }
+
+    writer_puts(writer,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" ");
+    if (dims_offset) *dims_offset = writer->bytes_written;
+    writer_puts(writer, dimensions);
+    // Rows leave the font size and default color to CSS, and name any other style by class
+    writer_puts(writer, ">\n  <defs><style type=\"text/css\">");
+    if (config->font_faces) {
+        writer_puts(writer, config->font_faces);
+        writer_puts(writer, " ");
+    }
+    writer_printf(writer, "%s .terminal-text { font-size: %dpx; fill: %s; }",
+                  font_css, config->font_size, TEXT_COLOR);
+    palette_write_css(writer, palette);
+    writer_printf(writer,
+        "</style></defs>\n"
+        "  <rect width=\"100%%\" height=\"100%%\" fill=\"%s\" rx=\"6\"/>\n",
+        BG_COLOR);
+
+    return writer->error ? -1 : 0;
+}
+
+void background_begin(BackgroundLayer *layer, const Config *config, double cell_width, int vertical, OutputWriter *out) {
+    memset(layer, 0, sizeof(*layer));
+    layer->config = config;
+    layer->cell_width = cell_width;
+    layer->vertical = vertical;
+    layer->out = out;
+}
+
+// Same geometry as Oh.sh's per-segment rects (font size + 2px, starting 2px
+// below the top of the em box); a rect covering several rows also fills the
+// gaps between them
+static void background_write_rect(BackgroundLayer *layer, const BackgroundSpan *span) {
+    const Config *config = layer->config;
+    double top = DEFAULT_PADDING + 2 + (span->first_row * config->font_height);
+    double height = (span->last_row - span->first_row) * config->font_height + config->font_size + 2;
+
+    writer_printf(layer->out, "  <rect x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\" fill=\"%s\"/>\n",
+                  DEFAULT_PADDING + (span->start * layer->cell_width), top,
+                  (span->end - span->start) * layer->cell_width, height, color_name(span->bg));
+    layer->rects++;
+}
+
+static int background_reserve(BackgroundLayer *layer, int needed) {
+    if (needed <= layer->capacity) return 0;
+    int new_capacity = layer->capacity ? layer->capacity : 64;
+    while (new_capacity < needed) new_capacity *= 2;
+    BackgroundSpan *open = realloc(layer->open, new_capacity * sizeof(BackgroundSpan));
+    if (!open) return -1;
+    layer->open = open;
+    BackgroundSpan *row = realloc(layer->row, new_capacity * sizeof(BackgroundSpan));
+    if (!row) return -1;
+    layer->row = row;
+    layer->capacity = new_capacity;
+    return 0;
+}
+
+// Add a row's background cells. Spans still open from the previous row are
+// extended when this row has the same span, and written out otherwise.
+int background_add_row(BackgroundLayer *layer, const LineData *line, int row) {
+    layer->row_count = 0;
+    for (int j = 0; j < line->segment_count; j++) {
+        const TextSegment *seg = LINE_SEGMENT(line, j);
+        if (seg->bg == COLOR_NONE || seg->text_length == 0) continue;
+
+        int start = seg->visible_pos;
+        int end = start + segment_cells(line, j);
+        BackgroundSpan *last = layer->row_count > 0 ? &layer->row[layer->row_count - 1] : NULL;
+        if (last && last->bg == seg->bg && last->end == start) {
+            last->end = end;
+            continue;
+        }
+        if (background_reserve(layer, layer->row_count + 1) != 0) return -1;
+        BackgroundSpan *span = &layer->row[layer->row_count++];
+        span->start = start;
+        span->end = end;
+        span->bg = seg->bg;
+        span->first_row = row;
+        span->last_row = row;
+    }
+
+    // Both lists are ordered by start column; match them pairwise
+    int o = 0;
+    for (int k = 0; k < layer->row_count; k++) {
+        BackgroundSpan *span = &layer->row[k];
+        while (o < layer->open_count && layer->open[o].start < span->start) {
+            background_write_rect(layer, &layer->open[o++]);
+        }
+        if (o < layer->open_count && layer->open[o].start == span->start && layer->open[o].end == span->end &&
+            layer->open[o].bg == span->bg && layer->open[o].last_row == row - 1) {
+            span->first_row = layer->open[o++].first_row;
+        }
+    }
+    while (o < layer->open_count) {
+        background_write_rect(layer, &layer->open[o++]);
+    }
+
+    BackgroundSpan *swap = layer->open;
+    layer->open = layer->row;
+    layer->row = swap;
+    layer->open_count = layer->row_count;
+    layer->row_count = 0;
+
+    if (!layer->vertical) {
+        for (int k = 0; k < layer->open_count; k++) background_write_rect(layer, &layer->open[k]);
+        layer->open_count = 0;
+    }
+    return layer->out->error ? -1 : 0;
+}
+
+// Write the spans still open and release the layer; returns -1 on a write error
+int background_end(BackgroundLayer *layer) {
+    for (int k = 0; k < layer->open_count; k++) {
+        background_write_rect(layer, &layer->open[k]);
+    }
+    free(layer->open);
+    free(layer->row);
+    layer->open = NULL;
+    layer->row = NULL;
+    layer->open_count = 0;
+    layer->capacity = 0;
+    return layer->out->error ? -1 : 0;
+}
+
+// --compact: one <text> per row stretched over the row's cells, with a <tspan>
+// per styled run. Default-styled runs are bare text inheriting the CSS fill;
+// monospace glyphs scale uniformly, so runs still land on their cells.
+static int render_line_compact(OutputWriter *writer, const LineData *line, double y_offset, double cell_width) {
+    int first = -1;
+    int last = -1;
+    for (int j = 0; j < line->segment_count; j++) {
+        if (LINE_SEGMENT(line, j)->text_length > 0) {
+            if (first < 0) first = j;
+            last = j;
+        }
+    }
+    if (first < 0) return 0;
+
+    const TextSegment *start = LINE_SEGMENT(line, first);
+    int cells = LINE_SEGMENT(line, last)->visible_pos + segment_cells(line, last) - start->visible_pos;
+
+    writer_printf(writer,
+        "  <text x=\"%.2f\" y=\"%.2f\" class=\"terminal-text\" xml:space=\"preserve\" textLength=\"%.2f\" lengthAdjust=\"spacingAndGlyphs\">",
+        DEFAULT_PADDING + (start->visible_pos * cell_width), y_offset, cells * cell_width);
+    for (int j = first; j <= last; j++) {
+        const TextSegment *seg = LINE_SEGMENT(line, j);
+        char style_class[STYLE_CLASS_LENGTH];
+        if (seg->text_length == 0) continue;
+        int styled = style_class_name(seg->fg, seg->bold, style_class) > 0;
+        if (styled) {
+            writer_printf(writer, "<tspan class=\"%s\">", style_class);
+        }
+        writer_write_escaped(writer, SEGMENT_TEXT(line, seg), seg->text_length, NULL, NULL);
+        if (styled) {
+            writer_puts(writer, "</tspan>");
+        }
+    }
+    writer_puts(writer, "</text>\n");
+
+    return writer->error ? -1 : 0;
+}
+
+// Write the <text> elements for one row
+int render_line_svg(OutputWriter *writer, const Config *config, const LineData *line, int row, double cell_width) {
+    double y_offset = DEFAULT_PADDING + config->font_size + (row * config->font_height);
+
+    if (config->compact) {
+        return render_line_compact(writer, line, y_offset, cell_width);
+    }
+
+    for (int j = 0; j < line->segment_count; j++) {
+        const TextSegment *seg = LINE_SEGMENT(line, j);
+        const char *seg_text = SEGMENT_TEXT(line, seg);
+
+        if (seg->text_length > 0) {
+            // Use cell_width for proper positioning (matches bash version); the
+            // segment's cell count comes from the positions, so the text is
+            // escaped straight into the writer after the start tag
+            double current_x = DEFAULT_PADDING + (seg->visible_pos * cell_width);
+            double text_width = segment_cells(line, j) * cell_width;
+
+            if (debug_mode) {
+                char debug_msg[512];
+                snprintf(debug_msg, sizeof(debug_msg), "  SVG segment: text='%s' visible_pos=%d current_x=%.2f cell_width=%.2f",
+                        seg_text, seg->visible_pos, current_x, cell_width);
+                log_output(debug_msg);
+            }
+
+            char style_class[STYLE_CLASS_LENGTH];
+            int styled = style_class_name(seg->fg, seg->bold, style_class) > 0;
+            writer_printf(writer,
+                "  <text x=\"%.2f\" y=\"%.2f\" class=\"terminal-text%s%s\" xml:space=\"preserve\" textLength=\"%.2f\" lengthAdjust=\"spacingAndGlyphs\">",
+                current_x, y_offset, styled ? " " : "", style_class, text_width);
+            writer_write_escaped(writer, seg_text, seg->text_length, NULL, NULL);
+            writer_puts(writer, "</text>\n");
+        }
+    }
+
+    return writer->error ? -1 : 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * Oh-serve.c - Render server (--serve) and its client (--connect)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * The server listens on a Unix socket and keeps parsed lines and rendered
+ * fragments in in-memory LRU caches across requests, so callers converting
+ * many small outputs pay for process startup and cold caches only once.
+ * A request is one line of options, quoted the way a shell would, followed
+ * by the ANSI input up to end of stream. The reply is "OK <bytes>\n" and the
+ * SVG, or "ERROR <message>\n". Each connection thread reads, renders
+ * (render_resident in Oh-lib.c, on the thread's own RenderState) and
+ * replies to its requests, so up to SERVE_CONNECTION_THREADS requests are
+ * rendered at once. One of them at a time spreads its lines across the
+ * worker pool; the others render on their connection thread alone.
+ */
+
+#include "Oh.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVE_TIMEOUT_SECONDS 30
+#define SERVE_MAX_REQUEST ((size_t)MAX_LINES * MAX_LINE_LENGTH)
+
+typedef struct {
+    int listen_fd;
+    long requests;
+} ServeState;
+
+static int fill_unix_address(struct sockaddr_un *address, const char *path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", path);
+        return -1;
+    }
+    snprintf(address->sun_path, sizeof(address->sun_path), "%s", path);
+    return 0;
+}
+
+static int send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return -1;
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return -1;
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+// Read fd to end of stream into a NUL-terminated buffer of at most limit bytes
+static char* read_to_end(int fd, size_t limit, size_t *length) {
+    size_t capacity = 64 * 1024;
+    size_t used = 0;
+    char *buffer = malloc(capacity + 1);
+    if (!buffer) return NULL;
+
+    for (;;) {
+        if (used == capacity) {
+            if (capacity >= limit) {
+                free(buffer);
+                return NULL;
+            }
+            capacity = capacity * 2 > limit ? limit : capacity * 2;
+            char *grown = realloc(buffer, capacity + 1);
+            if (!grown) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+        }
+        ssize_t got = read(fd, buffer + used, capacity - used);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            free(buffer);
+            return NULL;
+        }
+        if (got == 0) break;
+        used += (size_t)got;
+    }
+    buffer[used] = '\0';
+    *length = used;
+    return buffer;
+}
+
+static void send_error(int fd, const char *message) {
+    char reply[512];
+    int length = snprintf(reply, sizeof(reply), "ERROR %s\n", message);
+    if (length > 0) send_all(fd, reply, (size_t)length < sizeof(reply) ? (size_t)length : sizeof(reply) - 1);
+}
+
+// Render one request's input into writer; returns the lines it had, or -1
+static int render_request(ServeState *state, RenderState *render, const Config *config,
+                          const char *body, size_t body_length, OutputWriter *writer, char *error, size_t error_size) {
+    RenderSummary summary;
+    if (render_resident(render, config, body, body_length, writer, &summary, error, error_size) != 0) {
+        return -1;
+    }
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Request %ld: %d lines, %zu bytes; segments %d/%d, fragments %d/%d cached",
+             __atomic_add_fetch(&state->requests, 1, __ATOMIC_RELAXED), summary.lines, writer->length,
+             summary.segment_hits, summary.segment_hits + summary.segment_misses,
+             summary.fragment_hits, summary.fragment_hits + summary.fragment_misses);
+    status_output(msg);
+    return summary.lines;
+}
+
+static void handle_connection(ServeState *state, RenderState *render, int fd) {
+    char error[256];
+    size_t request_length = 0;
+    char *request = read_to_end(fd, SERVE_MAX_REQUEST + MAX_LINE_LENGTH, &request_length);
+    if (!request) {
+        send_error(fd, "request unreadable or too large");
+        return;
+    }
+
+    char *body = memchr(request, '\n', request_length);
+    if (!body || body - request >= MAX_LINE_LENGTH) {
+        send_error(fd, "missing options line");
+        free(request);
+        return;
+    }
+    *body++ = '\0';
+    size_t body_length = request_length - (size_t)(body - request);
+
+    Config config;
+    if (parse_render_options(request, &config, error, sizeof(error)) != 0) {
+        send_error(fd, error);
+        free(request);
+        return;
+    }
+    if (body_length == 0) {
+        send_error(fd, "no input");
+        free(request);
+        return;
+    }
+
+    OutputWriter writer;
+    if (writer_open_memory(&writer) != 0) {
+        send_error(fd, "out of memory");
+        free(request);
+        return;
+    }
+    if (render_request(state, render, &config, body, body_length, &writer, error, sizeof(error)) < 0) {
+        send_error(fd, error);
+    } else {
+        char header[64];
+        int length = snprintf(header, sizeof(header), "OK %zu\n", writer.length);
+        if (send_all(fd, header, (size_t)length) != 0 || send_all(fd, writer.buffer, writer.length) != 0) {
+            if (debug_mode) {
+                log_output("Serve: client went away before the reply was sent");
+            }
+        }
+    }
+    writer_close(&writer);
+    free(request);
+}
+
+static void* connection_thread(void *arg) {
+    ServeState *state = (ServeState *)arg;
+    RenderState render;
+    render_state_init(&render);
+    for (;;) {
+        int fd = accept(state->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;  // listening socket shut down
+        }
+        struct timeval timeout = { SERVE_TIMEOUT_SECONDS, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        handle_connection(state, &render, fd);
+        close(fd);
+    }
+    render_state_free(&render);
+    return NULL;
+}
+
+// Serve render requests on config->serve_socket until SIGINT or SIGTERM.
+// The caller blocks both signals before starting any thread.
+int serve_svg(Config *config) {
+    struct sockaddr_un address;
+    char msg[768];
+
+    if (fill_unix_address(&address, config->serve_socket) != 0) return -1;
+
+    // A socket left by a server that did not shut down is replaced; any
+    // other file at the path, or a socket a server still answers on, is not
+    struct stat st;
+    if (lstat(config->serve_socket, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "Error: Cannot listen on '%s': path exists and is not a socket\n", config->serve_socket);
+            return -1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            fprintf(stderr, "Error: Cannot listen on '%s': a server is already listening there\n", config->serve_socket);
+            return -1;
+        }
+        unlink(config->serve_socket);
+    }
+
+    if (memory_caches_create(config->memory_cache_mb, 1) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+
+    ServeState state;
+    memset(&state, 0, sizeof(state));
+
+    state.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (state.listen_fd < 0 ||
+        bind(state.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(state.listen_fd, 64) != 0) {
+        fprintf(stderr, "Error: Cannot listen on '%s': %s\n", config->serve_socket, strerror(errno));
+        if (state.listen_fd >= 0) close(state.listen_fd);
+        memory_caches_destroy();
+        return -1;
+    }
+
+    snprintf(msg, sizeof(msg), "Serving on %.500s (%d connection threads, %d render workers, %d MB memory cache)",
+             config->serve_socket, SERVE_CONNECTION_THREADS, pool_size(worker_pool), config->memory_cache_mb);
+    progress_output(msg);
+    resident_mode = 1;
+
+    pthread_t threads[SERVE_CONNECTION_THREADS];
+    int started = 0;
+    while (started < SERVE_CONNECTION_THREADS &&
+           pthread_create(&threads[started], NULL, connection_thread, &state) == 0) {
+        started++;
+    }
+
+    int stop_signal = 0;
+    if (started > 0) {
+        sigset_t stop_signals;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        sigwait(&stop_signals, &stop_signal);
+    }
+
+    // Wake the connection threads out of accept(); requests in flight finish first
+    shutdown(state.listen_fd, SHUT_RDWR);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    close(state.listen_fd);
+    unlink(config->serve_socket);
+    resident_mode = 0;
+
+    snprintf(msg, sizeof(msg), "Server stopped after %ld requests (line cache %zu entries, %ld evictions; fragment cache %zu entries, %ld evictions)",
+             state.requests, line_memory->entry_count, line_memory->evictions,
+             fragment_memory->entry_count, fragment_memory->evictions);
+    progress_output(msg);
+
+    memory_caches_destroy();
+    return started > 0 ? 0 : -1;
+}
+
+// Append argument to an options line, quoting it if it has spaces or quotes
+static int append_option(char *line, size_t line_size, const char *argument) {
+    const char *quote = "";
+    if (strpbrk(argument, " \t'\"") || argument[0] == '\0') {
+        if (!strchr(argument, '\'')) {
+            quote = "'";
+        } else if (!strchr(argument, '"')) {
+            quote = "\"";
+        } else {
+            return -1;
+        }
+    }
+    size_t used = strlen(line);
+    int written = snprintf(line + used, line_size - used, "%s%s%s%s", used ? " " : "", quote, argument, quote);
+    return written < 0 || (size_t)written >= line_size - used ? -1 : 0;
+}
+
+// Send this invocation's rendering options and input to a server and write
+// the SVG it returns to the output file or stdout
+int connect_svg(const Config *config, int argc, char **argv) {
+    struct sockaddr_un address;
+    char options[MAX_LINE_LENGTH] = "";
+    char msg[768];
+
+    if (fill_unix_address(&address, config->connect_socket) != 0) return -1;
+
+    // Everything but the options that only make sense to this process is forwarded
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--connect") == 0 || strcmp(arg, "-i") == 0 || strcmp(arg, "--input") == 0 ||
+            strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0 || strcmp(arg, "-j") == 0 ||
+            strcmp(arg, "--jobs") == 0 || strcmp(arg, "--memory-cache") == 0 ||
+            strcmp(arg, "--cache-format") == 0 || strcmp(arg, "--stats") == 0) {
+            i++;
+            continue;
+        }
+        if (strcmp(arg, "--debug") == 0 || strcmp(arg, "--stream") == 0 ||
+            strncmp(arg, "--cache-format=", 15) == 0 || strncmp(arg, "--stats=", 8) == 0) {
+            continue;
+        }
+        if (append_option(options, sizeof(options), arg) != 0) {
+            fprintf(stderr, "Error: Cannot forward option '%s' to the server\n", arg);
+            return -1;
+        }
+    }
+
+    // The server has no output file to pick a format from, so name the one -o implies
+    if (config->format == FORMAT_AUTO && output_backend(config)->render &&
+        (append_option(options, sizeof(options), "--format") != 0 ||
+         append_option(options, sizeof(options), output_backend(config)->name) != 0)) {
+        fprintf(stderr, "Error: Cannot forward option '--format' to the server\n");
+        return -1;
+    }
+
+    int input_fd = STDIN_FILENO;
+    if (strlen(config->input_file) > 0) {
+        input_fd = open(config->input_file, O_RDONLY);
+        if (input_fd < 0) {
+            fprintf(stderr, "Error: Input file '%s' not found\n", config->input_file);
+            return -1;
+        }
+    }
+    size_t input_length = 0;
+    long long read_start = STATS_START();
+    char *input = read_to_end(input_fd, SERVE_MAX_REQUEST, &input_length);
+    STATS_STOP(STATS_READ, read_start);
+    STATS_ADD_BYTES(stats_bytes_in, input_length);
+    if (input_fd != STDIN_FILENO) close(input_fd);
+    if (!input) {
+        fprintf(stderr, "Error: Cannot read input\n");
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error: Cannot connect to '%s': %s\n", config->connect_socket, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(input);
+        return -1;
+    }
+
+    size_t options_length = strlen(options);
+    options[options_length] = '\n';
+    int sent = send_all(fd, options, options_length + 1) == 0 && send_all(fd, input, input_length) == 0;
+    free(input);
+    shutdown(fd, SHUT_WR);
+
+    size_t reply_length = 0;
+    char *reply = sent ? read_to_end(fd, (size_t)-1 / 2, &reply_length) : NULL;
+    close(fd);
+    if (!reply) {
+        fprintf(stderr, "Error: No reply from server at '%s'\n", config->connect_socket);
+        return -1;
+    }
+
+    char *svg = memchr(reply, '\n', reply_length);
+    size_t svg_length = 0;
+    if (!svg || strncmp(reply, "OK ", 3) != 0) {
+        if (svg) *svg = '\0';
+        fprintf(stderr, "Error: Server: %s\n", strncmp(reply, "ERROR ", 6) == 0 ? reply + 6 : "malformed reply");
+        free(reply);
+        return -1;
+    }
+    svg++;
+    svg_length = (size_t)strtoull(reply + 3, NULL, 10);
+    if (svg_length != reply_length - (size_t)(svg - reply)) {
+        fprintf(stderr, "Error: Server reply was cut short\n");
+        free(reply);
+        return -1;
+    }
+
+    int output_fd = STDOUT_FILENO;
+    if (strlen(config->output_file) > 0) {
+        output_fd = open(config->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd < 0) {
+            fprintf(stderr, "Error: Cannot create output file '%s'\n", config->output_file);
+            free(reply);
+            return -1;
+        }
+    }
+    long long write_start = STATS_START();
+    int result = write_all(output_fd, svg, svg_length);
+    STATS_STOP(STATS_WRITE, write_start);
+    STATS_ADD_BYTES(stats_bytes_out, svg_length);
+    if (output_fd != STDOUT_FILENO) close(output_fd);
+    free(reply);
+    if (result != 0) {
+        fprintf(stderr, "Error: Failed to write SVG output\n");
+        return -1;
+    }
+
+    snprintf(msg, sizeof(msg), "Rendered by server at %.500s: %zu bytes", config->connect_socket, svg_length);
+    progress_output(msg);
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Oh-simd.c - Vectorized text scanning
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * One pass over a run of bytes finds the next stop byte (ESC or tab for the
+ * parser, one of &<>"' for the XML escaper) and counts UTF-8 lead bytes (visible
+ * characters) before it. The widest kernel the CPU supports is
+ * chosen once at runtime: AVX2 or SSE2 on x86-64, NEON on AArch64, and a
+ * scalar loop everywhere else.
+ */
+
+#include "Oh.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define OH_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define OH_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define ESC_BYTE 0x1B
+#define TAB_BYTE 0x09
+
+// What a kernel stops at
+#define SCAN_STOP_NONE   0
+#define SCAN_STOP_ESCAPE 1
+#define SCAN_STOP_MARKUP 2
+
+typedef size_t (*ScanTextKernel)(const unsigned char *text, size_t length, int stop, int *chars);
+
+static int is_markup_byte(unsigned char c) {
+    return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+}
+
+// Reference kernel; also handles the tails of the vector kernels
+static size_t scan_kernel_scalar(const unsigned char *text, size_t length, int stop, int *chars) {
+    size_t i = 0;
+    int count = 0;
+    for (; i < length; i++) {
+        if (stop == SCAN_STOP_ESCAPE && (text[i] == ESC_BYTE || text[i] == TAB_BYTE)) break;
+        if (stop == SCAN_STOP_MARKUP && is_markup_byte(text[i])) break;
+        if ((text[i] & 0xC0) != 0x80) count++;
+    }
+    *chars += count;
+    return i;
+}
+
+#ifdef OH_SIMD_X86
+static inline __m128i sse2_stop_mask(__m128i bytes, int stop) {
+    if (stop == SCAN_STOP_ESCAPE) {
+        return _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ESC_BYTE)), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(TAB_BYTE)));
+    }
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('&')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('<')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('>')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')));
+    return _mm_or_si128(hit, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\'')));
+}
+
+// As signed bytes, continuation bytes 0x80-0xBF are exactly those <= -65
+static size_t scan_kernel_sse2(const unsigned char *text, size_t length, int stop, int *chars) {
+    const __m128i continuation_max = _mm_set1_epi8(-65);
+    size_t i = 0;
+    int count = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(text + i));
+        unsigned int lead = (unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, continuation_max));
+        unsigned int hit = stop != SCAN_STOP_NONE ? (unsigned int)_mm_movemask_epi8(sse2_stop_mask(bytes, stop)) : 0;
+        if (hit) {
+            unsigned int offset = (unsigned int)__builtin_ctz(hit);
+            *chars += count + __builtin_popcount(lead & ((1u << offset) - 1));
+            return i + offset;
+        }
+        count += __builtin_popcount(lead);
+    }
+
+    i += scan_kernel_scalar(text + i, length - i, stop, &count);
+    *chars += count;
+    return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_stop_mask(__m256i bytes, int stop) {
+    if (stop == SCAN_STOP_ESCAPE) {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(ESC_BYTE)),
+                               _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(TAB_BYTE)));
+    }
+    __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('&')),
+                                  _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('<')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('>')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"')));
+    return _mm256_or_si256(hit, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\'')));
+}
+
+__attribute__((target("avx2")))
+static size_t scan_kernel_avx2(const unsigned char *text, size_t length, int stop, int *chars) {
+    const __m256i continuation_max = _mm256_set1_epi8(-65);
+    size_t i = 0;
+    int count = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(text + i));
+        uint32_t lead = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(bytes, continuation_max));
+        uint32_t hit = stop != SCAN_STOP_NONE ? (uint32_t)_mm256_movemask_epi8(avx2_stop_mask(bytes, stop)) : 0;
+        if (hit) {
+            unsigned int offset = (unsigned int)__builtin_ctz(hit);
+            *chars += count + __builtin_popcount(lead & ((1u << offset) - 1));
+            return i + offset;
+        }
+        count += __builtin_popcount(lead);
+    }
+
+    i += scan_kernel_sse2(text + i, length - i, stop, &count);
+    *chars += count;
+    return i;
+}
+#endif
+
+#ifdef OH_SIMD_NEON
+// Narrow a byte mask to 4 bits per byte (NEON has no movemask)
+static inline uint64_t neon_nibble_mask(uint8x16_t mask) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(mask), 4)), 0);
+}
+
+static inline uint8x16_t neon_stop_mask(uint8x16_t bytes, int stop) {
+    if (stop == SCAN_STOP_ESCAPE) {
+        return vorrq_u8(vceqq_u8(bytes, vdupq_n_u8(ESC_BYTE)), vceqq_u8(bytes, vdupq_n_u8(TAB_BYTE)));
+    }
+    uint8x16_t hit = vorrq_u8(vceqq_u8(bytes, vdupq_n_u8('&')), vceqq_u8(bytes, vdupq_n_u8('<')));
+    hit = vorrq_u8(hit, vceqq_u8(bytes, vdupq_n_u8('>')));
+    hit = vorrq_u8(hit, vceqq_u8(bytes, vdupq_n_u8('"')));
+    return vorrq_u8(hit, vceqq_u8(bytes, vdupq_n_u8('\'')));
+}
+
+static size_t scan_kernel_neon(const unsigned char *text, size_t length, int stop, int *chars) {
+    const int8x16_t continuation_max = vdupq_n_s8(-65);
+    size_t i = 0;
+    int count = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t bytes = vld1q_u8(text + i);
+        uint64_t lead = neon_nibble_mask(vcgtq_s8(vreinterpretq_s8_u8(bytes), continuation_max));
+        uint64_t hit = stop != SCAN_STOP_NONE ? neon_nibble_mask(neon_stop_mask(bytes, stop)) : 0;
+        if (hit) {
+            unsigned int offset = (unsigned int)__builtin_ctzll(hit) / 4;
+            *chars += count + __builtin_popcountll(lead & ((1ull << (offset * 4)) - 1)) / 4;
+            return i + offset;
+        }
+        count += __builtin_popcountll(lead) / 4;
+    }
+
+    i += scan_kernel_scalar(text + i, length - i, stop, &count);
+    *chars += count;
+    return i;
+}
+#endif
+
+static ScanTextKernel scan_kernel = scan_kernel_scalar;
+static const char *scan_kernel_name = "scalar";
+static pthread_once_t scan_kernel_once = PTHREAD_ONCE_INIT;
+
+static void scan_kernel_select(void) {
+#ifdef OH_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_kernel = scan_kernel_avx2;
+        scan_kernel_name = "avx2";
+    } else {
+        scan_kernel = scan_kernel_sse2;
+        scan_kernel_name = "sse2";
+    }
+#elif defined(OH_SIMD_NEON)
+    scan_kernel = scan_kernel_neon;
+    scan_kernel_name = "neon";
+#endif
+}
+
+// Bytes before the first ESC or tab in text[0..length); their visible characters are added to *chars
+size_t scan_text_run(const char *text, size_t length, int *chars) {
+    pthread_once(&scan_kernel_once, scan_kernel_select);
+    return scan_kernel((const unsigned char *)text, length, SCAN_STOP_ESCAPE, chars);
+}
+
+// Scalar reference for scan_text_run (used by the benchmark harness)
+size_t scan_text_run_scalar(const char *text, size_t length, int *chars) {
+    return scan_kernel_scalar((const unsigned char *)text, length, SCAN_STOP_ESCAPE, chars);
+}
+
+// XML-escape text[0..length) into output, which must hold XML_ESCAPE_MAX(length)
+// bytes. Clean runs are found by the vector kernel and copied in bulk; returns
+// the escaped length and adds the visible characters to *chars.
+static size_t xml_escape_with(ScanTextKernel kernel, char *output, const char *text, size_t length, int *chars) {
+    const unsigned char *input = (const unsigned char *)text;
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < length) {
+        size_t run = kernel(input + in, length - in, SCAN_STOP_MARKUP, chars);
+        memcpy(output + out, input + in, run);
+        in += run;
+        out += run;
+        if (in == length) break;
+
+        const char *entity;
+        size_t entity_length;
+        switch (input[in]) {
+            case '&': entity = "&amp;"; entity_length = 5; break;
+            case '<': entity = "&lt;"; entity_length = 4; break;
+            case '>': entity = "&gt;"; entity_length = 4; break;
+            case '"': entity = "&quot;"; entity_length = 6; break;
+            default: entity = "&apos;"; entity_length = 6; break;
+        }
+        memcpy(output + out, entity, entity_length);
+        out += entity_length;
+        in++;
+        (*chars)++;
+    }
+    return out;
+}
+
+size_t xml_escape_run(char *output, const char *text, size_t length, int *chars) {
+    pthread_once(&scan_kernel_once, scan_kernel_select);
+    return xml_escape_with(scan_kernel, output, text, length, chars);
+}
+
+// Scalar reference for xml_escape_run (used by the benchmark harness)
+size_t xml_escape_run_scalar(char *output, const char *text, size_t length, int *chars) {
+    return xml_escape_with(scan_kernel_scalar, output, text, length, chars);
+}
+
+// Number of UTF-8 characters in text[0..length)
+int utf8_count(const char *text, size_t length) {
+    int chars = 0;
+    pthread_once(&scan_kernel_once, scan_kernel_select);
+    scan_kernel((const unsigned char *)text, length, SCAN_STOP_NONE, &chars);
+    return chars;
+}
+
+// Name of the kernel selected for this CPU
+const char* scan_text_backend(void) {
+    pthread_once(&scan_kernel_once, scan_kernel_select);
+    return scan_kernel_name;
+}
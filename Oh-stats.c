@@ -0,0 +1,162 @@
+/*
+ * Oh-stats.c - Per-stage timings and counters (--stats=json)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * With --stats=json, or OH_STATS_FILE naming a file, a run times each
+ * pipeline stage on the monotonic clock and counts bytes in and out, lines,
+ * rows and segments, and cache hits by tier; when the process finishes it
+ * reports them with its peak RSS as one JSON object. Stage times are wall
+ * time on the thread running the stage, except cache_lookup, which sums the
+ * lookups of every worker and is contained in parse and render. Output
+ * flushed while a stage runs counts as validate and write, not as the stage.
+ * Counters of a process rendering many documents (--batch, --serve) are
+ * totals over all of them.
+ */
+
+#include "Oh.h"
+#include <sys/resource.h>
+
+int stats_enabled = 0;
+long long stats_bytes_in = 0;
+long long stats_bytes_out = 0;
+static long long stats_stage_ns[STATS_STAGES];
+static const char *stats_stage_names[STATS_STAGES] = {
+    "read", "hash", "cache_lookup", "parse", "render", "validate", "write"
+};
+
+// Totals over every document rendered, folded in from the cache counters
+typedef struct {
+    long long documents;
+    long long lines;
+    long long rows;
+    long long segments;
+    long long line_memory_hits;
+    long long line_hits;
+    long long line_misses;
+    long long fragment_memory_hits;
+    long long fragment_hits;
+    long long fragment_misses;
+    long long rows_reused;
+} StatsTotals;
+
+static StatsTotals stats_totals;
+static pthread_mutex_t stats_totals_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+long long stats_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Charge the time since start_ns to a stage (any thread)
+void stats_add_time(int stage, long long start_ns) {
+    __atomic_fetch_add(&stats_stage_ns[stage], stats_clock_ns() - start_ns, __ATOMIC_RELAXED);
+}
+
+// Validate and write time so far, for stages that flush output as they go
+long long stats_output_ns(void) {
+    return __atomic_load_n(&stats_stage_ns[STATS_VALIDATE], __ATOMIC_RELAXED) +
+           __atomic_load_n(&stats_stage_ns[STATS_WRITE], __ATOMIC_RELAXED);
+}
+
+// Fold one finished document, and its render's cache lookups when it had
+// any, into the totals (renders finish on several threads at once)
+void stats_add_document(const CacheCounters *counters, int lines, int rows, long long segments) {
+    if (!stats_enabled) return;
+    pthread_mutex_lock(&stats_totals_mutex);
+    stats_totals.documents++;
+    stats_totals.lines += lines;
+    stats_totals.rows += rows;
+    stats_totals.segments += segments;
+    if (counters) {
+        stats_totals.line_memory_hits += counters->line_memory_hits;
+        stats_totals.line_hits += counters->segment_hits;
+        stats_totals.line_misses += counters->segment_misses;
+        stats_totals.fragment_memory_hits += counters->fragment_memory_hits;
+        stats_totals.fragment_hits += counters->svg_hits;
+        stats_totals.fragment_misses += counters->svg_misses;
+        stats_totals.rows_reused += counters->rows_reused;
+    }
+    pthread_mutex_unlock(&stats_totals_mutex);
+}
+
+static json_t* stats_tier(const char *memory_name, long long memory_hits,
+                          const char *disk_name, long long disk_hits, long long misses) {
+    json_t *tier = json_object();
+    long long lookups = memory_hits + disk_hits + misses;
+    json_object_set_new(tier, memory_name, json_integer(memory_hits));
+    json_object_set_new(tier, disk_name, json_integer(disk_hits));
+    json_object_set_new(tier, "misses", json_integer(misses));
+    json_object_set_new(tier, "hit_rate", json_real(lookups > 0 ? (double)(memory_hits + disk_hits) / lookups : 0.0));
+    return tier;
+}
+
+static json_t* stats_document(int status) {
+    const StatsTotals *t = &stats_totals;
+    json_t *root = json_object();
+    json_object_set_new(root, "version", json_string(SCRIPT_VERSION));
+    json_object_set_new(root, "status", json_string(status == 0 ? "ok" : "error"));
+    json_object_set_new(root, "documents", json_integer(t->documents));
+    json_object_set_new(root, "lines", json_integer(t->lines));
+    json_object_set_new(root, "rows", json_integer(t->rows));
+    json_object_set_new(root, "segments", json_integer(t->segments));
+    json_object_set_new(root, "segments_per_line", json_real(t->lines > 0 ? (double)t->segments / t->lines : 0.0));
+    json_object_set_new(root, "bytes_in", json_integer(stats_bytes_in));
+    json_object_set_new(root, "bytes_out", json_integer(stats_bytes_out));
+
+    json_t *seconds = json_object();
+    json_object_set_new(seconds, "total", json_real(get_current_time() - script_start_time));
+    for (int s = 0; s < STATS_STAGES; s++) {
+        json_object_set_new(seconds, stats_stage_names[s], json_real(stats_stage_ns[s] / 1e9));
+    }
+    json_object_set_new(root, "seconds", seconds);
+
+    // Lines come from memory, else the disk cache (JSON files or pack); a
+    // run's fragments come from memory (--batch, --serve) or the pack
+    json_t *cache = json_object();
+    json_object_set_new(cache, "lines", stats_tier("memory_hits", t->line_memory_hits,
+                                                   "disk_hits", t->line_hits - t->line_memory_hits, t->line_misses));
+    json_object_set_new(cache, "fragments", stats_tier("memory_hits", t->fragment_memory_hits,
+                                                       "pack_hits", t->fragment_hits - t->fragment_memory_hits,
+                                                       t->fragment_misses));
+    json_object_set_new(cache, "rows_reused", json_integer(t->rows_reused));
+    json_object_set_new(root, "cache", cache);
+
+    struct rusage usage;
+    long long peak_rss = getrusage(RUSAGE_SELF, &usage) == 0 ? (long long)usage.ru_maxrss * 1024 : 0;
+    json_object_set_new(root, "peak_rss_bytes", json_integer(peak_rss));
+    return root;
+}
+
+// Report the run as one line of JSON on stderr (--stats=json) and/or into
+// OH_STATS_FILE, replaced atomically so a scraper never reads half of it
+int stats_report(const Config *config, int status) {
+    if (!stats_enabled) return 0;
+
+    json_t *root = stats_document(status);
+    char *text = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    if (!text) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+
+    int result = 0;
+    if (config->stats == STATS_JSON) {
+        fprintf(stderr, "%s\n", text);
+    }
+    if (strlen(config->stats_file) > 0) {
+        char temp_path[MAX_PATH_LENGTH + 32];
+        snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", config->stats_file, (long)getpid());
+        FILE *file = fopen(temp_path, "w");
+        int written = file && fprintf(file, "%s\n", text) >= 0;
+        if (file && fclose(file) != 0) written = 0;
+        if (!written || rename(temp_path, config->stats_file) != 0) {
+            if (file) unlink(temp_path);
+            fprintf(stderr, "Error: Cannot write statistics to '%s'\n", config->stats_file);
+            result = -1;
+        }
+    }
+    free(text);
+    return result;
+}
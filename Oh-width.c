@@ -0,0 +1,230 @@
+/*
+ * Oh-width.c - Terminal cell widths
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * How many grid cells a character covers, the way wcwidth() counts them:
+ * East Asian wide and fullwidth characters and emoji take two cells,
+ * combining marks and other zero-width characters none, everything else one.
+ * Widths are looked up in a two-level table built once from the range lists
+ * below: the high bits of a codepoint pick a 256-entry block, identical
+ * blocks are stored once, and each entry packs a width into two bits.
+ */
+
+#include "Oh.h"
+
+#define WIDTH_BLOCK_BITS 8
+#define WIDTH_BLOCK_SIZE (1 << WIDTH_BLOCK_BITS)
+#define WIDTH_MAX_CODEPOINT 0x110000
+#define WIDTH_BLOCK_COUNT (WIDTH_MAX_CODEPOINT >> WIDTH_BLOCK_BITS)
+#define WIDTH_MAX_BLOCKS 512
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} CodepointRange;
+
+// East Asian Wide (W) and Fullwidth (F) characters, including emoji presentation
+static const CodepointRange wide_ranges[] = {
+    { 0x1100, 0x115F }, { 0x231A, 0x231B }, { 0x2329, 0x232A }, { 0x23E9, 0x23EC },
+    { 0x23F0, 0x23F0 }, { 0x23F3, 0x23F3 }, { 0x25FD, 0x25FE }, { 0x2614, 0x2615 },
+    { 0x2648, 0x2653 }, { 0x267F, 0x267F }, { 0x2693, 0x2693 }, { 0x26A1, 0x26A1 },
+    { 0x26AA, 0x26AB }, { 0x26BD, 0x26BE }, { 0x26C4, 0x26C5 }, { 0x26CE, 0x26CE },
+    { 0x26D4, 0x26D4 }, { 0x26EA, 0x26EA }, { 0x26F2, 0x26F3 }, { 0x26F5, 0x26F5 },
+    { 0x26FA, 0x26FA }, { 0x26FD, 0x26FD }, { 0x2705, 0x2705 }, { 0x270A, 0x270B },
+    { 0x2728, 0x2728 }, { 0x274C, 0x274C }, { 0x274E, 0x274E }, { 0x2753, 0x2755 },
+    { 0x2757, 0x2757 }, { 0x2795, 0x2797 }, { 0x27B0, 0x27B0 }, { 0x27BF, 0x27BF },
+    { 0x2B1B, 0x2B1C }, { 0x2B50, 0x2B50 }, { 0x2B55, 0x2B55 }, { 0x2E80, 0x303E },
+    { 0x3041, 0x33FF }, { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF },
+    { 0xA960, 0xA97F }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 },
+    { 0xFE30, 0xFE6F }, { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x16FE0, 0x16FE4 },
+    { 0x17000, 0x18AFF }, { 0x1B000, 0x1B2FF }, { 0x1F004, 0x1F004 }, { 0x1F0CF, 0x1F0CF },
+    { 0x1F18E, 0x1F18E }, { 0x1F191, 0x1F19A }, { 0x1F200, 0x1F202 }, { 0x1F210, 0x1F23B },
+    { 0x1F240, 0x1F248 }, { 0x1F250, 0x1F251 }, { 0x1F260, 0x1F265 }, { 0x1F300, 0x1F320 },
+    { 0x1F32D, 0x1F335 }, { 0x1F337, 0x1F37C }, { 0x1F37E, 0x1F393 }, { 0x1F3A0, 0x1F3CA },
+    { 0x1F3CF, 0x1F3D3 }, { 0x1F3E0, 0x1F3F0 }, { 0x1F3F4, 0x1F3F4 }, { 0x1F3F8, 0x1F43E },
+    { 0x1F440, 0x1F440 }, { 0x1F442, 0x1F4FC }, { 0x1F4FF, 0x1F53D }, { 0x1F54B, 0x1F54E },
+    { 0x1F550, 0x1F567 }, { 0x1F57A, 0x1F57A }, { 0x1F595, 0x1F596 }, { 0x1F5A4, 0x1F5A4 },
+    { 0x1F5FB, 0x1F64F }, { 0x1F680, 0x1F6C5 }, { 0x1F6CC, 0x1F6CC }, { 0x1F6D0, 0x1F6D2 },
+    { 0x1F6D5, 0x1F6D7 }, { 0x1F6EB, 0x1F6EC }, { 0x1F6F4, 0x1F6FC }, { 0x1F7E0, 0x1F7EB },
+    { 0x1F90C, 0x1F93A }, { 0x1F93C, 0x1F945 }, { 0x1F947, 0x1F9FF }, { 0x1FA70, 0x1FAFF },
+    { 0x20000, 0x2FFFD }, { 0x30000, 0x3FFFD },
+};
+
+// Combining marks, format characters and Hangul medial/final jamo (applied after wide_ranges)
+static const CodepointRange zero_ranges[] = {
+    { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD }, { 0x05BF, 0x05BF },
+    { 0x05C1, 0x05C2 }, { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0610, 0x061A },
+    { 0x064B, 0x065F }, { 0x0670, 0x0670 }, { 0x06D6, 0x06DC }, { 0x06DF, 0x06E4 },
+    { 0x06E7, 0x06E8 }, { 0x06EA, 0x06ED }, { 0x0711, 0x0711 }, { 0x0730, 0x074A },
+    { 0x07A6, 0x07B0 }, { 0x07EB, 0x07F3 }, { 0x0816, 0x0819 }, { 0x081B, 0x0823 },
+    { 0x0825, 0x0827 }, { 0x0829, 0x082D }, { 0x0859, 0x085B }, { 0x08D3, 0x08E1 },
+    { 0x08E3, 0x0902 }, { 0x093A, 0x093A }, { 0x093C, 0x093C }, { 0x0941, 0x0948 },
+    { 0x094D, 0x094D }, { 0x0951, 0x0957 }, { 0x0962, 0x0963 }, { 0x0981, 0x0981 },
+    { 0x09BC, 0x09BC }, { 0x09C1, 0x09C4 }, { 0x09CD, 0x09CD }, { 0x09E2, 0x09E3 },
+    { 0x0A01, 0x0A02 }, { 0x0A3C, 0x0A3C }, { 0x0A41, 0x0A42 }, { 0x0A47, 0x0A48 },
+    { 0x0A4B, 0x0A4D }, { 0x0A51, 0x0A51 }, { 0x0A70, 0x0A71 }, { 0x0A75, 0x0A75 },
+    { 0x0A81, 0x0A82 }, { 0x0ABC, 0x0ABC }, { 0x0AC1, 0x0AC5 }, { 0x0AC7, 0x0AC8 },
+    { 0x0ACD, 0x0ACD }, { 0x0B01, 0x0B01 }, { 0x0B3C, 0x0B3C }, { 0x0B3F, 0x0B3F },
+    { 0x0B41, 0x0B44 }, { 0x0B4D, 0x0B4D }, { 0x0B56, 0x0B56 }, { 0x0B82, 0x0B82 },
+    { 0x0BC0, 0x0BC0 }, { 0x0BCD, 0x0BCD }, { 0x0C3E, 0x0C40 }, { 0x0C46, 0x0C48 },
+    { 0x0C4A, 0x0C4D }, { 0x0C55, 0x0C56 }, { 0x0CBC, 0x0CBC }, { 0x0CCC, 0x0CCD },
+    { 0x0D41, 0x0D44 }, { 0x0D4D, 0x0D4D }, { 0x0DCA, 0x0DCA }, { 0x0DD2, 0x0DD4 },
+    { 0x0DD6, 0x0DD6 }, { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E },
+    { 0x0EB1, 0x0EB1 }, { 0x0EB4, 0x0EBC }, { 0x0EC8, 0x0ECD }, { 0x0F18, 0x0F19 },
+    { 0x0F35, 0x0F35 }, { 0x0F37, 0x0F37 }, { 0x0F39, 0x0F39 }, { 0x0F71, 0x0F7E },
+    { 0x0F80, 0x0F84 }, { 0x0F86, 0x0F87 }, { 0x0F8D, 0x0FBC }, { 0x0FC6, 0x0FC6 },
+    { 0x102D, 0x1030 }, { 0x1032, 0x1037 }, { 0x1039, 0x103A }, { 0x103D, 0x103E },
+    { 0x1058, 0x1059 }, { 0x105E, 0x1060 }, { 0x1071, 0x1074 }, { 0x1082, 0x1082 },
+    { 0x1085, 0x1086 }, { 0x108D, 0x108D }, { 0x109D, 0x109D }, { 0x1160, 0x11FF },
+    { 0x135D, 0x135F }, { 0x1712, 0x1714 }, { 0x1732, 0x1734 }, { 0x1752, 0x1753 },
+    { 0x1772, 0x1773 }, { 0x17B4, 0x17B5 }, { 0x17B7, 0x17BD }, { 0x17C6, 0x17C6 },
+    { 0x17C9, 0x17D3 }, { 0x17DD, 0x17DD }, { 0x180B, 0x180E }, { 0x18A9, 0x18A9 },
+    { 0x1920, 0x1922 }, { 0x1927, 0x1928 }, { 0x1932, 0x1932 }, { 0x1939, 0x193B },
+    { 0x1A17, 0x1A18 }, { 0x1AB0, 0x1AFF }, { 0x1B00, 0x1B03 }, { 0x1B34, 0x1B34 },
+    { 0x1B36, 0x1B3A }, { 0x1B3C, 0x1B3C }, { 0x1B42, 0x1B42 }, { 0x1B6B, 0x1B73 },
+    { 0x1DC0, 0x1DFF }, { 0x200B, 0x200F }, { 0x202A, 0x202E }, { 0x2060, 0x2064 },
+    { 0x20D0, 0x20F0 }, { 0x2CEF, 0x2CF1 }, { 0x2D7F, 0x2D7F }, { 0x2DE0, 0x2DFF },
+    { 0x302A, 0x302D }, { 0x3099, 0x309A }, { 0xA66F, 0xA672 }, { 0xA674, 0xA67D },
+    { 0xA69E, 0xA69F }, { 0xA6F0, 0xA6F1 }, { 0xA802, 0xA802 }, { 0xA806, 0xA806 },
+    { 0xA80B, 0xA80B }, { 0xA825, 0xA826 }, { 0xA8C4, 0xA8C5 }, { 0xA8E0, 0xA8F1 },
+    { 0xA926, 0xA92D }, { 0xA947, 0xA951 }, { 0xA980, 0xA982 }, { 0xA9B3, 0xA9B3 },
+    { 0xA9B6, 0xA9B9 }, { 0xA9BC, 0xA9BC }, { 0xAA29, 0xAA2E }, { 0xAA31, 0xAA32 },
+    { 0xAA35, 0xAA36 }, { 0xAA43, 0xAA43 }, { 0xAA4C, 0xAA4C }, { 0xAAB0, 0xAAB0 },
+    { 0xAAB2, 0xAAB4 }, { 0xAAB7, 0xAAB8 }, { 0xAABE, 0xAABF }, { 0xAAC1, 0xAAC1 },
+    { 0xABE5, 0xABE5 }, { 0xABE8, 0xABE8 }, { 0xABED, 0xABED }, { 0xFB1E, 0xFB1E },
+    { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F }, { 0xFEFF, 0xFEFF }, { 0xFFF9, 0xFFFB },
+    { 0x101FD, 0x101FD }, { 0x10A01, 0x10A03 }, { 0x10A05, 0x10A06 }, { 0x10A0C, 0x10A0F },
+    { 0x10A38, 0x10A3A }, { 0x10A3F, 0x10A3F }, { 0x11001, 0x11001 }, { 0x11038, 0x11046 },
+    { 0x1D167, 0x1D169 }, { 0x1D173, 0x1D182 }, { 0x1D185, 0x1D18B }, { 0x1D1AA, 0x1D1AD },
+    { 0x1E8D0, 0x1E8D6 }, { 0x1E944, 0x1E94A }, { 0xE0001, 0xE0001 }, { 0xE0020, 0xE007F },
+    { 0xE0100, 0xE01EF },
+};
+
+// Block index per 256 codepoints, and the distinct blocks at 2 bits per entry
+static uint16_t width_index[WIDTH_BLOCK_COUNT];
+static uint8_t width_blocks[WIDTH_MAX_BLOCKS][WIDTH_BLOCK_SIZE / 4];
+static int width_block_count = 0;
+static pthread_once_t width_table_once = PTHREAD_ONCE_INIT;
+
+// Set the widths of the block at base covered by ranges (sorted), starting the
+// search at *next; returns whether any range touched the block
+static int block_fill(uint8_t *widths, uint32_t base, const CodepointRange *ranges, size_t count,
+                      size_t *next, uint8_t width) {
+    uint32_t end = base + WIDTH_BLOCK_SIZE - 1;
+    int touched = 0;
+    while (*next < count && ranges[*next].last < base) (*next)++;
+    for (size_t r = *next; r < count && ranges[r].first <= end; r++) {
+        uint32_t first = ranges[r].first > base ? ranges[r].first : base;
+        uint32_t last = ranges[r].last < end ? ranges[r].last : end;
+        for (uint32_t cp = first; cp <= last; cp++) widths[cp - base] = width;
+        touched = 1;
+    }
+    return touched;
+}
+
+// Index of a block with these packed widths, adding it when new
+static int block_intern(const uint8_t *packed) {
+    for (int b = 0; b < width_block_count; b++) {
+        if (memcmp(width_blocks[b], packed, sizeof(width_blocks[b])) == 0) return b;
+    }
+    if (width_block_count == WIDTH_MAX_BLOCKS) return 0;
+    memcpy(width_blocks[width_block_count], packed, sizeof(width_blocks[0]));
+    return width_block_count++;
+}
+
+static void width_table_build(void) {
+    uint8_t widths[WIDTH_BLOCK_SIZE];
+    uint8_t packed[WIDTH_BLOCK_SIZE / 4];
+
+    // Block 0 is all one-cell, which most of the codepoint space is
+    memset(packed, 0x55, sizeof(packed));
+    block_intern(packed);
+
+    size_t next_wide = 0;
+    size_t next_zero = 0;
+    for (uint32_t block = 0; block < WIDTH_BLOCK_COUNT; block++) {
+        uint32_t base = block << WIDTH_BLOCK_BITS;
+        memset(widths, 1, sizeof(widths));
+        int touched = block_fill(widths, base, wide_ranges, sizeof(wide_ranges) / sizeof(wide_ranges[0]),
+                                 &next_wide, 2);
+        touched |= block_fill(widths, base, zero_ranges, sizeof(zero_ranges) / sizeof(zero_ranges[0]),
+                              &next_zero, 0);
+        if (!touched) {
+            width_index[block] = 0;
+            continue;
+        }
+        memset(packed, 0, sizeof(packed));
+        for (int i = 0; i < WIDTH_BLOCK_SIZE; i++) {
+            packed[i / 4] |= (uint8_t)(widths[i] << ((i % 4) * 2));
+        }
+        width_index[block] = (uint16_t)block_intern(packed);
+    }
+}
+
+// Cells covered by a codepoint (controls count as one, like any other byte the grid shows)
+int codepoint_width(uint32_t codepoint) {
+    if (codepoint < 0x300) return 1;
+    if (codepoint >= WIDTH_MAX_CODEPOINT) return 1;
+    pthread_once(&width_table_once, width_table_build);
+    const uint8_t *block = width_blocks[width_index[codepoint >> WIDTH_BLOCK_BITS]];
+    unsigned int entry = codepoint & (WIDTH_BLOCK_SIZE - 1);
+    return (block[entry / 4] >> ((entry % 4) * 2)) & 3;
+}
+
+// Decode the character at text[*offset] and advance past it; returns its
+// width. A lead byte takes its continuation bytes along; a stray continuation
+// byte is zero-width, so widths add up like the UTF-8 character count did.
+int utf8_next_width(const char *text, size_t length, size_t *offset) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    size_t i = *offset;
+    unsigned char lead = bytes[i++];
+
+    if (lead < 0x80) {
+        *offset = i;
+        return 1;
+    }
+    if ((lead & 0xC0) == 0x80) {
+        *offset = i;
+        return 0;
+    }
+
+    int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : 1;
+    uint32_t codepoint = lead & (0x3F >> extra);
+    int taken = 0;
+    while (i < length && (bytes[i] & 0xC0) == 0x80) {
+        if (taken++ < extra) codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+        i++;
+    }
+    *offset = i;
+    return taken == extra ? codepoint_width(codepoint) : 1;
+}
+
+// Decode the character at text[*offset] and advance past it; returns 0 for
+// a malformed sequence or a surrogate
+uint32_t utf8_next_codepoint(const char *text, size_t length, size_t *offset) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    size_t i = *offset;
+    unsigned char lead = bytes[i++];
+    int extra = lead < 0x80 ? 0 : lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+    uint32_t codepoint = extra > 0 ? (uint32_t)(lead & (0x3F >> extra)) : lead;
+    for (int k = 0; k < extra; k++) {
+        if (i >= length || (bytes[i] & 0xC0) != 0x80) {
+            extra = -1;
+            break;
+        }
+        codepoint = (codepoint << 6) | (bytes[i++] & 0x3F);
+    }
+    *offset = i;
+    if (extra < 0 || codepoint >= WIDTH_MAX_CODEPOINT || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) return 0;
+    return codepoint;
+}
+
+// Cells covered by text[0..length)
+int utf8_cells(const char *text, size_t length) {
+    int cells = 0;
+    size_t i = 0;
+    while (i < length) {
+        cells += utf8_next_width(text, length, &i);
+    }
+    return cells;
+}
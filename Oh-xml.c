@@ -0,0 +1,470 @@
+/*
+ * Oh-xml.c - Streaming XML well-formedness checker
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * The output writer feeds every byte it emits through xml_check_feed(), so
+ * the document is checked as it is written instead of being kept in memory
+ * and handed to xmllint afterwards. The checker is a byte-at-a-time state
+ * machine that covers what the renderer can get wrong: tag and attribute
+ * syntax, quoting, duplicate attributes, matching end tags, entity and
+ * character references, comments, CDATA sections, processing instructions,
+ * the DOCTYPE and a single root element. It does not load the DTD.
+ */
+
+#include "Oh.h"
+
+enum {
+    XML_TEXT,
+    XML_TAG_OPEN,
+    XML_START_NAME,
+    XML_IN_TAG,
+    XML_ATTR_NAME,
+    XML_ATTR_AFTER_NAME,
+    XML_ATTR_EQUALS,
+    XML_ATTR_VALUE,
+    XML_AFTER_ATTR,
+    XML_EMPTY_CLOSE,
+    XML_END_NAME,
+    XML_END_TRAIL,
+    XML_REFERENCE,
+    XML_BANG,
+    XML_COMMENT_OPEN,
+    XML_COMMENT,
+    XML_CDATA_OPEN,
+    XML_CDATA,
+    XML_DOCTYPE_OPEN,
+    XML_DOCTYPE,
+    XML_PI,
+    XML_FAILED
+};
+
+static int is_name_start(unsigned char c) {
+    return isalpha(c) || c == '_' || c == ':' || c >= 0x80;
+}
+
+static int is_name_char(unsigned char c) {
+    return is_name_start(c) || isdigit(c) || c == '-' || c == '.';
+}
+
+static int is_xml_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void xml_check_init(XmlChecker *checker) {
+    memset(checker, 0, sizeof(*checker));
+    checker->state = XML_TEXT;
+    checker->line = 1;
+    checker->column = 0;
+}
+
+static void xml_fail(XmlChecker *checker, const char *message) {
+    if (checker->state == XML_FAILED) return;
+    snprintf(checker->error, sizeof(checker->error), "%s", message);
+    checker->error_line = checker->line;
+    checker->error_column = checker->column;
+    checker->state = XML_FAILED;
+}
+
+// Append c to the name being collected (start tag, attribute or reference)
+static void xml_name_push(XmlChecker *checker, unsigned char c) {
+    if (checker->name_length + 1 >= sizeof(checker->name)) {
+        xml_fail(checker, "Name too long");
+        return;
+    }
+    checker->name[checker->name_length++] = (char)c;
+}
+
+// Open the element whose name was just collected
+static void xml_open_element(XmlChecker *checker) {
+    if (checker->root_closed) {
+        xml_fail(checker, "Content after the root element");
+        return;
+    }
+    if (checker->depth >= XML_CHECK_MAX_DEPTH ||
+        checker->names_used + checker->name_length + 1 > sizeof(checker->names)) {
+        xml_fail(checker, "Elements nested too deeply");
+        return;
+    }
+    checker->name_start[checker->depth++] = checker->names_used;
+    memcpy(checker->names + checker->names_used, checker->name, checker->name_length);
+    checker->names_used += checker->name_length;
+    checker->names[checker->names_used++] = '\0';
+    checker->root_seen = 1;
+    checker->attributes_used = 0;
+}
+
+static void xml_close_element(XmlChecker *checker) {
+    checker->names_used = checker->name_start[--checker->depth];
+    if (checker->depth == 0) checker->root_closed = 1;
+}
+
+// Record an attribute name, rejecting repeats within the same start tag
+static void xml_attribute_done(XmlChecker *checker) {
+    size_t offset = 0;
+    while (offset < checker->attributes_used) {
+        size_t length = strlen(checker->attributes + offset);
+        if (length == checker->name_length &&
+            memcmp(checker->attributes + offset, checker->name, length) == 0) {
+            xml_fail(checker, "Duplicate attribute");
+            return;
+        }
+        offset += length + 1;
+    }
+    if (checker->attributes_used + checker->name_length + 1 > sizeof(checker->attributes)) {
+        xml_fail(checker, "Too many attributes");
+        return;
+    }
+    memcpy(checker->attributes + checker->attributes_used, checker->name, checker->name_length);
+    checker->attributes_used += checker->name_length;
+    checker->attributes[checker->attributes_used++] = '\0';
+}
+
+// Validate the reference collected between '&' and ';'
+static void xml_reference_done(XmlChecker *checker) {
+    const char *name = checker->name;
+    size_t length = checker->name_length;
+
+    if (length > 1 && name[0] == '#') {
+        int hex = name[1] == 'x';
+        size_t digits = hex ? 2 : 1;
+        if (digits >= length) {
+            xml_fail(checker, "Empty character reference");
+            return;
+        }
+        unsigned long code = 0;
+        for (size_t i = digits; i < length; i++) {
+            unsigned char c = (unsigned char)name[i];
+            if (hex ? !isxdigit(c) : !isdigit(c)) {
+                xml_fail(checker, "Malformed character reference");
+                return;
+            }
+            code = code * (hex ? 16 : 10) + (unsigned long)(isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+            if (code > 0x10FFFF) break;
+        }
+        if (code == 0 || code > 0x10FFFF || (code < 0x20 && code != 0x9 && code != 0xA && code != 0xD) ||
+            (code >= 0xD800 && code <= 0xDFFF)) {
+            xml_fail(checker, "Character reference to an invalid character");
+        }
+        return;
+    }
+
+    static const char *predefined[] = { "amp", "lt", "gt", "quot", "apos" };
+    for (size_t i = 0; i < sizeof(predefined) / sizeof(predefined[0]); i++) {
+        if (strlen(predefined[i]) == length && memcmp(predefined[i], name, length) == 0) return;
+    }
+    xml_fail(checker, "Undefined entity");
+}
+
+static void xml_check_byte(XmlChecker *checker, unsigned char c) {
+    switch (checker->state) {
+        case XML_TEXT:
+            if (c == '<') {
+                checker->state = XML_TAG_OPEN;
+            } else if (c == '&') {
+                if (checker->depth == 0) xml_fail(checker, "Reference outside the root element");
+                checker->name_length = 0;
+                checker->return_state = XML_TEXT;
+                checker->state = XML_REFERENCE;
+            } else if (checker->depth == 0 && !is_xml_space(c)) {
+                xml_fail(checker, "Text outside the root element");
+            } else if (c == '>' && checker->match > 1) {
+                xml_fail(checker, "']]>' in text");
+            }
+            checker->match = c == ']' ? checker->match + 1 : 0;
+            break;
+
+        case XML_TAG_OPEN:
+            checker->name_length = 0;
+            if (c == '/') {
+                if (checker->depth == 0) xml_fail(checker, "End tag without a start tag");
+                checker->match = 0;
+                checker->state = XML_END_NAME;
+            } else if (c == '!') {
+                checker->state = XML_BANG;
+            } else if (c == '?') {
+                checker->match = 0;
+                checker->state = XML_PI;
+            } else if (is_name_start(c)) {
+                xml_name_push(checker, c);
+                checker->state = XML_START_NAME;
+            } else {
+                xml_fail(checker, "Invalid character after '<'");
+            }
+            break;
+
+        case XML_START_NAME:
+            if (is_name_char(c)) {
+                xml_name_push(checker, c);
+                break;
+            }
+            xml_open_element(checker);
+            if (checker->state == XML_FAILED) break;
+            if (is_xml_space(c)) {
+                checker->state = XML_IN_TAG;
+            } else if (c == '/') {
+                checker->state = XML_EMPTY_CLOSE;
+            } else if (c == '>') {
+                checker->state = XML_TEXT;
+            } else {
+                xml_fail(checker, "Invalid character in element name");
+            }
+            break;
+
+        case XML_IN_TAG:
+        case XML_AFTER_ATTR:
+            if (is_xml_space(c)) {
+                checker->state = XML_IN_TAG;
+            } else if (c == '/') {
+                checker->state = XML_EMPTY_CLOSE;
+            } else if (c == '>') {
+                checker->state = XML_TEXT;
+            } else if (checker->state == XML_IN_TAG && is_name_start(c)) {
+                checker->name_length = 0;
+                xml_name_push(checker, c);
+                checker->state = XML_ATTR_NAME;
+            } else {
+                xml_fail(checker, checker->state == XML_IN_TAG ? "Invalid character in start tag"
+                                                              : "Attributes must be separated by whitespace");
+            }
+            break;
+
+        case XML_ATTR_NAME:
+            if (is_name_char(c)) {
+                xml_name_push(checker, c);
+                break;
+            }
+            xml_attribute_done(checker);
+            if (checker->state == XML_FAILED) break;
+            if (is_xml_space(c)) {
+                checker->state = XML_ATTR_AFTER_NAME;
+            } else if (c == '=') {
+                checker->state = XML_ATTR_EQUALS;
+            } else {
+                xml_fail(checker, "Attribute without a value");
+            }
+            break;
+
+        case XML_ATTR_AFTER_NAME:
+            if (c == '=') {
+                checker->state = XML_ATTR_EQUALS;
+            } else if (!is_xml_space(c)) {
+                xml_fail(checker, "Attribute without a value");
+            }
+            break;
+
+        case XML_ATTR_EQUALS:
+            if (c == '"' || c == '\'') {
+                checker->quote = c;
+                checker->state = XML_ATTR_VALUE;
+            } else if (!is_xml_space(c)) {
+                xml_fail(checker, "Unquoted attribute value");
+            }
+            break;
+
+        case XML_ATTR_VALUE:
+            if (c == checker->quote) {
+                checker->state = XML_AFTER_ATTR;
+            } else if (c == '<') {
+                xml_fail(checker, "'<' in attribute value");
+            } else if (c == '&') {
+                checker->name_length = 0;
+                checker->return_state = XML_ATTR_VALUE;
+                checker->state = XML_REFERENCE;
+            }
+            break;
+
+        case XML_EMPTY_CLOSE:
+            if (c == '>') {
+                xml_close_element(checker);
+                checker->state = XML_TEXT;
+            } else {
+                xml_fail(checker, "Expected '>' after '/'");
+            }
+            break;
+
+        case XML_END_NAME: {
+            // Compare against the open element as the name arrives
+            const char *open = checker->names + checker->name_start[checker->depth - 1];
+            if (is_name_char(c)) {
+                if (open[checker->name_length] != (char)c) {
+                    xml_fail(checker, "Mismatched end tag");
+                    break;
+                }
+                checker->name_length++;
+                break;
+            }
+            if (checker->name_length == 0 || open[checker->name_length] != '\0') {
+                xml_fail(checker, "Mismatched end tag");
+                break;
+            }
+            if (c == '>') {
+                xml_close_element(checker);
+                checker->state = XML_TEXT;
+            } else if (is_xml_space(c)) {
+                checker->state = XML_END_TRAIL;
+            } else {
+                xml_fail(checker, "Invalid character in end tag");
+            }
+            break;
+        }
+
+        case XML_END_TRAIL:
+            if (c == '>') {
+                xml_close_element(checker);
+                checker->state = XML_TEXT;
+            } else if (!is_xml_space(c)) {
+                xml_fail(checker, "Invalid character in end tag");
+            }
+            break;
+
+        case XML_REFERENCE:
+            if (c == ';') {
+                xml_reference_done(checker);
+                if (checker->state != XML_FAILED) checker->state = checker->return_state;
+            } else if ((checker->name_length == 0 && (c == '#' || is_name_start(c))) ||
+                       (checker->name_length > 0 && is_name_char(c))) {
+                xml_name_push(checker, c);
+            } else {
+                xml_fail(checker, "Unescaped '&'");
+            }
+            break;
+
+        case XML_BANG:
+            checker->match = 0;
+            if (c == '-') {
+                checker->state = XML_COMMENT_OPEN;
+            } else if (c == '[') {
+                if (checker->depth == 0) xml_fail(checker, "CDATA section outside the root element");
+                checker->state = XML_CDATA_OPEN;
+            } else if (c == 'D') {
+                if (checker->root_seen) xml_fail(checker, "DOCTYPE after the root element");
+                checker->state = XML_DOCTYPE_OPEN;
+            } else {
+                xml_fail(checker, "Invalid markup declaration");
+            }
+            break;
+
+        case XML_COMMENT_OPEN:
+            if (c == '-') {
+                checker->state = XML_COMMENT;
+            } else {
+                xml_fail(checker, "Invalid comment");
+            }
+            break;
+
+        case XML_COMMENT:
+            // match counts consecutive '-'; "--" may only be followed by '>'
+            if (checker->match >= 2) {
+                if (c == '>') {
+                    checker->state = XML_TEXT;
+                } else {
+                    xml_fail(checker, "'--' inside comment");
+                }
+            }
+            checker->match = c == '-' ? checker->match + 1 : 0;
+            break;
+
+        case XML_CDATA_OPEN:
+            if (c != (unsigned char)"CDATA["[checker->match]) {
+                xml_fail(checker, "Invalid CDATA section");
+            } else if (++checker->match == 6) {
+                checker->match = 0;
+                checker->state = XML_CDATA;
+            }
+            break;
+
+        case XML_CDATA:
+            if (c == '>' && checker->match >= 2) {
+                checker->match = 0;
+                checker->state = XML_TEXT;
+                break;
+            }
+            checker->match = c == ']' ? checker->match + 1 : 0;
+            break;
+
+        case XML_DOCTYPE_OPEN:
+            if (c != (unsigned char)"OCTYPE"[checker->match]) {
+                xml_fail(checker, "Invalid DOCTYPE");
+            } else if (++checker->match == 6) {
+                checker->match = 0;
+                checker->quote = 0;
+                checker->state = XML_DOCTYPE;
+            }
+            break;
+
+        case XML_DOCTYPE:
+            // match is the internal subset bracket depth; quotes hide brackets
+            if (checker->quote) {
+                if (c == checker->quote) checker->quote = 0;
+            } else if (c == '"' || c == '\'') {
+                checker->quote = c;
+            } else if (c == '[') {
+                checker->match++;
+            } else if (c == ']' && checker->match > 0) {
+                checker->match--;
+            } else if (c == '>' && checker->match == 0) {
+                checker->state = XML_TEXT;
+            }
+            break;
+
+        case XML_PI:
+            if (c == '>' && checker->match) {
+                checker->state = XML_TEXT;
+            }
+            checker->match = c == '?';
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Bytes that need no look in element content or attribute values
+static int is_plain_byte(unsigned char c) {
+    return c >= 0x20 && c != '<' && c != '&' && c != '>' && c != ']' && c != '"' && c != '\'';
+}
+
+// Check the next length bytes of the document
+void xml_check_feed(XmlChecker *checker, const char *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < length && checker->state != XML_FAILED; i++) {
+        // Skip runs of ordinary text in one go; they cannot change the state
+        if ((checker->state == XML_TEXT && checker->depth > 0) || checker->state == XML_ATTR_VALUE) {
+            size_t run = i;
+            while (run < length && is_plain_byte(bytes[run])) run++;
+            if (run > i) {
+                checker->column += (long)(run - i);
+                checker->match = 0;
+                i = run;
+                if (i == length) break;
+            }
+        }
+        unsigned char c = bytes[i];
+        if (c == '\n') {
+            checker->line++;
+            checker->column = 0;
+        } else {
+            checker->column++;
+        }
+        if (c < 0x20 && !is_xml_space(c)) {
+            xml_fail(checker, "Control character not allowed in XML");
+            break;
+        }
+        xml_check_byte(checker, c);
+    }
+}
+
+// End of document: returns 0 when it was well-formed, -1 otherwise (see checker->error)
+int xml_check_finish(XmlChecker *checker) {
+    if (checker->state != XML_FAILED) {
+        if (checker->state != XML_TEXT) {
+            xml_fail(checker, "Document ends inside markup");
+        } else if (checker->depth > 0) {
+            xml_fail(checker, "Unclosed element at end of document");
+        } else if (!checker->root_seen) {
+            xml_fail(checker, "No root element");
+        }
+    }
+    return checker->state == XML_FAILED ? -1 : 0;
+}
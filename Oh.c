@@ -3,28 +3,52 @@
  * C implementation mirroring Oh.sh functionality
  * 
  * CHANGELOG
+ * 1.038 - Take per-render arrays from a bump arena and keep line arenas and fragment writers between resident renders; the CLI has jansson allocate cache-file trees from per-thread scratch arenas
+ * 1.037 - Build liboh.a and liboh.so: reusable oh_context objects, each with its own render state, rendering concurrently through oh_render(); the CLI links the library
+ * 1.036 - Add --format html|png and --font-file: HTML and PNG backends drawing the parsed grid directly
+ * 1.035 - Add --embed-font: inline Google fonts as cached, subset base64 @font-face rules
+ * 1.034 - Add --page-height N: split tall output into cached page files shown by an index SVG; lift the 10,000-line input limit
+ * 1.033 - Add --dedup: parse repeated lines once and draw repeated rows as <use> references to their first occurrence
+ * 1.032 - Add --cast: play asciicast v2 recordings through a screen emulator into an animated SVG of keyframes that redraw only changed rows, each distinct row a shared <symbol>
+ * 1.031 - Read file input through mmap as (pointer, length) line views parsed in place; drop the 4096-byte line limit
+ * 1.030 - Add --stats=json and OH_STATS_FILE: monotonic per-stage timings, byte, line and segment counts, cache hits by tier and peak RSS
+ * 1.029 - Bound the disk cache with --cache-max-size (LRU by last-use mtime) and add --cache-gc; keep parsed lines in memory in front of the disk cache
+ * 1.028 - Add --batch (or repeated -i/-o pairs): convert every input/output pair in one process, -j files at a time, sharing in-memory line and fragment caches across files
+ * 1.027 - Add --serve: a Unix socket render server with in-memory LRU line and fragment caches, and --connect to use it
+ * 1.026 - Expand tabs to tab stops and count East Asian wide/zero-width cells while parsing, via a two-level width table
+ * 1.025 - Implement --wrap: split parsed lines into rows at the grid width, each row cached under its own hash
+ * 1.024 - Draw background colors as a layer of <rect>s merged across cells and consecutive rows
+ * 1.023 - Direct-indexed 256-color palette and an in-place SGR state machine with 38/48;5 and 38/48;2 colors; the config hash now ends with a segment format version, so Oh.sh and Oh.c no longer share parsed line caches
+ * 1.022 - Name each (fg, bold) style with a CSS class instead of repeating font-size and fill on every element
+ * 1.021 - Merge adjacent segments with identical style; add --compact (one <text> per row with <tspan> runs)
+ * 1.020 - Check well-formedness in-process as output streams; add --validate=none|fast|dtd (dtd pipes to xmllint)
+ * 1.019 - Incremental re-render: align previous and current line hashes and copy unchanged rows from the previous output
+ * 1.018 - Cache rendered rows in a per-config SVG fragment pack so warm runs skip rendering
+ * 1.017 - Escape segment text with the vectorized scanner straight into the output writer, counting visible characters in the same pass
+ * 1.016 - Scan escape-free text runs with runtime-selected AVX2/SSE2/NEON kernels that find ESC and count UTF-8 characters in one pass
+ * 1.015 - Add -j/--jobs: hash, parse and render lines on a worker thread pool, joining fragments in line order
+ * 1.014 - Add --stream: render lines as they arrive with bounded memory, patching SVG dimensions at the end
+ * 1.013 - Replace the fixed 1 MB SVG buffer with a buffered output writer; stream output with --no-validate
+ * 1.012 - Store parsed segments as slices of a shared text arena with interned color indices instead of fixed 4 MB LineData
+ * 1.011 - Add --cache-format=pack: one append-only, mmap'd pack file per config hash for the line cache
+ * 1.010 - Replace popen(cksum) per line with an in-process slice-by-8 CRC-32 matching POSIX cksum; add bench-hash
  * 1.009 - Fix DTD validation by adding --loaddtd flag to enable external entity loading
  * 1.008 - Add XML validation with xmllint, SVG DOCTYPE declaration, and type="text/css" attribute for SVG 1.1 DTD compliance
  * 1.007 - Initial C implementation matching Oh.sh v1.007 functionality
  */
 
 #include "Oh.h"
+#include <fcntl.h>
+#include <sys/mman.h>
 
 // Global variable definitions
 double script_start_time;
 int debug_mode = 0;
 char cache_dir[MAX_PATH_LENGTH];
 char svg_cache_dir[MAX_PATH_LENGTH];
+char font_cache_dir[MAX_PATH_LENGTH];
 char incremental_cache_file[MAX_PATH_LENGTH];
-int cache_stats_segment_hits = 0;
-int cache_stats_segment_misses = 0;
-int cache_stats_svg_hits = 0;
-int cache_stats_svg_misses = 0;
-char input_lines[MAX_LINES][MAX_LINE_LENGTH];
-char hash_cache[MAX_LINES][MAX_HASH_LENGTH];
-int input_line_count = 0;
-char global_input_hash[MAX_HASH_LENGTH];
-char previous_input_hash[MAX_HASH_LENGTH];
+int resident_mode = 0;  // rendering many documents in one process (--serve, --batch)
 
 // Font character width ratios (scaled by 100 for integer arithmetic)
 FontRatio font_ratios[] = {
@@ -52,34 +76,34 @@ GoogleFont google_fonts[] = {
 };
 
 // ANSI color mappings
-AnsiColor ansi_colors[] = {
-    {30, "#000000"},   // Black
-    {31, "#cd3131"},   // Red
-    {32, "#0dbc79"},   // Green
-    {33, "#e5e510"},   // Yellow
-    {34, "#2472c8"},   // Blue
-    {35, "#bc3fbc"},   // Magenta
-    {36, "#11a8cd"},   // Cyan
-    {37, "#e5e5e5"},   // White
-    {90, "#666666"},   // Bright Black (Gray)
-    {91, "#f14c4c"},   // Bright Red
-    {92, "#23d18b"},   // Bright Green
-    {93, "#f5f543"},   // Bright Yellow
-    {94, "#3b8eea"},   // Bright Blue
-    {95, "#d670d6"},   // Bright Magenta
-    {96, "#29b8db"},   // Bright Cyan
-    {97, "#e5e5e5"},   // Bright White
-    {0, ""} // Terminator
+// xterm 256-color palette, indexed directly by color number: the 16 ANSI colors
+// (30-37 and 90-97), the 6x6x6 color cube (16-231) and the gray ramp (232-255).
+// The cube and ramp are spelled out by the preprocessor from their channel levels.
+#define CUBE_B(r, g) "#" r g "00", "#" r g "5f", "#" r g "87", "#" r g "af", "#" r g "d7", "#" r g "ff"
+#define CUBE_G(r) CUBE_B(r, "00"), CUBE_B(r, "5f"), CUBE_B(r, "87"), CUBE_B(r, "af"), CUBE_B(r, "d7"), CUBE_B(r, "ff")
+#define GRAY(v) "#" v v v
+const char ansi_palette[256][8] = {
+    "#000000", "#cd3131", "#0dbc79", "#e5e510", "#2472c8", "#bc3fbc", "#11a8cd", "#e5e5e5",   // 30-37
+    "#666666", "#f14c4c", "#23d18b", "#f5f543", "#3b8eea", "#d670d6", "#29b8db", "#e5e5e5",   // 90-97
+    CUBE_G("00"), CUBE_G("5f"), CUBE_G("87"), CUBE_G("af"), CUBE_G("d7"), CUBE_G("ff"),
+    GRAY("08"), GRAY("12"), GRAY("1c"), GRAY("26"), GRAY("30"), GRAY("3a"), GRAY("44"), GRAY("4e"),
+    GRAY("58"), GRAY("62"), GRAY("6c"), GRAY("76"), GRAY("80"), GRAY("8a"), GRAY("94"), GRAY("9e"),
+    GRAY("a8"), GRAY("b2"), GRAY("bc"), GRAY("c6"), GRAY("d0"), GRAY("da"), GRAY("e4"), GRAY("ee")
 };
+#undef CUBE_B
+#undef CUBE_G
+#undef GRAY
 
-// Get current time in seconds with microsecond precision
+// Get the monotonic time in seconds (immune to wall clock adjustments)
 double get_current_time(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
 }
 
-// Log output with timestamp (mirrors bash version)
+// Log output with timestamp (mirrors bash version).
+// Each message is a single fprintf, which stdio locks, so lines logged from
+// worker threads never interleave.
 void log_output(const char *message) {
     if (debug_mode) {
         double current_time = get_current_time();
@@ -88,8 +112,17 @@ void log_output(const char *message) {
     }
 }
 
-// Progress output with timestamp (always shown, mirrors bash version)
+// Progress output with timestamp (always shown, mirrors bash version;
+// a process rendering many documents keeps per-document progress for --debug)
 void progress_output(const char *message) {
+    if (resident_mode && !debug_mode) return;
+    double current_time = get_current_time();
+    double elapsed = current_time - script_start_time;
+    fprintf(stderr, "%07.3f - %s\n", elapsed, message);
+}
+
+// Status output with timestamp, shown even while per-document progress is muted
+void status_output(const char *message) {
     double current_time = get_current_time();
     double elapsed = current_time - script_start_time;
     fprintf(stderr, "%07.3f - %s\n", elapsed, message);
@@ -106,7 +139,8 @@ void show_help(void) {
     show_version();
     fprintf(stderr, "\nUSAGE:\n");
     fprintf(stderr, "    command | %s [OPTIONS] > output.svg\n", SCRIPT_NAME);
-    fprintf(stderr, "    %s [OPTIONS] -i input.txt -o output.svg\n\n", SCRIPT_NAME);
+    fprintf(stderr, "    %s [OPTIONS] -i input.txt -o output.svg\n", SCRIPT_NAME);
+    fprintf(stderr, "    %s [OPTIONS] -j 4 -i a.txt -o a.svg -i b.txt -o b.svg ...\n\n", SCRIPT_NAME);
     fprintf(stderr, "OPTIONS:\n");
     fprintf(stderr, "    -h, --help              Show this help\n");
     fprintf(stderr, "    -i, --input FILE        Input file (default: stdin)\n");
@@ -120,6 +154,26 @@ void show_help(void) {
     fprintf(stderr, "    --height CHARS          Grid height in lines (default: input line count)\n");
     fprintf(stderr, "    --wrap                  Wrap lines at width (default: false)\n");
     fprintf(stderr, "    --tab-size SIZE         Tab stop size (default: 8)\n");
+    fprintf(stderr, "    --cache-format FORMAT   Line cache format: json (one file per line, as Oh.sh writes) or pack (default: json)\n");
+    fprintf(stderr, "    --compact               One <text> per row with <tspan> runs; shared attributes move to CSS\n");
+    fprintf(stderr, "    --stream                Render each line as it arrives (unbounded input, no validation)\n");
+    fprintf(stderr, "    --embed-font            Inline the Google font, subset to the characters drawn, instead of linking it\n");
+    fprintf(stderr, "    --format FORMAT         Output format: svg, html or png (default: from the output file's extension, else svg)\n");
+    fprintf(stderr, "    --font-file PATH        TrueType or OpenType font to rasterize PNG output with\n");
+    fprintf(stderr, "    --page-height N         Write pages of N rows beside the output, which becomes an index of them\n");
+    fprintf(stderr, "    --dedup                 Parse repeated lines once and draw repeated rows as <use> references\n");
+    fprintf(stderr, "    --cast                  Input is an asciicast v2 recording: write an animated SVG (default for *.cast)\n");
+    fprintf(stderr, "    --validate LEVEL        Check the output while writing it: none, fast (well-formedness) or dtd (default: fast)\n");
+    fprintf(stderr, "    --no-validate           Same as --validate=none\n");
+    fprintf(stderr, "    -j, --jobs N            Worker threads for hashing, parsing and rendering (0 = all cores, default: 1)\n");
+    fprintf(stderr, "    --cache-max-size SIZE   Keep the disk cache under SIZE bytes (K, M, G suffixes), evicting least recently used\n");
+    fprintf(stderr, "    --cache-gc              Evict cache files down to --cache-max-size (default: 1G) and exit\n");
+    fprintf(stderr, "    --batch FILE            Convert every \"input output\" pair listed in FILE in one process, -j files at a time\n");
+    fprintf(stderr, "    --serve SOCKET          Serve render requests on a Unix socket, keeping caches in memory;\n");
+    fprintf(stderr, "                            renders %d requests at once, one of them across the -j workers\n", SERVE_CONNECTION_THREADS);
+    fprintf(stderr, "    --connect SOCKET        Render through a server started with --serve\n");
+    fprintf(stderr, "    --memory-cache MB       Memory for --serve/--batch line and fragment caches (default: %d)\n", DEFAULT_MEMORY_CACHE_MB);
+    fprintf(stderr, "    --stats FORMAT          Report stage timings and counters when done: json (also written to $OH_STATS_FILE if set)\n");
     fprintf(stderr, "    --debug                 Enable debug output\n");
     fprintf(stderr, "    --version               Show version information\n");
     fprintf(stderr, "\nSUPPORTED FONTS:\n");
@@ -133,6 +187,21 @@ void show_help(void) {
     fprintf(stderr, "    %s --font Inconsolata --width 60 --wrap -i terminal-output.txt -o styled.svg\n", SCRIPT_NAME);
 }
 
+// Move the current -i/-o pair to the list converted as a batch
+static int add_file_pair(Config *config) {
+    FilePair *pairs = realloc(config->file_pairs, (config->file_pair_count + 1) * sizeof(FilePair));
+    if (!pairs) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+    config->file_pairs = pairs;
+    FilePair *pair = &pairs[config->file_pair_count++];
+    snprintf(pair->input_file, sizeof(pair->input_file), "%s", config->input_file);
+    snprintf(pair->output_file, sizeof(pair->output_file), "%s", config->output_file);
+    strcpy(config->output_file, "");
+    return 0;
+}
+
 // Parse command line arguments
 int parse_arguments(int argc, char **argv, Config *config) {
     // Initialize defaults
@@ -149,6 +218,29 @@ int parse_arguments(int argc, char **argv, Config *config) {
     config->tab_size = DEFAULT_TAB_SIZE;
     config->font_width_explicit = 0;
     config->font_height_explicit = 0;
+    config->width_explicit = 0;
+    config->height_explicit = 0;
+    config->validate = VALIDATE_FAST;
+    config->stream = 0;
+    config->font_faces = NULL;
+    config->jobs = 1;
+    config->compact = 0;
+    strcpy(config->serve_socket, "");
+    strcpy(config->connect_socket, "");
+    strcpy(config->batch_file, "");
+    config->file_pairs = NULL;
+    config->file_pair_count = 0;
+    config->cache_gc = 0;
+    config->memory_cache_mb = DEFAULT_MEMORY_CACHE_MB;
+    config->stats = STATS_NONE;
+    config->cast = 0;
+    config->dedup = 0;
+    config->page_height = 0;
+    config->embed_font = 0;
+    config->format = FORMAT_AUTO;
+    strcpy(config->font_file, "");
+    const char *stats_file = getenv("OH_STATS_FILE");
+    snprintf(config->stats_file, sizeof(config->stats_file), "%s", stats_file ? stats_file : "");
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
@@ -162,19 +254,21 @@ int parse_arguments(int argc, char **argv, Config *config) {
                 fprintf(stderr, "Error: --input requires a filename\n");
                 return -1;
             }
-            strcpy(config->input_file, argv[++i]);
+            // A further -i starts the next pair; the ones before it become a batch
+            if (strlen(config->input_file) > 0 && add_file_pair(config) != 0) return -1;
+            snprintf(config->input_file, sizeof(config->input_file), "%s", argv[++i]);
         } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --output requires a filename\n");
                 return -1;
             }
-            strcpy(config->output_file, argv[++i]);
+            snprintf(config->output_file, sizeof(config->output_file), "%s", argv[++i]);
         } else if (strcmp(argv[i], "--font") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --font requires a font family name\n");
                 return -1;
             }
-            strcpy(config->font_family, argv[++i]);
+            snprintf(config->font_family, sizeof(config->font_family), "%s", argv[++i]);
         } else if (strcmp(argv[i], "--font-size") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --font-size requires a number\n");
@@ -232,6 +326,7 @@ int parse_arguments(int argc, char **argv, Config *config) {
                 return -1;
             }
             config->width = width;
+            config->width_explicit = 1;
         } else if (strcmp(argv[i], "--height") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --height requires a number\n");
@@ -243,6 +338,7 @@ int parse_arguments(int argc, char **argv, Config *config) {
                 return -1;
             }
             config->height = height;
+            config->height_explicit = 1;
         } else if (strcmp(argv[i], "--wrap") == 0) {
             config->wrap = 1;
         } else if (strcmp(argv[i], "--tab-size") == 0) {
@@ -256,6 +352,164 @@ int parse_arguments(int argc, char **argv, Config *config) {
                 return -1;
             }
             config->tab_size = tab_size;
+        } else if (strcmp(argv[i], "--cache-format") == 0 || strncmp(argv[i], "--cache-format=", 15) == 0) {
+            const char *format;
+            if (argv[i][14] == '=') {
+                format = argv[i] + 15;
+            } else if (i + 1 < argc) {
+                format = argv[++i];
+            } else {
+                fprintf(stderr, "Error: --cache-format requires json or pack\n");
+                return -1;
+            }
+            if (strcmp(format, "json") == 0) {
+                cache_format = CACHE_FORMAT_JSON;
+            } else if (strcmp(format, "pack") == 0) {
+                cache_format = CACHE_FORMAT_PACK;
+            } else {
+                fprintf(stderr, "Error: --cache-format must be json or pack\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            config->compact = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            config->stream = 1;
+        } else if (strcmp(argv[i], "--validate") == 0 || strncmp(argv[i], "--validate=", 11) == 0) {
+            const char *level;
+            if (argv[i][10] == '=') {
+                level = argv[i] + 11;
+            } else if (i + 1 < argc) {
+                level = argv[++i];
+            } else {
+                fprintf(stderr, "Error: --validate requires none, fast or dtd\n");
+                return -1;
+            }
+            if (strcmp(level, "none") == 0) {
+                config->validate = VALIDATE_NONE;
+            } else if (strcmp(level, "fast") == 0) {
+                config->validate = VALIDATE_FAST;
+            } else if (strcmp(level, "dtd") == 0) {
+                config->validate = VALIDATE_DTD;
+            } else {
+                fprintf(stderr, "Error: --validate must be none, fast or dtd\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--no-validate") == 0) {
+            config->validate = VALIDATE_NONE;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --jobs requires a number\n");
+                return -1;
+            }
+            int jobs = atoi(argv[++i]);
+            if (jobs < 0 || jobs > MAX_JOBS) {
+                fprintf(stderr, "Error: --jobs must be between 0 and %d\n", MAX_JOBS);
+                return -1;
+            }
+            if (jobs == 0) {
+                long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                jobs = cores < 1 ? 1 : cores > MAX_JOBS ? MAX_JOBS : (int)cores;
+            }
+            config->jobs = jobs;
+        } else if (strcmp(argv[i], "--serve") == 0 || strcmp(argv[i], "--connect") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires a socket path\n", argv[i]);
+                return -1;
+            }
+            char *socket_path = argv[i][2] == 's' ? config->serve_socket : config->connect_socket;
+            snprintf(socket_path, MAX_PATH_LENGTH, "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--cache-max-size") == 0 || strncmp(argv[i], "--cache-max-size=", 17) == 0) {
+            const char *size;
+            if (argv[i][16] == '=') {
+                size = argv[i] + 17;
+            } else if (i + 1 < argc) {
+                size = argv[++i];
+            } else {
+                fprintf(stderr, "Error: --cache-max-size requires a size\n");
+                return -1;
+            }
+            char *unit;
+            long long bytes = strtoll(size, &unit, 10);
+            if (*unit == 'K' || *unit == 'k') { bytes <<= 10; unit++; }
+            else if (*unit == 'M' || *unit == 'm') { bytes <<= 20; unit++; }
+            else if (*unit == 'G' || *unit == 'g') { bytes <<= 30; unit++; }
+            if (unit == size || *unit != '\0' || bytes < 1024 * 1024 || bytes > (1LL << 50)) {
+                fprintf(stderr, "Error: --cache-max-size must be a size of at least 1M\n");
+                return -1;
+            }
+            cache_max_size = bytes;
+        } else if (strcmp(argv[i], "--cache-gc") == 0) {
+            config->cache_gc = 1;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --batch requires a manifest file\n");
+                return -1;
+            }
+            snprintf(config->batch_file, sizeof(config->batch_file), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0 || strncmp(argv[i], "--stats=", 8) == 0) {
+            const char *format;
+            if (argv[i][7] == '=') {
+                format = argv[i] + 8;
+            } else if (i + 1 < argc) {
+                format = argv[++i];
+            } else {
+                fprintf(stderr, "Error: --stats requires json\n");
+                return -1;
+            }
+            if (strcmp(format, "json") == 0) {
+                config->stats = STATS_JSON;
+            } else {
+                fprintf(stderr, "Error: --stats must be json\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--memory-cache") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --memory-cache requires a number\n");
+                return -1;
+            }
+            int megabytes = atoi(argv[++i]);
+            if (megabytes < 1 || megabytes > 65536) {
+                fprintf(stderr, "Error: --memory-cache must be between 1 and 65536\n");
+                return -1;
+            }
+            config->memory_cache_mb = megabytes;
+        } else if (strcmp(argv[i], "--cast") == 0) {
+            config->cast = 1;
+        } else if (strcmp(argv[i], "--dedup") == 0) {
+            config->dedup = 1;
+        } else if (strcmp(argv[i], "--embed-font") == 0) {
+            config->embed_font = 1;
+        } else if (strcmp(argv[i], "--format") == 0 || strncmp(argv[i], "--format=", 9) == 0) {
+            const char *format = argv[i][8] == '=' ? argv[i] + 9 : (i + 1 < argc ? argv[++i] : NULL);
+            if (!format) {
+                fprintf(stderr, "Error: --format requires svg, html or png\n");
+                return -1;
+            }
+            config->format = FORMAT_AUTO;
+            for (int f = 0; output_backends[f].name; f++) {
+                if (strcmp(format, output_backends[f].name) == 0) config->format = f;
+            }
+            if (config->format == FORMAT_AUTO) {
+                fprintf(stderr, "Error: --format must be svg, html or png\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--font-file") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --font-file requires a path\n");
+                return -1;
+            }
+            snprintf(config->font_file, sizeof(config->font_file), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--page-height") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --page-height requires a number\n");
+                return -1;
+            }
+            int rows = atoi(argv[++i]);
+            if (rows < 1 || rows > MAX_LINES) {
+                fprintf(stderr, "Error: --page-height must be between 1 and %d\n", MAX_LINES);
+                return -1;
+            }
+            config->page_height = rows;
         } else if (strcmp(argv[i], "--debug") == 0) {
             debug_mode = 1;
         } else {
@@ -265,6 +519,26 @@ int parse_arguments(int argc, char **argv, Config *config) {
         }
     }
 
+    if (config->stream && config->page_height > 0) {
+        fprintf(stderr, "Error: --page-height cannot be combined with --stream\n");
+        return -1;
+    }
+    if (config->file_pair_count > 0) {
+        if (add_file_pair(config) != 0) return -1;
+        if (strlen(config->batch_file) > 0 || strlen(config->serve_socket) > 0 ||
+            strlen(config->connect_socket) > 0 || config->stream) {
+            fprintf(stderr, "Error: Several --input files cannot be combined with --batch, --serve, --connect or --stream\n");
+            return -1;
+        }
+        for (int p = 0; p < config->file_pair_count; p++) {
+            if (strlen(config->file_pairs[p].output_file) == 0) {
+                fprintf(stderr, "Error: --input '%s' needs its own --output when several inputs are given\n",
+                        config->file_pairs[p].input_file);
+                return -1;
+            }
+        }
+    }
+
     return 0;
 }
 
@@ -278,11 +552,13 @@ void setup_cache_directories(void) {
     
     snprintf(cache_dir, sizeof(cache_dir), "%s/.cache/Oh", home);
     snprintf(svg_cache_dir, sizeof(svg_cache_dir), "%s/.cache/Oh/svg", home);
+    snprintf(font_cache_dir, sizeof(font_cache_dir), "%s/.cache/Oh/fonts", home);
     snprintf(incremental_cache_file, sizeof(incremental_cache_file), "%s/.cache/Oh/incremental.json", home);
     
     // Create directories
     mkdir(cache_dir, 0755);
     mkdir(svg_cache_dir, 0755);
+    mkdir(font_cache_dir, 0755);
 }
 
 // Get font character width ratio
@@ -323,22 +599,101 @@ const char* get_google_font_url(const char *font_family) {
     return NULL;
 }
 
-// Get ANSI color by code
+// Get ANSI color by SGR foreground code (30-37, 90-97)
 const char* get_ansi_color(int code) {
-    for (int i = 0; ansi_colors[i].code != 0 || ansi_colors[i].color[0] != '\0'; i++) {
-        if (ansi_colors[i].code == code) {
-            return ansi_colors[i].color;
-        }
-    }
+    if (code >= 30 && code <= 37) return ansi_palette[code - 30];
+    if (code >= 90 && code <= 97) return ansi_palette[code - 90 + 8];
     return TEXT_COLOR; // Default color
 }
 
 
-// Read input (simplified version)
-int read_input(Config *config) {
+// Hash one block of input lines (pool task)
+static void hash_block_task(void *context, int task, int worker) {
+    RenderState *render = (RenderState *)context;
+    (void)worker;
+    int end = (task + 1) * LINE_BLOCK_SIZE;
+    if (end > render->line_count) end = render->line_count;
+    for (int i = task * LINE_BLOCK_SIZE; i < end; i++) {
+        unsigned int hash = generate_hash_bytes(render->lines[i].text, render->lines[i].length);
+        snprintf(render->line_hashes[i], sizeof(render->line_hashes[i]), "%u", hash);
+    }
+}
+
+// Mapped inputs at least this large are read ahead sequentially
+#define INPUT_SEQUENTIAL_MIN (1024 * 1024)
+
+void render_state_init(RenderState *render) {
+    memset(render, 0, sizeof(*render));
+    render->line_pack.fd = -1;
+    render->fragment_pack.fd = -1;
+}
+
+// Drop the input the line table views, which is the render's until the next read:
+// a mapped file, or a buffer a pipe (or other unmappable source) was read into
+void release_input(RenderState *render) {
+    if (render->input_mapped) {
+        munmap(render->input_data, render->input_size);
+    } else {
+        free(render->input_data);
+    }
+    render->input_data = NULL;
+    render->input_size = 0;
+    render->input_mapped = 0;
+    render->line_count = 0;
+}
+
+// Map a regular file read from its start; returns -1 if it cannot be mapped
+static int map_input(RenderState *render, FILE *source) {
+    struct stat st;
+    int fd = fileno(source);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || lseek(fd, 0, SEEK_CUR) != 0) {
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    if (st.st_size >= INPUT_SEQUENTIAL_MIN) {
+        posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    }
+    render->input_data = map;
+    render->input_size = (size_t)st.st_size;
+    render->input_mapped = 1;
+    return 0;
+}
+
+// Read a stream into the input buffer
+static int buffer_input(RenderState *render, FILE *source) {
+    size_t capacity = 0;
+    for (;;) {
+        if (render->input_size == capacity) {
+            size_t grown = capacity ? capacity * 2 : 65536;
+            char *data = realloc(render->input_data, grown);
+            if (!data) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                return -1;
+            }
+            render->input_data = data;
+            capacity = grown;
+        }
+        size_t n = fread(render->input_data + render->input_size, 1, capacity - render->input_size, source);
+        if (n == 0) break;
+        render->input_size += n;
+    }
+    if (ferror(source)) {
+        fprintf(stderr, "Error: Cannot read input\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Read input: files are mapped and their lines parsed in place, other sources
+// are read into one buffer; either way no line is copied or truncated
+int read_input(RenderState *render, Config *config) {
     FILE *input_source;
     
     progress_output("Reading source input");
+    release_input(render);
     
     if (strlen(config->input_file) > 0) {
         input_source = fopen(config->input_file, "r");
@@ -350,64 +705,100 @@ int read_input(Config *config) {
         input_source = stdin;
     }
     
-    char line[MAX_LINE_LENGTH];
-    input_line_count = 0;
-    
-    while (fgets(line, sizeof(line), input_source) && input_line_count < MAX_LINES) {
-        int len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-        }
-        
-        char expanded_line[MAX_LINE_LENGTH];
-        expand_tabs(line, expanded_line, config->tab_size);
-        strcpy(input_lines[input_line_count], expanded_line);
-        input_line_count++;
-    }
-    
+    long long read_start = STATS_START();
+    int result = map_input(render, input_source) == 0 ? 0 : buffer_input(render, input_source);
+    STATS_STOP(STATS_READ, read_start);
     if (input_source != stdin) {
         fclose(input_source);
     }
+    if (result != 0) {
+        return -1;
+    }
     
-    char msg[768];  // Larger buffer to accommodate long paths
     const char *input_source_name = strlen(config->input_file) > 0 ? config->input_file : "stdin";
-    snprintf(msg, sizeof(msg), "Read %d lines from %.500s", input_line_count, input_source_name);
+    return load_input_lines(render, config, render->input_data, render->input_size, input_source_name);
+}
+
+// Make room for one more line in the line table
+static int grow_line_table(RenderState *render) {
+    int capacity = render->line_capacity ? render->line_capacity * 2 : 1024;
+    InputLine *lines = realloc(render->lines, (size_t)capacity * sizeof(InputLine));
+    if (!lines) return -1;
+    render->lines = lines;
+    char (*hashes)[MAX_HASH_LENGTH] = realloc(render->line_hashes, (size_t)capacity * MAX_HASH_LENGTH);
+    if (!hashes) return -1;
+    render->line_hashes = hashes;
+    render->line_capacity = capacity;
+    return 0;
+}
+
+// Split input held in memory into line views and hash them. The data
+// must stay in place until the document is written.
+int load_input_lines(RenderState *render, Config *config, const char *data, size_t size, const char *source_name) {
+    render->line_count = 0;
+    long long read_start = STATS_START();
+    
+    // Lines are kept as read; tabs are expanded to tab stops while parsing.
+    // As when lines were read as C strings, a NUL byte ends a line's text.
+    const char *ptr = data;
+    const char *end = data + size;
+    while (ptr < end) {
+        if (render->line_count == render->line_capacity && grow_line_table(render) != 0) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            render->line_count = 0;
+            return -1;
+        }
+        const char *newline = memchr(ptr, '\n', (size_t)(end - ptr));
+        size_t length = newline ? (size_t)(newline - ptr) : (size_t)(end - ptr);
+        const char *nul = memchr(ptr, '\0', length);
+        InputLine *line = &render->lines[render->line_count++];
+        line->text = ptr;
+        line->length = nul ? (size_t)(nul - ptr) : length;
+        ptr += length + 1;
+    }
+    STATS_ADD_BYTES(stats_bytes_in, size);
+    STATS_STOP(STATS_READ, read_start);
+    
+    char msg[768];  // Larger buffer to accommodate long paths
+    snprintf(msg, sizeof(msg), "Read %d lines from %.500s", render->line_count, source_name);
     progress_output(msg);
     
-    if (input_line_count == 0) {
+    if (render->line_count == 0) {
         fprintf(stderr, "Error: No input provided\n");
         return -1;
     }
     
-    if (config->height == 0) {
-        config->height = input_line_count;
+    // With --wrap the height follows the wrapped row count, known after parsing
+    if (config->height == 0 && !config->wrap) {
+        config->height = render->line_count;
     }
     
     // Generate hashes with timing
     char hash_msg[256];
-    snprintf(hash_msg, sizeof(hash_msg), "Hashing %d lines after wrapping/truncation", input_line_count);
+    snprintf(hash_msg, sizeof(hash_msg), "Hashing %d lines after wrapping/truncation", render->line_count);
     progress_output(hash_msg);
     
     double hash_start_time = get_current_time();
+    long long hash_start = STATS_START();
     
-    for (int i = 0; i < input_line_count; i++) {
-        unsigned int hash = generate_hash(input_lines[i]);
-        snprintf(hash_cache[i], sizeof(hash_cache[i]), "%u", hash);
-    }
+    pool_run(worker_pool, hash_block_task, render, (render->line_count + LINE_BLOCK_SIZE - 1) / LINE_BLOCK_SIZE);
     
+    STATS_STOP(STATS_HASH, hash_start);
     double hash_time = get_current_time() - hash_start_time;
     snprintf(hash_msg, sizeof(hash_msg), "Hash time: %.3fs, Time per line: %.3fs", 
-            hash_time, hash_time / input_line_count);
+            hash_time, hash_time / render->line_count);
     progress_output(hash_msg);
     
     return 0;
 }
 
 // Build font CSS
-void build_font_css(const char *font, char *css_output, size_t css_size) {
+void build_font_css(const Config *config, char *css_output, size_t css_size) {
+    const char *font = config->font_family;
     const char *google_url = get_google_font_url(font);
     
-    if (google_url) {
+    // An embedded font's @font-face rules come first instead of the @import
+    if (google_url && !config->font_faces) {
         char escaped_url[MAX_URL_LENGTH];
         xml_escape_url(google_url, escaped_url, sizeof(escaped_url));
         snprintf(css_output, css_size, "@import url('%s'); .terminal-text { font-family: '%s', 'Consolas', 'Monaco', 'Courier New', monospace; }", 
@@ -417,39 +808,825 @@ void build_font_css(const char *font, char *css_output, size_t css_size) {
     }
 }
 
+// Rows made by wrapping one block of lines (--wrap)
+typedef struct {
+    LineData *rows;
+    uint32_t *hashes;
+    int count;
+    int capacity;
+} WrappedBlock;
+
+// Shared state for the parse and render pool tasks
+typedef struct {
+    RenderState *render;
+    const Config *config;
+    const char *config_hash;
+    LineData *line_data;
+    LineArena *arenas;          // one per worker
+    WrappedBlock *wrapped;      // one per parse block when wrapping
+    LineData *rows;             // what is drawn: line_data itself, or the wrapped rows
+    uint32_t *row_hashes;       // content hash of each row (fragment cache and incremental keys)
+    int row_count;
+    OutputWriter *fragments;    // one per block in the current render round
+    OutputWriter scratch;       // serial path: captures fragments when the output writer streams
+    const char *previous_output;    // mapped previous output file (incremental re-render)
+    size_t previous_output_size;
+    size_t *previous_offsets;       // start of each previous row in previous_output
+    int *reuse_from;                // previous row each row is unchanged from, or -1
+    const int *line_first;          // --dedup: first line with the same text; only those are parsed
+    int *row_first;                 // --dedup: first row drawn the same, or -1 for rows without text
+    uint8_t *row_shared;            // --dedup: rows that later rows refer to
+    int first_block;
+    int row_limit;
+    int row_base;               // --page-height: first row of the page being drawn
+    double cell_width;
+    int error;
+} LineTaskContext;
+
+// A row cut from a wrapped line gets a hash of its own, so its fragment is
+// cached (and kept across incremental runs) like any other line's
+static uint32_t wrapped_row_hash(uint32_t line_hash, int width, int index) {
+    uint32_t key[3] = { line_hash, (uint32_t)width, (uint32_t)index };
+    return cksum_finish(cksum_update(0, key, sizeof(key)), sizeof(key));
+}
+
+// Append the rows of a parsed line to its block's wrapped rows
+static int wrap_into_block(WrappedBlock *block, const LineData *line, uint32_t line_hash, int width) {
+    int bound = wrap_row_bound(line, width);
+    if (block->count + bound > block->capacity) {
+        int new_capacity = block->capacity ? block->capacity : LINE_BLOCK_SIZE;
+        while (new_capacity < block->count + bound) new_capacity *= 2;
+        LineData *rows = realloc(block->rows, new_capacity * sizeof(LineData));
+        if (!rows) return -1;
+        block->rows = rows;
+        uint32_t *hashes = realloc(block->hashes, new_capacity * sizeof(uint32_t));
+        if (!hashes) return -1;
+        block->hashes = hashes;
+        block->capacity = new_capacity;
+    }
+    int count = wrap_line(line, width, block->rows + block->count);
+    if (count < 0) return -1;
+    for (int k = 0; k < count; k++) {
+        block->hashes[block->count + k] = count == 1 ? line_hash : wrapped_row_hash(line_hash, width, k);
+    }
+    block->count += count;
+    return 0;
+}
+
+// Parse one block of lines into the worker's arena, wrapping them into rows
+// there as well when --wrap is on (pool task)
+static void parse_block_task(void *context, int task, int worker) {
+    LineTaskContext *ctx = (LineTaskContext *)context;
+    RenderState *render = ctx->render;
+    int end = (task + 1) * LINE_BLOCK_SIZE;
+    if (end > render->line_count) end = render->line_count;
+    for (int i = task * LINE_BLOCK_SIZE; i < end; i++) {
+        if (ctx->line_first && ctx->line_first[i] != i) continue;
+        ctx->line_data[i].arena = &ctx->arenas[worker];
+        if (parse_ansi_line(render, render->lines[i].text, render->lines[i].length, render->line_hashes[i],
+                            ctx->config_hash, ctx->config->tab_size, &ctx->line_data[i]) != 0 ||
+            (ctx->wrapped && wrap_into_block(&ctx->wrapped[task], &ctx->line_data[i],
+                                             (uint32_t)strtoul(render->line_hashes[i], NULL, 10), ctx->config->width) != 0)) {
+            __atomic_store_n(&ctx->error, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+// Per-render memory: the render's arrays come from its arena, and the
+// workers' line arenas and the fragment writers are kept, so a resident
+// process (--serve, --batch, liboh) resets them between documents instead
+// of allocating them again. A single run frees them when it is done.
+#define KEPT_LINE_ARENA_MAX (64 * 1024 * 1024)  // bigger line arenas are freed, not kept
+
+// count empty line arenas, one per worker
+static LineArena* render_line_arenas(RenderState *render, int count) {
+    if (count > render->line_arena_count) {
+        LineArena *arenas = realloc(render->line_arenas, count * sizeof(LineArena));
+        if (!arenas) return NULL;
+        for (int t = render->line_arena_count; t < count; t++) {
+            line_arena_init(&arenas[t]);
+        }
+        render->line_arenas = arenas;
+        render->line_arena_count = count;
+    }
+    return render->line_arenas;
+}
+
+// count empty memory writers for render_lines_parallel's blocks
+static OutputWriter* render_fragment_writers(RenderState *render, int count) {
+    if (count > render->fragment_count) {
+        OutputWriter *writers = realloc(render->fragments, count * sizeof(OutputWriter));
+        if (!writers) return NULL;
+        render->fragments = writers;
+        while (render->fragment_count < count) {
+            if (writer_open_memory(&render->fragments[render->fragment_count]) != 0) return NULL;
+            render->fragment_count++;
+        }
+    }
+    return render->fragments;
+}
+
+static void render_scratch_free(RenderState *render) {
+    arena_free(&render->arena);
+    for (int t = 0; t < render->line_arena_count; t++) {
+        line_arena_free(&render->line_arenas[t]);
+    }
+    free(render->line_arenas);
+    for (int b = 0; b < render->fragment_count; b++) {
+        writer_close(&render->fragments[b]);
+    }
+    free(render->fragments);
+    render->line_arenas = NULL;
+    render->line_arena_count = 0;
+    render->fragments = NULL;
+    render->fragment_count = 0;
+}
+
+static void render_scratch_release(RenderState *render) {
+    if (!resident_mode) {
+        render_scratch_free(render);
+        return;
+    }
+    for (int t = 0; t < render->line_arena_count; t++) {
+        LineArena *arena = &render->line_arenas[t];
+        if (arena->text_capacity + arena->segment_capacity * sizeof(TextSegment) <= KEPT_LINE_ARENA_MAX) {
+            line_arena_reset(arena);
+        } else {
+            line_arena_free(arena);
+        }
+    }
+    for (int b = 0; b < render->fragment_count; b++) {
+        writer_reset(&render->fragments[b]);
+    }
+    arena_reset(&render->arena);
+}
+
+// Free everything a render holds; the state can be initialized again after
+void render_state_free(RenderState *render) {
+    release_input(render);
+    render_scratch_free(render);
+    render_layout_free(&render->current_layout);
+    render_layout_free(&render->previous_layout);
+    free(render->lines);
+    free(render->line_hashes);
+    render_state_init(render);
+}
+
+// Lay out the rows to draw: every line is one row, or with --wrap the blocks'
+// rows are joined in line order
+static int collect_rows(LineTaskContext *ctx, int blocks) {
+    RenderState *render = ctx->render;
+    int count = render->line_count;
+    if (ctx->wrapped) {
+        count = 0;
+        for (int b = 0; b < blocks; b++) count += ctx->wrapped[b].count;
+    }
+    
+    ctx->row_hashes = arena_alloc(&render->arena, (size_t)count * sizeof(uint32_t));
+    if (!ctx->row_hashes) return -1;
+    ctx->row_count = count;
+    if (!ctx->wrapped) {
+        ctx->rows = ctx->line_data;
+        for (int i = 0; i < count; i++) {
+            ctx->row_hashes[i] = (uint32_t)strtoul(render->line_hashes[i], NULL, 10);
+        }
+        return 0;
+    }
+    
+    ctx->rows = arena_alloc(&render->arena, (size_t)count * sizeof(LineData));
+    if (!ctx->rows) return -1;
+    int row = 0;
+    for (int b = 0; b < blocks; b++) {
+        memcpy(ctx->rows + row, ctx->wrapped[b].rows, ctx->wrapped[b].count * sizeof(LineData));
+        memcpy(ctx->row_hashes + row, ctx->wrapped[b].hashes, ctx->wrapped[b].count * sizeof(uint32_t));
+        row += ctx->wrapped[b].count;
+    }
+    return 0;
+}
+
+static void release_rows(LineTaskContext *ctx, int blocks) {
+    if (ctx->wrapped) {
+        for (int b = 0; b < blocks; b++) {
+            free(ctx->wrapped[b].rows);
+            free(ctx->wrapped[b].hashes);
+        }
+    }
+    ctx->wrapped = NULL;
+    ctx->rows = NULL;
+    ctx->row_hashes = NULL;
+}
+
+// Emit one row, reusing its cached SVG fragment when the fragment pack has it.
+// Freshly rendered rows are captured and queued for the pack; memory writers
+// are captured in place, streaming writers go through the scratch writer.
+static void render_row_uncounted(LineTaskContext *ctx, OutputWriter *writer, int row) {
+    const LineData *line = &ctx->rows[row];
+    int position = row - ctx->row_base;
+    if (ctx->reuse_from && ctx->reuse_from[row] >= 0) {
+        int old_row = ctx->reuse_from[row];
+        const char *fragment = ctx->previous_output + ctx->previous_offsets[old_row];
+        size_t length = ctx->render->previous_layout.row_lengths[old_row];
+        if (old_row == row) {
+            writer_write(writer, fragment, length);
+        } else {
+            // The row moved: only its baseline changes
+            char from[64];
+            char to[64];
+            snprintf(from, sizeof(from), " y=\"%.2f\"", DEFAULT_PADDING + ctx->config->font_size + (old_row * ctx->config->font_height));
+            snprintf(to, sizeof(to), " y=\"%.2f\"", DEFAULT_PADDING + ctx->config->font_size + (row * ctx->config->font_height));
+            writer_write_replacing(writer, fragment, length, from, to);
+        }
+        CACHE_STAT_INC(ctx->render->stats.rows_reused);
+        return;
+    }
+    if (ctx->render->fragment_pack.fd < 0 && !fragment_memory) {
+        render_line_svg(writer, ctx->config, line, position, ctx->cell_width);
+        return;
+    }
+    long long lookup_start = STATS_START();
+    int cached = load_svg_fragment_pack(ctx->render, ctx->row_hashes[row], position, writer);
+    STATS_STOP(STATS_CACHE_LOOKUP, lookup_start);
+    if (cached == 0) {
+        return;
+    }
+    
+    if (!writer->file) {
+        size_t start = writer->length;
+        render_line_svg(writer, ctx->config, line, position, ctx->cell_width);
+        if (!writer->error) {
+            save_svg_fragment_pack(ctx->render, ctx->row_hashes[row], position, writer->buffer + start, writer->length - start);
+        }
+        return;
+    }
+    
+    if (!ctx->scratch.buffer && writer_open_memory(&ctx->scratch) != 0) {
+        render_line_svg(writer, ctx->config, line, position, ctx->cell_width);
+        return;
+    }
+    writer_reset(&ctx->scratch);
+    render_line_svg(&ctx->scratch, ctx->config, line, position, ctx->cell_width);
+    if (!ctx->scratch.error) {
+        save_svg_fragment_pack(ctx->render, ctx->row_hashes[row], position, ctx->scratch.buffer, ctx->scratch.length);
+    }
+    writer_write(writer, ctx->scratch.buffer, ctx->scratch.length);
+}
+
+// Emit one row and record how many bytes it took for the next incremental run.
+// With --dedup a row drawn before is a reference to its first occurrence,
+// which is grouped under an id when later rows refer to it.
+static void render_row(LineTaskContext *ctx, OutputWriter *writer, int row) {
+    size_t start = writer->bytes_written;
+    int first = ctx->row_first ? ctx->row_first[row] : -1;
+    if (first >= 0 && first != row) {
+        writer_printf(writer, "  <use xlink:href=\"#d%d\" y=\"%.2f\"/>\n", first, (row - first) * ctx->config->font_height);
+    } else if (first == row && ctx->row_shared[row]) {
+        writer_printf(writer, "  <g id=\"d%d\">\n", row);
+        render_row_uncounted(ctx, writer, row);
+        writer_puts(writer, "  </g>\n");
+    } else {
+        render_row_uncounted(ctx, writer, row);
+    }
+    RenderLayout *layout = &ctx->render->current_layout;
+    if (layout->row_lengths) {
+        layout->row_lengths[row] = (uint32_t)(writer->bytes_written - start);
+    }
+}
+
+static int same_input_line(int a, int b, const void *context) {
+    const InputLine *lines = (const InputLine *)context;
+    return lines[a].length == lines[b].length && memcmp(lines[a].text, lines[b].text, lines[a].length) == 0;
+}
+
+static int same_row(int a, int b, const void *context) {
+    const LineData *left = &((const LineData *)context)[a];
+    const LineData *right = &((const LineData *)context)[b];
+    if (left->segment_count != right->segment_count || left->visible_length != right->visible_length) return 0;
+    for (int j = 0; j < left->segment_count; j++) {
+        const TextSegment *x = LINE_SEGMENT(left, j);
+        const TextSegment *y = LINE_SEGMENT(right, j);
+        if (x->fg != y->fg || x->bg != y->bg || x->bold != y->bold || x->visible_pos != y->visible_pos ||
+            x->text_length != y->text_length || memcmp(SEGMENT_TEXT(left, x), SEGMENT_TEXT(right, y), x->text_length) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// --dedup: map each line to the first line with the same text, so repeated
+// lines are parsed once; returns NULL (parse them all) when out of memory
+static int* find_duplicate_lines(RenderState *render, int *duplicates) {
+    uint32_t *hashes = arena_alloc(&render->arena, render->line_count * sizeof(uint32_t));
+    int *first = arena_calloc(&render->arena, render->line_count, sizeof(int));
+    *duplicates = -1;
+    if (hashes && first) {
+        for (int i = 0; i < render->line_count; i++) {
+            hashes[i] = (uint32_t)strtoul(render->line_hashes[i], NULL, 10);
+        }
+        *duplicates = find_duplicates(hashes, render->line_count, same_input_line, render->lines, first);
+    }
+    return *duplicates < 0 ? NULL : first;
+}
+
+// --dedup: point every row with text that was drawn before at its first
+// occurrence; returns the number of such rows
+static int find_duplicate_rows(LineTaskContext *ctx, int row_limit) {
+    ctx->row_first = arena_alloc(&ctx->render->arena, (size_t)row_limit * sizeof(int));
+    ctx->row_shared = arena_calloc(&ctx->render->arena, (size_t)row_limit, 1);
+    int duplicates = -1;
+    if (ctx->row_first && ctx->row_shared) {
+        for (int r = 0; r < row_limit; r++) {
+            const LineData *line = &ctx->rows[r];
+            ctx->row_first[r] = -1;
+            for (int j = 0; j < line->segment_count; j++) {
+                if (LINE_SEGMENT(line, j)->text_length > 0) ctx->row_first[r] = 0;
+            }
+        }
+        duplicates = find_duplicates(ctx->row_hashes, row_limit, same_row, ctx->rows, ctx->row_first);
+    }
+    if (duplicates <= 0) {
+        ctx->row_first = NULL;
+        ctx->row_shared = NULL;
+        return 0;
+    }
+    for (int r = 0; r < row_limit; r++) {
+        if (ctx->row_first[r] >= 0 && ctx->row_first[r] != r) ctx->row_shared[ctx->row_first[r]] = 1;
+    }
+    return duplicates;
+}
+
+// Map the previous output and align its rows with the current ones. Rows can
+// only be reused when the previous run wrote the same file with the same row
+// layout and the file is untouched since.
+static void prepare_row_reuse(const Config *config, LineTaskContext *ctx, int row_limit) {
+    char msg[256];
+    const RenderLayout *previous = &ctx->render->previous_layout;
+    struct stat st;
+    
+    if (previous->row_count == 0 || strlen(config->output_file) == 0 ||
+        strcmp(previous->output_file, config->output_file) != 0 ||
+        strcmp(previous->render_key, ctx->render->current_layout.render_key) != 0 ||
+        stat(config->output_file, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (long long)st.st_size != previous->output_size ||
+        (long long)st.st_mtim.tv_sec != previous->output_mtime_sec ||
+        (long long)st.st_mtim.tv_nsec != previous->output_mtime_nsec) {
+        if (debug_mode) {
+            log_output("Incremental: previous output not reusable, rendering all rows");
+        }
+        return;
+    }
+    
+    size_t *offsets = malloc((size_t)previous->row_count * sizeof(size_t));
+    int *match = malloc((size_t)row_limit * sizeof(int));
+    if (!offsets || !match) {
+        free(offsets);
+        free(match);
+        return;
+    }
+    
+    size_t offset = (size_t)previous->body_offset;
+    for (int i = 0; i < previous->row_count; i++) {
+        offsets[i] = offset;
+        offset += previous->row_lengths[i];
+    }
+    
+    int fd = offset <= (size_t)st.st_size ? open(config->output_file, O_RDONLY) : -1;
+    void *map = fd >= 0 && st.st_size > 0 ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        free(offsets);
+        free(match);
+        return;
+    }
+    
+    int matched = align_line_hashes(previous->row_hashes, previous->row_count, ctx->row_hashes, row_limit, match);
+    
+    ctx->previous_output = map;
+    ctx->previous_output_size = (size_t)st.st_size;
+    ctx->previous_offsets = offsets;
+    ctx->reuse_from = match;
+    
+    snprintf(msg, sizeof(msg), "Incremental: %d of %d rows unchanged since the previous output, %d to render",
+            matched, row_limit, row_limit - matched);
+    progress_output(msg);
+}
+
+static void release_row_reuse(LineTaskContext *ctx) {
+    if (ctx->previous_output) {
+        munmap((void *)ctx->previous_output, ctx->previous_output_size);
+    }
+    free(ctx->previous_offsets);
+    free(ctx->reuse_from);
+    ctx->previous_output = NULL;
+    ctx->previous_offsets = NULL;
+    ctx->reuse_from = NULL;
+}
+
+// Render one block of lines into its own fragment writer (pool task)
+static void render_block_task(void *context, int task, int worker) {
+    LineTaskContext *ctx = (LineTaskContext *)context;
+    (void)worker;
+    int block = ctx->first_block + task;
+    int end = (block + 1) * LINE_BLOCK_SIZE;
+    if (end > ctx->row_limit) end = ctx->row_limit;
+    for (int i = block * LINE_BLOCK_SIZE; i < end; i++) {
+        render_row(ctx, &ctx->fragments[task], i);
+    }
+}
+
+// Render rows in rounds of blocks across the pool, appending fragments in line order
+static int render_lines_parallel(LineTaskContext *ctx, OutputWriter *writer) {
+    int threads = pool_size(worker_pool);
+    int round_blocks = threads * 4;
+    int total_blocks = (ctx->row_limit + LINE_BLOCK_SIZE - 1) / LINE_BLOCK_SIZE;
+
+    ctx->fragments = render_fragment_writers(ctx->render, round_blocks);
+    if (!ctx->fragments) return -1;
+
+    int result = 0;
+    for (ctx->first_block = 0; ctx->first_block < total_blocks && result == 0; ctx->first_block += round_blocks) {
+        int blocks = total_blocks - ctx->first_block;
+        if (blocks > round_blocks) blocks = round_blocks;
+        pool_run(worker_pool, render_block_task, ctx, blocks);
+        for (int b = 0; b < blocks; b++) {
+            if (ctx->fragments[b].error) result = -1;
+            writer_write(writer, ctx->fragments[b].buffer, ctx->fragments[b].length);
+            writer_reset(&ctx->fragments[b]);
+        }
+    }
+
+    ctx->fragments = NULL;
+    return result;
+}
+
+// Draw the rows as one document: the header names a style class for every
+// style the rows use, backgrounds go in a layer beneath the text
+static void render_document(LineTaskContext *tasks, OutputWriter *writer, double svg_width, double svg_height) {
+    const Config *config = tasks->config;
+    int row_limit = tasks->row_limit;
+    char msg[256];
+    
+    StylePalette palette = { 0 };
+    for (int i = 0; i < row_limit; i++) {
+        palette_mark_line(&palette, &tasks->rows[i]);
+    }
+    write_svg_header(writer, config, svg_width, svg_height, 0, NULL, &palette);
+    palette_free(&palette);
+    
+    // Backgrounds go in their own layer beneath the text, merged across cells
+    // and rows; rows stay free of rects so their fragments remain reusable
+    BackgroundLayer backgrounds;
+    background_begin(&backgrounds, config, tasks->cell_width, 1, writer);
+    for (int i = 0; i < row_limit; i++) {
+        background_add_row(&backgrounds, &tasks->rows[i], i);
+    }
+    background_end(&backgrounds);
+    if (debug_mode && backgrounds.rects > 0) {
+        snprintf(msg, sizeof(msg), "Background layer: %d rects", backgrounds.rects);
+        log_output(msg);
+    }
+    
+    // Record this render's row layout; reuse rows of the previous output where possible
+    RenderLayout *layout = &tasks->render->current_layout;
+    layout->body_offset = (long long)writer->bytes_written;
+    layout->row_count = row_limit;
+    layout->row_hashes = malloc((row_limit > 0 ? row_limit : 1) * sizeof(uint32_t));
+    if (layout->row_hashes) {
+        memcpy(layout->row_hashes, tasks->row_hashes, row_limit * sizeof(uint32_t));
+    }
+    
+    // References name rows by position, so deduplicated output records no
+    // row layout for the next run and reuses none from the previous one
+    int references = 0;
+    if (config->dedup) {
+        references = find_duplicate_rows(tasks, row_limit);
+        snprintf(msg, sizeof(msg), "Dedup: %d of %d rows drawn as references to earlier rows", references, row_limit);
+        progress_output(msg);
+        if (references > 0) {
+            writer_puts(writer, "  <g xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
+        }
+    } else {
+        layout->row_lengths = calloc(row_limit > 0 ? row_limit : 1, sizeof(uint32_t));
+        prepare_row_reuse(config, tasks, row_limit);
+    }
+    
+    // Process each line; with workers, fragments are rendered per block and joined in order
+    if (pool_size(worker_pool) > 1) {
+        if (render_lines_parallel(tasks, writer) != 0) {
+            writer->error = 1;
+        }
+    } else {
+        for (int i = 0; i < row_limit; i++) {
+            render_row(tasks, writer, i);
+        }
+    }
+    if (tasks->scratch.buffer) {
+        writer_close(&tasks->scratch);
+    }
+    release_row_reuse(tasks);
+    
+    if (references > 0) {
+        writer_puts(writer, "  </g>\n");
+    }
+    writer_puts(writer, "</svg>\n");
+}
+
+// Paged output (--page-height): the rows of every page, drawn in parallel
+typedef struct {
+    LineTaskContext *tasks;
+    const char *stem;           // output path without .svg; page n is <stem>-<n>.svg
+    double svg_width;
+    int written;
+    int error;
+} PageTaskContext;
+
+static void page_path(char *path, size_t size, const char *stem, int page) {
+    snprintf(path, size, "%s-%d.svg", stem, page + 1);
+}
+
+// A page depends on the row markup, its header (the document width, its
+// palette and any embedded font) and its own rows, so it keeps its key, and
+// its file, while rows change on other pages
+static uint32_t page_key(const LineTaskContext *tasks, const OutputWriter *header, int start, int end) {
+    const char *render_key = tasks->render->current_layout.render_key;
+    uint32_t crc = cksum_update(0, render_key, strlen(render_key));
+    crc = cksum_update(crc, header->buffer, header->length);
+    crc = cksum_update(crc, tasks->row_hashes + start, (end - start) * sizeof(uint32_t));
+    return cksum_finish(crc, strlen(render_key) + header->length + (end - start) * sizeof(uint32_t));
+}
+
+// Page files end with a trailer holding the page's key
+#define PAGE_TRAILER "<!-- Oh page %08x -->\n</svg>\n"
+#define PAGE_TRAILER_PREFIX "<!-- Oh page "
+
+// Read the last length bytes of a file; returns -1 if it is shorter or unreadable
+static int read_file_tail(const char *path, char *tail, size_t length) {
+    FILE *file = fopen(path, "r");
+    int complete = file && fseeko(file, -(off_t)length, SEEK_END) == 0 && fread(tail, 1, length, file) == length;
+    if (file) fclose(file);
+    return complete ? 0 : -1;
+}
+
+// Tell whether the page file on disk already ends with this page's key
+static int page_unchanged(const char *path, const char *trailer) {
+    size_t length = strlen(trailer);
+    char tail[64];
+    return read_file_tail(path, tail, length) == 0 && memcmp(tail, trailer, length) == 0;
+}
+
+// Tell whether a file is a page this program wrote, so it may be removed
+static int page_written_by_oh(const char *path) {
+    char trailer[64];
+    char tail[64];
+    size_t length = (size_t)snprintf(trailer, sizeof(trailer), PAGE_TRAILER, 0u);
+    size_t key_end = strlen(PAGE_TRAILER_PREFIX) + 8;
+    return read_file_tail(path, tail, length) == 0 &&
+           memcmp(tail, PAGE_TRAILER_PREFIX, strlen(PAGE_TRAILER_PREFIX)) == 0 &&
+           memcmp(tail + key_end, trailer + key_end, length - key_end) == 0;
+}
+
+// Write beside the page and rename into place, so a viewer never loads half of it
+static int write_page_file(const char *path, const char *data, size_t length) {
+    char temp_path[MAX_PATH_LENGTH + 64];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE *file = fopen(temp_path, "w");
+    int written = file && fwrite(data, 1, length, file) == length;
+    if (file && fclose(file) != 0) written = 0;
+    if (!written || rename(temp_path, path) != 0) {
+        if (file) unlink(temp_path);
+        return -1;
+    }
+    STATS_ADD_BYTES(stats_bytes_out, length);
+    return 0;
+}
+
+// Render one page into memory and write it unless it is unchanged (pool task).
+// Rows are drawn at their position on the page, so a page's fragments are
+// the same wherever the page falls in the document.
+static void render_page_task(void *context, int task, int worker) {
+    PageTaskContext *pages = (PageTaskContext *)context;
+    LineTaskContext page = *pages->tasks;
+    const Config *config = page.config;
+    (void)worker;
+    int start = task * config->page_height;
+    int end = start + config->page_height < page.row_limit ? start + config->page_height : page.row_limit;
+    page.row_base = start;
+    
+    OutputWriter writer;
+    if (writer_open_memory(&writer) != 0) {
+        __atomic_store_n(&pages->error, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    StylePalette palette = { 0 };
+    for (int i = start; i < end; i++) {
+        palette_mark_line(&palette, &page.rows[i]);
+    }
+    write_svg_header(&writer, config, pages->svg_width,
+                     (2 * DEFAULT_PADDING) + ((end - start) * config->font_height), 0, NULL, &palette);
+    palette_free(&palette);
+    
+    char path[MAX_PATH_LENGTH + 32];
+    char trailer[64];
+    page_path(path, sizeof(path), pages->stem, task);
+    snprintf(trailer, sizeof(trailer), PAGE_TRAILER, page_key(&page, &writer, start, end));
+    if (page_unchanged(path, trailer)) {
+        writer_close(&writer);
+        return;
+    }
+    BackgroundLayer backgrounds;
+    background_begin(&backgrounds, config, page.cell_width, 1, &writer);
+    for (int i = start; i < end; i++) {
+        background_add_row(&backgrounds, &page.rows[i], i - start);
+    }
+    background_end(&backgrounds);
+    for (int i = start; i < end; i++) {
+        render_row_uncounted(&page, &writer, i);
+    }
+    writer_puts(&writer, trailer);
+    
+    if (writer.error || write_page_file(path, writer.buffer, writer.length) != 0) {
+        fprintf(stderr, "Error: Cannot write page '%s'\n", path);
+        __atomic_store_n(&pages->error, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&pages->written, 1, __ATOMIC_RELAXED);
+    }
+    writer_close(&writer);
+}
+
+// Split the rows into pages of --page-height rows beside the output file and
+// make the output an index that shows them as <image> tiles. Tiles overlap
+// by their padding, so the index looks like the unpaged document.
+static int render_pages(LineTaskContext *tasks, OutputWriter *writer, double svg_width, double svg_height) {
+    const Config *config = tasks->config;
+    char msg[256];
+    char stem[MAX_PATH_LENGTH];
+    int stem_length = (int)strlen(config->output_file);
+    if (stem_length > 4 && strcmp(config->output_file + stem_length - 4, ".svg") == 0) stem_length -= 4;
+    snprintf(stem, sizeof(stem), "%.*s", stem_length, config->output_file);
+    
+    int page_count = (tasks->row_limit + config->page_height - 1) / config->page_height;
+    PageTaskContext pages = { tasks, stem, svg_width, 0, 0 };
+    pool_run(worker_pool, render_page_task, &pages, page_count);
+    
+    // Pages past the last one are left from a longer document; files of
+    // those names that this program did not write are left alone
+    char path[MAX_PATH_LENGTH + 32];
+    struct stat st;
+    for (int p = page_count; page_path(path, sizeof(path), stem, p), lstat(path, &st) == 0; p++) {
+        if (S_ISREG(st.st_mode) && page_written_by_oh(path)) unlink(path);
+    }
+    
+    char dimensions[SVG_DIMENSIONS_RESERVE + 1];
+    char name[MAX_PATH_LENGTH * 3];
+    const char *slash = strrchr(stem, '/');
+    format_svg_dimensions(dimensions, sizeof(dimensions), svg_width, svg_height);
+    xml_escape(slash ? slash + 1 : stem, name, sizeof(name));
+    writer_printf(writer,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" %s>\n"
+        "  <rect width=\"100%%\" height=\"100%%\" fill=\"%s\" rx=\"6\"/>\n", dimensions, BG_COLOR);
+    for (int p = 0; p < page_count; p++) {
+        int rows = tasks->row_limit - p * config->page_height;
+        if (rows > config->page_height) rows = config->page_height;
+        writer_printf(writer, "  <image x=\"0\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\" xlink:href=\"%s-%d.svg\"/>\n",
+                      p * config->page_height * config->font_height, svg_width,
+                      (2 * DEFAULT_PADDING) + (rows * config->font_height), name, p + 1);
+    }
+    writer_puts(writer, "</svg>\n");
+    
+    snprintf(msg, sizeof(msg), "Pages: wrote %d of %d pages of %d rows (%d unchanged)",
+             pages.written, page_count, config->page_height, page_count - pages.written);
+    progress_output(msg);
+    return pages.error ? -1 : 0;
+}
+
+// Output backends by FORMAT_ value. SVG is drawn by render_document and
+// render_pages; the others get the wrapped rows to draw themselves.
+const OutputBackend output_backends[] = {
+    { "svg", "SVG", ".svg", NULL },
+    { "html", "HTML", ".html", html_render },
+    { "png", "PNG", ".png", png_render },
+    { NULL, NULL, NULL, NULL }
+};
+
+// The backend --format names, or the one the output file's extension implies
+const OutputBackend* output_backend(const Config *config) {
+    if (config->format != FORMAT_AUTO) return &output_backends[config->format];
+    const char *extension = strrchr(config->output_file, '.');
+    if (extension && strchr(extension, '/') == NULL) {
+        if (strcasecmp(extension, ".htm") == 0) return &output_backends[FORMAT_HTML];
+        for (int f = 0; output_backends[f].name; f++) {
+            if (strcasecmp(extension, output_backends[f].extension) == 0) return &output_backends[f];
+        }
+    }
+    return &output_backends[FORMAT_SVG];
+}
+
 // Process lines (simplified version)
-int process_lines_single_pass(Config *config, char **svg_output) {
+int process_lines_single_pass(RenderState *render, Config *config, OutputWriter *writer) {
     char config_hash[MAX_HASH_LENGTH];
     generate_config_hash(config, config_hash);
+    int line_count = render->line_count;
     
-    generate_global_input_hash();
-    load_incremental_cache();
+    // The counters hold this document's cache lookups
+    memset(&render->stats, 0, sizeof(render->stats));
+    
+    // Many documents in one process have no single previous output to build on
+    if (!resident_mode) {
+        generate_global_input_hash(render);
+        load_incremental_cache(render);
+    }
     
     char msg[256];
-    snprintf(msg, sizeof(msg), "Processing %d lines", input_line_count);
+    snprintf(msg, sizeof(msg), "Processing %d lines", line_count);
     progress_output(msg);
     
     // Determine processing approach
-    int cache_changed = (strcmp(global_input_hash, previous_input_hash) != 0);
-    if (cache_changed || strlen(previous_input_hash) == 0) {
-        snprintf(msg, sizeof(msg), "First run or major changes - processing all %d lines", input_line_count);
+    int cache_changed = (strcmp(render->input_hash, render->previous_input_hash) != 0);
+    if (cache_changed || strlen(render->previous_input_hash) == 0) {
+        snprintf(msg, sizeof(msg), "First run or major changes - processing all %d lines", line_count);
         progress_output(msg);
     }
     
-    snprintf(msg, sizeof(msg), "Starting enhanced single-pass processing for %d lines", input_line_count);
+    snprintf(msg, sizeof(msg), "Starting enhanced single-pass processing for %d lines", line_count);
     progress_output(msg);
     
-    // Parse all lines
-    LineData *line_data = malloc(input_line_count * sizeof(LineData));
-    if (!line_data) {
+    // Parse all lines into one arena per worker
+    int threads = pool_size(worker_pool);
+    LineArena *arenas = render_line_arenas(render, threads);
+    LineData *line_data = arena_alloc(&render->arena, line_count * sizeof(LineData));
+    if (!arenas || !line_data) {
         fprintf(stderr, "Error: Memory allocation failed\n");
+        render_scratch_release(render);
         return -1;
     }
     
+    if (cache_format == CACHE_FORMAT_PACK && open_line_pack(render, config_hash) != 0) {
+        progress_output("Warning: Cannot open pack cache, falling back to JSON cache");
+    }
+    
+    LineTaskContext tasks;
+    memset(&tasks, 0, sizeof(tasks));
+    tasks.render = render;
+    tasks.config = config;
+    tasks.config_hash = config_hash;
+    tasks.line_data = line_data;
+    tasks.arenas = arenas;
+    
+    int parse_blocks = (line_count + LINE_BLOCK_SIZE - 1) / LINE_BLOCK_SIZE;
+    if (config->wrap) {
+        tasks.wrapped = arena_calloc(&render->arena, parse_blocks, sizeof(WrappedBlock));
+        if (!tasks.wrapped) tasks.error = 1;
+    }
+    
+    if (threads > 1) {
+        snprintf(msg, sizeof(msg), "Using %d worker threads", threads);
+        progress_output(msg);
+    }
+    
+    // Wrapped lines are parsed each time, as their rows go to the parsing worker's block
+    int *line_first = NULL;
+    if (config->dedup && !config->wrap) {
+        int duplicates = 0;
+        line_first = find_duplicate_lines(render, &duplicates);
+        tasks.line_first = line_first;
+        snprintf(msg, sizeof(msg), "Dedup: parsing %d distinct lines of %d", line_count - duplicates, line_count);
+        if (line_first) progress_output(msg);
+    }
+    if (!tasks.error) {
+        long long parse_start = STATS_START();
+        pool_run(worker_pool, parse_block_task, &tasks, parse_blocks);
+        if (line_first) {
+            for (int i = 0; i < line_count; i++) {
+                if (line_first[i] != i) line_data[i] = line_data[line_first[i]];
+            }
+        }
+        STATS_STOP(STATS_PARSE, parse_start);
+    }
+    if (tasks.error || collect_rows(&tasks, parse_blocks) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        close_line_pack(render);
+        release_rows(&tasks, parse_blocks);
+        render_scratch_release(render);
+        return -1;
+    }
+    
+    // Wrapped output is as tall as its rows unless --height says otherwise
+    if (config->height == 0) {
+        config->height = tasks.row_count;
+    }
+    if (config->wrap) {
+        snprintf(msg, sizeof(msg), "Wrapped %d lines into %d rows at %d columns",
+                line_count, tasks.row_count, config->width);
+        progress_output(msg);
+    }
+    
     int max_width = 0;
     int max_width_line = 0;
-    for (int i = 0; i < input_line_count; i++) {
-        parse_ansi_line(input_lines[i], hash_cache[i], config_hash, &line_data[i]);
+    long long segments = 0;
+    for (int i = 0; i < line_count; i++) {
+        segments += line_data[i].segment_count;
         if (line_data[i].visible_length > max_width) {
             max_width = line_data[i].visible_length;
             max_width_line = i;
@@ -457,33 +1634,31 @@ int process_lines_single_pass(Config *config, char **svg_output) {
         
         if (debug_mode && line_data[i].visible_length > 0) {
             char debug_msg[512];
-            snprintf(debug_msg, sizeof(debug_msg), "Line %d: visible_length=%d, content: %.50s...", 
-                    i + 1, line_data[i].visible_length, input_lines[i]);
+            snprintf(debug_msg, sizeof(debug_msg), "Line %d: visible_length=%d, content: %.*s...", 
+                    i + 1, line_data[i].visible_length,
+                    render->lines[i].length < 50 ? (int)render->lines[i].length : 50, render->lines[i].text);
             log_output(debug_msg);
         }
     }
     
+    close_line_pack(render);
+    
     // Content analysis
     snprintf(msg, sizeof(msg), "Content analysis: longest line is %d characters (line %d)", max_width, max_width_line + 1);
     progress_output(msg);
     
     if (debug_mode) {
         char debug_msg[512];
-        snprintf(debug_msg, sizeof(debug_msg), "Longest line content: %.100s...", input_lines[max_width_line]);
+        const InputLine *longest = &render->lines[max_width_line];
+        snprintf(debug_msg, sizeof(debug_msg), "Longest line content: %.*s...",
+                longest->length < 100 ? (int)longest->length : 100, longest->text);
         log_output(debug_msg);
     }
     
     // Fix grid width calculation to match bash version logic
-    int grid_width;
-    if (config->width == 80 && max_width > 80) {
-        // Auto-detect width, but cap at 100 to match bash version behavior
-        grid_width = max_width;
-        if (grid_width > 100) grid_width = 100;
-    } else {
-        grid_width = config->width;
-    }
+    int grid_width = get_grid_width(config, max_width);
     
-    if (config->width == 80 && max_width > 80) {
+    if (grid_width != config->width) {
         snprintf(msg, sizeof(msg), "Auto-detected width: %d characters (max_width: %d, capped at 100)", 
                 grid_width, max_width);
         progress_output(msg);
@@ -502,207 +1677,481 @@ int process_lines_single_pass(Config *config, char **svg_output) {
     
     progress_output("Generating SVG fragments with enhanced caching");
     
-    // Generate SVG
-    size_t svg_size = 1024 * 1024;
-    *svg_output = malloc(svg_size);
-    if (!*svg_output) {
-        free(line_data);
-        return -1;
-    }
-    
-    char font_css[1024];
-    build_font_css(config->font_family, font_css, sizeof(font_css));
-    
-    int pos = 0;
-    pos += snprintf(*svg_output + pos, svg_size - pos,
-        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-        "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
-        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.2f\" height=\"%.2f\" viewBox=\"0 0 %.2f %.2f\">\n"
-        "  <defs><style type=\"text/css\">%s</style></defs>\n"
-        "  <rect width=\"100%%\" height=\"100%%\" fill=\"%s\" rx=\"6\"/>\n",
-        svg_width, svg_height, svg_width, svg_height, font_css, BG_COLOR);
+    // Generate SVG; rows are drawn reusing their fragments under this render's key
+    long long render_start = STATS_START();
+    long long render_output_ns = stats_output_ns();
+    tasks.row_limit = tasks.row_count < config->height ? tasks.row_count : config->height;
     
     // Calculate cell width (same logic as bash version)
-    double cell_width = (svg_width - (2.0 * DEFAULT_PADDING)) / grid_width;
+    tasks.cell_width = (svg_width - (2.0 * DEFAULT_PADDING)) / grid_width;
+    RenderLayout *layout = &render->current_layout;
+    render_layout_free(layout);
+    snprintf(layout->config_hash, sizeof(layout->config_hash), "%s", config_hash);
+    generate_render_key(config, tasks.cell_width, layout->render_key);
     
-    // Process each line
-    for (int i = 0; i < input_line_count && i < config->height; i++) {
-        double y_offset = DEFAULT_PADDING + config->font_size + (i * config->font_height);
-        
-        for (int j = 0; j < line_data[i].segment_count; j++) {
-            TextSegment *seg = &line_data[i].segments[j];
-            
-            if (strlen(seg->text) > 0) {
-                char escaped_text[MAX_LINE_LENGTH * 6];
-                xml_escape(seg->text, escaped_text, sizeof(escaped_text));
-                
-                // Use cell_width for proper positioning (matches bash version)
-                double current_x = DEFAULT_PADDING + (seg->visible_pos * cell_width);
-                double text_width = utf8_strlen(seg->text) * cell_width;
-                
-                if (debug_mode) {
-                    char debug_msg[512];
-                    snprintf(debug_msg, sizeof(debug_msg), "  SVG segment: text='%s' visible_pos=%d current_x=%.2f cell_width=%.2f", 
-                            seg->text, seg->visible_pos, current_x, cell_width);
-                    log_output(debug_msg);
-                }
-                
-                pos += snprintf(*svg_output + pos, svg_size - pos,
-                    "  <text x=\"%.2f\" y=\"%.2f\" font-size=\"%d\" class=\"terminal-text\" xml:space=\"preserve\" textLength=\"%.2f\" lengthAdjust=\"spacingAndGlyphs\" fill=\"%s\">%s</text>\n",
-                    current_x, y_offset, config->font_size, text_width, seg->fg_color, escaped_text);
-            }
-        }
-    }
-    
-    pos += snprintf(*svg_output + pos, svg_size - pos, "</svg>\n");
+    char *font_faces = config->embed_font ? font_embed_prepare(config, tasks.rows, tasks.row_limit) : NULL;
+    config->font_faces = font_faces;
+    const OutputBackend *backend = output_backend(config);
+    if (backend->render) {
+        // Other formats draw the wrapped rows themselves, at the SVG's geometry
+        BackendGrid grid = { tasks.rows, tasks.row_limit, grid_width, tasks.cell_width, svg_width, svg_height };
+        if (backend->render(config, &grid, writer) != 0) {
+            writer->error = 1;
+        }
+    } else {
+        // Rows whose line, position and layout are unchanged come straight from the fragment pack
+        if (open_fragment_pack(render, layout->render_key) != 0 && debug_mode) {
+            log_output("SVG fragment cache unavailable, rendering every line");
+        }
+        if (config->page_height > 0) {
+            if (render_pages(&tasks, writer, svg_width, svg_height) != 0) {
+                writer->error = 1;
+            }
+        } else {
+            render_document(&tasks, writer, svg_width, svg_height);
+        }
+        close_fragment_pack(render);
+    }
+    config->font_faces = NULL;
+    free(font_faces);
+    STATS_STOP(STATS_RENDER, render_start + (stats_output_ns() - render_output_ns));
+    stats_add_document(&render->stats, line_count, tasks.row_limit, segments);
     
     // Show cache statistics
+    const CacheCounters *counts = &render->stats;
     snprintf(msg, sizeof(msg), "Cache statistics: Segments %d/%d hits, SVG fragments %d/%d hits", 
-            cache_stats_segment_hits, cache_stats_segment_hits + cache_stats_segment_misses,
-            cache_stats_svg_hits, cache_stats_svg_hits + cache_stats_svg_misses);
+            counts->segment_hits, counts->segment_hits + counts->segment_misses,
+            counts->svg_hits, counts->svg_hits + counts->svg_misses);
     progress_output(msg);
+    if (counts->rows_reused > 0) {
+        snprintf(msg, sizeof(msg), "Incremental: reused %d of %d rows from the previous output",
+                counts->rows_reused, tasks.row_limit);
+        progress_output(msg);
+    }
+    
+    release_rows(&tasks, parse_blocks);
+    render_scratch_release(render);
     
-    save_incremental_cache(config_hash);
-    free(line_data);
+    if (writer->error) {
+        fprintf(stderr, "Error: Failed to write %s output\n", backend->label);
+        return -1;
+    }
     return 0;
 }
 
-// Validate SVG output using xmllint
-int validate_svg_output(const char *svg_content) {
-    char temp_file_path[MAX_PATH_LENGTH];
-    FILE *temp_file;
-    int validation_result = 0;
-
-    progress_output("SVG validation started");
-
-    // Create temporary file
-    char temp_filename[] = "/temp_validation.svg";
-    size_t cache_dir_len = strlen(cache_dir);
-    if (cache_dir_len + sizeof(temp_filename) > sizeof(temp_file_path)) {
-        fprintf(stderr, "Error: Cache directory path too long for temporary file\n");
-        return -1;
-    }
-    strcpy(temp_file_path, cache_dir);
-    strcat(temp_file_path, temp_filename);
-    temp_file = fopen(temp_file_path, "w");
-    if (!temp_file) {
-        fprintf(stderr, "Error: Cannot create temporary validation file\n");
-        return -1;
+// Start xmllint --valid reading the document from a pipe (--validate=dtd).
+// SIGPIPE is ignored so an xmllint that exits early only stops the tee.
+FILE* start_dtd_validation(void) {
+    signal(SIGPIPE, SIG_IGN);
+    FILE *pipe = popen("xmllint --loaddtd --valid --noout - >/dev/null 2>&1", "w");
+    if (!pipe && debug_mode) {
+        log_output("SVG validation: Cannot start xmllint for DTD validation");
     }
-    fprintf(temp_file, "%s", svg_content);
-    fclose(temp_file);
+    return pipe;
+}
 
-    // Check XML well-formedness
-    char command[1024];
-    snprintf(command, sizeof(command), "xmllint --noout \"%s\" 2>/dev/null", temp_file_path);
+// Report the outcome of validating the document just written; returns 1 when it was not well-formed
+int finish_svg_validation(const Config *config, XmlChecker *checker, FILE *dtd_pipe, int tee_error) {
+    char msg[256];
+    int validation_result = 0;
 
-    int xmllint_result = system(command);
-    if (xmllint_result != 0) {
-        progress_output("SVG validation failed: Not well-formed XML");
+    if (xml_check_finish(checker) != 0) {
+        snprintf(msg, sizeof(msg), "SVG validation failed: Not well-formed XML (line %ld, column %ld: %s)",
+                 checker->error_line, checker->error_column, checker->error);
+        progress_output(msg);
         validation_result = 1;
     } else {
         progress_output("SVG validation passed: Well-formed XML");
+    }
 
-        // Try validating against SVG 1.1 DTD with external entity loading enabled
-        snprintf(command, sizeof(command), "xmllint --loaddtd --valid --noout \"%s\" 2>/dev/null", temp_file_path);
-        xmllint_result = system(command);
-        if (xmllint_result == 0) {
-            if (debug_mode) {
-                log_output("SVG validation passed: Valid against DTD");
-            }
+    if (config->validate == VALIDATE_DTD) {
+        int status = dtd_pipe ? pclose(dtd_pipe) : -1;
+        if (status == 0 && !tee_error) {
+            progress_output("SVG validation passed: Valid against DTD");
         } else {
-            if (debug_mode) {
-                log_output("SVG validation: DTD validation completed (some features not in SVG 1.1 DTD)");
-            }
+            progress_output("SVG validation: DTD validation completed (some features not in SVG 1.1 DTD)");
         }
     }
-
-    // Clean up temporary file
-    unlink(temp_file_path);
+    signal(SIGPIPE, SIG_DFL);
 
     return validation_result;
 }
 
 // Output SVG
-int output_svg(Config *config) {
-    char *svg_content;
-
-    if (process_lines_single_pass(config, &svg_content) != 0) {
+int output_svg(RenderState *render, Config *config) {
+    OutputWriter writer;
+    FILE *output_file = stdout;
+    char temp_path[MAX_PATH_LENGTH + 32] = "";
+    
+    // Pages are named after the output file
+    if (config->page_height > 0 && strlen(config->output_file) == 0) {
+        fprintf(stderr, "Error: --page-height requires an output file\n");
         return -1;
     }
-
-    // Validate SVG output
-    validate_svg_output(svg_content);
-
+    const OutputBackend *backend = output_backend(config);
+    if (backend->render && config->page_height > 0) {
+        fprintf(stderr, "Error: --page-height writes SVG pages only, not %s\n", backend->label);
+        return -1;
+    }
+    // Validation is of the SVG's XML
+    int validate = backend->render ? VALIDATE_NONE : config->validate;
+    
+    // Regular files are written beside the target and renamed into place, so the
+    // previous output stays intact (and reusable) until the new one is complete
     if (strlen(config->output_file) > 0) {
-        FILE *output_file = fopen(config->output_file, "w");
+        struct stat st;
+        if (stat(config->output_file, &st) != 0 || S_ISREG(st.st_mode)) {
+            snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", config->output_file, (long)getpid());
+        }
+        output_file = fopen(temp_path[0] ? temp_path : config->output_file, "w");
         if (!output_file) {
             fprintf(stderr, "Error: Cannot create output file '%s'\n", config->output_file);
-            free(svg_content);
             return -1;
         }
-        fprintf(output_file, "%s", svg_content);
-        fclose(output_file);
-        
+    }
+    
+    // Validation checks the bytes as they stream out, so the document never has to sit in memory
+    if (writer_open_file(&writer, output_file) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        if (output_file != stdout) fclose(output_file);
+        return -1;
+    }
+    
+    XmlChecker checker;
+    FILE *dtd_pipe = NULL;
+    if (validate != VALIDATE_NONE) {
+        progress_output("SVG validation started");
+        xml_check_init(&checker);
+        writer.checker = &checker;
+        if (validate == VALIDATE_DTD) {
+            dtd_pipe = start_dtd_validation();
+            writer.tee = dtd_pipe;
+        }
+    }
+    
+    int result = process_lines_single_pass(render, config, &writer);
+    
+    if (writer_close(&writer) != 0) {
+        result = -1;
+    }
+    long long validate_start = STATS_START();
+    if (validate != VALIDATE_NONE) {
+        if (result == 0) {
+            finish_svg_validation(config, &checker, dtd_pipe, writer.tee_error);
+        } else if (dtd_pipe) {
+            pclose(dtd_pipe);
+            signal(SIGPIPE, SIG_DFL);
+        }
+        STATS_STOP(STATS_VALIDATE, validate_start);
+    }
+    long long write_start = STATS_START();
+    if (output_file != stdout) {
+        if (fclose(output_file) != 0) result = -1;
+    } else if (fflush(stdout) != 0) {
+        result = -1;
+    }
+    
+    if (result == 0 && temp_path[0] && rename(temp_path, config->output_file) != 0) {
+        result = -1;
+    }
+    STATS_STOP(STATS_WRITE, write_start);
+    if (result != 0) {
+        if (temp_path[0]) unlink(temp_path);
+        fprintf(stderr, "Error: Failed to write %s output\n", backend->label);
+        render_layout_free(&render->current_layout);
+        render_layout_free(&render->previous_layout);
+        return -1;
+    }
+    
+    // Remember where each row landed (and which file version) for the next run
+    RenderLayout *layout = &render->current_layout;
+    struct stat written;
+    if (!backend->render && temp_path[0] && stat(config->output_file, &written) == 0) {
+        snprintf(layout->output_file, sizeof(layout->output_file), "%s", config->output_file);
+        layout->output_size = (long long)written.st_size;
+        layout->output_mtime_sec = (long long)written.st_mtim.tv_sec;
+        layout->output_mtime_nsec = (long long)written.st_mtim.tv_nsec;
+    }
+    if (!resident_mode) {
+        save_incremental_cache(render, layout->config_hash);
+    }
+    render_layout_free(&render->current_layout);
+    render_layout_free(&render->previous_layout);
+    
+    if (strlen(config->output_file) > 0) {
         char msg[768];  // Larger buffer to accommodate long paths
-        snprintf(msg, sizeof(msg), "SVG written to: %.500s", config->output_file);
+        snprintf(msg, sizeof(msg), "%s written to: %.500s", backend->label, config->output_file);
         progress_output(msg);
-    } else {
-        printf("%s", svg_content);
     }
     
-    free(svg_content);
     return 0;
 }
 
-// Main function
-int main(int argc, char **argv) {
-    script_start_time = get_current_time();
+// Stream output targets: how the final dimensions reach the root element
+#define STREAM_DIRECT 0  // dimensions known up front (--width and --height given)
+#define STREAM_PATCH  1  // seekable output: patch a reserved region at the end
+#define STREAM_OPEN   2  // pipe: the grid width up front and no height
+
+// Open the stream output and write the header once the first line is known
+static int stream_begin(Config *config, FILE **output, OutputWriter *writer,
+                        int *mode, off_t *header_base, size_t *dims_offset) {
+    *output = stdout;
+    if (strlen(config->output_file) > 0) {
+        *output = fopen(config->output_file, "w");
+        if (!*output) {
+            fprintf(stderr, "Error: Cannot create output file '%s'\n", config->output_file);
+            return -1;
+        }
+    }
     
-    Config config;
+    struct stat st;
+    *header_base = -1;
+    if (fstat(fileno(*output), &st) == 0 && S_ISREG(st.st_mode)) {
+        fflush(*output);
+        *header_base = ftello(*output);
+    }
     
-    if (argc == 1 && isatty(STDIN_FILENO)) {
-        show_help();
-        return 0;
+    // Bytes sent down a pipe stay sent, so a pipe gets what is known up front:
+    // the grid width (--width, or 80) and the height only when it is given
+    if (config->height_explicit && (config->width_explicit || *header_base < 0)) {
+        *mode = STREAM_DIRECT;
+    } else if (*header_base >= 0) {
+        *mode = STREAM_PATCH;
+    } else {
+        *mode = STREAM_OPEN;
     }
     
-    if (parse_arguments(argc, argv, &config) != 0) {
-        return 1;
+    if (writer_open_file(writer, *output) != 0) {
+        fprintf(stderr, "Error: Cannot set up streaming output\n");
+        return -1;
     }
     
-    setup_cache_directories();
+    if (*mode == STREAM_PATCH) {
+        return write_svg_header(writer, config, 0, 0, SVG_DIMENSIONS_RESERVE, dims_offset, NULL);
+    }
+    double svg_width = (2 * DEFAULT_PADDING) + (config->width * config->font_width);
+    double svg_height = *mode == STREAM_DIRECT ? (2 * DEFAULT_PADDING) + (config->height * config->font_height) : 0;
+    return write_svg_header(writer, config, svg_width, svg_height, 0, NULL, NULL);
+}
+
+// Put the final dimensions in place and finish the document. A header written
+// before the rows could not name their styles, so those follow in a second <style>.
+static int stream_finish(Config *config, FILE *output, OutputWriter *writer,
+                         int mode, off_t header_base, size_t dims_offset, int grid_width, int rows,
+                         const StylePalette *palette) {
+    double svg_width = (2 * DEFAULT_PADDING) + (grid_width * config->font_width);
+    double svg_height = (2 * DEFAULT_PADDING) + (rows * config->font_height);
+    int result = 0;
+    
+    writer_puts(writer, "  <defs><style type=\"text/css\">");
+    palette_write_css(writer, palette);
+    writer_puts(writer, "</style></defs>\n");
+    writer_puts(writer, "</svg>\n");
+    if (writer_close(writer) != 0) result = -1;
     
-    if (!config.font_width_explicit || !config.font_height_explicit) {
-        calculate_font_metrics(&config);
+    if (mode == STREAM_PATCH) {
+        char dimensions[SVG_DIMENSIONS_RESERVE + 1];
+        int length = format_svg_dimensions(dimensions, sizeof(dimensions), svg_width, svg_height);
+        memset(dimensions + length, ' ', SVG_DIMENSIONS_RESERVE - length);
+        if (fflush(output) != 0 ||
+            fseeko(output, header_base + (off_t)dims_offset, SEEK_SET) != 0 ||
+            fwrite(dimensions, 1, SVG_DIMENSIONS_RESERVE, output) != SVG_DIMENSIONS_RESERVE ||
+            fseeko(output, 0, SEEK_END) != 0) {
+            result = -1;
+        }
     }
     
-    char msg[768];  // Larger buffer to accommodate long paths
-    progress_output("Parsed options:");
-    const char *input_name = strlen(config.input_file) > 0 ? config.input_file : "stdin";
-    const char *output_name = strlen(config.output_file) > 0 ? config.output_file : "stdout";
-    snprintf(msg, sizeof(msg), "  Input: %.500s", input_name);
-    progress_output(msg);
-    snprintf(msg, sizeof(msg), "  Output: %.500s", output_name);
-    progress_output(msg);
-    snprintf(msg, sizeof(msg), "  Font: %s %dpx (width: %.2f, line height: %.2f, weight: %d)", 
-            config.font_family, config.font_size, config.font_width, config.font_height, config.font_weight);
-    progress_output(msg);
-    snprintf(msg, sizeof(msg), "  Grid: %dx%d", config.width, config.height);
-    progress_output(msg);
-    snprintf(msg, sizeof(msg), "  Wrap: %s", config.wrap ? "true" : "false");
-    progress_output(msg);
-    snprintf(msg, sizeof(msg), "  Tab size: %d", config.tab_size);
+    if (output != stdout) {
+        if (fclose(output) != 0) result = -1;
+    } else if (fflush(stdout) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// Stream mode: parse and emit each line as it arrives, without the line table
+int stream_svg(RenderState *render, Config *config) {
+    FILE *input = stdin;
+    const char *input_name = strlen(config->input_file) > 0 ? config->input_file : "stdin";
+    if (output_backend(config)->render) {
+        fprintf(stderr, "Error: --stream writes SVG only, not %s\n", output_backend(config)->label);
+        return -1;
+    }
+    if (strlen(config->input_file) > 0) {
+        input = fopen(config->input_file, "r");
+        if (!input) {
+            fprintf(stderr, "Error: Input file '%s' not found\n", config->input_file);
+            return -1;
+        }
+    }
+    
+    char msg[768];
+    snprintf(msg, sizeof(msg), "Streaming lines from %.500s", input_name);
     progress_output(msg);
     
-    if (read_input(&config) != 0) {
-        return 1;
+    char config_hash[MAX_HASH_LENGTH];
+    generate_config_hash(config, config_hash);
+    memset(&render->stats, 0, sizeof(render->stats));
+    if (cache_format == CACHE_FORMAT_PACK && open_line_pack(render, config_hash) != 0) {
+        progress_output("Warning: Cannot open pack cache, falling back to JSON cache");
+    }
+    
+    OutputWriter writer;
+    FILE *output = NULL;
+    int mode = STREAM_DIRECT;
+    off_t header_base = -1;
+    size_t dims_offset = 0;
+    
+    LineArena arena;
+    LineData line_data;
+    LineData *wrapped = NULL;
+    int wrapped_capacity = 0;
+    StylePalette palette = { 0 };
+    BackgroundLayer backgrounds = { 0 };
+    line_arena_init(&arena);
+    
+    // With a producer behind the input, each line goes out as soon as it is drawn
+    struct stat input_stat;
+    int flush_rows = fstat(fileno(input), &input_stat) != 0 || !S_ISREG(input_stat.st_mode);
+    
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    int rows = 0;
+    int lines = 0;
+    long long segments = 0;
+    int max_width = 0;
+    int wide_lines = 0;
+    int result = 0;
+    
+    long long stage_start = STATS_START();
+    while ((length = getline(&line, &line_capacity, input)) != -1) {
+        STATS_STOP(STATS_READ, stage_start);
+        STATS_ADD_BYTES(stats_bytes_in, length);
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+        length = (ssize_t)strlen(line);  // a NUL byte ends the line's text
+        
+        stage_start = STATS_START();
+        char line_hash[MAX_HASH_LENGTH];
+        snprintf(line_hash, sizeof(line_hash), "%u", generate_hash(line));
+        STATS_STOP(STATS_HASH, stage_start);
+        
+        stage_start = STATS_START();
+        line_arena_reset(&arena);
+        line_data.arena = &arena;
+        if (parse_ansi_line(render, line, (size_t)length, line_hash, config_hash, config->tab_size, &line_data) != 0) {
+            result = -1;
+            break;
+        }
+        STATS_STOP(STATS_PARSE, stage_start);
+        lines++;
+        segments += line_data.segment_count;
+        if (line_data.visible_length > max_width) {
+            max_width = line_data.visible_length;
+        }
+        
+        if (rows == 0) {
+            if (stream_begin(config, &output, &writer, &mode, &header_base, &dims_offset) != 0) {
+                result = -1;
+                break;
+            }
+            // Each row's rects go out just before its text
+            background_begin(&backgrounds, config, config->font_width, 0, &writer);
+        }
+        // A header already sent fixed the grid width; say so once when a line cannot fit
+        if (!config->wrap && mode != STREAM_PATCH && line_data.visible_length > config->width && wide_lines++ == 0) {
+            snprintf(msg, sizeof(msg), "Warning: Line %d is %d columns wide and is cut off at the %d-column grid "
+                     "declared before streaming; pass a wider --width or --wrap",
+                     lines, line_data.visible_length, config->width);
+            progress_output(msg);
+        }
+        
+        // Without --wrap a line is a single row
+        int bound = config->wrap ? wrap_row_bound(&line_data, config->width) : 1;
+        if (bound > wrapped_capacity) {
+            LineData *grown = realloc(wrapped, bound * sizeof(LineData));
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            wrapped = grown;
+            wrapped_capacity = bound;
+        }
+        int count = config->wrap ? wrap_line(&line_data, config->width, wrapped) : 1;
+        if (count < 0) {
+            result = -1;
+            break;
+        }
+        if (!config->wrap) wrapped[0] = line_data;
+        stage_start = STATS_START();
+        long long output_ns = stats_output_ns();
+        for (int k = 0; k < count; k++) {
+            if (config->height == 0 || rows < config->height) {
+                palette_mark_line(&palette, &wrapped[k]);
+                background_add_row(&backgrounds, &wrapped[k], rows);
+                render_line_svg(&writer, config, &wrapped[k], rows, config->font_width);
+            }
+            rows++;
+        }
+        if (flush_rows && (writer_flush(&writer) != 0 || fflush(output) != 0)) {
+            result = -1;
+            break;
+        }
+        STATS_STOP(STATS_RENDER, stage_start + (stats_output_ns() - output_ns));
+        stage_start = STATS_START();
+    }
+    
+    free(line);
+    free(wrapped);
+    line_arena_free(&arena);
+    if (input != stdin) {
+        fclose(input);
     }
+    close_line_pack(render);
     
-    if (output_svg(&config) != 0) {
-        return 1;
+    if (rows == 0) {
+        if (result == 0) fprintf(stderr, "Error: No input provided\n");
+        palette_free(&palette);
+        return -1;
+    }
+    
+    // Only a patched header can take the width of the widest line
+    int grid_width = mode == STREAM_PATCH ? get_grid_width(config, max_width) : config->width;
+    int height = config->height > 0 ? config->height : rows;
+    if (backgrounds.out) background_end(&backgrounds);
+    long long write_start = STATS_START();
+    long long output_ns = stats_output_ns();
+    int finished = stream_finish(config, output, &writer, mode, header_base, dims_offset, grid_width, height,
+                                 &palette);
+    STATS_STOP(STATS_WRITE, write_start + (stats_output_ns() - output_ns));
+    stats_add_document(&render->stats, lines, height < rows ? height : rows, segments);
+    palette_free(&palette);
+    if (finished != 0 || result != 0) {
+        fprintf(stderr, "Error: Failed to write SVG output\n");
+        return -1;
     }
     
-    progress_output("Oh v1.009 SVG generation complete! 🎯");
+    snprintf(msg, sizeof(msg), "Streamed %d rows (grid width: %d chars, %s)", rows, grid_width,
+            mode == STREAM_DIRECT ? "fixed dimensions" : mode == STREAM_PATCH ? "dimensions patched in place" : "no height");
+    progress_output(msg);
+    if (wide_lines > 1) {
+        snprintf(msg, sizeof(msg), "Warning: %d lines were cut off at the %d-column grid", wide_lines, grid_width);
+        progress_output(msg);
+    }
+    const CacheCounters *counts = &render->stats;
+    snprintf(msg, sizeof(msg), "Cache statistics: Segments %d/%d hits, SVG fragments %d/%d hits", 
+            counts->segment_hits, counts->segment_hits + counts->segment_misses,
+            counts->svg_hits, counts->svg_hits + counts->svg_misses);
+    progress_output(msg);
+    if (config->validate) {
+        progress_output("SVG validation skipped in stream mode");
+    }
+    if (strlen(config->output_file) > 0) {
+        snprintf(msg, sizeof(msg), "SVG written to: %.500s", config->output_file);
+        progress_output(msg);
+    }
     
     return 0;
 }
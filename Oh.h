@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -17,46 +18,90 @@
 #include <errno.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
 #include <jansson.h>
 
 // MetaData
 #define SCRIPT_NAME "Oh"
-#define SCRIPT_VERSION "1.009"
+#define SCRIPT_VERSION "1.038"
+// Bump when parsed segments change meaning, so cached ones are not reused
+#define SEGMENT_CACHE_VERSION 2
 
 // Configuration constants
 #define MAX_LINE_LENGTH 4096
+#define SVG_DIMENSIONS_RESERVE 128
+#define XML_ESCAPE_MAX(length) ((length) * 6)
 #define MAX_LINES 10000
-#define MAX_SEGMENTS 1000
 #define MAX_PATH_LENGTH 512
 #define MAX_HASH_LENGTH 64
 #define MAX_COLOR_LENGTH 16
 #define MAX_FONT_NAME_LENGTH 64
 #define MAX_URL_LENGTH 256
 #define MAX_CACHE_KEY_LENGTH 128
+#define MAX_JOBS 256
+#define XML_CHECK_MAX_DEPTH 64
+#define LINE_BLOCK_SIZE 256
 #define DEFAULT_FONT_SIZE 14
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 0
 #define DEFAULT_TAB_SIZE 8
 #define DEFAULT_PADDING 20
 #define DEFAULT_FONT_WEIGHT 400
+#define DEFAULT_MEMORY_CACHE_MB 256
+#define SERVE_CONNECTION_THREADS 4      // --serve requests rendered at once
+#define DEFAULT_CACHE_MAX_SIZE (1024LL * 1024 * 1024)
+#define CACHE_FORMAT_JSON 0
+#define CACHE_FORMAT_PACK 1
 #define BG_COLOR "#1e1e1e"
 #define TEXT_COLOR "#ffffff"
 
+// An input line: a view into the mapped input file or the buffer a stream
+// was read into, so it is not NUL-terminated
+typedef struct {
+    const char *text;
+    size_t length;
+} InputLine;
+
 // Global variables (declared as extern)
 extern double script_start_time;
 extern int debug_mode;
 extern char cache_dir[MAX_PATH_LENGTH];
 extern char svg_cache_dir[MAX_PATH_LENGTH];
+extern char font_cache_dir[MAX_PATH_LENGTH];
 extern char incremental_cache_file[MAX_PATH_LENGTH];
-extern int cache_stats_segment_hits;
-extern int cache_stats_segment_misses;
-extern int cache_stats_svg_hits;
-extern int cache_stats_svg_misses;
-extern char input_lines[MAX_LINES][MAX_LINE_LENGTH];
-extern char hash_cache[MAX_LINES][MAX_HASH_LENGTH];
-extern int input_line_count;
-extern char global_input_hash[MAX_HASH_LENGTH];
-extern char previous_input_hash[MAX_HASH_LENGTH];
+extern int cache_format;
+extern int resident_mode;
+extern long long cache_max_size;
+
+// Statistics counters are bumped from worker threads (and byte counts from
+// renders running at once)
+#define CACHE_STAT_INC(counter) __atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+#define STATS_ADD_BYTES(counter, bytes) __atomic_fetch_add(&(counter), (long long)(bytes), __ATOMIC_RELAXED)
+
+// Pipeline stages timed for --stats
+#define STATS_READ          0
+#define STATS_HASH          1
+#define STATS_CACHE_LOOKUP  2
+#define STATS_PARSE         3
+#define STATS_RENDER        4
+#define STATS_VALIDATE      5
+#define STATS_WRITE         6
+#define STATS_STAGES        7
+
+// Stage timers read the clock only when statistics were asked for
+extern int stats_enabled;
+extern long long stats_bytes_in;
+extern long long stats_bytes_out;
+#define STATS_START() (stats_enabled ? stats_clock_ns() : 0)
+#define STATS_STOP(stage, start) do { if (stats_enabled) stats_add_time((stage), (start)); } while (0)
+
+// One input file and where its SVG goes (--batch entries, repeated -i/-o)
+typedef struct {
+    char input_file[MAX_PATH_LENGTH];
+    char output_file[MAX_PATH_LENGTH];
+} FilePair;
 
 // Configuration structure
 typedef struct {
@@ -73,24 +118,188 @@ typedef struct {
     int tab_size;
     int font_width_explicit;
     int font_height_explicit;
+    int width_explicit;
+    int height_explicit;
+    int validate;
+    int stream;
+    int jobs;
+    int compact;
+    char serve_socket[MAX_PATH_LENGTH];
+    char connect_socket[MAX_PATH_LENGTH];
+    char batch_file[MAX_PATH_LENGTH];
+    FilePair *file_pairs;       // every -i/-o pair when more than one -i is given
+    int file_pair_count;
+    int cache_gc;
+    int memory_cache_mb;
+    int stats;
+    char stats_file[MAX_PATH_LENGTH];
+    int cast;
+    int dedup;
+    int page_height;
+    int embed_font;
+    int format;
+    char font_file[MAX_PATH_LENGTH];
+    const char *font_faces;     // --embed-font: @font-face rules, set while rendering
 } Config;
 
-// Text segment for ANSI parsing
+// Output formats (--format); FORMAT_AUTO picks one from the output file's extension
+#define FORMAT_AUTO -1
+#define FORMAT_SVG   0
+#define FORMAT_HTML  1
+#define FORMAT_PNG   2
+
+// Statistics reports (--stats)
+#define STATS_NONE 0
+#define STATS_JSON 1  // one JSON object on stderr when the run finishes
+
+// Validation levels (--validate)
+#define VALIDATE_NONE 0  // no checking
+#define VALIDATE_FAST 1  // in-process well-formedness check while writing
+#define VALIDATE_DTD  2  // fast check plus xmllint --valid fed through a pipe
+
+// Streaming XML well-formedness checker state
 typedef struct {
-    char text[MAX_LINE_LENGTH];
-    char fg_color[MAX_COLOR_LENGTH];
-    char bg_color[MAX_COLOR_LENGTH];
-    int bold;
+    int state;
+    int return_state;
+    int match;
+    unsigned char quote;
+    int depth;
+    int root_seen;
+    int root_closed;
+    size_t name_start[XML_CHECK_MAX_DEPTH];
+    char names[1024];
+    size_t names_used;
+    char name[128];
+    size_t name_length;
+    char attributes[512];
+    size_t attributes_used;
+    long line;
+    long column;
+    long error_line;
+    long error_column;
+    char error[64];
+} XmlChecker;
+
+// Buffered output writer: streams to a FILE, or grows in memory when file is NULL.
+// Bytes leaving a file writer also pass through the optional checker and tee.
+typedef struct {
+    FILE *file;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    size_t bytes_written;
+    int error;
+    XmlChecker *checker;
+    FILE *tee;
+    int tee_error;
+} OutputWriter;
+
+// Sentinel color index for "no color" (e.g. default background)
+#define COLOR_NONE 0xFFFF
+
+// Text segment for ANSI parsing; text is a NUL-terminated slice of the line arena
+typedef struct {
+    uint32_t text_offset;
+    uint32_t text_length;
+    uint16_t fg;
+    uint16_t bg;
+    uint8_t bold;
     int visible_pos;
 } TextSegment;
 
-// Line data
+// Shared, growable storage for parsed segments and their text
+typedef struct {
+    char *text;
+    size_t text_size;
+    size_t text_capacity;
+    TextSegment *segments;
+    size_t segment_count;
+    size_t segment_capacity;
+} LineArena;
+
+// Bump allocator: memory lives until the arena is reset (Oh-arena.c)
+typedef struct ArenaChunk ArenaChunk;
 typedef struct {
-    TextSegment segments[MAX_SEGMENTS];
+    ArenaChunk *chunks;     // newest first
+    size_t allocated;       // bytes handed out since the last reset
+} Arena;
+
+// Line data: a contiguous run of segments in an arena
+typedef struct {
+    LineArena *arena;
+    uint32_t first_segment;
     int segment_count;
     int visible_length;
 } LineData;
 
+#define LINE_SEGMENT(line, i) (&(line)->arena->segments[(line)->first_segment + (i)])
+#define SEGMENT_TEXT(line, seg) ((line)->arena->text + (seg)->text_offset)
+
+// Graphic rendition state while parsing a line (or emulating a screen)
+typedef struct {
+    uint16_t fg;
+    uint16_t bg;
+    int bold;
+} SgrState;
+
+#define SGR_MAX_PARAMS 32
+
+// Style classes a document uses: one CSS class per (fg, bold) combination
+typedef struct {
+    uint8_t *used;      // indexed by fg * 2 + bold
+    size_t capacity;
+} StylePalette;
+
+#define STYLE_CLASS_LENGTH (MAX_COLOR_LENGTH + 2)
+
+// A run of cells [start, end) with one background color over rows first_row..last_row
+typedef struct {
+    int start;
+    int end;
+    uint16_t bg;
+    int first_row;
+    int last_row;
+} BackgroundSpan;
+
+// Merges background cells into as few <rect>s as possible: adjacent cells of
+// a row join into spans, and a span repeated on the following row grows down
+// instead of starting a new rect. Finished rects are written to out.
+typedef struct {
+    const Config *config;
+    double cell_width;
+    int vertical;       // merge across rows (0: every row's rects are written at once)
+    OutputWriter *out;
+    BackgroundSpan *open;
+    int open_count;
+    BackgroundSpan *row;
+    int row_count;
+    int capacity;
+    int rects;
+} BackgroundLayer;
+
+// The parsed cell grid a backend draws: rows and the same geometry as the SVG
+typedef struct {
+    const LineData *rows;
+    int row_count;
+    int grid_width;         // columns
+    double cell_width;
+    double width;           // document size in pixels
+    double height;
+} BackendGrid;
+
+// An output format drawn straight from the parsed grid. SVG is the native
+// path with its fragment caches and incremental reuse (render is NULL);
+// other backends write the whole document from the grid.
+typedef struct {
+    const char *name;       // --format value
+    const char *label;      // in progress messages
+    const char *extension;
+    int (*render)(const Config *config, const BackendGrid *grid, OutputWriter *writer);
+} OutputBackend;
+
+extern const OutputBackend output_backends[];
+const OutputBackend* output_backend(const Config *config);
+
 // Font character width ratios structure
 typedef struct {
     char name[MAX_FONT_NAME_LENGTH];
@@ -103,21 +312,155 @@ typedef struct {
     char url[MAX_URL_LENGTH];
 } GoogleFont;
 
-// ANSI color mappings structure
+// Pack file index slot (open addressing)
 typedef struct {
-    int code;
-    char color[MAX_COLOR_LENGTH];
-} AnsiColor;
+    uint64_t key;
+    size_t offset;
+    int used;
+    int pending;
+} PackIndexEntry;
+
+// Append-only, mmap'd cache pack file
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    int fd;
+    const unsigned char *map;
+    size_t map_size;
+    size_t valid_size;
+    pthread_mutex_t mutex;
+    PackIndexEntry *index;
+    size_t index_count;
+    size_t index_capacity;
+    unsigned char *pending;
+    size_t pending_size;
+    size_t pending_capacity;
+} PackFile;
+
+
+// In-memory LRU cache entry: 128-bit key and payload, on a hash chain and the recency list
+typedef struct MemoryCacheEntry {
+    struct MemoryCacheEntry *hash_next;
+    struct MemoryCacheEntry *newer;
+    struct MemoryCacheEntry *older;
+    uint64_t key_hi;
+    uint64_t key_lo;
+    uint32_t length;
+    unsigned char data[];
+} MemoryCacheEntry;
+
+// Byte-bounded LRU cache shared by worker threads (callers hold mutex)
+typedef struct {
+    pthread_mutex_t mutex;
+    MemoryCacheEntry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    MemoryCacheEntry *newest;
+    MemoryCacheEntry *oldest;
+    size_t bytes;
+    size_t max_bytes;
+    long hits;
+    long misses;
+    long evictions;
+} MemoryCache;
+
+extern MemoryCache *line_memory;
+extern MemoryCache *fragment_memory;
+
+// Where each row of a rendered SVG lives, kept in incremental.json so the
+// next run can copy unchanged rows out of the previous output file
+typedef struct {
+    char output_file[MAX_PATH_LENGTH];
+    char config_hash[MAX_HASH_LENGTH];
+    char render_key[MAX_HASH_LENGTH];
+    long long output_size;
+    long long output_mtime_sec;
+    long long output_mtime_nsec;
+    long long body_offset;
+    int row_count;
+    uint32_t *row_hashes;
+    uint32_t *row_lengths;
+} RenderLayout;
+
+// Cache lookups of one document, bumped from the workers rendering it
+typedef struct {
+    int segment_hits;
+    int segment_misses;
+    int svg_hits;
+    int svg_misses;
+    int rows_reused;
+    int line_memory_hits;
+    int fragment_memory_hits;
+} CacheCounters;
+
+// Everything one render works on: its input and the line table of views
+// into it, the caches it has open, the row layouts of incremental
+// re-rendering and the memory it draws from. The CLI has one, every liboh
+// context and --serve connection its own, so renders run side by side.
+typedef struct {
+    char *input_data;           // the whole input: a mapped file or a read buffer
+    size_t input_size;
+    int input_mapped;
+    InputLine *lines;
+    char (*line_hashes)[MAX_HASH_LENGTH];
+    int line_count;
+    int line_capacity;
+    char input_hash[MAX_HASH_LENGTH];
+    char previous_input_hash[MAX_HASH_LENGTH];
+    RenderLayout previous_layout;
+    RenderLayout current_layout;
+    CacheCounters stats;
+    PackFile line_pack;
+    PackFile fragment_pack;
+    uint64_t fragment_namespace;
+    Arena arena;                // the render's arrays
+    LineArena *line_arenas;     // one per worker, kept between resident renders
+    int line_arena_count;
+    OutputWriter *fragments;    // render_lines_parallel's block writers, kept likewise
+    int fragment_count;
+} RenderState;
+
+// Tells whether items a and b that share a hash are the same (--dedup)
+typedef int (*DuplicateTest)(int a, int b, const void *context);
+
+// Worker thread pool
+typedef void (*PoolTask)(void *context, int task, int worker);
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+    ThreadPool *pool;
+    pthread_t thread;
+    int index;
+} ThreadPoolWorker;
+
+struct ThreadPool {
+    ThreadPoolWorker *workers;
+    int thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    PoolTask task;
+    void *context;
+    int task_count;
+    int next_task;
+    int active;
+    int busy;               // a caller's job is running on the threads
+    unsigned int generation;
+    int shutdown;
+};
+
+extern ThreadPool *worker_pool;
 
 // External data arrays (declared in Oh.c)
 extern FontRatio font_ratios[];
 extern GoogleFont google_fonts[];
-extern AnsiColor ansi_colors[];
+extern const char ansi_palette[256][8];
 
 // Function declarations
 double get_current_time(void);
 void log_output(const char *message);
 void progress_output(const char *message);
+void status_output(const char *message);
 void show_version(void);
 void show_help(void);
 int parse_arguments(int argc, char **argv, Config *config);
@@ -128,24 +471,157 @@ const char* get_google_font_url(const char *font_family);
 const char* get_ansi_color(int code);
 void xml_escape(const char *input, char *output, size_t output_size);
 void xml_escape_url(const char *input, char *output, size_t output_size);
+void cksum_init_tables(void);
+uint32_t cksum_update(uint32_t crc, const void *data, size_t length);
+uint32_t cksum_finish(uint32_t crc, size_t total_length);
 unsigned int generate_hash(const char *input);
+unsigned int generate_hash_bytes(const char *input, size_t length);
+unsigned int generate_hash_popen(const char *input);
 void generate_config_hash(const Config *config, char *hash_out);
+void generate_render_key(const Config *config, double cell_width, char *key_out);
 void get_cache_key(const char *line_hash, const char *config_hash, char *cache_key);
 int save_line_cache(const char *cache_key, const LineData *line_data);
 int load_line_cache(const char *cache_key, LineData *line_data);
 void get_svg_fragment_cache_key(const char *line_hash, const char *config_hash, int line_number, char *cache_key);
 int save_svg_fragment_cache(const char *cache_key, const char *svg_fragment);
 char* load_svg_fragment_cache(const char *cache_key);
-void generate_global_input_hash(void);
-int load_incremental_cache(void);
-int save_incremental_cache(const char *config_hash);
-void expand_tabs(const char *input, char *output, int tab_size);
+int pack_open(PackFile *pack, const char *path);
+const void* pack_lookup(const PackFile *pack, uint64_t key, uint32_t *length);
+int pack_append(PackFile *pack, uint64_t key, const void *data, uint32_t length);
+int pack_close(PackFile *pack);
+int open_line_pack(RenderState *render, const char *config_hash);
+void close_line_pack(RenderState *render);
+int save_line_pack(PackFile *pack, const char *line_hash, const LineData *line_data);
+int load_line_pack(PackFile *pack, const char *line_hash, LineData *line_data);
+int open_fragment_pack(RenderState *render, const char *render_key);
+void close_fragment_pack(RenderState *render);
+int load_svg_fragment_pack(RenderState *render, uint32_t row_hash, int row, OutputWriter *writer);
+int save_svg_fragment_pack(RenderState *render, uint32_t row_hash, int row, const char *fragment, size_t length);
+unsigned char* line_payload_encode(const LineData *line_data, size_t *payload_size);
+int line_payload_decode(const unsigned char *payload, uint32_t length, LineData *line_data);
+MemoryCache* memory_cache_create(size_t max_bytes);
+void memory_cache_destroy(MemoryCache *cache);
+const void* memory_cache_lookup(MemoryCache *cache, uint64_t key_hi, uint64_t key_lo, uint32_t *length);
+int memory_cache_store(MemoryCache *cache, uint64_t key_hi, uint64_t key_lo, const void *data, uint32_t length);
+void cache_usage_add(size_t bytes);
+void cache_touch(const char *path);
+int cache_gc(long long max_bytes);
+void cache_enforce_limit(void);
+long long stats_clock_ns(void);
+void stats_add_time(int stage, long long start_ns);
+long long stats_output_ns(void);
+void stats_add_document(const CacheCounters *counters, int lines, int rows, long long segments);
+int stats_report(const Config *config, int status);
+int memory_caches_create(int megabytes, int fragments);
+void memory_caches_destroy(void);
+int load_line_memory(const char *line_hash, const char *config_hash, LineData *line_data);
+int save_line_memory(const char *line_hash, const char *config_hash, const LineData *line_data);
+int load_fragment_memory(uint64_t render_key, uint64_t fragment_key, OutputWriter *writer);
+int save_fragment_memory(uint64_t render_key, uint64_t fragment_key, const char *fragment, size_t length);
+void generate_global_input_hash(RenderState *render);
+int load_incremental_cache(RenderState *render);
+int save_incremental_cache(const RenderState *render, const char *config_hash);
+void render_layout_free(RenderLayout *layout);
+int align_line_hashes(const uint32_t *old_hashes, int old_count,
+                      const uint32_t *new_hashes, int new_count, int *match);
+int find_duplicates(const uint32_t *hashes, int count, DuplicateTest same, const void *context, int *first);
+void* arena_alloc(Arena *arena, size_t size);
+void* arena_calloc(Arena *arena, size_t count, size_t size);
+int arena_owns(const Arena *arena, const void *pointer);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+void scratch_begin(void);
+void scratch_end(void);
+void* scratch_alloc(size_t size);
+void scratch_install(void);
+uint16_t intern_color(const char *color);
+const char* color_name(uint16_t index);
+void line_arena_init(LineArena *arena);
+void line_arena_free(LineArena *arena);
+void line_arena_reset(LineArena *arena);
+void line_begin(LineData *line_data, LineArena *arena);
+int line_add_segment(LineData *line_data, const char *text, size_t length,
+                     uint16_t fg, uint16_t bg, int bold, int visible_pos);
+int segment_cells(const LineData *line, int index);
+int wrap_row_bound(const LineData *line, int width);
+int wrap_line(const LineData *line, int width, LineData *rows);
 int utf8_strlen(const char *str);
-int parse_ansi_line(const char *line, const char *line_hash, const char *config_hash, LineData *line_data);
-int read_input(Config *config);
-void build_font_css(const char *font, char *css_output, size_t css_size);
-int process_lines_single_pass(Config *config, char **svg_output);
-int validate_svg_output(const char *svg_content);
-int output_svg(Config *config);
+int codepoint_width(uint32_t codepoint);
+int utf8_next_width(const char *text, size_t length, size_t *offset);
+uint32_t utf8_next_codepoint(const char *text, size_t length, size_t *offset);
+int utf8_cells(const char *text, size_t length);
+size_t scan_text_run(const char *text, size_t length, int *chars);
+size_t scan_text_run_scalar(const char *text, size_t length, int *chars);
+int utf8_count(const char *text, size_t length);
+size_t xml_escape_run(char *output, const char *text, size_t length, int *chars);
+size_t xml_escape_run_scalar(char *output, const char *text, size_t length, int *chars);
+const char* scan_text_backend(void);
+void sgr_reset(SgrState *state);
+void sgr_apply(SgrState *state, const int *params, const uint8_t *colon, int count);
+int parse_ansi_line(RenderState *render, const char *line, size_t line_length, const char *line_hash,
+                    const char *config_hash, int tab_size, LineData *line_data);
+void render_state_init(RenderState *render);
+void render_state_free(RenderState *render);
+int read_input(RenderState *render, Config *config);
+int load_input_lines(RenderState *render, Config *config, const char *data, size_t size, const char *source_name);
+void release_input(RenderState *render);
+void build_font_css(const Config *config, char *css_output, size_t css_size);
+int writer_open_file(OutputWriter *writer, FILE *file);
+int writer_open_memory(OutputWriter *writer);
+int writer_flush(OutputWriter *writer);
+int writer_write(OutputWriter *writer, const char *data, size_t length);
+int writer_puts(OutputWriter *writer, const char *text);
+int writer_printf(OutputWriter *writer, const char *format, ...);
+int writer_close(OutputWriter *writer);
+void writer_reset(OutputWriter *writer);
+ThreadPool* pool_create(int thread_count);
+void pool_run(ThreadPool *pool, PoolTask task, void *context, int task_count);
+void pool_destroy(ThreadPool *pool);
+int pool_size(const ThreadPool *pool);
+int writer_write_replacing(OutputWriter *writer, const char *data, size_t length,
+                           const char *from, const char *to);
+int writer_write_escaped(OutputWriter *writer, const char *text, size_t length,
+                         size_t *escaped_length, int *chars);
+int get_grid_width(const Config *config, int max_width);
+int format_svg_dimensions(char *output, size_t output_size, double svg_width, double svg_height);
+int write_svg_header(OutputWriter *writer, const Config *config, double svg_width, double svg_height,
+                     size_t reserve, size_t *dims_offset, const StylePalette *palette);
+void palette_mark_line(StylePalette *palette, const LineData *line);
+int palette_write_css(OutputWriter *writer, const StylePalette *palette);
+int palette_write_rules(OutputWriter *writer, const StylePalette *palette, const char *property);
+void palette_free(StylePalette *palette);
+int style_class_name(uint16_t fg, int bold, char *class_out);
+void background_begin(BackgroundLayer *layer, const Config *config, double cell_width, int vertical, OutputWriter *out);
+int background_add_row(BackgroundLayer *layer, const LineData *line, int row);
+int background_end(BackgroundLayer *layer);
+int render_line_svg(OutputWriter *writer, const Config *config, const LineData *line, int row, double cell_width);
+int process_lines_single_pass(RenderState *render, Config *config, OutputWriter *writer);
+FILE* start_dtd_validation(void);
+int finish_svg_validation(const Config *config, XmlChecker *checker, FILE *dtd_pipe, int tee_error);
+void xml_check_init(XmlChecker *checker);
+void xml_check_feed(XmlChecker *checker, const char *data, size_t length);
+int xml_check_finish(XmlChecker *checker);
+int output_svg(RenderState *render, Config *config);
+int stream_svg(RenderState *render, Config *config);
+int serve_svg(Config *config);
+// What one resident render did, for --serve's status lines
+typedef struct {
+    int lines;
+    int segment_hits;
+    int segment_misses;
+    int fragment_hits;
+    int fragment_misses;
+} RenderSummary;
+
+int parse_render_options(char *line, Config *config, char *error, size_t error_size);
+int render_resident(RenderState *render, const Config *config, const char *input, size_t length,
+                    OutputWriter *writer, RenderSummary *summary, char *error, size_t error_size);
+int connect_svg(const Config *config, int argc, char **argv);
+int batch_svg(Config *config);
+int is_cast_file(const char *path);
+int cast_svg(Config *config);
+char* font_embed_prepare(const Config *config, const LineData *rows, int row_count);
+int html_render(const Config *config, const BackendGrid *grid, OutputWriter *writer);
+int png_render(const Config *config, const BackendGrid *grid, OutputWriter *writer);
 
 #endif // OH_H
@@ -0,0 +1,46 @@
+/*
+ * liboh.h - Embeddable API for Oh (liboh.a, liboh.so)
+ * Part of Oh.c - Convert ANSI terminal output to GitHub-compatible SVG
+ *
+ * A context holds one set of rendering options, parsed once, and renders
+ * any number of inputs with them; the parsed lines and fragments stay in
+ * the process's in-memory caches between renders, as in --serve.
+ *
+ * Each context keeps its own line table, layout, counters and working
+ * memory, so contexts render concurrently on different threads; use each
+ * context from one thread at a time. One render at a time spreads over the
+ * worker pool, and a render that finds the pool busy runs on its own
+ * thread instead of waiting.
+ */
+
+#ifndef LIBOH_H
+#define LIBOH_H
+
+#include <stddef.h>
+
+typedef struct oh_context oh_context;
+
+// Receives the rendered document; returning nonzero fails the render
+typedef struct {
+    int (*write)(void *user, const char *data, size_t length);
+    void *user;
+} oh_writer;
+
+// Create a context from options written as on the command line, e.g.
+// "--font 'Fira Code' --wrap --width 100"; options that belong to a process
+// (input, output, --jobs, --serve, ...) are refused, as is --embed-font,
+// which would fetch from the network while other renders wait. Returns NULL with a
+// message in error when the options are invalid or Oh cannot start.
+// OH_JOBS (0 for all cores) and OH_MEMORY_CACHE (MB) are read when the
+// first context is created.
+oh_context* oh_context_new(const char *options, char *error, size_t error_size);
+
+// Render length bytes of ANSI input and write the document to writer.
+// Returns 0, or -1 with the reason in oh_context_error().
+int oh_render(oh_context *ctx, const char *input, size_t length, const oh_writer *writer);
+
+const char* oh_context_error(const oh_context *ctx);
+void oh_context_free(oh_context *ctx);
+const char* oh_version(void);
+
+#endif // LIBOH_H
@@ -10,8 +10,8 @@ setup() {
 
 # Teardown: Clean up generated files
 teardown() {
-    rm -f bash_output.svg c_output.svg test_output.svg
-    rm -rf "$HOME/.cache/Oh"
+    rm -f bash_output.svg c_output.svg test_output.svg test_output.txt test_output.sock test_output.log test_output.list test_output.json test_output.cast test_output-*.svg test_output.html test_output.png test_output.c test_output.bin
+    rm -rf "$HOME/.cache/Oh" test_output.fonts
 }
 
 @test "01 Oh.sh passes shellcheck" {
@@ -20,7 +20,7 @@ teardown() {
 }
 
 @test "02 C sources pass cppcheck" {
-    run cppcheck --error-exitcode=1 --suppress=missingIncludeSystem Oh.c Oh-parse.c Oh-cache.c
+    run cppcheck --error-exitcode=1 --suppress=missingIncludeSystem Oh.c Oh-parse.c Oh-cache.c Oh-pack.c Oh-output.c Oh-render.c Oh-pool.c Oh-simd.c Oh-diff.c Oh-xml.c Oh-width.c Oh-lru.c Oh-serve.c Oh-batch.c Oh-gc.c Oh-stats.c Oh-cast.c Oh-font.c Oh-html.c Oh-png.c Oh-lib.c Oh-arena.c Oh-main.c Oh-bench.c
     [ "$status" -eq 0 ]
 }
 
@@ -109,4 +109,550 @@ teardown() {
 @test "12 Oh.c --help succeeds" {
     run ./Oh --help
     [ "$status" -eq 0 ]
-}
\ No newline at end of file
+}
+
+@test "13 Oh.c line hashes match cksum for shared cache keys" {
+    rm -rf "$HOME/.cache/Oh"
+    printf 'plain text line\n' > test_output.txt
+    ./Oh -i test_output.txt -o c_output.svg
+    line_hash=$(printf '%s' 'plain text line' | cksum | cut -d' ' -f1)
+    ls "$HOME"/.cache/Oh/*_"${line_hash}".json
+}
+
+@test "14 Oh.c pack cache format round-trips on warm runs" {
+    rm -rf "$HOME/.cache/Oh"
+    ./Oh --cache-format=pack -i sample.ansi -o c_output.svg
+    ls "$HOME"/.cache/Oh/*.pack
+    run ./Oh --cache-format pack -i sample.ansi -o test_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Segments 44/44 hits"* ]]
+    cmp c_output.svg test_output.svg
+}
+
+@test "15 Oh.c keeps every segment of a line with many color changes" {
+    for i in $(seq 1 1200); do printf '\033[3%dmx' $((i % 8)); done > test_output.txt
+    printf '\n' >> test_output.txt
+    run ./Oh -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    [ "$(grep -c '<text ' c_output.svg)" -eq 1200 ]
+}
+
+@test "16 Oh.c writes multi-megabyte SVGs in full, with and without validation" {
+    for i in $(seq 1 6000); do printf '\033[31mline %d \033[32mgreen\033[0m tail\n' "$i"; done > test_output.txt
+    run ./Oh -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    [ "$(stat -c %s c_output.svg)" -gt 1048576 ]
+    [ "$(tail -n 1 c_output.svg)" = "</svg>" ]
+    ./Oh --no-validate -i test_output.txt > test_output.svg
+    cmp c_output.svg test_output.svg
+}
+
+@test "17 Oh.c --stream handles inputs beyond MAX_LINES and MAX_LINE_LENGTH" {
+    seq 1 12000 > test_output.txt
+    head -c 10000 /dev/zero | tr '\0' 'x' >> test_output.txt
+    run ./Oh --stream -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    [ "$(grep -c '<text ' c_output.svg)" -eq 12001 ]
+    grep -q 'height="201656.80"' c_output.svg
+    grep -q "x\{10000\}" c_output.svg
+    xmllint --noout c_output.svg
+    ./Oh --stream < sample.ansi | cat > test_output.svg
+    xmllint --noout test_output.svg
+    grep -q '<svg xmlns="http://www.w3.org/2000/svg" width="712.00">' test_output.svg
+    ./Oh -i sample.ansi | grep '<text ' | diff - <(grep '<text ' test_output.svg)
+}
+
+@test "18 Oh.c -j output matches the serial output byte for byte" {
+    rm -rf "$HOME/.cache/Oh"
+    for i in $(seq 1 3000); do printf '\033[3%dmrow %d\033[0m \033[1;9%dm<&>\033[0m\n' $((i % 8)) "$i" $((i % 8)); done > test_output.txt
+    ./Oh --no-validate -i test_output.txt -o c_output.svg
+    rm -rf "$HOME/.cache/Oh"
+    run ./Oh -j 4 --no-validate -i test_output.txt -o test_output.svg
+    [ "$status" -eq 0 ]
+    cmp c_output.svg test_output.svg
+    ./Oh --jobs 0 --cache-format pack -i sample.ansi | cmp - <(./Oh -i sample.ansi)
+}
+
+@test "19 Oh.c counts multi-byte runs longer than a vector register" {
+    { printf '\033[31m'; for i in $(seq 1 40); do printf '\303\251'; done; printf '\033[32m%050d\033[0m\n' 0; } > test_output.txt
+    run ./Oh -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    grep -q 'textLength="336.00"' c_output.svg
+    grep -q 'x="356.00".*textLength="420.00"' c_output.svg
+}
+
+@test "20 Oh.c escapes XML specials at every offset of long runs" {
+    for i in $(seq 0 40); do printf '%*s<a href="x">&'"'"'%*s\n' "$i" '' $((40 - i)) ''; done > test_output.txt
+    run ./Oh -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    xmllint --noout c_output.svg
+    [ "$(grep -c '&lt;a href=&quot;x&quot;&gt;&amp;&apos;' c_output.svg)" -eq 41 ]
+    [ "$(grep -c 'textLength="453.60"' c_output.svg)" -eq 41 ]
+}
+
+@test "21 Oh.c reuses cached SVG fragments for unchanged rows" {
+    rm -rf "$HOME/.cache/Oh"
+    ./Oh -i sample.ansi -o c_output.svg
+    run ./Oh -i sample.ansi -o test_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"SVG fragments 44/44 hits"* ]]
+    cmp c_output.svg test_output.svg
+    { head -n 43 sample.ansi; echo "changed last line"; } > test_output.txt
+    run ./Oh -j 2 -i test_output.txt -o c_output.svg
+    [[ "$output" == *"SVG fragments 43/44 hits"* ]]
+    grep -q "changed last line" c_output.svg
+}
+
+@test "22 Oh.c re-renders only changed rows of the previous output" {
+    rm -rf "$HOME/.cache/Oh"
+    ./Oh -i sample.ansi -o test_output.svg
+    { head -n 10 sample.ansi; printf 'inserted \033[31mline\033[0m\n'; tail -n +11 sample.ansi; } > test_output.txt
+    run ./Oh -i test_output.txt -o test_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Incremental: reused 44 of 45 rows"* ]]
+    rm -rf "$HOME/.cache/Oh"
+    ./Oh -i test_output.txt -o c_output.svg
+    cmp c_output.svg test_output.svg
+    [ -z "$(ls test_output.svg.*.tmp 2>/dev/null)" ]
+}
+
+@test "23 Oh.c checks well-formedness while streaming at every --validate level" {
+    run ./Oh -i sample.ansi -o c_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"SVG validation passed: Well-formed XML"* ]]
+    run ./Oh --validate=none -i sample.ansi -o test_output.svg
+    [[ "$output" != *"SVG validation"* ]]
+    cmp c_output.svg test_output.svg
+    run ./Oh --validate dtd -i sample.ansi -o test_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"DTD validation"* ]]
+    cmp c_output.svg test_output.svg
+    [ ! -e "$HOME/.cache/Oh/temp_validation.svg" ]
+    run ./Oh --validate=full -i sample.ansi
+    [ "$status" -ne 0 ]
+}
+
+@test "24 Oh.c merges same-style segments and --compact emits one text per row" {
+    printf 'a\033[0m\033[0mb\033[31mc\033[31md\033[0m e\n\033[1;32mok\033[0m\n' > test_output.txt
+    ./Oh -i test_output.txt -o c_output.svg
+    [ "$(grep -c '<text ' c_output.svg)" -eq 4 ]
+    grep -q '>ab</text>' c_output.svg
+    grep -q 'class="terminal-text ccd3131" .*>cd</text>' c_output.svg
+    ./Oh --compact -i test_output.txt -o test_output.svg
+    xmllint --noout test_output.svg
+    [ "$(grep -c '<text ' test_output.svg)" -eq 2 ]
+    grep -q 'textLength="50.40" lengthAdjust="spacingAndGlyphs">ab<tspan class="ccd3131">cd</tspan> e</text>' test_output.svg
+    ! grep -q '<text [^>]*font-size=' test_output.svg
+    ./Oh -i sample.ansi -o c_output.svg
+    ./Oh --compact -i sample.ansi -o test_output.svg
+    [ "$(grep -c '<text ' test_output.svg)" -le 44 ]
+    [ "$(stat -c %s test_output.svg)" -lt "$(stat -c %s c_output.svg)" ]
+}
+
+@test "25 Oh.c names each style with one CSS class" {
+    printf '\033[31mred\033[0m plain \033[1;31mbold red\033[0m \033[31magain\033[0m\n' > test_output.txt
+    ./Oh -i test_output.txt -o c_output.svg
+    xmllint --noout c_output.svg
+    ! grep -q '<text [^>]*fill=' c_output.svg
+    ! grep -q '<text [^>]*font-size=' c_output.svg
+    [ "$(grep -o '\.ccd3131 { fill: #cd3131; }' c_output.svg | wc -l)" -eq 1 ]
+    grep -q '\.ccd3131b { fill: #cd3131; font-weight: bold; }' c_output.svg
+    [ "$(grep -c 'class="terminal-text ccd3131"' c_output.svg)" -eq 2 ]
+    ./Oh --stream -i test_output.txt -o test_output.svg
+    xmllint --noout test_output.svg
+    grep -q '\.ccd3131b { fill: #cd3131; font-weight: bold; }' test_output.svg
+}
+
+@test "26 Oh.c parses 256-color and 24-bit SGR sequences" {
+    printf '\033[38;5;196mA\033[38;5;244mB\033[38;2;1;2;255mC\033[38:2::10:20:30mD\033[39mE\033[2KF\033[1mG\033[22mH\033[0m\n' > test_output.txt
+    ./Oh -i test_output.txt -o c_output.svg
+    xmllint --noout c_output.svg
+    grep -q 'class="terminal-text cff0000" [^>]*>A</text>' c_output.svg
+    grep -q 'class="terminal-text c808080" [^>]*>B</text>' c_output.svg
+    grep -q 'class="terminal-text c0102ff" [^>]*>C</text>' c_output.svg
+    grep -q 'class="terminal-text c0a141e" [^>]*>D</text>' c_output.svg
+    grep -q 'class="terminal-text" [^>]*>EF</text>' c_output.svg
+    grep -q 'class="terminal-text cffffffb" [^>]*>G</text>' c_output.svg
+    grep -q 'class="terminal-text" [^>]*>H</text>' c_output.svg
+}
+
+@test "27 Oh.c merges background rects across cells and rows" {
+    for i in $(seq 1 30); do printf '\033[44;37m row %-4d\033[31mX\033[37m data \033[0m\033[42m  \033[0m\n' "$i"; done > test_output.txt
+    ./Oh -i test_output.txt -o c_output.svg
+    xmllint --noout c_output.svg
+    [ "$(grep -c '<rect ' c_output.svg)" -eq 3 ]
+    grep -q '<rect x="20.00" y="22.00" width="134.40" height="503.20" fill="#2472c8"/>' c_output.svg
+    [ "$(grep -n '<rect x=' c_output.svg | tail -1 | cut -d: -f1)" -lt "$(grep -n '<text ' c_output.svg | head -1 | cut -d: -f1)" ]
+    ./Oh --stream < test_output.txt | cat > test_output.svg
+    xmllint --noout test_output.svg
+    diff <(grep '<text ' c_output.svg) <(grep '<text ' test_output.svg)
+}
+
+@test "28 Oh.c wraps long lines into rows at the grid width" {
+    printf '\033[31m%s\033[0m%s\n' "$(printf 'é%.0s' $(seq 1 25))" "$(printf 'x%.0s' $(seq 1 10))" > test_output.txt
+    printf 'short\n' >> test_output.txt
+    run ./Oh --width 30 --wrap -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Wrapped 2 lines into 3 rows at 30 columns"* ]]
+    xmllint --noout c_output.svg
+    grep -q 'width="292.00" height="90.40"' c_output.svg
+    grep -q '<text x="230.00" y="34.00" class="terminal-text" xml:space="preserve" textLength="42.00" lengthAdjust="spacingAndGlyphs">xxxxx</text>' c_output.svg
+    grep -q '<text x="20.00" y="50.80" class="terminal-text" xml:space="preserve" textLength="42.00" lengthAdjust="spacingAndGlyphs">xxxxx</text>' c_output.svg
+    grep -q 'y="67.60" class="terminal-text" xml:space="preserve" textLength="42.00" lengthAdjust="spacingAndGlyphs">short<' c_output.svg
+    run ./Oh --width 30 --wrap -i test_output.txt -o test_output.svg
+    [[ "$output" == *"SVG fragments 3/3 hits"* ]]
+    cmp c_output.svg test_output.svg
+    ./Oh --width 30 --wrap --stream < test_output.txt | cat > test_output.svg
+    diff <(grep '<text ' c_output.svg) <(grep '<text ' test_output.svg)
+}
+
+@test "29 Oh.c expands tabs to tab stops and counts wide characters as two cells" {
+    printf 'ab\tc\t\033[31md\033[0m\n\xe4\xb8\xad\xe6\x96\x87x\t!\ne\xcc\x81\xf0\x9f\x98\x80!\n' > test_output.txt
+    ./Oh -i test_output.txt -o c_output.svg
+    xmllint --noout c_output.svg
+    grep -q 'textLength="134.40" lengthAdjust="spacingAndGlyphs">ab      c       </text>' c_output.svg
+    grep -q '<text x="154.40" y="34.00" class="terminal-text ccd3131"' c_output.svg
+    grep -q 'textLength="75.60" lengthAdjust="spacingAndGlyphs">中文x   !</text>' c_output.svg
+    grep -q $'textLength="33.60" lengthAdjust="spacingAndGlyphs">e\xcc\x81\xf0\x9f\x98\x80!</text>' c_output.svg
+    ./Oh -i test_output.txt -o test_output.svg
+    cmp c_output.svg test_output.svg
+    ./Oh --tab-size 4 -i test_output.txt | grep -q '>ab  c   </text>'
+    ./Oh --wrap --width 3 -i test_output.txt | grep -q 'textLength="16.80" lengthAdjust="spacingAndGlyphs">中</text>'
+}
+
+@test "30 Oh.c serves render requests on a Unix socket with in-memory caches" {
+    ./Oh -i sample.ansi -o c_output.svg
+    ./Oh --serve test_output.sock 2> test_output.log &
+    for i in $(seq 1 50); do [ -S test_output.sock ] && break; sleep 0.1; done
+    ./Oh --connect test_output.sock -i sample.ansi -o test_output.svg
+    cmp c_output.svg test_output.svg
+    ./Oh --connect test_output.sock < sample.ansi | cmp - c_output.svg
+    run ./Oh --connect test_output.sock --font "Fira Code" --embed-font < sample.ansi
+    [ "$status" -ne 0 ]
+    [[ "$output" == *"option '--embed-font' is not accepted in a request"* ]]
+    kill %1
+    wait
+    [ ! -e test_output.sock ]
+    run ./Oh --connect test_output.sock < sample.ansi
+    [ "$status" -ne 0 ]
+    grep -q 'Request 2: 44 lines, [0-9]* bytes; segments 44/44, fragments 44/44 cached' test_output.log
+}
+
+@test "31 Oh.c converts every file of a batch manifest with shared caches" {
+    ./Oh -i sample.ansi -o c_output.svg
+    cp sample.ansi test_output.txt
+    printf '# docs\nsample.ansi bash_output.svg\n\ntest_output.txt\n' > test_output.list
+    run ./Oh --batch test_output.list
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Batch: test_output.txt -> test_output.svg (44 lines; segments 44/44, fragments 44/44 cached)"* ]]
+    [[ "$output" == *"Batch: converted 2 of 2 files"* ]]
+    cmp c_output.svg bash_output.svg
+    cmp c_output.svg test_output.svg
+    printf 'missing.ansi\n' >> test_output.list
+    run ./Oh --batch test_output.list
+    [ "$status" -ne 0 ]
+    [[ "$output" == *"Batch: converted 2 of 3 files"* ]]
+}
+
+@test "32 Oh.c evicts least recently used cache files to stay under --cache-max-size" {
+    ./Oh -i sample.ansi -o c_output.svg
+    seq 1 600 | sed 's/^/\x1b[32mline /' > test_output.txt
+    ./Oh -i test_output.txt -o test_output.svg
+    [ "$(ls "$HOME/.cache/Oh" | grep -c '\.json$')" -gt 600 ]
+    sleep 0.1
+    ./Oh -i sample.ansi -o c_output.svg --cache-max-size 100M
+    run ./Oh --cache-gc --cache-max-size 1M
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Cache GC: "*"(limit 1.0 MB); evicted "* ]]
+    [ "$(du -sk "$HOME/.cache/Oh" | cut -f1)" -lt 1100 ]
+    run ./Oh -i sample.ansi -o c_output.svg
+    [[ "$output" == *"Segments 44/44 hits"* ]]
+    run ./Oh --cache-max-size 10 -i sample.ansi
+    [ "$status" -ne 0 ]
+}
+
+@test "33 Oh.c reports stage timings and cache tiers with --stats=json" {
+    run ./Oh -i sample.ansi -o c_output.svg --stats=json
+    [ "$status" -eq 0 ]
+    [[ "$output" == *'{"version":"'*'"documents":1,"lines":44,"rows":44,'* ]]
+    [[ "$output" == *'"seconds":{"total":'*'"parse":'*'"validate":'*'"lines":{"memory_hits":4,"disk_hits":0,"misses":40,'* ]]
+    OH_STATS_FILE=test_output.json ./Oh -i sample.ansi -o test_output.svg
+    grep -q '"lines":{"memory_hits":4,"disk_hits":40,"misses":0,"hit_rate":1' test_output.json
+    grep -q '"fragments":{"memory_hits":0,"pack_hits":44,"misses":0' test_output.json
+    run ./Oh --stats=xml -i sample.ansi
+    [ "$status" -ne 0 ]
+}
+
+@test "34 Oh.c keeps lines longer than 4096 bytes whole, mapped or piped" {
+    printf '%*s\n' 5000 '' | tr ' ' x > test_output.txt
+    run ./Oh --wrap -i test_output.txt -o c_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Read 1 lines from test_output.txt"* ]]
+    [[ "$output" == *"Wrapped 1 lines into 63 rows at 80 columns"* ]]
+    ./Oh --wrap < test_output.txt > test_output.svg
+    cmp c_output.svg test_output.svg
+    cat test_output.txt | ./Oh --wrap > test_output.svg
+    cmp c_output.svg test_output.svg
+}
+
+@test "35 Oh.c animates asciicast recordings, drawing each distinct row once" {
+    printf '%s\n' '{"version": 2, "width": 20, "height": 3}' '[0.0, "o", "$ ls\r\n"]' \
+        '[0.5, "o", "file\r\n$ "]' '[0.7, "i", "q"]' '[1.0, "o", "\u001b[2J\u001b[H$ ls"]' > test_output.cast
+    run ./Oh -i test_output.cast -o c_output.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Cast: 20x3 terminal, 3 events into 3 keyframes over 1.00s (4 distinct rows, 5 row updates)"* ]]
+    xmllint --noout c_output.svg
+    grep -q '@keyframes k2 { 0% { visibility: hidden; } 33.333% { visibility: visible; } }' c_output.svg
+    [ "$(grep -c '<symbol' c_output.svg)" -eq 4 ]
+    [ "$(grep -o '<use' c_output.svg | wc -l)" -eq 5 ]
+    ./Oh --cast < test_output.cast > test_output.svg
+    cmp c_output.svg test_output.svg
+    run ./Oh --cast -i sample.ansi
+    [ "$status" -ne 0 ]
+}
+
+@test "36 Oh.c draws repeated rows once with --dedup" {
+    for step in 1 2 3; do
+        printf '\033[1;34m==== build ====\033[0m\n\033[32mok\033[0m step %d\n\n' "$step"
+    done > test_output.txt
+    run ./Oh -i test_output.txt -o c_output.svg --dedup
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Dedup: parsing 5 distinct lines of 9"* ]]
+    [[ "$output" == *"Dedup: 2 of 9 rows drawn as references to earlier rows"* ]]
+    xmllint --noout c_output.svg
+    grep -q '<g id="d0">' c_output.svg
+    [ "$(grep -c '<use xlink:href="#d0"' c_output.svg)" -eq 2 ]
+    ./Oh -i test_output.txt -o test_output.svg
+    [ "$(grep -c 'step' test_output.svg)" -eq 3 ]
+    [ "$(wc -c < c_output.svg)" -lt "$(wc -c < test_output.svg)" ]
+}
+
+@test "37 Oh.c splits output into cached pages with --page-height" {
+    run ./Oh -i sample.ansi -o test_output.svg --page-height 10
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Pages: wrote 5 of 5 pages of 10 rows (0 unchanged)"* ]]
+    xmllint --noout test_output.svg test_output-1.svg test_output-5.svg
+    [ "$(grep -c '<image' test_output.svg)" -eq 5 ]
+    grep -q 'y="672.00" width="880.00" height="107.20" xlink:href="test_output-5.svg"' test_output.svg
+    [ ! -e test_output-6.svg ]
+    { cat sample.ansi; echo "one more line"; } > test_output.txt
+    run ./Oh -i test_output.txt -o test_output.svg --page-height 10 -j 2
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Pages: wrote 1 of 5 pages of 10 rows (4 unchanged)"* ]]
+    run ./Oh -i sample.ansi --page-height 10
+    [ "$status" -ne 0 ]
+}
+
+@test "38 Oh.c inlines a subset Google font with --embed-font and caches it" {
+    mkdir -p test_output.fonts
+    printf "@font-face { font-family: 'Fira Code'; font-weight: 400; src: url(file://%s/test_output.fonts/font) format('woff2'); }" "$PWD" > test_output.fonts/css2
+    printf 'wOF2' > test_output.fonts/font
+    printf 'abc\nbca\n' > test_output.txt
+    OH_FONTS_URL="file://$PWD/test_output.fonts" run ./Oh -i test_output.txt -o c_output.svg --font "Fira Code" --embed-font
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Font: embedding Fira Code subset of 3 glyphs (4 bytes fetched)"* ]]
+    xmllint --noout c_output.svg
+    grep -q "src: url(data:font/woff2;base64,d09GMg==) format('woff2')" c_output.svg
+    ! grep -q '@import' c_output.svg
+    rm -rf test_output.fonts
+    OH_FONTS_URL="file://$PWD/test_output.fonts" run ./Oh -i test_output.txt -o test_output.svg --font "Fira Code" --embed-font
+    [[ "$output" == *"Font: embedding Fira Code subset of 3 glyphs from the font cache"* ]]
+    cmp c_output.svg test_output.svg
+    mkdir -p test_output.fonts
+    printf "@font-face { font-family: 'Fira Code'; src: url(file://%s/sample.ansi) format('woff2'); }" "$PWD" > test_output.fonts/css2
+    OH_FONTS_URL="file://$PWD/test_output.fonts/" run ./Oh -i test_output.txt -o test_output.svg --font "Fira Code" --embed-font
+    [[ "$output" == *"Warning: Cannot fetch Fira Code for embedding, linking it instead"* ]]
+    rm -rf test_output.fonts
+    OH_FONTS_URL="file://$PWD/test_output.fonts" run ./Oh -i sample.ansi -o test_output.svg --font "Fira Code" --embed-font
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Warning: Cannot fetch Fira Code for embedding, linking it instead"* ]]
+    grep -q '@import' test_output.svg
+}
+
+@test "39 Oh.c writes HTML and PNG output from the parsed rows" {
+    run ./Oh -i sample.ansi -o test_output.html
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"HTML written to: test_output.html"* ]]
+    grep -q '<pre class="terminal-text"><span class="ccd3131">' test_output.html
+    grep -q '.ccd3131 { color: #cd3131; }' test_output.html
+    ! grep -q '<svg' test_output.html
+    run ./Oh -i sample.ansi --format png
+    [ "$status" -ne 0 ]
+    font="${OH_TEST_FONT:-$(find /usr/share/fonts -name '*Mono*.ttf' 2>/dev/null | head -n 1)}"
+    [ -n "$font" ] || skip "no TrueType font to rasterize with"
+    run ./Oh -i sample.ansi -o test_output.png --font-file "$font"
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"PNG: 880x780 pixels"* ]]
+    [ "$(head -c 8 test_output.png | od -An -tx1 | tr -d ' \n')" = "89504e470d0a1a0a" ]
+}
+
+@test "40 liboh renders through reusable contexts on several threads" {
+    make -s liboh.a
+    cat > test_output.c <<'EOF'
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liboh.h"
+
+static char input[1 << 16];
+static size_t input_length;
+static oh_context *contexts[4];
+
+static int collect(void *user, const char *data, size_t length) {
+    FILE *file = user;
+    return fwrite(data, 1, length, file) == length ? 0 : -1;
+}
+
+static void *worker(void *arg) {
+    oh_context *ctx = contexts[(long)arg];
+    for (int i = 0; i < 20; i++) {
+        oh_writer writer = { collect, fopen("/dev/null", "w") };
+        int result = oh_render(ctx, input, input_length, &writer);
+        fclose(writer.user);
+        if (result != 0) return arg;
+    }
+    return NULL;
+}
+
+int main(void) {
+    char error[256];
+    FILE *file = fopen("sample.ansi", "rb");
+    input_length = fread(input, 1, sizeof(input), file);
+    fclose(file);
+    // A context is used by one thread at a time, so each thread gets its own
+    for (int t = 0; t < 4; t++) {
+        contexts[t] = oh_context_new(t % 2 ? "--font-size 16 --wrap" : "", error, sizeof(error));
+        if (!contexts[t]) return 1;
+    }
+    if (oh_context_new("-o x.svg", error, sizeof(error))) return 1;
+    fprintf(stderr, "%s\n", error);
+    pthread_t threads[4];
+    for (long t = 0; t < 4; t++) pthread_create(&threads[t], NULL, worker, (void *)t);
+    int failed = 0;
+    for (int t = 0; t < 4; t++) {
+        void *result;
+        pthread_join(threads[t], &result);
+        failed |= result != NULL;
+    }
+    oh_writer writer = { collect, stdout };
+    failed |= oh_render(contexts[0], input, input_length, &writer);
+    failed |= oh_render(contexts[0], input, 0, &writer) != -1;
+    fprintf(stderr, "%s\n", oh_context_error(contexts[0]));
+    for (int t = 0; t < 4; t++) oh_context_free(contexts[t]);
+    return failed;
+}
+EOF
+    cc -std=c99 -I. -o test_output.bin test_output.c liboh.a $(pkg-config --libs jansson) $(pkg-config --libs freetype2 zlib 2>/dev/null) -lm -pthread
+    ./Oh -i sample.ansi -o c_output.svg
+    run sh -c './test_output.bin > test_output.svg'
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"option '-o' is not accepted in a request"*"no input"* ]]
+    cmp c_output.svg test_output.svg
+}
+
+@test "41 Oh.c rewrites every page when the document width changes" {
+    seq -f 'line %g' 30 > test_output.txt
+    run ./Oh -i test_output.txt -o test_output.svg --page-height 10
+    [ "$status" -eq 0 ]
+    grep -q '<svg xmlns="http://www.w3.org/2000/svg" width="712.00"' test_output-1.svg
+    printf 'wide %090d\n' 0 >> test_output.txt
+    run ./Oh -i test_output.txt -o test_output.svg --page-height 10
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Pages: wrote 4 of 4 pages of 10 rows (0 unchanged)"* ]]
+    [ "$(grep -l 'width="838.00"' test_output-[1-4].svg | wc -l)" -eq 4 ]
+    grep -q 'width="838.00" height="56.80" xlink:href="test_output-4.svg"' test_output.svg
+}
+
+@test "42 Oh.c --stream writes each row before the producer finishes" {
+    { printf 'first row\n'; sleep 3; printf 'last row\n'; } | ./Oh --stream | cat > test_output.svg &
+    { printf 'first row\n'; sleep 3; printf 'last row\n'; } | ./Oh --stream -o c_output.svg &
+    for i in $(seq 1 20); do
+        grep -qs 'first row' test_output.svg && grep -qs 'first row' c_output.svg && break
+        sleep 0.1
+    done
+    grep -q '<svg xmlns="http://www.w3.org/2000/svg" width="712.00">' test_output.svg
+    grep -q 'first row' test_output.svg
+    grep -q 'first row' c_output.svg
+    ! grep -q 'last row' test_output.svg
+    wait
+    xmllint --noout test_output.svg c_output.svg
+    grep -q 'last row' test_output.svg
+    run ./Oh --stream --width 80 --height 2 -i sample.ansi -o test_output.svg
+    [[ "$output" == *"Streamed 44 rows (grid width: 80 chars, fixed dimensions)"* ]]
+    grep -q 'width="712.00" height="73.60"' test_output.svg
+}
+
+@test "43 Oh.c converts repeated -i/-o pairs a file per worker" {
+    ./Oh -i sample.ansi -o c_output.svg
+    seq -f 'line %g' 300 > test_output.txt
+    ./Oh -i test_output.txt -o test_output-1.svg
+    rm -rf "$HOME/.cache/Oh"
+    run ./Oh -j 4 -i sample.ansi -o bash_output.svg -i test_output.txt -o test_output.svg -i sample.ansi -o test_output-2.svg
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Batch: converting 3 files, 4 at a time"* ]]
+    [[ "$output" == *"Batch: converted 3 of 3 files"* ]]
+    cmp c_output.svg bash_output.svg
+    cmp c_output.svg test_output-2.svg
+    cmp test_output-1.svg test_output.svg
+    run ./Oh -i sample.ansi -i test_output.txt -o test_output.svg
+    [ "$status" -ne 0 ]
+    [[ "$output" == *"--input 'sample.ansi' needs its own --output"* ]]
+}
+
+@test "44 Oh.c pages long inputs whole and removes only its own leftover pages" {
+    seq -f 'line %g' 12000 > test_output.txt
+    run ./Oh -i test_output.txt -o test_output.svg --page-height 1000 --no-validate
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Read 12000 lines"* ]]
+    [[ "$output" == *"Pages: wrote 12 of 12 pages"* ]]
+    grep -q '>line 12000<' test_output-12.svg
+    printf 'not a page\n' > test_output-5.svg
+    seq -f 'line %g' 2500 > test_output.txt
+    run ./Oh -i test_output.txt -o test_output.svg --page-height 1000 --no-validate
+    [ "$status" -eq 0 ]
+    [ ! -e test_output-4.svg ]
+    [ ! -e test_output-6.svg ]
+    [ ! -e test_output-12.svg ]
+    [ "$(cat test_output-5.svg)" = "not a page" ]
+    run ./Oh --stream --page-height 10 -i test_output.txt -o test_output.svg
+    [ "$status" -ne 0 ]
+    [[ "$output" == *"--page-height cannot be combined with --stream"* ]]
+}
+
+@test "45 Oh.c --serve replaces only a stale socket" {
+    printf 'keep me\n' > test_output.sock
+    run ./Oh --serve test_output.sock
+    [ "$status" -ne 0 ]
+    [[ "$output" == *"path exists and is not a socket"* ]]
+    [ "$(cat test_output.sock)" = "keep me" ]
+    rm -f test_output.sock
+    ./Oh --serve test_output.sock 2> test_output.log &
+    server=$!
+    for i in $(seq 1 50); do [ -S test_output.sock ] && break; sleep 0.1; done
+    run ./Oh --serve test_output.sock
+    [ "$status" -ne 0 ]
+    [[ "$output" == *"a server is already listening there"* ]]
+    kill -9 "$server"
+    wait "$server" || true
+    [ -S test_output.sock ]
+    ./Oh --serve test_output.sock 2> test_output.log &
+    server=$!
+    for i in $(seq 1 50); do grep -qs 'Serving on' test_output.log && break; sleep 0.1; done
+    ./Oh --connect test_output.sock < sample.ansi | cmp - <(./Oh -i sample.ansi)
+    kill "$server"
+    wait "$server"
+    [ ! -e test_output.sock ]
+}
+
+@test "46 Oh.c warns when a streamed line is wider than a grid fixed up front" {
+    printf 'short\n%0100d\n%0100d\n' 0 0 > test_output.txt
+    run sh -c './Oh --stream < test_output.txt | cat > test_output.svg'
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"Warning: Line 2 is 100 columns wide and is cut off at the 80-column grid"* ]]
+    [[ "$output" == *"Warning: 2 lines were cut off at the 80-column grid"* ]]
+    run sh -c './Oh --stream --width 100 < test_output.txt | cat > test_output.svg'
+    [[ "$output" != *"Warning"* ]]
+    run ./Oh --stream -i test_output.txt -o test_output.svg
+    [[ "$output" != *"Warning"* ]]
+}